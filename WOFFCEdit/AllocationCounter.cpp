@@ -0,0 +1,49 @@
+#include "AllocationCounter.h"
+#include <atomic>
+#if defined(_MSC_VER) && defined(_DEBUG)
+#include <windows.h>
+#include <crtdbg.h>
+#define ALLOCATION_HOOK
+#endif
+
+namespace
+{
+    std::atomic<uint64_t> s_allocations(0);
+    std::atomic<uint64_t> s_mainThreadAllocations(0);
+
+#ifdef ALLOCATION_HOOK
+    _CRT_ALLOC_HOOK s_previousHook = nullptr;
+    DWORD s_mainThread = 0;
+
+    int __cdecl AllocationHook(int allocType, void* userData, size_t size, int blockType, long requestNumber, const unsigned char* fileName, int lineNumber)
+    {
+        // The CRT's own bookkeeping blocks aren't the caller's allocations
+        if ((allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC) && blockType != _CRT_BLOCK)
+        {
+            s_allocations.fetch_add(1, std::memory_order_relaxed);
+            if (GetCurrentThreadId() == s_mainThread)
+                s_mainThreadAllocations.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        return s_previousHook ? s_previousHook(allocType, userData, size, blockType, requestNumber, fileName, lineNumber) : TRUE;
+    }
+#endif
+}
+
+void AllocationCounter::Install()
+{
+#ifdef ALLOCATION_HOOK
+    s_mainThread = GetCurrentThreadId();
+    s_previousHook = _CrtSetAllocHook(AllocationHook);
+#endif
+}
+
+uint64_t AllocationCounter::Count()
+{
+    return s_allocations.load(std::memory_order_relaxed);
+}
+
+uint64_t AllocationCounter::CountOnMainThread()
+{
+    return s_mainThreadAllocations.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+
+// Counts heap allocations, so loops that are meant not to allocate can check that they don't.
+//
+// Debug builds hook the CRT debug heap, which sees every malloc and operator new in the process (the
+// containers built on them included) from every thread. Count() is all of them, so it takes in whatever
+// the job system's workers allocate meanwhile, the pipelined update task and background loads included.
+// CountOnMainThread() is only those of the thread that installed the hook. Release builds install nothing
+// and always count 0.
+namespace AllocationCounter
+{
+    // Once, at startup, from the main thread
+    void Install();
+
+    // Allocations and reallocations since Install, on any thread
+    uint64_t Count();
+
+    // Those of them made on the thread that called Install
+    uint64_t CountOnMainThread();
+}
@@ -0,0 +1,260 @@
+#include "CmoFile.h"
+#include "Platform.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    // Sizes of the records DirectXTK's CMO loader reads whole
+    constexpr size_t MATERIAL_SIZE = (4 * 4 * 3) + 4 + (4 * 4) + (4 * 16);	//ambient, diffuse, specular, specular power, emissive, uv transform
+    constexpr size_t MAX_TEXTURES = 8;
+    constexpr size_t SKINNING_VERTEX_SIZE = (4 * 4) + (4 * 4);				//bone indices and weights
+    constexpr size_t EXTENTS_SIZE = 10 * 4;
+    constexpr size_t BONE_SIZE = 4 + (3 * 4 * 16);							//parent, inverse bind pose, bind pose, local transform
+    constexpr size_t ANIMATION_CLIP_SIZE = 4 + 4 + 4;						//start, end, keyframe count
+    constexpr size_t KEYFRAME_SIZE = 4 + 4 + (4 * 16);						//bone, time, transform
+
+    static_assert(sizeof(CmoFile::SubMesh) == 20, "submeshes are read and written as they are in the file");
+    static_assert(sizeof(CmoFile::Vertex) == 52, "vertices are read and written as they are in the file");
+
+    // Bounds checked cursor over the file
+    class Reader
+    {
+    public:
+        Reader(const std::vector<uint8_t>& data) : m_data(data) {}
+
+        size_t Offset() const { return m_offset; }
+
+        bool Skip(size_t size)
+        {
+            if (size > m_data.size() - m_offset)
+                return false;
+            m_offset += size;
+            return true;
+        }
+
+        bool Read(void* destination, size_t size)
+        {
+            if (size > m_data.size() - m_offset)
+                return false;
+            std::memcpy(destination, &m_data[m_offset], size);
+            m_offset += size;
+            return true;
+        }
+
+        bool Count(uint32_t& count) { return Read(&count, sizeof(count)); }
+
+        // Strings are a character count followed by that many UTF-16 characters
+        bool SkipString()
+        {
+            uint32_t length;
+            return Count(length) && Skip(size_t(length) * 2);
+        }
+
+        // Count and records of 'recordSize' bytes, skipped
+        bool SkipArray(size_t recordSize)
+        {
+            uint32_t count;
+            return Count(count) && (count == 0 || count <= (m_data.size() - m_offset) / recordSize) && Skip(count * recordSize);
+        }
+
+        template<typename T>
+        bool ReadArray(std::vector<T>& values)
+        {
+            uint32_t count;
+            if (!Count(count) || (count > 0 && count > (m_data.size() - m_offset) / sizeof(T)))
+                return false;
+            values.resize(count);
+            return Read(values.data(), count * sizeof(T));
+        }
+
+    private:
+        const std::vector<uint8_t>&	m_data;
+        size_t						m_offset = 0;
+    };
+
+    template<typename T>
+    void Append(std::vector<uint8_t>& out, const T* values, size_t count)
+    {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values);
+        out.insert(out.end(), bytes, bytes + (count * sizeof(T)));
+    }
+
+    void AppendCount(std::vector<uint8_t>& out, size_t count)
+    {
+        const uint32_t value = uint32_t(count);
+        Append(out, &value, 1);
+    }
+}
+
+bool CmoFile::Read(const std::string& path)
+{
+    meshes.clear();
+
+    FILE* pFile = nullptr;
+    errno_t ret = fopen_s(&pFile, path.c_str(), "rb");
+    if (ret != 0 || pFile == nullptr)
+        return false;
+
+    std::vector<uint8_t> data;
+    uint8_t buffer[64 * 1024];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+        data.insert(data.end(), buffer, buffer + read);
+    fclose(pFile);
+
+    Reader reader(data);
+    uint32_t numMeshes;
+    if (!reader.Count(numMeshes))
+        return false;
+
+    for (uint32_t m = 0; m < numMeshes; m++)
+    {
+        Mesh mesh;
+        const size_t meshStart = reader.Offset();
+
+        // Name and materials
+        uint32_t numMaterials;
+        if (!reader.SkipString() || !reader.Count(numMaterials))
+            return false;
+
+        for (uint32_t i = 0; i < numMaterials; i++)
+        {
+            if (!reader.SkipString() || !reader.Skip(MATERIAL_SIZE) || !reader.SkipString())
+                return false;
+            for (size_t t = 0; t < MAX_TEXTURES; t++)
+            {
+                if (!reader.SkipString())
+                    return false;
+            }
+        }
+
+        uint8_t skeleton;
+        if (!reader.Read(&skeleton, 1))
+            return false;
+        mesh.header.assign(data.begin() + meshStart, data.begin() + reader.Offset());
+
+        // Geometry
+        uint32_t numIndexBuffers, numVertexBuffers;
+        if (!reader.ReadArray(mesh.subMeshes) || !reader.Count(numIndexBuffers))
+            return false;
+
+        mesh.indexBuffers.resize(std::min<size_t>(numIndexBuffers, data.size()));
+        for (auto& indices : mesh.indexBuffers)
+        {
+            if (!reader.ReadArray(indices))
+                return false;
+        }
+
+        if (!reader.Count(numVertexBuffers))
+            return false;
+
+        mesh.vertexBuffers.resize(std::min<size_t>(numVertexBuffers, data.size()));
+        for (auto& vertices : mesh.vertexBuffers)
+        {
+            if (!reader.ReadArray(vertices))
+                return false;
+        }
+
+        // Everything after, as is
+        const size_t trailerStart = reader.Offset();
+        uint32_t numSkinningBuffers;
+        if (!reader.Count(numSkinningBuffers))
+            return false;
+        for (uint32_t i = 0; i < numSkinningBuffers; i++)
+        {
+            if (!reader.SkipArray(SKINNING_VERTEX_SIZE))
+                return false;
+        }
+
+        if (!reader.Skip(EXTENTS_SIZE))
+            return false;
+
+        if (skeleton)
+        {
+            uint32_t numBones, numClips;
+            if (!reader.Count(numBones))
+                return false;
+            for (uint32_t i = 0; i < numBones; i++)
+            {
+                if (!reader.SkipString() || !reader.Skip(BONE_SIZE))
+                    return false;
+            }
+
+            if (!reader.Count(numClips))
+                return false;
+            for (uint32_t i = 0; i < numClips; i++)
+            {
+                uint8_t clip[ANIMATION_CLIP_SIZE];
+                uint32_t numKeys;
+                if (!reader.SkipString() || !reader.Read(clip, sizeof(clip)))
+                    return false;
+                std::memcpy(&numKeys, clip + 8, sizeof(numKeys));
+                if (numKeys > data.size() / KEYFRAME_SIZE || !reader.Skip(numKeys * KEYFRAME_SIZE))
+                    return false;
+            }
+        }
+        mesh.trailer.assign(data.begin() + trailerStart, data.begin() + reader.Offset());
+
+        // Submeshes must stay inside their buffers
+        for (const SubMesh& subMesh : mesh.subMeshes)
+        {
+            if (subMesh.indexBuffer >= mesh.indexBuffers.size() || subMesh.vertexBuffer >= mesh.vertexBuffers.size()
+                || size_t(subMesh.startIndex) + (size_t(subMesh.primCount) * 3) > mesh.indexBuffers[subMesh.indexBuffer].size())
+                return false;
+        }
+
+        meshes.push_back(std::move(mesh));
+    }
+
+    return true;
+}
+
+bool CmoFile::Write(const std::string& path) const
+{
+    std::vector<uint8_t> data;
+    AppendCount(data, meshes.size());
+
+    for (const Mesh& mesh : meshes)
+    {
+        Append(data, mesh.header.data(), mesh.header.size());
+
+        AppendCount(data, mesh.subMeshes.size());
+        Append(data, mesh.subMeshes.data(), mesh.subMeshes.size());
+
+        AppendCount(data, mesh.indexBuffers.size());
+        for (const auto& indices : mesh.indexBuffers)
+        {
+            AppendCount(data, indices.size());
+            Append(data, indices.data(), indices.size());
+        }
+
+        AppendCount(data, mesh.vertexBuffers.size());
+        for (const auto& vertices : mesh.vertexBuffers)
+        {
+            AppendCount(data, vertices.size());
+            Append(data, vertices.data(), vertices.size());
+        }
+
+        Append(data, mesh.trailer.data(), mesh.trailer.size());
+    }
+
+    FILE* pFile = nullptr;
+    errno_t ret = fopen_s(&pFile, path.c_str(), "wb");
+    if (ret != 0 || pFile == nullptr)
+        return false;
+
+    const bool written = fwrite(data.data(), 1, data.size(), pFile) == data.size();
+    return fclose(pFile) == 0 && written;
+}
+
+size_t CmoFile::NumTriangles() const
+{
+    size_t triangles = 0;
+    for (const Mesh& mesh : meshes)
+    {
+        for (const SubMesh& subMesh : mesh.subMeshes)
+            triangles += subMesh.primCount;
+    }
+    return triangles;
+}
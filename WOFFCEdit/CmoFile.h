@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Reads and writes Visual Studio CMO models (the format DirectX::Model::CreateFromCMO loads) without
+// a device, so model data can be processed by headless tools.
+//
+// Index and vertex buffers and submesh ranges are parsed. Everything else - names, materials, skinning
+// vertices, extents, bones and animations - is kept as the file's own bytes and written back
+// unchanged, so a model can be rewritten with new indices and still load like the original.
+class CmoFile
+{
+public:
+    // VSD3DStarter::SubMesh
+    struct SubMesh
+    {
+        uint32_t	material;
+        uint32_t	indexBuffer;
+        uint32_t	vertexBuffer;
+        uint32_t	startIndex;
+        uint32_t	primCount;		//triangles
+    };
+
+    // VSD3DStarter::Vertex
+    struct Vertex
+    {
+        float		position[3];
+        float		normal[3];
+        float		tangent[4];
+        uint32_t	color;
+        float		texcoord[2];
+    };
+
+    struct Mesh
+    {
+        std::vector<uint8_t>				header;			//name, materials and skeleton flag
+        std::vector<SubMesh>				subMeshes;
+        std::vector<std::vector<uint16_t>>	indexBuffers;
+        std::vector<std::vector<Vertex>>	vertexBuffers;
+        std::vector<uint8_t>				trailer;		//skinning vertices, extents, bones and animations
+    };
+
+    // False if the file can't be opened or isn't a well formed CMO
+    bool Read(const std::string& path);
+    bool Write(const std::string& path) const;
+
+    size_t NumTriangles() const;
+
+    std::vector<Mesh>	meshes;
+};
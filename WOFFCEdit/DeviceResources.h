@@ -51,6 +51,8 @@ namespace DX
         UINT                    GetBackBufferCount() const { return m_backBufferCount; }
 
         // Performance events
+        bool IsPIXCapturing() const { return m_d3dAnnotation && m_d3dAnnotation->GetStatus(); }
+
         void PIXBeginEvent(_In_z_ const wchar_t* name)
         {
             if (m_d3dAnnotation)
@@ -1,7 +1,10 @@
 #include "DisplayChunk.h"
 #include "ChunkObject.h"
 #include "DeviceResources.h"
+#include "TerrainIndexBuilder.h"
+#include "ObjFile.h"
 #include "pch.h"
+#include "TerrainVS.inc"
 #include <string>
 #include <locale>
 #include <codecvt>
@@ -10,6 +13,30 @@
 using namespace DirectX;
 using namespace DirectX::SimpleMath;
 
+namespace
+{
+    // Constants of TerrainVS.hlsl after the frame's
+    struct TerrainConstants
+    {
+        XMFLOAT4	diffuseColor;
+        XMFLOAT3	emissiveColor;
+        float		specularPower;
+        XMFLOAT3	specularColor;
+        float		maxHeight;
+        XMFLOAT2	origin;
+        float		cellSize;
+        float		texCoordStep;
+        uint32_t	resolution;
+        uint32_t	padding[3];
+    };
+
+    // BasicEffect's material with EnableDefaultLighting, as the terrain effect has: white, lit by the default ambient light
+    const XMFLOAT4 TERRAIN_DIFFUSE = { 1.f, 1.f, 1.f, 1.f };
+    const XMFLOAT3 TERRAIN_EMISSIVE = { 0.05333332f, 0.09882354f, 0.1819608f };
+    const XMFLOAT3 TERRAIN_SPECULAR = { 1.f, 1.f, 1.f };
+    constexpr float TERRAIN_SPECULAR_POWER = 16.f;
+}
+
 void DisplayChunk::PopulateChunkData(ChunkObject * SceneChunk)
 {
     m_name = SceneChunk->name;
@@ -32,8 +59,33 @@ void DisplayChunk::PopulateChunkData(ChunkObject * SceneChunk)
     m_tex_splat_4_tiling = SceneChunk->tex_splat_4_tiling;
 }
 
-void DisplayChunk::RenderBatch(ID3D11DeviceContext* context)
+void DisplayChunk::RenderBatch(ID3D11DeviceContext* context, ID3D11Buffer* frameConstants, ID3D11PixelShader* pixelShader)
 {
+    if (m_compactVS)
+    {
+        if (m_compactGeometryDirty)
+        {
+            context->UpdateSubresource(m_compactVertexBuffer.Get(), 0, nullptr, m_compactGeometry, 0, 0);
+            m_compactGeometryDirty = false;
+        }
+
+        const UINT stride = sizeof(TerrainVertexCompact);
+        const UINT offset = 0;
+        context->IASetInputLayout(m_compactInputLayout.Get());
+        context->IASetVertexBuffers(0, 1, m_compactVertexBuffer.GetAddressOf(), &stride, &offset);
+        context->IASetIndexBuffer(m_indexBuffer.Get(), DXGI_FORMAT_R16_UINT, 0);
+        context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+        ID3D11Buffer* constants[] = { frameConstants, m_terrainConstants.Get() };
+        context->VSSetConstantBuffers(0, 2, constants);
+        context->VSSetShader(m_compactVS.Get(), nullptr, 0);
+        context->PSSetShader(pixelShader, nullptr, 0);
+        context->PSSetShaderResources(0, 1, &m_texture_diffuse);
+
+        context->DrawIndexed(UINT(m_indices.size()), 0, 0);
+        return;
+    }
+
     m_terrainEffect->Apply(context);
     context->IASetInputLayout(m_terrainInputLayout.Get());
 
@@ -47,6 +99,7 @@ void DisplayChunk::InitialiseBatch()
     //build geometry for our terrain array
     //iterate through all the vertices of our required resolution terrain.
     const float terrainSizeH = m_terrainSize * 0.5f;
+    const uint8_t* heights = m_heightMap.GetHeights();
 
     for (size_t z = 0; z < TERRAINRESOLUTION; z++)
     {
@@ -57,7 +110,7 @@ void DisplayChunk::InitialiseBatch()
             //This will create a terrain going from -64->64.  rather than 0->128.  So the center of the terrain is on the origin
             m_terrainGeometry[index].position = {
                 (x * m_terrainPositionScalingFactor) - terrainSizeH,
-                float(m_heightMap[index]) * m_terrainHeightScale,
+                float(heights[index]) * m_terrainHeightScale,
                 (z * m_terrainPositionScalingFactor) - terrainSizeH
             };
 
@@ -67,29 +120,14 @@ void DisplayChunk::InitialiseBatch()
         }
     }
 
-    // Initialise indices
-    for (size_t z = 0; z < TERRAINRESOLUTION - 1; z++)
-    {
-        for (size_t x = 0; x < TERRAINRESOLUTION - 1; x++)
-        {
-            int bottomL = (TERRAINRESOLUTION * z) + x;
-            int bottomR = (TERRAINRESOLUTION * z) + x + 1;
-            int topR = (TERRAINRESOLUTION * (z + 1)) + x + 1;
-            int topL = (TERRAINRESOLUTION * (z + 1)) + x;
-
-            // First triangle
-            m_indices.push_back(bottomL);
-            m_indices.push_back(bottomR);
-            m_indices.push_back(topR);
-
-            // Second triangle
-            m_indices.push_back(bottomL);
-            m_indices.push_back(topR);
-            m_indices.push_back(topL);
-        }
-    }
+    // Initialise indices in a vertex cache friendly order
+    TerrainIndexBuilder::BuildGridIndices(m_indices, TERRAINRESOLUTION);
 
     CalculateTerrainNormals();
+    UpdateCompactGeometry();
+    UpdateMinMaxTree();
+
+    m_splatMap.Update(heights);
 }
 
 void DisplayChunk::InitialiseRendering(DX::DeviceResources* deviceResources)
@@ -118,29 +156,64 @@ void DisplayChunk::InitialiseRendering(DX::DeviceResources* deviceResources)
                                   m_terrainInputLayout.GetAddressOf())
     );
 
-    m_batch = std::make_unique<PrimitiveBatch<VertexPositionNormalTexture>>(context, m_indices.size() + 1, NUM_VERTICES + 1);
+    // SV_VertexID, which places the compact vertices, needs feature level 10. Below it the full vertices are streamed.
+    m_compactVS.Reset();
+    m_batch.reset();
+    if (deviceResources->GetDeviceFeatureLevel() < D3D_FEATURE_LEVEL_10_0)
+    {
+        m_batch = std::make_unique<PrimitiveBatch<VertexPositionNormalTexture>>(context, m_indices.size() + 1, NUM_VERTICES + 1);
+        return;
+    }
+
+    DX::ThrowIfFailed(device->CreateVertexShader(g_TerrainVS, sizeof(g_TerrainVS), nullptr, m_compactVS.ReleaseAndGetAddressOf()));
+
+    const D3D11_INPUT_ELEMENT_DESC compactElements[] =
+    {
+        { "HEIGHT", 0, DXGI_FORMAT_R16_UNORM, 0, offsetof(TerrainVertexCompact, height), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "NORMAL", 0, DXGI_FORMAT_R8G8_UNORM, 0, offsetof(TerrainVertexCompact, normalU), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+    };
+    DX::ThrowIfFailed(device->CreateInputLayout(compactElements, _countof(compactElements), g_TerrainVS, sizeof(g_TerrainVS), m_compactInputLayout.ReleaseAndGetAddressOf()));
+
+    CD3D11_BUFFER_DESC vertexDesc(sizeof(m_compactGeometry), D3D11_BIND_VERTEX_BUFFER);
+    D3D11_SUBRESOURCE_DATA vertexData = { m_compactGeometry, 0, 0 };
+    DX::ThrowIfFailed(device->CreateBuffer(&vertexDesc, &vertexData, m_compactVertexBuffer.ReleaseAndGetAddressOf()));
+    m_compactGeometryDirty = false;
+
+    CD3D11_BUFFER_DESC indexDesc(UINT(m_indices.size() * sizeof(uint16_t)), D3D11_BIND_INDEX_BUFFER, D3D11_USAGE_IMMUTABLE);
+    D3D11_SUBRESOURCE_DATA indexData = { m_indices.data(), 0, 0 };
+    DX::ThrowIfFailed(device->CreateBuffer(&indexDesc, &indexData, m_indexBuffer.ReleaseAndGetAddressOf()));
+
+    //same placement as the vertices in InitialiseBatch
+    TerrainConstants terrainConstants = {};
+    terrainConstants.diffuseColor = TERRAIN_DIFFUSE;
+    terrainConstants.emissiveColor = TERRAIN_EMISSIVE;
+    terrainConstants.specularPower = TERRAIN_SPECULAR_POWER;
+    terrainConstants.specularColor = TERRAIN_SPECULAR;
+    terrainConstants.maxHeight = GetMaxTerrainHeight();
+    terrainConstants.origin = XMFLOAT2(m_terrainSize * -0.5f, m_terrainSize * -0.5f);
+    terrainConstants.cellSize = m_terrainPositionScalingFactor;
+    terrainConstants.texCoordStep = TEXCOORD_STEP * m_tex_diffuse_tiling;
+    terrainConstants.resolution = TERRAINRESOLUTION;
+
+    CD3D11_BUFFER_DESC constantsDesc(sizeof(TerrainConstants), D3D11_BIND_CONSTANT_BUFFER, D3D11_USAGE_IMMUTABLE);
+    D3D11_SUBRESOURCE_DATA constantsData = { &terrainConstants, 0, 0 };
+    DX::ThrowIfFailed(device->CreateBuffer(&constantsDesc, &constantsData, m_terrainConstants.ReleaseAndGetAddressOf()));
 }
 
 void DisplayChunk::LoadHeightMap(ID3D11Device* device)
 {
     //load in heightmap .raw
-    FILE *pFile = NULL;
-
-    // Open The File In Read / Binary Mode.
-    errno_t ret = fopen_s(&pFile, m_heightmap_path.c_str(), "rb");
-    // Check To See If We Found The File And Could Open It
-    if (ret != 0 || pFile == NULL)
+    if (!m_heightMap.Load(m_heightmap_path))
     {
         // Display Error Message And Stop The Function
         MessageBox(NULL, L"Can't Find The Height Map!", L"Error", MB_OK);
         return;
     }
 
-    // Here We Load The .RAW File Into Our pHeightMap Data Array
-    // We Are Only Reading In '1', And The Size Is (Width * Height)
-    fread(m_heightMap, 1, TERRAINRESOLUTION*TERRAINRESOLUTION, pFile);
-
-    fclose(pFile);
+    //load the splat alpha map if the chunk has one, otherwise paint it from the heightmap
+    m_splatMap.Initialise(TERRAINRESOLUTION, m_terrainHeightScale, m_terrainPositionScalingFactor);
+    if (m_tex_splat_alpha_path.empty() || !m_splatMap.Load(m_tex_splat_alpha_path))
+        m_splatMap.MarkAllDirty();
 
     //load the diffuse texture
     std::wstring_convert<std::codecvt_utf8<wchar_t>> convertToWide;
@@ -150,29 +223,80 @@ void DisplayChunk::LoadHeightMap(ID3D11Device* device)
 
 void DisplayChunk::SaveHeightMap()
 {
-    FILE *pFile = NULL;
-
-    // Open The File In Read / Binary Mode.
-    errno_t ret = fopen_s(&pFile, m_heightmap_path.c_str(), "wb+");;
-    // Check To See If We Found The File And Could Open It
-    if (ret != 0 || pFile == NULL)
+    if (!m_heightMap.Save(m_heightmap_path))
     {
         // Display Error Message And Stop The Function
-        MessageBox(NULL, L"Can't Find The Height Map!", L"Error", MB_OK);
-        return;
+        MessageBox(NULL, L"Can't Save The Height Map!", L"Error", MB_OK);
+    }
+}
+
+void DisplayChunk::SaveSplatMap()
+{
+    if (m_tex_splat_alpha_path.empty())
+    {
+        //no splat map assigned yet, store it alongside the heightmap
+        const size_t extension = m_heightmap_path.find_last_of('.');
+        m_tex_splat_alpha_path = m_heightmap_path.substr(0, extension) + "_splat.raw";
     }
 
-    fwrite(m_heightMap, 1, TERRAINRESOLUTION*TERRAINRESOLUTION, pFile);
-    fclose(pFile);
+    m_splatMap.Update(m_heightMap.GetHeights());
+
+    if (!m_splatMap.Save(m_tex_splat_alpha_path))
+    {
+        MessageBox(NULL, L"Can't Save The Splat Map!", L"Error", MB_OK);
+    }
+}
+
+void DisplayChunk::MarkTerrainRegionDirty(size_t minX, size_t minZ, size_t maxX, size_t maxZ)
+{
+    m_splatMap.MarkDirty(minX, minZ, maxX, maxZ);
 }
 
 void DisplayChunk::UpdateTerrain()
 {
     //all this is doing is transferring the height from the heigtmap into the terrain geometry.
+    const uint8_t* heights = m_heightMap.GetHeights();
     for (size_t i = 0; i < NUM_VERTICES; ++i)
-        m_terrainGeometry[i].position.y = float(m_heightMap[i]) * m_terrainHeightScale;
+        m_terrainGeometry[i].position.y = float(heights[i]) * m_terrainHeightScale;
 
     CalculateTerrainNormals();
+    UpdateCompactGeometry();
+    UpdateMinMaxTree();
+
+    m_splatMap.Update(heights);
+}
+
+void DisplayChunk::BeginHeightEdit()
+{
+    const uint8_t* heights = m_heightMap.GetHeights();
+    m_heightsBeforeEdit.assign(heights, heights + NUM_VERTICES);
+}
+
+void DisplayChunk::EndHeightEdit()
+{
+    //bounds of the samples the edit changed, the splat map is only re-painted around them
+    const uint8_t* heights = m_heightMap.GetHeights();
+    size_t minX = TERRAINRESOLUTION, minZ = TERRAINRESOLUTION, maxX = 0, maxZ = 0;
+    for (size_t z = 0; z < TERRAINRESOLUTION; z++)
+    {
+        for (size_t x = 0; x < TERRAINRESOLUTION; x++)
+        {
+            const size_t i = (z * TERRAINRESOLUTION) + x;
+            if (heights[i] != m_heightsBeforeEdit[i])
+            {
+                minX = std::min(minX, x);
+                maxX = std::max(maxX, x);
+                minZ = std::min(minZ, z);
+                maxZ = std::max(maxZ, z);
+            }
+        }
+    }
+
+    if (minX > maxX)
+        return;	//nothing changed
+
+    MarkTerrainRegionDirty(minX, minZ, maxX, maxZ);
+    UpdateTerrain();
 }
 
 void DisplayChunk::GenerateHeightmap()
@@ -180,39 +304,61 @@ void DisplayChunk::GenerateHeightmap()
     //insert how YOU want to update the heigtmap here! :D
 }
 
+bool DisplayChunk::ApplyHydraulicErosion(const HydraulicErosionSettings& settings, const ErosionProgressCallback& progress)
+{
+    BeginHeightEdit();
+    const bool completed = m_heightMap.ApplyHydraulicErosion(settings, progress);
+    EndHeightEdit();
+    return completed;
+}
+
+bool DisplayChunk::ApplyThermalErosion(const ThermalErosionSettings& settings, const ErosionProgressCallback& progress)
+{
+    BeginHeightEdit();
+    const bool completed = m_heightMap.ApplyThermalErosion(settings, progress);
+    EndHeightEdit();
+    return completed;
+}
+
 void DisplayChunk::CalculateTerrainNormals()
 {
-    // Lambda for testing if two indices are on the same terrain row
-    static const auto OnSameRow = [](int i0, int i1)
-    {
-        return (i0 / TERRAINRESOLUTION) == (i1 / TERRAINRESOLUTION);
-    };
+    m_heightMap.CalculateNormals(&m_terrainGeometry[0].normal.x, sizeof(VertexPositionNormalTexture));
+}
 
-    for (int i = 0; i < NUM_QUADS; i++)
-    {
-        // Neighbour index calculation and range checks
-        int upIdx = (i + TERRAINRESOLUTION >= (TERRAINRESOLUTION * TERRAINRESOLUTION) ? i : i + TERRAINRESOLUTION);
-        int downIdx = (i - TERRAINRESOLUTION < 0 ? i : i - TERRAINRESOLUTION);
-
-        int leftIdx = (OnSameRow(i, i - 1) ? i - 1 : i);
-        int rightIdx = (OnSameRow(i, i + 1) ? i + 1 : i);
-
-        // Normal calculation
-        Vector3 upDownVector(
-            (m_terrainGeometry[upIdx].position.x - m_terrainGeometry[downIdx].position.x),
-            (m_terrainGeometry[upIdx].position.y - m_terrainGeometry[downIdx].position.y),
-            (m_terrainGeometry[upIdx].position.z - m_terrainGeometry[downIdx].position.z)
-        );
-
-        Vector3 leftRightVector(
-            (m_terrainGeometry[leftIdx].position.x - m_terrainGeometry[rightIdx].position.x),
-            (m_terrainGeometry[leftIdx].position.y - m_terrainGeometry[rightIdx].position.y),
-            (m_terrainGeometry[leftIdx].position.z - m_terrainGeometry[rightIdx].position.z)
-        );
-
-        Vector3 normalVector = leftRightVector.Cross(upDownVector);
-        normalVector.Normalize();
-
-        m_terrainGeometry[i].normal = normalVector;
-    }
+void DisplayChunk::UpdateCompactGeometry()
+{
+    TerrainVertexCodec::EncodeHeights(&m_terrainGeometry[0].position.y, sizeof(VertexPositionNormalTexture), NUM_VERTICES, GetMaxTerrainHeight(), m_compactGeometry);
+    TerrainVertexCodec::EncodeNormals(&m_terrainGeometry[0].normal.x, sizeof(VertexPositionNormalTexture), NUM_VERTICES, m_compactGeometry);
+    m_compactGeometryDirty = true;
+}
+
+void DisplayChunk::UpdateMinMaxTree()
+{
+    //same placement as the vertices in InitialiseBatch
+    const float terrainSizeH = m_terrainSize * 0.5f;
+    m_minMaxTree.Build(m_heightMap.GetHeights(), TERRAINRESOLUTION, m_terrainHeightScale, m_terrainPositionScalingFactor, -terrainSizeH, -terrainSizeH);
+}
+
+void DisplayChunk::ExportObj(ObjWriter& writer) const
+{
+    writer.BeginObject(m_name.empty() ? "terrain" : m_name.c_str());
+
+    for (const VertexPositionNormalTexture& vertex : m_terrainGeometry)
+        writer.Position(vertex.position.x, vertex.position.y, vertex.position.z);
+    for (const VertexPositionNormalTexture& vertex : m_terrainGeometry)
+        writer.TexCoord(vertex.textureCoordinate.x, vertex.textureCoordinate.y);
+    for (const VertexPositionNormalTexture& vertex : m_terrainGeometry)
+        writer.Normal(vertex.normal.x, vertex.normal.y, vertex.normal.z);
+
+    for (size_t i = 0; i + 2 < m_indices.size(); i += 3)
+        writer.Triangle(m_indices[i], m_indices[i + 1], m_indices[i + 2]);
+}
+
+void DisplayChunk::ImportObjHeights(const ObjMesh& mesh)
+{
+    //same placement as the vertices in InitialiseBatch
+    const float terrainSizeH = m_terrainSize * 0.5f;
+    BeginHeightEdit();
+    m_heightMap.ImportObjHeights(mesh, -terrainSizeH, -terrainSizeH);
+    EndHeightEdit();
 }
@@ -5,6 +5,14 @@
 #include "PrimitiveBatch.h"
 #include "Effects.h"
 #include "VertexTypes.h"
+#include "TerrainVertexCodec.h"
+#include "SplatMapGenerator.h"
+#include "TerrainErosion.h"
+#include "TerrainMinMaxTree.h"
+#include "TerrainHeightmap.h"
+
+class ObjWriter;
+struct ObjMesh;
 
 namespace DX
 {
@@ -22,14 +30,28 @@ public:
     static constexpr float TEXCOORD_STEP = 1.f / (TERRAINRESOLUTION - 1);
 
     void PopulateChunkData(ChunkObject * SceneChunk);
-    void RenderBatch(ID3D11DeviceContext* context);
+    void RenderBatch(ID3D11DeviceContext* context, ID3D11Buffer* frameConstants, ID3D11PixelShader* pixelShader);	//the compact vertices through TerrainVS.hlsl, sharing the instanced models' frame constants and pixel shader
     void InitialiseBatch();	//initial setup, base coordinates etc based on scale
     void InitialiseRendering(DX::DeviceResources* deviceResources);
     void LoadHeightMap(ID3D11Device* device);
     void SaveHeightMap();			//saves the heigtmap back to file.
-    void UpdateTerrain();			//updates the geometry based on the heigtmap
+    void SaveSplatMap();			//saves the splat alpha map to m_tex_splat_alpha_path, picking a path next to the heightmap if there is none
+    void MarkTerrainRegionDirty(size_t minX, size_t minZ, size_t maxX, size_t maxZ);	//flags heightmap samples changed by an edit, inclusive
+    void UpdateTerrain();			//updates the geometry based on the heigtmap. Re-paints the splat regions flagged dirty
     void GenerateHeightmap();		//creates or alters the heightmap
-    std::unique_ptr<DirectX::PrimitiveBatch<DirectX::VertexPositionNormalTexture>>  m_batch;
+    bool ApplyHydraulicErosion(const HydraulicErosionSettings& settings, const ErosionProgressCallback& progress);	//returns false if cancelled, the terrain keeps the partial result
+    bool ApplyThermalErosion(const ThermalErosionSettings& settings, const ErosionProgressCallback& progress);
+    void ExportObj(ObjWriter& writer) const;		//writes the terrain mesh as an OBJ object
+    void ImportObjHeights(const ObjMesh& mesh);		//sets the heightmap from the vertices of a terrain mesh covering the chunk
+
+    float GetMaxTerrainHeight() const { return 255.f * m_terrainHeightScale; }
+
+    const TerrainMinMaxTree& GetMinMaxTree() const { return m_minMaxTree; }
+
+    const SplatMapGenerator& GetSplatMap() const { return m_splatMap; }
+    const std::string& GetSplatAlphaPath() const { return m_tex_splat_alpha_path; }
+
+    std::unique_ptr<DirectX::PrimitiveBatch<DirectX::VertexPositionNormalTexture>>  m_batch;	//only below feature level 10
     std::unique_ptr<DirectX::BasicEffect>       m_terrainEffect;
 
     ID3D11ShaderResourceView *					m_texture_diffuse;				//diffuse texture
@@ -39,12 +61,29 @@ private:
 
     std::vector<uint16_t> m_indices;
     DirectX::VertexPositionNormalTexture m_terrainGeometry[NUM_VERTICES];
-    BYTE m_heightMap[NUM_VERTICES];
+    TerrainVertexCompact m_compactGeometry[NUM_VERTICES];	//what the GPU draws from, X/Z and UVs are implied by the index in the grid
+    bool m_compactGeometryDirty = true;						//changed since it was last copied into m_compactVertexBuffer
+    SplatMapGenerator m_splatMap;		//auto-painted splat weights, one RGBA texel per heightmap sample
+    TerrainMinMaxTree m_minMaxTree;		//height bounds of the terrain, rebuilt whenever the geometry changes
+    std::vector<uint8_t> m_heightsBeforeEdit;	//between BeginHeightEdit and EndHeightEdit
     void CalculateTerrainNormals();
+    void UpdateCompactGeometry();	//re-encodes m_compactGeometry from m_terrainGeometry
+    void UpdateMinMaxTree();
+    void BeginHeightEdit();			//keeps the heights, for EndHeightEdit to find what changed
+    void EndHeightEdit();			//flags the region the edit changed and updates the terrain, if anything changed
+
+    // Terrain drawn from the compact vertices, 4 bytes each in a buffer that is only written when the
+    // terrain changes, rather than 32 byte vertices streamed through m_batch every frame
+    Microsoft::WRL::ComPtr<ID3D11VertexShader>	m_compactVS;		//null below feature level 10, where m_batch draws the terrain
+    Microsoft::WRL::ComPtr<ID3D11InputLayout>	m_compactInputLayout;
+    Microsoft::WRL::ComPtr<ID3D11Buffer>		m_compactVertexBuffer;
+    Microsoft::WRL::ComPtr<ID3D11Buffer>		m_indexBuffer;
+    Microsoft::WRL::ComPtr<ID3D11Buffer>		m_terrainConstants;
 
     float	m_terrainHeightScale = 0.25f;	//convert our 0-256 terrain to 64
     int		m_terrainSize = 512;				//size of terrain in metres
     float   m_terrainPositionScalingFactor = m_terrainSize / (float) (TERRAINRESOLUTION - 1);	//factor we multiply the position by to convert it from its native resolution( 0- Terrain Resolution) to full scale size in metres dictated by m_Terrainsize
+    TerrainHeightmap m_heightMap{ TERRAINRESOLUTION, m_terrainHeightScale, m_terrainPositionScalingFactor };	//after the scales it is made from
 
     std::string m_name;
     int m_chunk_x_size_metres;
@@ -1,8 +1,10 @@
 #pragma once
 #include <memory>
+#include <vector>
 #include <wrl/client.h>
 #include <d3d11_1.h>
 #include <SimpleMath.h>
+#include <DirectXCollision.h>
 
 namespace DirectX
 {
@@ -12,13 +14,16 @@ namespace DirectX
 struct DisplayObject
 {
     std::shared_ptr<DirectX::Model>						m_model = NULL;						//main Mesh
+    std::vector<std::shared_ptr<DirectX::Model>>		m_lodModels;						//m_model, then its lower detail versions, coarsest last
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_texture_diffuse = NULL;			//diffuse texture
 
     int m_ID;
     DirectX::SimpleMath::Vector3			m_position;
     DirectX::SimpleMath::Vector3			m_orientation;
     DirectX::SimpleMath::Vector3			m_scale;
+    DirectX::BoundingBox					m_worldBounds;						//axis aligned, around all meshes of the model
     bool									m_render = true;
     bool									m_wireframe = false;
+    bool									m_static = false;					//never moves in game, can be merged with its neighbours
 };
 
@@ -0,0 +1,61 @@
+#include "FrameArena.h"
+#include <algorithm>
+#include <cassert>
+
+constexpr size_t FrameArena::DEFAULT_CAPACITY;
+constexpr size_t FrameArena::GROWTH_PERCENT;
+
+FrameArena::FrameArena(size_t capacity)
+    : m_block(new unsigned char[capacity])
+    , m_offset(0)
+    , m_spillCapacity(0)
+{
+    m_stats.capacity = capacity;
+}
+
+void* FrameArena::Allocate(size_t bytes, size_t alignment)
+{
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+    unsigned char* block = m_spills.empty() ? m_block.get() : m_spills.back().get();
+    const size_t capacity = m_spills.empty() ? m_stats.capacity : m_spillCapacity;
+
+    const uintptr_t start = (uintptr_t(block) + m_offset + alignment - 1) & ~uintptr_t(alignment - 1);
+    const size_t end = size_t(start - uintptr_t(block)) + bytes;
+    if (end > capacity)
+        return AllocateFromHeap(bytes, alignment);
+
+    m_stats.used += end - m_offset;
+    m_stats.peak = std::max(m_stats.peak, m_stats.used);
+    m_stats.allocations++;
+    m_offset = end;
+    return reinterpret_cast<void*>(start);
+}
+
+void* FrameArena::AllocateFromHeap(size_t bytes, size_t alignment)
+{
+    // Room for the allocation at any alignment, and for more like it after
+    m_spillCapacity = std::max(m_stats.capacity, bytes + alignment);
+    m_spills.emplace_back(new unsigned char[m_spillCapacity]);
+    m_offset = 0;
+    m_stats.heapBlocks++;
+    return Allocate(bytes, alignment);
+}
+
+void FrameArena::Reset()
+{
+    // One block for everything the frame took, with some to spare, instead of spilling again next frame
+    if (!m_spills.empty())
+    {
+        const size_t capacity = std::max(m_stats.capacity, m_stats.used / 100 * GROWTH_PERCENT);
+        m_spills.clear();
+        m_block.reset();
+        m_block.reset(new unsigned char[capacity]);
+        m_stats.capacity = capacity;
+        m_stats.heapBlocks++;
+    }
+
+    m_offset = 0;
+    m_stats.used = 0;
+    m_stats.allocations = 0;
+}
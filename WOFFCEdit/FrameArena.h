@@ -0,0 +1,97 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Linear allocator for data that only lives for a frame. Allocating moves a pointer along a block, freeing
+// does nothing, and Reset() takes everything back at once when the frame is over.
+//
+// A frame that needs more than the block spills into extra blocks from the heap, and the next Reset() swaps
+// them all for one block big enough for that frame, so a steady frame stops touching the heap after its
+// first few frames. An arena is used by one thread at a time; pipelined frames each get their own.
+//
+//     FrameVector<uint32_t> visible{ FrameAllocator<uint32_t>(arena) };
+//     uint8_t* flags = arena.AllocateArray<uint8_t>(count);
+//     ...
+//     arena.Reset();		//once nothing points into the frame's data any more
+class FrameArena
+{
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 256 * 1024;
+    static constexpr size_t GROWTH_PERCENT = 150;		//of a frame that outgrew the block, for the block after Reset
+
+    struct Stats
+    {
+        size_t		capacity = 0;		//bytes of the block, what a frame can take without the heap
+        size_t		used = 0;			//this frame so far, alignment padding included
+        size_t		peak = 0;			//most any frame used
+        size_t		allocations = 0;	//this frame so far
+        uint64_t	heapBlocks = 0;		//blocks taken from the heap after the first, because a frame outgrew the one before
+    };
+
+    explicit FrameArena(size_t capacity = DEFAULT_CAPACITY);
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // Never returns nullptr, a frame can take as much as the heap has
+    void* Allocate(size_t bytes, size_t alignment);
+
+    // Uninitialised, and never destroyed: only for types that don't need it
+    template<class T>
+    T* AllocateArray(size_t count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "the arena doesn't run destructors");
+        return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+    }
+
+    // Frees everything allocated since the last Reset
+    void Reset();
+
+    const Stats& GetStats() const { return m_stats; }
+
+private:
+    void* AllocateFromHeap(size_t bytes, size_t alignment);
+
+    std::unique_ptr<unsigned char[]>	m_block;
+    size_t								m_offset;			//into m_block, or into the last spill block once there are any
+    std::vector<std::unique_ptr<unsigned char[]>>	m_spills;	//this frame's blocks past m_block
+    size_t								m_spillCapacity;	//of the last spill block
+    Stats								m_stats;
+};
+
+// std allocator taking memory from a FrameArena, for containers that don't outlive the frame.
+// Containers only grow: storage they let go of stays taken until the arena resets.
+template<class T>
+class FrameAllocator
+{
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    explicit FrameAllocator(FrameArena& arena) noexcept : m_arena(&arena) {}
+
+    template<class U>
+    FrameAllocator(const FrameAllocator<U>& other) noexcept : m_arena(other.GetArena()) {}
+
+    T* allocate(size_t count) { return static_cast<T*>(m_arena->Allocate(count * sizeof(T), alignof(T))); }
+    void deallocate(T*, size_t) noexcept {}		//the arena takes it back on Reset
+
+    FrameArena* GetArena() const noexcept { return m_arena; }
+
+private:
+    FrameArena*		m_arena;
+};
+
+template<class T, class U>
+bool operator==(const FrameAllocator<T>& a, const FrameAllocator<U>& b) noexcept { return a.GetArena() == b.GetArena(); }
+
+template<class T, class U>
+bool operator!=(const FrameAllocator<T>& a, const FrameAllocator<U>& b) noexcept { return a.GetArena() != b.GetArena(); }
+
+template<class T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
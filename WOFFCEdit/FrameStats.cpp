@@ -0,0 +1,122 @@
+#include "FrameStats.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    constexpr size_t EVENTS_PER_READ = 64;		//events copied to the stack at a time
+}
+
+constexpr size_t FrameStats::WINDOW;
+constexpr size_t FrameStats::MAX_SECTIONS;
+
+FrameStats::FrameStats()
+    : m_numFrames(0)
+    , m_nextFrame(0)
+    , m_numSections(0)
+    , m_eventCursor(0)
+{
+}
+
+void FrameStats::SetSections(const char* const* names, size_t count)
+{
+    m_numSections = std::min(count, MAX_SECTIONS);
+    std::copy(names, names + m_numSections, m_sectionNames);
+
+    // Events from before are not worth telling apart from the new sections
+    m_numFrames = 0;
+    m_nextFrame = 0;
+    Profiler::Event skipped[EVENTS_PER_READ];
+    while (Profiler::ReadThreadEvents(m_eventCursor, skipped, EVENTS_PER_READ) > 0)
+    {
+    }
+}
+
+void FrameStats::EndFrame(float milliseconds, const float* otherSections)
+{
+    const int64_t start = Profiler::Now();
+
+    float* sections = m_sectionMs[m_nextFrame];
+    if (otherSections)
+        std::copy(otherSections, otherSections + MAX_SECTIONS, sections);
+    else
+        std::fill(sections, sections + MAX_SECTIONS, 0.f);
+
+    // Usually a handful of events, thousands on frames that load a scene
+    CollectSections(m_eventCursor, sections);
+
+    m_frameMs[m_nextFrame] = milliseconds;
+    m_nextFrame = (m_nextFrame + 1) % WINDOW;
+    m_numFrames = std::min(m_numFrames + 1, WINDOW);
+
+    m_stats.microseconds = (Profiler::Now() - start) * 1e-3;
+}
+
+void FrameStats::CollectSections(uint64_t& cursor, float* sections) const
+{
+    Profiler::Event events[EVENTS_PER_READ];
+    size_t count;
+    while ((count = Profiler::ReadThreadEvents(cursor, events, EVENTS_PER_READ)) > 0)
+    {
+        for (size_t e = 0; e < count; e++)
+        {
+            // Literals are usually pooled, so names mostly match on the pointer
+            for (size_t s = 0; s < m_numSections; s++)
+            {
+                if (events[e].name == m_sectionNames[s] || strcmp(events[e].name, m_sectionNames[s]) == 0)
+                {
+                    sections[s] += float(events[e].end - events[e].start) * 1e-6f;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+FrameStats::Summary FrameStats::Summarise() const
+{
+    Summary summary;
+    summary.frames = m_numFrames;
+    if (m_numFrames == 0)
+        return summary;
+
+    // The window isn't in order once it wraps, which doesn't matter to any of these
+    float sorted[WINDOW];
+    std::copy(m_frameMs, m_frameMs + m_numFrames, sorted);
+
+    double total = 0.0;
+    for (size_t f = 0; f < m_numFrames; f++)
+        total += sorted[f];
+
+    // Nearest rank: the frame time 99% of the window is at or under
+    const size_t rank = std::min(m_numFrames - 1, (m_numFrames * 99 + 99) / 100 - 1);
+    std::nth_element(sorted, sorted + rank, sorted + m_numFrames);
+
+    summary.minMs = *std::min_element(m_frameMs, m_frameMs + m_numFrames);
+    summary.maxMs = *std::max_element(m_frameMs, m_frameMs + m_numFrames);
+    summary.averageMs = float(total / m_numFrames);
+    summary.p99Ms = sorted[rank];
+    return summary;
+}
+
+float FrameStats::GetFrameMs(size_t age) const
+{
+    return m_frameMs[(m_nextFrame + WINDOW - 1 - age) % WINDOW];
+}
+
+float FrameStats::GetFrameSectionMs(size_t age, size_t section) const
+{
+    return m_sectionMs[(m_nextFrame + WINDOW - 1 - age) % WINDOW][section];
+}
+
+float FrameStats::GetSectionMs(size_t section) const
+{
+    if (m_numFrames == 0)
+        return 0.f;
+
+    double total = 0.0;
+    for (size_t f = 0; f < m_numFrames; f++)
+        total += m_sectionMs[f][section];
+    return float(total / m_numFrames);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Rolling statistics of the last frames for the stats overlay: frame times, and the CPU time spent per
+// frame in named profiler scopes, read back from the profiler's buffer for the thread running the frames.
+//
+// Gathering runs every frame whether the overlay shows or not, so the window is there the moment it is
+// turned on. It only stores a few numbers and reads the profiler events the frame produced, without
+// allocating; percentiles and averages are worked out when the overlay asks for them.
+class FrameStats
+{
+public:
+    static constexpr size_t WINDOW = 240;			//frames, about four seconds at 60 frames a second
+    static constexpr size_t MAX_SECTIONS = 8;
+
+    struct Summary
+    {
+        size_t	frames = 0;			//in the window so far
+        float	minMs = 0.f;
+        float	averageMs = 0.f;
+        float	p99Ms = 0.f;
+        float	maxMs = 0.f;
+    };
+
+    struct Stats
+    {
+        double	microseconds = 0.0;	//spent gathering the last frame's stats
+    };
+
+    FrameStats();
+
+    // Profiler scope names to time, string literals. Nested scopes are each counted in full.
+    void SetSections(const char* const* names, size_t count);
+
+    // Records a finished frame, and adds up the calling thread's profiler events since the last frame into the sections.
+    // Work the frame ran on another thread can be added with 'otherSections', from CollectSections() there.
+    void EndFrame(float milliseconds, const float* otherSections = nullptr);
+
+    // Adds the calling thread's profiler events from 'cursor' on into 'sections', MAX_SECTIONS of them.
+    // Doesn't change the stats, so any thread may call it while the frame runs.
+    void CollectSections(uint64_t& cursor, float* sections) const;
+
+    Summary Summarise() const;
+    size_t GetNumFrames() const { return m_numFrames; }
+    float GetFrameMs(size_t age) const;				//0 is the last frame, up to GetNumFrames() - 1
+
+    size_t GetNumSections() const { return m_numSections; }
+    const char* GetSectionName(size_t section) const { return m_sectionNames[section]; }
+    float GetSectionMs(size_t section) const;		//average over the window
+    float GetFrameSectionMs(size_t age, size_t section) const;	//of one frame, as GetFrameMs
+
+    const Stats& GetStats() const { return m_stats; }
+
+private:
+    float			m_frameMs[WINDOW];				//ring, m_nextFrame is the oldest once full
+    float			m_sectionMs[WINDOW][MAX_SECTIONS];
+    size_t			m_numFrames;
+    size_t			m_nextFrame;
+    const char*		m_sectionNames[MAX_SECTIONS];
+    size_t			m_numSections;
+    uint64_t		m_eventCursor;					//profiler events read so far
+    Stats			m_stats;
+};
@@ -4,9 +4,20 @@
 
 #include "Game.h"
 #include "SceneObject.h"
+#include "ObjFile.h"
+#include "LodCooker.h"
+#include "Profiler.h"
+#include "StartupTimings.h"
+#include "InstancedModelVS.inc"
+#include "InstancedModelPS.inc"
+#include <DirectXPackedVector.h>
 #include <string>
 #include <locale>
 #include <codecvt>
+#include <chrono>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 
 using namespace DirectX;
@@ -14,20 +25,391 @@ using namespace DirectX::SimpleMath;
 
 using Microsoft::WRL::ComPtr;
 
+namespace
+{
+    // Per frame constants of InstancedModelVS.hlsl
+    struct InstanceFrameConstants
+    {
+        XMMATRIX	viewProjection;			//transposed
+        XMFLOAT4	eyePosition;
+        XMFLOAT4	lightDirection[3];
+        XMFLOAT4	lightDiffuseColor[3];
+        XMFLOAT4	lightSpecularColor[3];
+    };
+
+    // The lights of BasicEffect::EnableDefaultLighting, which the model loaders turn on
+    const XMFLOAT4 DEFAULT_LIGHT_DIRECTIONS[3] = { { -0.5265408f, -0.5735765f, -0.6275069f, 0.f }, { 0.7198464f, 0.3420201f, 0.6040227f, 0.f }, { 0.4545195f, -0.7660444f, 0.4545195f, 0.f } };
+    const XMFLOAT4 DEFAULT_LIGHT_DIFFUSE[3] = { { 1.f, 0.9607844f, 0.8078432f, 0.f }, { 0.9647059f, 0.7607844f, 0.4078432f, 0.f }, { 0.3231373f, 0.3607844f, 0.3937255f, 0.f } };
+    const XMFLOAT4 DEFAULT_LIGHT_SPECULAR[3] = { { 1.f, 0.9607844f, 0.8078432f, 0.f }, { 0.f, 0.f, 0.f, 0.f }, { 0.3231373f, 0.3607844f, 0.3937255f, 0.f } };
+
+    // Object to world transform of a display object, before Game::m_world
+    Matrix ObjectTransform(const DisplayObject& displayObject)
+    {
+        return Matrix::CreateScale(displayObject.m_scale)
+            * Matrix::CreateFromYawPitchRoll(XMConvertToRadians(displayObject.m_orientation.y), XMConvertToRadians(displayObject.m_orientation.x), XMConvertToRadians(displayObject.m_orientation.z))
+            * Matrix::CreateTranslation(displayObject.m_position);
+    }
+
+    // Size in bytes of the vertex element formats DirectXTK's model loaders produce
+    UINT VertexFormatSize(DXGI_FORMAT format)
+    {
+        switch (format)
+        {
+            case DXGI_FORMAT_R32G32B32A32_FLOAT:	return 16;
+            case DXGI_FORMAT_R32G32B32_FLOAT:		return 12;
+            case DXGI_FORMAT_R32G32_FLOAT:
+            case DXGI_FORMAT_R16G16B16A16_FLOAT:	return 8;
+            case DXGI_FORMAT_R32_FLOAT:
+            case DXGI_FORMAT_R32_UINT:
+            case DXGI_FORMAT_R8G8B8A8_UNORM:
+            case DXGI_FORMAT_B8G8R8A8_UNORM:
+            case DXGI_FORMAT_R8G8B8A8_UINT:
+            case DXGI_FORMAT_R16G16_FLOAT:
+            case DXGI_FORMAT_R10G10B10A2_UNORM:		return 4;
+            default:								return 0;
+        }
+    }
+
+    // Finds an input element of the vertices of 'part', with its byte offset resolved. False if they don't have it.
+    bool FindElement(const ModelMeshPart& part, const char* semanticName, UINT semanticIndex, D3D11_INPUT_ELEMENT_DESC& found)
+    {
+        UINT offset = 0;
+        for (const D3D11_INPUT_ELEMENT_DESC& element : *part.vbDecl)
+        {
+            if (element.AlignedByteOffset != D3D11_APPEND_ALIGNED_ELEMENT)
+                offset = element.AlignedByteOffset;
+
+            if (_stricmp(element.SemanticName, semanticName) == 0 && element.SemanticIndex == semanticIndex)
+            {
+                found = element;
+                found.AlignedByteOffset = offset;
+                return true;
+            }
+
+            offset += VertexFormatSize(element.Format);
+        }
+
+        return false;
+    }
+
+    // Byte offset of an input element within the vertices of 'part', or -1 if they don't have it
+    int ElementOffset(const ModelMeshPart& part, const char* semanticName, UINT semanticIndex)
+    {
+        D3D11_INPUT_ELEMENT_DESC element;
+        return FindElement(part, semanticName, semanticIndex, element) ? int(element.AlignedByteOffset) : -1;
+    }
+
+    int PositionOffset(const ModelMeshPart& part)
+    {
+        const int offset = ElementOffset(part, "SV_Position", 0);
+        return offset >= 0 ? offset : ElementOffset(part, "POSITION", 0);
+    }
+
+    // Copies a GPU buffer into a CPU readable staging buffer and returns its contents
+    std::vector<uint8_t> ReadBackBuffer(ID3D11Device* device, ID3D11DeviceContext* context, ID3D11Buffer* buffer)
+    {
+        D3D11_BUFFER_DESC desc;
+        buffer->GetDesc(&desc);
+        desc.Usage = D3D11_USAGE_STAGING;
+        desc.BindFlags = 0;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+        desc.MiscFlags = 0;
+
+        ComPtr<ID3D11Buffer> staging;
+        DX::ThrowIfFailed(device->CreateBuffer(&desc, nullptr, staging.GetAddressOf()));
+        context->CopyResource(staging.Get(), buffer);
+
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        DX::ThrowIfFailed(context->Map(staging.Get(), 0, D3D11_MAP_READ, 0, &mapped));
+        const uint8_t* data = static_cast<const uint8_t*>(mapped.pData);
+        std::vector<uint8_t> contents(data, data + desc.ByteWidth);
+        context->Unmap(staging.Get(), 0);
+
+        return contents;
+    }
+
+    // Reads the first two components of a texture coordinate element, in the formats models are exported with
+    bool ReadTexCoord(const uint8_t* element, DXGI_FORMAT format, XMFLOAT2& texcoord)
+    {
+        switch (format)
+        {
+            case DXGI_FORMAT_R32G32_FLOAT:
+            case DXGI_FORMAT_R32G32B32_FLOAT:
+            case DXGI_FORMAT_R32G32B32A32_FLOAT:
+                memcpy(&texcoord, element, sizeof(texcoord));
+                return true;
+            case DXGI_FORMAT_R16G16_FLOAT:
+            case DXGI_FORMAT_R16G16B16A16_FLOAT:
+                XMStoreFloat2(&texcoord, PackedVector::XMLoadHalf2(reinterpret_cast<const PackedVector::XMHALF2*>(element)));
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Writes every triangle list part of a model to 'writer' as one OBJ object, transformed by 'world'.
+    // Parts of a mesh usually share its vertex buffer, which is written once and indexed by all of them.
+    void ExportModelObj(ObjWriter& writer, ID3D11Device* device, ID3D11DeviceContext* context, const Model& model, const Matrix& world, const std::string& name)
+    {
+        const Matrix normalMatrix = world.Invert().Transpose();
+
+        struct WrittenVertices
+        {
+            ID3D11Buffer*	buffer;
+            const std::vector<D3D11_INPUT_ELEMENT_DESC>* layout;	//the same buffer read as other vertices would be written again
+            uint32_t		base;		//of its first vertex in the object
+        };
+
+        writer.BeginObject(name.c_str());
+        uint32_t numWritten = 0;
+
+        for (const auto& mesh : model.meshes)
+        {
+            std::vector<WrittenVertices> written;
+
+            for (const auto& part : mesh->meshParts)
+            {
+                if (part->primitiveType != D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST || !part->vbDecl)
+                    continue;
+
+                // Locate position, normal and texcoord within the vertex, only reading formats that are understood
+                D3D11_INPUT_ELEMENT_DESC position, normal, texcoord;
+                if (!FindElement(*part, "SV_Position", 0, position) && !FindElement(*part, "POSITION", 0, position))
+                    continue;
+                if (position.Format != DXGI_FORMAT_R32G32B32_FLOAT && position.Format != DXGI_FORMAT_R32G32B32A32_FLOAT)
+                    continue;
+
+                const bool hasNormal = FindElement(*part, "NORMAL", 0, normal) && (normal.Format == DXGI_FORMAT_R32G32B32_FLOAT || normal.Format == DXGI_FORMAT_R32G32B32A32_FLOAT);
+                const bool hasTexcoord = FindElement(*part, "TEXCOORD", 0, texcoord);
+
+                auto vertices = std::find_if(written.begin(), written.end(), [&](const WrittenVertices& w)
+                {
+                    return w.buffer == part->vertexBuffer.Get() && w.layout == part->vbDecl.get();
+                });
+
+                if (vertices == written.end())
+                {
+                    const std::vector<uint8_t> data = ReadBackBuffer(device, context, part->vertexBuffer.Get());
+                    const size_t numVertices = data.size() / part->vertexStride;
+
+                    for (size_t v = 0; v < numVertices; v++)
+                    {
+                        const uint8_t* vertex = &data[v * part->vertexStride];
+                        const Vector3 worldPosition = Vector3::Transform(Vector3(*reinterpret_cast<const XMFLOAT3*>(vertex + position.AlignedByteOffset)), world);
+                        writer.Position(worldPosition.x, worldPosition.y, worldPosition.z);
+                    }
+                    for (size_t v = 0; v < numVertices; v++)
+                    {
+                        XMFLOAT2 uv(0.f, 0.f);
+                        if (hasTexcoord)
+                            ReadTexCoord(&data[(v * part->vertexStride) + texcoord.AlignedByteOffset], texcoord.Format, uv);
+                        writer.TexCoord(uv.x, uv.y);
+                    }
+                    for (size_t v = 0; v < numVertices; v++)
+                    {
+                        Vector3 worldNormal = hasNormal ? Vector3(*reinterpret_cast<const XMFLOAT3*>(&data[(v * part->vertexStride) + normal.AlignedByteOffset])) : Vector3::UnitY;
+                        worldNormal = Vector3::TransformNormal(worldNormal, normalMatrix);
+                        worldNormal.Normalize();
+                        writer.Normal(worldNormal.x, worldNormal.y, worldNormal.z);
+                    }
+
+                    written.push_back({ part->vertexBuffer.Get(), part->vbDecl.get(), numWritten });
+                    vertices = written.end() - 1;
+                    numWritten += uint32_t(numVertices);
+                }
+
+                // Indices are relative to the part's vertexOffset, just like the draw call
+                const std::vector<uint8_t> indices = ReadBackBuffer(device, context, part->indexBuffer.Get());
+                const bool wideIndices = part->indexFormat == DXGI_FORMAT_R32_UINT;
+                const uint32_t base = vertices->base;
+                const auto IndexAt = [&](size_t i) -> uint32_t
+                {
+                    const size_t byteOffset = i * (wideIndices ? 4 : 2);
+                    const uint32_t index = wideIndices ? *reinterpret_cast<const uint32_t*>(&indices[byteOffset]) : *reinterpret_cast<const uint16_t*>(&indices[byteOffset]);
+                    return base + index + part->vertexOffset;
+                };
+
+                for (size_t i = part->startIndex; i + 2 < part->startIndex + part->indexCount; i += 3)
+                    writer.Triangle(IndexAt(i), IndexAt(i + 1), IndexAt(i + 2));
+            }
+        }
+    }
+
+    // Object space positions and triangles of every triangle list part of a model, for the occlusion buffer
+    std::shared_ptr<OccluderMesh> ReadOccluderMesh(ID3D11Device* device, ID3D11DeviceContext* context, const Model& model)
+    {
+        auto occluder = std::make_shared<OccluderMesh>();
+
+        for (const auto& mesh : model.meshes)
+        {
+            for (const auto& part : mesh->meshParts)
+            {
+                if (part->primitiveType != D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST || !part->vbDecl)
+                    continue;
+
+                const int positionOffset = PositionOffset(*part);
+                if (positionOffset < 0)
+                    continue;
+
+                const std::vector<uint8_t> vertices = ReadBackBuffer(device, context, part->vertexBuffer.Get());
+                const std::vector<uint8_t> indices = ReadBackBuffer(device, context, part->indexBuffer.Get());
+                const size_t numVertices = vertices.size() / part->vertexStride;
+                const uint32_t base = uint32_t(occluder->positions.size() / 3);
+
+                for (size_t v = 0; v < numVertices; v++)
+                {
+                    const float* position = reinterpret_cast<const float*>(&vertices[(v * part->vertexStride) + positionOffset]);
+                    occluder->positions.insert(occluder->positions.end(), position, position + 3);
+                }
+
+                const bool wideIndices = part->indexFormat == DXGI_FORMAT_R32_UINT;
+                for (size_t i = part->startIndex; i < part->startIndex + part->indexCount; i++)
+                {
+                    const uint32_t index = wideIndices ? reinterpret_cast<const uint32_t*>(indices.data())[i] : reinterpret_cast<const uint16_t*>(indices.data())[i];
+                    occluder->indices.push_back(base + index + part->vertexOffset);
+                }
+            }
+        }
+
+        return occluder;
+    }
+
+    // Whether the vertices of a part hold 32 bit float positions, normals and texcoords, which is what
+    // static geometry merging reads back
+    bool HasStaticVertexFormat(const ModelMeshPart& part)
+    {
+        if (part.primitiveType != D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST || !part.vbDecl)
+            return false;
+
+        D3D11_INPUT_ELEMENT_DESC position, normal, texcoord;
+        if ((!FindElement(part, "SV_Position", 0, position) && !FindElement(part, "POSITION", 0, position))
+            || !FindElement(part, "NORMAL", 0, normal) || !FindElement(part, "TEXCOORD", 0, texcoord))
+            return false;
+
+        const auto IsFloat3 = [](DXGI_FORMAT format) { return format == DXGI_FORMAT_R32G32B32_FLOAT || format == DXGI_FORMAT_R32G32B32A32_FLOAT; };
+        return IsFloat3(position.Format) && IsFloat3(normal.Format) && texcoord.Format == DXGI_FORMAT_R32G32_FLOAT;
+    }
+
+    // Object space copy of every part of a model, in mesh then part order, holding only the vertices the
+    // part's indices reference. Null for parts HasStaticVertexFormat rejects.
+    std::vector<std::shared_ptr<StaticGeometryBaker::Mesh>> ReadStaticMeshes(ID3D11Device* device, ID3D11DeviceContext* context, const Model& model)
+    {
+        std::vector<std::shared_ptr<StaticGeometryBaker::Mesh>> meshes;
+        std::map<ID3D11Buffer*, std::vector<uint8_t>> buffers;		//parts of a mesh usually share their buffers, read each once
+
+        const auto ReadBuffer = [&](ID3D11Buffer* buffer) -> const std::vector<uint8_t>&
+        {
+            std::vector<uint8_t>& contents = buffers[buffer];
+            if (contents.empty())
+                contents = ReadBackBuffer(device, context, buffer);
+            return contents;
+        };
+
+        for (const auto& mesh : model.meshes)
+        {
+            for (const auto& part : mesh->meshParts)
+            {
+                meshes.emplace_back();
+                if (!HasStaticVertexFormat(*part))
+                    continue;
+
+                const std::vector<uint8_t>& vertices = ReadBuffer(part->vertexBuffer.Get());
+                const std::vector<uint8_t>& indices = ReadBuffer(part->indexBuffer.Get());
+                const size_t numVertices = vertices.size() / part->vertexStride;
+                const int positionOffset = PositionOffset(*part);
+                const int normalOffset = ElementOffset(*part, "NORMAL", 0);
+                const int texcoordOffset = ElementOffset(*part, "TEXCOORD", 0);
+
+                auto staticMesh = std::make_shared<StaticGeometryBaker::Mesh>();
+                std::vector<uint32_t> remap(numVertices, UINT32_MAX);
+                const bool wideIndices = part->indexFormat == DXGI_FORMAT_R32_UINT;
+                const size_t numIndices = indices.size() / (wideIndices ? 4 : 2);
+
+                for (size_t i = part->startIndex; i < part->startIndex + part->indexCount && i < numIndices; i++)
+                {
+                    const uint32_t index = (wideIndices ? reinterpret_cast<const uint32_t*>(indices.data())[i] : reinterpret_cast<const uint16_t*>(indices.data())[i]) + part->vertexOffset;
+                    if (index >= numVertices)
+                        break;
+
+                    if (remap[index] == UINT32_MAX)
+                    {
+                        remap[index] = uint32_t(staticMesh->vertices.size());
+
+                        const uint8_t* vertex = &vertices[index * part->vertexStride];
+                        StaticGeometryBaker::Vertex copy;
+                        std::copy_n(reinterpret_cast<const float*>(vertex + positionOffset), 3, copy.position);
+                        std::copy_n(reinterpret_cast<const float*>(vertex + normalOffset), 3, copy.normal);
+                        std::copy_n(reinterpret_cast<const float*>(vertex + texcoordOffset), 2, copy.texcoord);
+                        staticMesh->vertices.push_back(copy);
+                    }
+                    staticMesh->indices.push_back(remap[index]);
+                }
+
+                //whole triangles only
+                staticMesh->indices.resize(staticMesh->indices.size() - (staticMesh->indices.size() % 3));
+                meshes.back() = staticMesh;
+            }
+        }
+
+        return meshes;
+    }
+
+    // Size and modification time of a file, so cached geometry notices when its model is re-exported
+    std::pair<int64_t, int64_t> FileStamp(const std::string& path)
+    {
+        struct _stat64 status;
+        if (_stat64(path.c_str(), &status) != 0)
+            return std::make_pair(int64_t(-1), int64_t(-1));
+
+        return std::make_pair(int64_t(status.st_size), int64_t(status.st_mtime));
+    }
+
+    // Profiler markers on the render thread, passed on to PIX while it captures
+    void PIXForwardBegin(void* user, const wchar_t* name)
+    {
+        static_cast<DX::DeviceResources*>(user)->PIXBeginEvent(name);
+    }
+
+    void PIXForwardEnd(void* user)
+    {
+        static_cast<DX::DeviceResources*>(user)->PIXEndEvent();
+    }
+
+    // Profiler scopes timed per frame on the stats overlay
+    const char* const STATS_SECTIONS[] = { "Update", "Horizon culling", "Occlusion culling", "Draw models", "Render" };
+
+    constexpr float GRAPH_HEIGHT = 60.f;		//pixels, for GRAPH_SCALE_MS
+    constexpr float GRAPH_SCALE_MS = 33.3f;		//frame time at the top of the graph, longer frames are cut off
+    constexpr float GRAPH_BAR_WIDTH = 2.f;
+    constexpr int STARTUP_DEPTHS_SHOWN = 4;		//deeper startup phases are only in the log
+
+    static_assert(LodCooker::MAX_LEVELS == LodSelector::MAX_LEVELS, "every cooked level of detail should be selectable");
+}
+
 
 // Initialize the Direct3D resources required to run.
 void Game::Initialize(HWND window, int width, int height)
 {
+    STARTUP_PHASE("Game::Initialize");
+
     m_deviceResources = std::make_unique<DX::DeviceResources>();
     m_deviceResources->RegisterDeviceNotify(this);
 
     m_deviceResources->SetWindow(window, width, height);
 
-    m_deviceResources->CreateDeviceResources();
+    {
+        STARTUP_PHASE("Create device");
+        m_deviceResources->CreateDeviceResources();
+    }
     CreateDeviceDependentResources();
 
-    m_deviceResources->CreateWindowSizeDependentResources();
-    CreateWindowSizeDependentResources();
+    {
+        STARTUP_PHASE("Create swap chain");
+        m_deviceResources->CreateWindowSizeDependentResources();
+        CreateWindowSizeDependentResources();
+    }
+
+    m_frameStats.SetSections(STATS_SECTIONS, _countof(STATS_SECTIONS));
 
 #ifdef DXTK_AUDIO
     // Create DirectXTK for Audio objects
@@ -62,10 +444,66 @@ void Game::SetGridState(bool state)
 // Executes the basic game loop.
 void Game::Tick(DirectX::Mouse::State& mouse, DirectX::Keyboard::State& keyboard)
 {
+    const int64_t frameStart = Profiler::Now();
+
+    // Update writes the snapshot Render isn't reading. Only this thread publishes, and the update is waited
+    // for before it does, so the snapshots don't change under Render or under the other entry points.
+    const uint32_t front = m_frontSnapshot.load(std::memory_order_relaxed);
+    const uint32_t back = front == 0 ? 1 : 0;
+    FrameSnapshot& next = m_snapshots[back];
+    FrameArena& nextArena = m_frameArenas[back];
+    const double drawCostMs = m_drawCostMs;
+    bool pipelined = false;
+
     //copy over the input commands so we have a local version to use elsewhere.
     m_timer.Tick([&]()
     {
-        Update(m_timer, mouse, keyboard);
+#ifdef DXTK_AUDIO
+        m_audioTimerAcc -= (float) m_timer.GetElapsedSeconds();
+        if (m_audioTimerAcc < 0)
+        {
+            if (m_retryDefault)
+            {
+                m_retryDefault = false;
+                if (m_audEngine->Reset())
+                {
+                    // Restart looping audio
+                    m_effect1->Play(true);
+                }
+            }
+            else
+            {
+                m_audioTimerAcc = 4.f;
+
+                m_waveBank->Play(m_audioEvent++);
+
+                if (m_audioEvent >= 11)
+                    m_audioEvent = 0;
+            }
+        }
+#endif
+
+        // With nothing to draw yet the update has to come first
+        if (front == NO_SNAPSHOT)
+        {
+            Update(m_timer, mouse, keyboard, drawCostMs, next, nextArena);
+            std::fill(next.sectionMs, next.sectionMs + FrameStats::MAX_SECTIONS, 0.f);
+            PublishSnapshot(back);
+            return;
+        }
+
+        // The input outlives the task, it is waited for before Tick returns
+        m_updateTask.Run([this, &mouse, &keyboard, &next, &nextArena, drawCostMs]()
+        {
+            uint64_t eventCursor = Profiler::GetThreadEventCount();
+            Update(m_timer, mouse, keyboard, drawCostMs, next, nextArena);
+
+            // When the main thread picks the task up, its events are counted at the end of the frame anyway
+            std::fill(next.sectionMs, next.sectionMs + FrameStats::MAX_SECTIONS, 0.f);
+            if (!JobSystem::IsMainThread())
+                m_frameStats.CollectSections(eventCursor, next.sectionMs);
+        });
+        pipelined = true;
     });
 
 #ifdef DXTK_AUDIO
@@ -79,10 +517,47 @@ void Game::Tick(DirectX::Mouse::State& mouse, DirectX::Keyboard::State& keyboard
 #endif
 
     Render();
+    m_retiredRenderArena = m_renderArena.GetStats();
+    m_renderArena.Reset();
+
+    if (pipelined)
+    {
+        m_updateTask.Wait();
+        PublishSnapshot(back);
+
+        // The frame drawn is over, and its snapshot retired with it
+        m_retiredArena = m_frameArenas[front].GetStats();
+        m_frameArenas[front].Reset();
+    }
+
+    m_frameStats.EndFrame(float(Profiler::Now() - frameStart) * 1e-6f, pipelined ? next.sectionMs : nullptr);
+}
+
+void Game::PublishSnapshot(uint32_t snapshot)
+{
+    m_snapshotPending = m_snapshots[snapshot].changed;
+    m_frontSnapshot.store(snapshot, std::memory_order_release);
 }
 
-void Game::Update(DX::StepTimer const & timer, Mouse::State& mouse, Keyboard::State& keyboard)
+void Game::InvalidateSnapshots()
 {
+    m_updateTask.Wait();
+    m_frontSnapshot.store(NO_SNAPSHOT, std::memory_order_release);
+    m_snapshotPending = false;
+
+    m_frameArenas[0].Reset();
+    m_frameArenas[1].Reset();
+}
+
+bool Game::IsSettling() const
+{
+    return m_snapshotPending || m_smoothDelta.LengthSquared() > MOUSE_SETTLED_DELTA * MOUSE_SETTLED_DELTA;
+}
+
+void Game::Update(DX::StepTimer const & timer, Mouse::State& mouse, Keyboard::State& keyboard, double drawCostMs, FrameSnapshot& snapshot, FrameArena& arena)
+{
+    PROFILE_SCOPE("Update");
+
     //TODO  any more complex than this, and the camera should be abstracted out to somewhere else
     //camera motion is on a plane, so kill the 7 component of the look direction
     if (mouse.positionMode == Mouse::MODE_RELATIVE)
@@ -102,6 +577,9 @@ void Game::Update(DX::StepTimer const & timer, Mouse::State& mouse, Keyboard::St
     }
     else
     {
+        // Nothing left to smooth once the mouse is released
+        m_smoothDelta = Vector3::Zero;
+
         if (keyboard.E)
         {
             m_camOrientation.y -= m_camRotRate;
@@ -154,36 +632,133 @@ void Game::Update(DX::StepTimer const & timer, Mouse::State& mouse, Keyboard::St
     //apply camera vectors
     m_view = Matrix::CreateLookAt(m_camPosition, m_camLookAt, Vector3::UnitY);
 
-    m_batchEffect->SetView(m_view);
-    m_batchEffect->SetWorld(Matrix::Identity);
-    m_displayChunk.m_terrainEffect->SetView(m_view);
+    //hide objects behind the terrain
+    if (m_keyboardTracker->IsKeyPressed(Keyboard::H))
+    {
+        m_horizonCulling = !m_horizonCulling;
+        m_cullingLosses = 0;
+        m_cullingBackoff = 0;
+    }
 
-    m_displayChunk.m_terrainEffect->SetWorld(Matrix::Identity);
+    if (m_keyboardTracker->IsKeyPressed(Keyboard::O))
+        m_occlusionCulling = !m_occlusionCulling;
+
+    if (m_keyboardTracker->IsKeyPressed(Keyboard::F3))
+        m_statsOverlay = !m_statsOverlay;
+
+    //occluders rasterise on worker threads while the rest of the frame's update runs
+    const size_t numObjects = m_displayList.size();
+    snapshot.numObjects = numObjects;
+    snapshot.objectVisible = arena.AllocateArray<uint8_t>(numObjects);
+    snapshot.objectLevel = arena.AllocateArray<uint8_t>(numObjects);
+    BeginOcclusionRender();
+    CullObjects(drawCostMs, snapshot);
+
+    //projection _22 is 1 / tan(fovY / 2)
+    m_lodSelector.Select(m_camPosition.x, m_camPosition.y, m_camPosition.z, m_projection._22);
+
+    ApplyOcclusionCulling(snapshot);
+
+    for (size_t i = 0; i < numObjects; i++)
+        snapshot.objectLevel[i] = uint8_t(m_lodSelector.GetLevel(i));
+
+    snapshot.view = m_view;
+    snapshot.projection = m_projection;
+    snapshot.camPosition = m_camPosition;
+    snapshot.camLookDirection = m_camLookDirection;
+    snapshot.visibleObjects = int(std::count(snapshot.objectVisible, snapshot.objectVisible + numObjects, uint8_t(1)));
+    snapshot.horizonCulling = m_horizonCulling;
+    snapshot.horizonPaused = m_cullingBackoff > 0;
+    snapshot.horizonStats = m_horizonCuller.GetStats();
+    snapshot.occlusionCulling = m_occlusionCulling;
+    snapshot.occlusionStats = m_occlusionBuffer.GetStats();
+    snapshot.lodStats = m_lodSelector.GetStats();
+    snapshot.statsOverlay = m_statsOverlay;
+
+    // Frames only need drawing again while they would look different. The shown snapshot is only read here,
+    // as Render does, so the comparison is safe while it draws.
+    const uint32_t front = m_frontSnapshot.load(std::memory_order_acquire);
+    const FrameSnapshot* shown = front != NO_SNAPSHOT ? &m_snapshots[front] : nullptr;
+    snapshot.changed = !shown || snapshot.view != shown->view || snapshot.projection != shown->projection || snapshot.numObjects != shown->numObjects
+        || memcmp(snapshot.objectVisible, shown->objectVisible, numObjects) != 0 || memcmp(snapshot.objectLevel, shown->objectLevel, numObjects) != 0
+        || snapshot.horizonCulling != shown->horizonCulling || snapshot.occlusionCulling != shown->occlusionCulling || snapshot.statsOverlay != shown->statsOverlay;
+}
 
-#ifdef DXTK_AUDIO
-    m_audioTimerAcc -= (float) timer.GetElapsedSeconds();
-    if (m_audioTimerAcc < 0)
+void Game::CullObjects(double drawCostMs, FrameSnapshot& snapshot)
+{
+    PROFILE_SCOPE("Horizon culling");
+
+    if (!m_horizonCulling || m_cullingBackoff > 0)
     {
-        if (m_retryDefault)
-        {
-            m_retryDefault = false;
-            if (m_audEngine->Reset())
-            {
-                // Restart looping audio
-                m_effect1->Play(true);
-            }
-        }
-        else
-        {
-            m_audioTimerAcc = 4.f;
+        std::fill(snapshot.objectVisible, snapshot.objectVisible + snapshot.numObjects, uint8_t(1));
+        if (m_cullingBackoff > 0)
+            m_cullingBackoff--;
+        return;
+    }
+
+    m_horizonCuller.Cull(m_displayChunk.GetMinMaxTree(), m_camPosition.x, m_camPosition.y, m_camPosition.z, m_objectBounds.data(), m_objectBounds.size(), snapshot.objectVisible);
+
+    // The pass has to pay for itself: weigh its cost against the draws it saved, at the average CPU cost
+    // of a draw. If it keeps losing, e.g. from a viewpoint that overlooks everything, pause it for a while.
+    if (!m_adaptiveCulling)
+        return;
+
+    const HorizonCuller::Stats& stats = m_horizonCuller.GetStats();
+    if (stats.milliseconds > stats.culled * drawCostMs)
+        m_cullingLosses++;
+    else
+        m_cullingLosses = 0;
+
+    if (m_cullingLosses >= CULLING_LOSS_FRAMES)
+    {
+        m_cullingLosses = 0;
+        m_cullingBackoff = CULLING_BACKOFF_FRAMES;
+    }
+}
+
+void Game::SetAdaptiveCulling(bool enabled)
+{
+    m_adaptiveCulling = enabled;
+    m_cullingLosses = 0;
+    m_cullingBackoff = 0;
+}
 
-            m_waveBank->Play(m_audioEvent++);
+void Game::BeginOcclusionRender()
+{
+    m_occlusionTask.Wait();
+    m_occlusionPending = false;
+
+    if (!m_occlusionCulling || m_occluders.empty())
+        return;
+
+    const Matrix viewProjection = m_view * m_projection;
+    m_occlusionTask.Run([this, viewProjection]()
+    {
+        PROFILE_SCOPE("Occlusion render");
+        m_occlusionBuffer.Render(m_occluders.data(), m_occluders.size(), &viewProjection._11);
+    });
+    m_occlusionPending = true;
+}
 
-            if (m_audioEvent >= 11)
-                m_audioEvent = 0;
+void Game::ApplyOcclusionCulling(FrameSnapshot& snapshot)
+{
+    PROFILE_SCOPE("Occlusion culling");
+    m_occlusionTask.Wait();
+    snapshot.occlusionCulled = 0;
+
+    if (!m_occlusionPending)
+        return;
+
+    // Only objects that survived horizon culling need testing
+    const size_t numObjects = m_displayList.size();
+    for (size_t i = 0; i < numObjects; i++)
+    {
+        if (snapshot.objectVisible[i] && !m_occlusionBuffer.IsVisible(&m_objectBounds[i].minX, &m_objectBounds[i].maxX))
+        {
+            snapshot.objectVisible[i] = 0;
+            snapshot.occlusionCulled++;
         }
     }
-#endif
 }
 
 #pragma endregion
@@ -192,17 +767,27 @@ void Game::Update(DX::StepTimer const & timer, Mouse::State& mouse, Keyboard::St
 // Draws the scene.
 void Game::Render()
 {
+    PROFILE_SCOPE("Render");
+
     // Don't try to render anything before the first Update.
-    if (m_timer.GetFrameCount() == 0)
+    const uint32_t front = m_frontSnapshot.load(std::memory_order_acquire);
+    if (front == NO_SNAPSHOT)
     {
         return;
     }
+    const FrameSnapshot& snapshot = m_snapshots[front];
 
     Clear();
 
-    m_deviceResources->PIXBeginEvent(L"Render");
     auto context = m_deviceResources->GetD3DDeviceContext();
 
+    m_batchEffect->SetView(snapshot.view);
+    m_batchEffect->SetProjection(snapshot.projection);
+    m_batchEffect->SetWorld(Matrix::Identity);
+    m_displayChunk.m_terrainEffect->SetView(snapshot.view);
+    m_displayChunk.m_terrainEffect->SetProjection(snapshot.projection);
+    m_displayChunk.m_terrainEffect->SetWorld(Matrix::Identity);
+
     if (m_grid)
     {
         // Draw procedurally generated dynamic grid
@@ -212,25 +797,15 @@ void Game::Render()
     }
 
     //RENDER OBJECTS FROM SCENEGRAPH
-    int numRenderObjects = m_displayList.size();
-    for (int i = 0; i < numRenderObjects; i++)
-    {
-        m_deviceResources->PIXBeginEvent(L"Draw model");
-        const XMVECTORF32 scale = { m_displayList[i].m_scale.x, m_displayList[i].m_scale.y, m_displayList[i].m_scale.z };
-        const XMVECTORF32 translate = { m_displayList[i].m_position.x, m_displayList[i].m_position.y, m_displayList[i].m_position.z };
-
-        //convert degrees into radians for rotation matrix
-        XMVECTOR rotate = Quaternion::CreateFromYawPitchRoll(XMConvertToRadians(m_displayList[i].m_orientation.y),
-                                                             XMConvertToRadians(m_displayList[i].m_orientation.x),
-                                                             XMConvertToRadians(m_displayList[i].m_orientation.z));
-
-        XMMATRIX local = m_world * XMMatrixTransformation(g_XMZero, Quaternion::Identity, scale, g_XMZero, rotate, translate);
+    const auto drawStart = std::chrono::high_resolution_clock::now();
+    DrawDisplayList(context, snapshot, m_renderArena);
 
-        m_displayList[i].m_model->Draw(context, *m_states, local, m_view, m_projection, false);	//last variable in draw,  make TRUE for wireframe
-
-        m_deviceResources->PIXEndEvent();
+    //average cost of a draw, which culling is weighed against
+    if (snapshot.visibleObjects > 0)
+    {
+        const double drawCostMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - drawStart).count() / snapshot.visibleObjects;
+        m_drawCostMs = m_drawCostMs > 0.0 ? (0.9 * m_drawCostMs) + (0.1 * drawCostMs) : drawCostMs;
     }
-    m_deviceResources->PIXEndEvent();
 
     //RENDER TERRAIN
     context->OMSetBlendState(m_states->Opaque(), nullptr, 0xFFFFFFFF);
@@ -242,21 +817,478 @@ void Game::Render()
     context->PSSetSamplers(0, 1, sampler);
 
     //Render the batch,  This is handled in the Display chunk becuase it has the potential to get complex
-    m_displayChunk.RenderBatch(context);
+    m_displayChunk.RenderBatch(context, m_instanceFrameConstants.Get(), m_instancedPS.Get());
+
+    //HUD text is formatted into one buffer, line by line, so drawing it doesn't allocate
+    wchar_t text[256];
 
     //CAMERA POSITION ON HUD
     m_sprites->Begin();
-    std::wstring var = L"Cam X: " + std::to_wstring(m_camPosition.x) + L"Cam Z: " + std::to_wstring(m_camPosition.z);
-    m_font->DrawString(m_sprites.get(), var.c_str(), XMFLOAT2(100, 10), Colors::Yellow);
+    swprintf_s(text, L"Cam X: %fCam Z: %f", snapshot.camPosition.x, snapshot.camPosition.z);
+    m_font->DrawString(m_sprites.get(), text, XMFLOAT2(100, 10), Colors::Yellow);
+
+    //OCCLUSION CULLING ON HUD
+    if (!snapshot.horizonCulling)
+        swprintf_s(text, L"Horizon culling: off");
+    else if (snapshot.horizonPaused)
+        swprintf_s(text, L"Horizon culling: paused, cost more than it saved");
+    else
+        swprintf_s(text, L"Horizon culled: %zu / %zu (%f ms)", snapshot.horizonStats.culled, snapshot.horizonStats.tested, snapshot.horizonStats.milliseconds);
+    m_font->DrawString(m_sprites.get(), text, XMFLOAT2(100, 40), Colors::Yellow);
+
+    if (!snapshot.occlusionCulling)
+        swprintf_s(text, L"Occlusion culling: off");
+    else
+        swprintf_s(text, L"Occlusion culled: %zu by %zu occluders (%f ms)", snapshot.occlusionCulled, m_occluders.size(), snapshot.occlusionStats.renderMilliseconds);
+    m_font->DrawString(m_sprites.get(), text, XMFLOAT2(100, 70), Colors::Yellow);
+
+    swprintf_s(text, L"Draws: %u, state changes: %u, instance batches: %zu", m_drawCalls, m_stateChanges, m_instanceBatcher.GetNumBatches());
+    m_font->DrawString(m_sprites.get(), text, XMFLOAT2(100, 100), Colors::Yellow);
+
+    const MaterialCache::Stats& materialStats = m_materialCache->GetStats();
+    swprintf_s(text, L"Materials: %zu for %zu model materials (%zu KB), textures: %zu (%zu MB)", materialStats.materials, materialStats.requests,
+               materialStats.effectBytes / 1024, materialStats.textures, materialStats.textureBytes / (1024 * 1024));
+    m_font->DrawString(m_sprites.get(), text, XMFLOAT2(100, 130), Colors::Yellow);
+
+    if (!m_staticMerging)
+        swprintf_s(text, L"Static merging: off");
+    else
+    {
+        const StaticGeometryBaker::Stats& bakeStats = m_staticBaker.GetStats();
+        swprintf_s(text, L"Static merging: %zu groups in %zu cells, %zu merged, %zu loaded, %zu reused (%f ms)",
+                   bakeStats.groups, bakeStats.cells, bakeStats.merged, bakeStats.loaded, bakeStats.reused, bakeStats.milliseconds);
+    }
+    m_font->DrawString(m_sprites.get(), text, XMFLOAT2(100, 160), Colors::Yellow);
+
+    swprintf_s(text, L"Triangles: %zu, LOD switches: %zu (%f ms)", m_trianglesDrawn, snapshot.lodStats.switches, snapshot.lodStats.milliseconds);
+    m_font->DrawString(m_sprites.get(), text, XMFLOAT2(100, 190), Colors::Yellow);
+
+    swprintf_s(text, L"Rendering %ls: %d frames/s, waiting %d%%, CPU %d%%", m_framePacing.onDemand ? L"on demand" : L"continuously",
+               int(m_framePacing.framesPerSecond + 0.5f), int(m_framePacing.waiting * 100.f), int(m_framePacing.cpu * 100.f));
+#ifdef _DEBUG
+    const size_t length = wcslen(text);
+    swprintf_s(text + length, _countof(text) - length, L", idle loop allocations: %llu", m_framePacing.loopAllocations);
+#endif
+    m_font->DrawString(m_sprites.get(), text, XMFLOAT2(100, 220), Colors::Yellow);
+
+    if (snapshot.statsOverlay)
+        DrawStatsOverlay(snapshot, 250.f);
     m_sprites->End();
 
     m_deviceResources->Present();
 }
 
+void Game::DrawStatsOverlay(const FrameSnapshot& snapshot, float top)
+{
+    wchar_t text[256];
+    const FrameStats::Summary summary = m_frameStats.Summarise();
+
+    swprintf_s(text, L"Frame: min %.2f, avg %.2f, p99 %.2f, max %.2f ms over %zu frames",
+               summary.minMs, summary.averageMs, summary.p99Ms, summary.maxMs, summary.frames);
+    m_font->DrawString(m_sprites.get(), text, XMFLOAT2(100, top), Colors::Yellow);
+
+    //nested scopes are counted in each of them, Render holds Draw models. Occluders rasterise on worker threads
+    int length = swprintf_s(text, L"CPU ms: occluders %.2f", snapshot.occlusionStats.renderMilliseconds);
+    for (size_t s = 0; s < m_frameStats.GetNumSections() && length > 0; s++)
+        length += swprintf_s(text + length, _countof(text) - length, L", %hs %.2f", m_frameStats.GetSectionName(s), m_frameStats.GetSectionMs(s));
+    m_font->DrawString(m_sprites.get(), text, XMFLOAT2(100, top + 30), Colors::Yellow);
+
+    swprintf_s(text, L"Objects: %d visible of %zu, draws: %u, triangles: %zu", snapshot.visibleObjects, m_displayList.size(), m_drawCalls, m_trianglesDrawn);
+    m_font->DrawString(m_sprites.get(), text, XMFLOAT2(100, top + 60), Colors::Yellow);
+
+    const MaterialCache::Stats& materialStats = m_materialCache->GetStats();
+    swprintf_s(text, L"Cache hits: models %zu / %zu, effects %zu / %zu, textures %zu / %zu", m_modelRequests - m_modelLoads, m_modelRequests,
+               materialStats.requests - materialStats.materials, materialStats.requests, materialStats.textureHits, materialStats.textureRequests);
+    m_font->DrawString(m_sprites.get(), text, XMFLOAT2(100, top + 90), Colors::Yellow);
+
+    swprintf_s(text, L"Memory: working set %llu MB, private %llu MB, frame arenas %zu + %zu KB in %zu allocations, peak %zu + %zu KB", m_framePacing.workingSetBytes / (1024 * 1024),
+               m_framePacing.privateBytes / (1024 * 1024), m_retiredArena.used / 1024, m_retiredRenderArena.used / 1024, m_retiredArena.allocations + m_retiredRenderArena.allocations,
+               m_retiredArena.peak / 1024, m_retiredRenderArena.peak / 1024);
+    m_font->DrawString(m_sprites.get(), text, XMFLOAT2(100, top + 120), Colors::Yellow);
+
+    const double gatherMs = m_frameStats.GetStats().microseconds * 1e-3;
+    swprintf_s(text, L"Stats gathering: %.1f us, %.3f%% of the frame", gatherMs * 1e3, summary.averageMs > 0.f ? 100.0 * gatherMs / summary.averageMs : 0.0);
+    m_font->DrawString(m_sprites.get(), text, XMFLOAT2(100, top + 150), Colors::Yellow);
+
+    //frame time graph, newest frame on the right, with a line at 60 frames a second
+    const float graphTop = top + 190.f;
+    const float graphWidth = FrameStats::WINDOW * GRAPH_BAR_WIDTH;
+    const float sixtyHz = GRAPH_HEIGHT * (1000.f / 60.f) / GRAPH_SCALE_MS;
+    m_sprites->Draw(m_whiteTexture.Get(), RECT{ 100, LONG(graphTop), LONG(100 + graphWidth), LONG(graphTop + GRAPH_HEIGHT) }, XMVECTORF32{ 0.f, 0.f, 0.f, 0.5f });
+    for (size_t age = 0; age < m_frameStats.GetNumFrames(); age++)
+    {
+        const float frameMs = m_frameStats.GetFrameMs(age);
+        const float height = std::max(1.f, GRAPH_HEIGHT * std::min(frameMs / GRAPH_SCALE_MS, 1.f));
+        const float left = 100.f + graphWidth - (age + 1) * GRAPH_BAR_WIDTH;
+        const XMVECTORF32& color = frameMs <= 1000.f / 60.f ? Colors::LimeGreen : frameMs <= 1000.f / 30.f ? Colors::Yellow : Colors::Red;
+        m_sprites->Draw(m_whiteTexture.Get(), RECT{ LONG(left), LONG(graphTop + GRAPH_HEIGHT - height), LONG(left + GRAPH_BAR_WIDTH), LONG(graphTop + GRAPH_HEIGHT) }, color);
+    }
+    m_sprites->Draw(m_whiteTexture.Get(), RECT{ 100, LONG(graphTop + GRAPH_HEIGHT - sixtyHz), LONG(100 + graphWidth), LONG(graphTop + GRAPH_HEIGHT - sixtyHz + 1) }, Colors::Gray);
+
+    //startup phases, a line per nesting depth. Names can run long, so lines are cut rather than overflow
+    float lineTop = graphTop + GRAPH_HEIGHT + 10.f;
+    for (int depth = 0; depth < STARTUP_DEPTHS_SHOWN; depth++)
+    {
+        int length = depth == 0 ? _snwprintf_s(text, _TRUNCATE, L"Startup: %.0f ms to first frame.", StartupTimings::GetTotalMilliseconds())
+                                : _snwprintf_s(text, _TRUNCATE, L"%*ls", depth * 4, L"");
+        const int emptyLength = length;
+        for (size_t p = 0; p < StartupTimings::GetNumPhases() && length >= 0; p++)
+        {
+            const StartupTimings::Phase& phase = StartupTimings::GetPhase(p);
+            if (phase.depth == depth && phase.end >= 0)
+            {
+                const int added = _snwprintf_s(text + length, _countof(text) - length, _TRUNCATE, L" %hs %.0f,", phase.name, (phase.end - phase.start) * 1e-6);
+                length = added >= 0 ? length + added : -1;
+            }
+        }
+
+        if (length == emptyLength && depth > 0)
+            break;
+        if (length > 0 && text[length - 1] == L',')
+            text[length - 1] = L'\0';
+        m_font->DrawString(m_sprites.get(), text, XMFLOAT2(100, lineTop), Colors::Yellow);
+        lineTop += 30.f;
+    }
+}
+
+void Game::DrawDisplayList(ID3D11DeviceContext* context, const FrameSnapshot& snapshot, FrameArena& arena)
+{
+    PROFILE_SCOPE("Draw models");
+
+    // Upload the transforms of batches whose members moved
+    for (uint32_t b = 0; b < m_instanceBatcher.GetNumBatches(); b++)
+    {
+        const InstanceBatcher::Batch& batch = m_instanceBatcher.GetBatch(b);
+        if (!batch.dirty || !m_instanceBuffer)
+            continue;
+
+        const UINT instanceSize = UINT(InstanceBatcher::FLOATS_PER_INSTANCE * sizeof(float));
+        const D3D11_BOX box = { batch.firstInstance * instanceSize, 0, 0, (batch.firstInstance + batch.numInstances) * instanceSize, 1, 1 };
+        context->UpdateSubresource(m_instanceBuffer.Get(), 0, &box, m_instanceBatcher.GetInstanceData() + (batch.firstInstance * InstanceBatcher::FLOATS_PER_INSTANCE), 0, 0);
+        m_instanceBatcher.ClearDirty(b);
+    }
+
+    // One sort key per visible mesh part drawn per object
+    m_renderQueue.Clear();
+    const int numObjects = int(m_displayList.size());
+    for (int i = 0; i < numObjects; i++)
+    {
+        if (!snapshot.objectVisible[i])
+            continue;
+
+        const Vector3 toObject = Vector3(m_displayList[i].m_worldBounds.Center) - snapshot.camPosition;
+        const uint32_t depth = RenderQueue::DepthBucket(toObject.Dot(snapshot.camLookDirection), FAR_PLANE);
+        const uint32_t level = snapshot.objectLevel[i];
+
+        for (uint32_t p = m_objectFirstPart[i]; p < m_objectFirstPart[i + 1]; p++)
+        {
+            const DrawPart& drawPart = m_drawParts[p];
+            if (drawPart.lod != level)
+                continue;
+
+            m_renderQueue.Add(drawPart.part->isAlpha ? RenderQueue::MakeTransparentKey(drawPart.state, drawPart.effect, drawPart.texture, depth)
+                                                     : RenderQueue::MakeOpaqueKey(drawPart.state, drawPart.effect, drawPart.texture, depth), p);
+        }
+    }
+
+    // and one per part of every batch with visible members at the part's level, drawn as instance ranges.
+    // Members are split by level first, so each level of a batch gets its own ranges.
+    uint8_t* lodVisible = arena.AllocateArray<uint8_t>(numObjects * LodSelector::MAX_LEVELS);	//visible objects at level L, one object count long mask per level
+    std::fill(lodVisible, lodVisible + (numObjects * LodSelector::MAX_LEVELS), uint8_t(0));
+    for (int i = 0; i < numObjects; i++)
+    {
+        if (snapshot.objectVisible[i])
+            lodVisible[(snapshot.objectLevel[i] * numObjects) + i] = 1;
+    }
+
+    //ranges of batch b at level L start at batchFirstRange[(b * LodSelector::MAX_LEVELS) + L], and end where the next one starts
+    FrameVector<InstanceBatcher::Range> instanceRanges{ FrameAllocator<InstanceBatcher::Range>(arena) };
+    FrameVector<uint32_t> batchFirstRange{ FrameAllocator<uint32_t>(arena) };
+    batchFirstRange.reserve((m_instanceBatcher.GetNumBatches() * LodSelector::MAX_LEVELS) + 1);
+    batchFirstRange.push_back(0);
+    for (uint32_t b = 0; b < m_instanceBatcher.GetNumBatches(); b++)
+    {
+        uint32_t depth[LodSelector::MAX_LEVELS];
+        for (uint32_t level = 0; level < LodSelector::MAX_LEVELS; level++)
+        {
+            const uint32_t firstRange = uint32_t(instanceRanges.size());
+            m_instanceBatcher.GetVisibleRanges(b, lodVisible + (level * numObjects), instanceRanges);
+            batchFirstRange.push_back(uint32_t(instanceRanges.size()));
+
+            // Front to back by the nearest visible member
+            float nearest = FAR_PLANE;
+            for (uint32_t r = firstRange; r < instanceRanges.size(); r++)
+            {
+                const InstanceBatcher::Range& range = instanceRanges[r];
+                for (uint32_t instance = range.firstInstance; instance < range.firstInstance + range.numInstances; instance++)
+                {
+                    const Vector3 toObject = Vector3(m_displayList[m_instanceBatcher.GetObjectOfInstance(instance)].m_worldBounds.Center) - snapshot.camPosition;
+                    nearest = std::min(nearest, toObject.Dot(snapshot.camLookDirection));
+                }
+            }
+            depth[level] = RenderQueue::DepthBucket(nearest, FAR_PLANE);
+        }
+
+        for (uint32_t p = m_batchFirstPart[b]; p < m_batchFirstPart[b + 1]; p++)
+        {
+            const DrawPart& drawPart = m_drawParts[p];
+            const uint32_t ranges = (b * LodSelector::MAX_LEVELS) + drawPart.lod;
+            if (batchFirstRange[ranges] != batchFirstRange[ranges + 1])
+                m_renderQueue.Add(RenderQueue::MakeOpaqueKey(drawPart.state, drawPart.effect, drawPart.texture, depth[drawPart.lod]), p);
+        }
+    }
+
+    // and one per merged group of static objects with any of them visible
+    const uint32_t firstMergedPart = m_batchFirstPart.back();
+    for (uint32_t p = firstMergedPart; p < uint32_t(m_drawParts.size()); p++)
+    {
+        const DrawPart& drawPart = m_drawParts[p];
+
+        float nearest = FAR_PLANE;
+        bool visible = false;
+        for (uint32_t object : m_mergedGroups[drawPart.merged]->objects)
+        {
+            if (!snapshot.objectVisible[object])
+                continue;
+
+            const Vector3 toObject = Vector3(m_displayList[object].m_worldBounds.Center) - snapshot.camPosition;
+            nearest = std::min(nearest, toObject.Dot(snapshot.camLookDirection));
+            visible = true;
+        }
+
+        if (visible)
+            m_renderQueue.Add(RenderQueue::MakeOpaqueKey(drawPart.state, drawPart.effect, drawPart.texture, RenderQueue::DepthBucket(nearest, FAR_PLANE)), p);
+    }
+
+    m_renderQueue.Sort();
+
+    if (m_instancedVS)
+    {
+        InstanceFrameConstants frameConstants;
+        frameConstants.viewProjection = XMMatrixTranspose(snapshot.view * snapshot.projection);
+        frameConstants.eyePosition = XMFLOAT4(snapshot.camPosition.x, snapshot.camPosition.y, snapshot.camPosition.z, 0.f);
+        for (int light = 0; light < 3; light++)
+        {
+            frameConstants.lightDirection[light] = DEFAULT_LIGHT_DIRECTIONS[light];
+            frameConstants.lightDiffuseColor[light] = DEFAULT_LIGHT_DIFFUSE[light];
+            frameConstants.lightSpecularColor[light] = DEFAULT_LIGHT_SPECULAR[light];
+        }
+        context->UpdateSubresource(m_instanceFrameConstants.Get(), 0, nullptr, &frameConstants, 0, 0);
+    }
+
+    // Submit in key order, only setting what differs from the previous draw. This is what
+    // Model::Draw does for every part, minus the redundant calls.
+    m_drawCalls = 0;
+    m_stateChanges = 0;
+    m_trianglesDrawn = 0;
+
+    ID3D11SamplerState* sampler[] = { m_states->LinearWrap() };
+    context->PSSetSamplers(0, 1, sampler);
+
+    int lastPass = -1;
+    uint32_t lastState = UINT32_MAX;
+    ID3D11InputLayout* lastLayout = nullptr;
+    ID3D11Buffer* lastVertexBuffer = nullptr;
+    ID3D11Buffer* lastIndexBuffer = nullptr;
+    D3D11_PRIMITIVE_TOPOLOGY lastTopology = D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+    IEffect* lastEffect = nullptr;
+    IEffectMatrices* matrices = nullptr;
+    bool instancedShaders = false;
+    const InstanceMaterial* lastMaterial = nullptr;
+    ID3D11ShaderResourceView* lastTexture = nullptr;
+
+    for (const RenderQueue::Item& item : m_renderQueue)
+    {
+        const DrawPart& drawPart = m_drawParts[item.value];
+        const ModelMeshPart& part = *drawPart.part;
+        const int pass = int(RenderQueue::GetPass(item.key));
+
+        if (pass != lastPass || drawPart.state != lastState)
+        {
+            const bool alpha = pass == RenderQueue::PASS_TRANSPARENT;
+            context->OMSetBlendState(alpha ? (drawPart.mesh->pmalpha ? m_states->AlphaBlend() : m_states->NonPremultiplied()) : m_states->Opaque(), nullptr, 0xFFFFFFFF);
+            context->OMSetDepthStencilState(alpha ? m_states->DepthRead() : m_states->DepthDefault(), 0);
+            context->RSSetState(drawPart.mesh->ccw ? m_states->CullCounterClockwise() : m_states->CullClockwise());
+            lastPass = pass;
+            lastState = drawPart.state;
+            m_stateChanges++;
+        }
+
+        const bool instanced = drawPart.batch != NO_BATCH || drawPart.merged != NO_GROUP;
+        ID3D11InputLayout* layout = instanced ? drawPart.instancedLayout : part.inputLayout.Get();
+        if (layout != lastLayout)
+        {
+            lastLayout = layout;
+            context->IASetInputLayout(lastLayout);
+            m_stateChanges++;
+        }
+
+        if (part.vertexBuffer.Get() != lastVertexBuffer)
+        {
+            lastVertexBuffer = part.vertexBuffer.Get();
+            const UINT stride = part.vertexStride;
+            const UINT offset = 0;
+            context->IASetVertexBuffers(0, 1, &lastVertexBuffer, &stride, &offset);
+            m_stateChanges++;
+        }
+
+        if (part.indexBuffer.Get() != lastIndexBuffer)
+        {
+            lastIndexBuffer = part.indexBuffer.Get();
+            context->IASetIndexBuffer(lastIndexBuffer, part.indexFormat, 0);
+            m_stateChanges++;
+        }
+
+        if (part.primitiveType != lastTopology)
+        {
+            lastTopology = part.primitiveType;
+            context->IASetPrimitiveTopology(lastTopology);
+            m_stateChanges++;
+        }
+
+        if (instanced)
+        {
+            if (!instancedShaders)
+            {
+                ID3D11Buffer* constants[] = { m_instanceFrameConstants.Get(), m_instanceMaterialConstants.Get() };
+                const UINT stride = UINT(InstanceBatcher::FLOATS_PER_INSTANCE * sizeof(float));
+                const UINT offset = 0;
+                context->VSSetShader(m_instancedVS.Get(), nullptr, 0);
+                context->PSSetShader(m_instancedPS.Get(), nullptr, 0);
+                context->VSSetConstantBuffers(0, 2, constants);
+                context->IASetVertexBuffers(1, 1, m_instanceBuffer.GetAddressOf(), &stride, &offset);
+                instancedShaders = true;
+                lastEffect = nullptr;
+                m_stateChanges++;
+            }
+
+            if (drawPart.material != lastMaterial)
+            {
+                lastMaterial = drawPart.material;
+                context->UpdateSubresource(m_instanceMaterialConstants.Get(), 0, nullptr, lastMaterial, 0, 0);
+                m_stateChanges++;
+            }
+
+            ID3D11ShaderResourceView* texture = m_displayList[drawPart.object].m_texture_diffuse.Get();
+            if (texture != lastTexture)
+            {
+                lastTexture = texture;
+                context->PSSetShaderResources(0, 1, &lastTexture);
+                m_stateChanges++;
+            }
+
+            // Merged geometry is already in world space, it is drawn once with the identity transform
+            if (drawPart.merged != NO_GROUP)
+            {
+                context->DrawIndexedInstanced(part.indexCount, 1, part.startIndex, part.vertexOffset, m_identityInstance);
+                m_drawCalls++;
+                m_trianglesDrawn += part.indexCount / 3;
+                continue;
+            }
+
+            // One call per contiguous range of visible members
+            const uint32_t ranges = (drawPart.batch * LodSelector::MAX_LEVELS) + drawPart.lod;
+            for (uint32_t r = batchFirstRange[ranges]; r < batchFirstRange[ranges + 1]; r++)
+            {
+                context->DrawIndexedInstanced(part.indexCount, instanceRanges[r].numInstances, part.startIndex, part.vertexOffset, instanceRanges[r].firstInstance);
+                m_drawCalls++;
+                m_trianglesDrawn += size_t(part.indexCount / 3) * instanceRanges[r].numInstances;
+            }
+            continue;
+        }
+
+        if (part.effect.get() != lastEffect)
+        {
+            lastEffect = part.effect.get();
+            matrices = dynamic_cast<IEffectMatrices*>(lastEffect);
+            if (matrices)
+            {
+                matrices->SetView(snapshot.view);
+                matrices->SetProjection(snapshot.projection);
+            }
+            instancedShaders = false;
+            m_stateChanges++;
+        }
+
+        // The world matrix is per object, the effect only uploads its constants again when they change.
+        // Models are shared between objects, so BasicEffects take the object's texture here too.
+        if (matrices)
+            matrices->SetWorld(m_objectWorld[drawPart.object]);
+        if (drawPart.basicEffect)
+            drawPart.basicEffect->SetTexture(m_displayList[drawPart.object].m_texture_diffuse.Get());
+        lastEffect->Apply(context);
+        lastTexture = nullptr;
+
+        context->DrawIndexed(part.indexCount, part.startIndex, part.vertexOffset);
+        m_drawCalls++;
+        m_trianglesDrawn += part.indexCount / 3;
+    }
+}
+
+ID3D11InputLayout* Game::GetInstancedLayout(const ModelMeshPart& part)
+{
+    if (!m_instancedVS || part.isAlpha || !part.vbDecl || part.primitiveType != D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST)
+        return nullptr;
+
+    D3D11_INPUT_ELEMENT_DESC position, normal, texcoord;
+    if ((!FindElement(part, "SV_Position", 0, position) && !FindElement(part, "POSITION", 0, position))
+        || !FindElement(part, "NORMAL", 0, normal) || !FindElement(part, "TEXCOORD", 0, texcoord))
+        return nullptr;
+
+    // Skinned vertices can't be drawn with a single world matrix
+    D3D11_INPUT_ELEMENT_DESC blendIndices;
+    if (FindElement(part, "BLENDINDICES", 0, blendIndices))
+        return nullptr;
+
+    ComPtr<ID3D11InputLayout>& layout = m_instancedLayouts[std::make_tuple(position.AlignedByteOffset, position.Format, normal.AlignedByteOffset, normal.Format, texcoord.AlignedByteOffset, texcoord.Format)];
+    if (!layout)
+    {
+        // The model's own elements under the shader's names, then the packed transform from the second stream
+        position.SemanticName = "SV_Position";
+        const D3D11_INPUT_ELEMENT_DESC elements[] =
+        {
+            position,
+            normal,
+            texcoord,
+            { "WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+            { "WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+            { "WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+        };
+
+        DX::ThrowIfFailed(
+            m_deviceResources->GetD3DDevice()->CreateInputLayout(elements, _countof(elements), g_InstancedModelVS, sizeof(g_InstancedModelVS), layout.GetAddressOf()));
+    }
+
+    return layout.Get();
+}
+
+const Game::InstanceMaterial* Game::GetInstanceMaterial(const IEffect* effect)
+{
+    auto found = m_instanceMaterials.find(effect);
+    if (found != m_instanceMaterials.end())
+        return &found->second;
+
+    // Only plain textured BasicEffects, and their material from the cache
+    const MaterialCache::Material* cached = m_materialCache->GetMaterial(effect);
+    if (!cached || !dynamic_cast<const BasicEffect*>(effect) || cached->perVertexColor || cached->diffuseTexture.empty())
+        return nullptr;
+
+    InstanceMaterial& material = m_instanceMaterials[effect];
+    material.diffuseColor = XMFLOAT4(cached->diffuseColor.x, cached->diffuseColor.y, cached->diffuseColor.z, cached->alpha);
+    XMStoreFloat3(&material.emissiveColor, XMLoadFloat3(&cached->emissiveColor) + (XMLoadFloat3(&cached->ambientColor) * XMLoadFloat3(&cached->diffuseColor)));
+
+    //as EffectFactory does, a black specular colour turns specular off
+    const bool specular = cached->specularColor.x != 0.f || cached->specularColor.y != 0.f || cached->specularColor.z != 0.f;
+    material.specularColor = specular ? XMFLOAT4(cached->specularColor.x, cached->specularColor.y, cached->specularColor.z, 0.f) : XMFLOAT4(0.f, 0.f, 0.f, 0.f);
+    material.specularPower = specular ? cached->specularPower : 1.f;
+
+    return &material;
+}
+
 // Helper method to clear the back buffers.
 void Game::Clear()
 {
-    m_deviceResources->PIXBeginEvent(L"Clear");
+    PROFILE_SCOPE("Clear");
 
     // Clear the views.
     auto context = m_deviceResources->GetD3DDeviceContext();
@@ -270,13 +1302,11 @@ void Game::Clear()
     // Set the viewport.
     auto viewport = m_deviceResources->GetScreenViewport();
     context->RSSetViewports(1, &viewport);
-
-    m_deviceResources->PIXEndEvent();
 }
 
 void XM_CALLCONV Game::DrawGrid(FXMVECTOR xAxis, FXMVECTOR yAxis, FXMVECTOR origin, size_t xdivs, size_t ydivs, GXMVECTOR color)
 {
-    m_deviceResources->PIXBeginEvent(L"Draw grid");
+    PROFILE_SCOPE("Draw grid");
 
     auto context = m_deviceResources->GetD3DDeviceContext();
     context->OMSetBlendState(m_states->Opaque(), nullptr, 0xFFFFFFFF);
@@ -317,8 +1347,6 @@ void XM_CALLCONV Game::DrawGrid(FXMVECTOR xAxis, FXMVECTOR yAxis, FXMVECTOR orig
     }
 
     m_batch->End();
-
-    m_deviceResources->PIXEndEvent();
 }
 #pragma endregion
 
@@ -356,18 +1384,42 @@ void Game::OnWindowSizeChanged(int width, int height)
     CreateWindowSizeDependentResources();
 }
 
-void Game::BuildDisplayList(std::vector<SceneObject> * SceneGraph)
+void Game::BuildDisplayList(const std::vector<SceneObject> * SceneGraph)
 {
+    STARTUP_PHASE("Build display list");
+
     auto device = m_deviceResources->GetD3DDevice();
     auto devicecontext = m_deviceResources->GetD3DDeviceContext();
 
+    //the update and its occlusion task read the display list and the occluders
+    InvalidateSnapshots();
+    m_occlusionTask.Wait();
+    m_occlusionPending = false;
+
     if (!m_displayList.empty())		//is the vector empty
     {
         m_displayList.clear();		//if not, empty it
     }
+    m_objectBounds.clear();
+    m_occluders.clear();
+    m_drawParts.clear();
+    m_objectFirstPart.assign(1, 0);
+    m_modelRequests = 0;
+    m_modelLoads = 0;
+    m_objectWorld.clear();
+
+    //small ids for the render queue's sort keys
+    std::unordered_map<const void*, uint32_t> effectIds;
+    std::unordered_map<const void*, uint32_t> textureIds;
+
+    //objects using the same model file share one model, which is what lets them be instanced, along
+    //with the lower detail versions found next to it
+    std::map<std::string, std::vector<std::shared_ptr<Model>>> models;
 
     //for every item in the scenegraph
     const int numObjects = SceneGraph->size();
+    std::vector<uint8_t> objectMerged(numObjects);
+    m_lodSelector.Reset(numObjects);
     for (int i = 0; i < numObjects; i++)
     {
         const SceneObject& sceneObject = (*SceneGraph)[i];
@@ -378,33 +1430,40 @@ void Game::BuildDisplayList(std::vector<SceneObject> * SceneGraph)
 
         //load model
         std::wstring_convert<std::codecvt_utf8<wchar_t>> convertToWide;
-        std::wstring modelwstr = convertToWide.from_bytes(sceneObject.model_path);							//convect string to Wchar
-        newDisplayObject.m_model = Model::CreateFromCMO(device, modelwstr.c_str(), *m_fxFactory, true);	//get DXSDK to load model "False" for LH coordinate system (maya)
+        std::vector<std::shared_ptr<Model>>& lodModels = models[sceneObject.model_path];
+        m_modelRequests++;
+        if (lodModels.empty())
+        {
+            PROFILE_SCOPE("Load model");
+            m_modelLoads++;
+            std::wstring modelwstr = convertToWide.from_bytes(sceneObject.model_path);							//convect string to Wchar
+            lodModels.push_back(Model::CreateFromCMO(device, modelwstr.c_str(), *m_materialCache, true));	//get DXSDK to load model "False" for LH coordinate system (maya)
+
+            for (size_t level = 1; level < LodSelector::MAX_LEVELS; level++)
+            {
+                const std::string lodPath = LodCooker::LodPath(sceneObject.model_path, level);
+                if (FileStamp(lodPath).first < 0)
+                    break;
 
-        //Load Texture
+                lodModels.push_back(Model::CreateFromCMO(device, convertToWide.from_bytes(lodPath).c_str(), *m_materialCache, true));
+            }
+        }
+        newDisplayObject.m_model = lodModels[0];
+        newDisplayObject.m_lodModels = lodModels;
+
+        //Load Texture, once per file
         std::wstring texturewstr = convertToWide.from_bytes(sceneObject.tex_diffuse_path);								//convect string to Wchar
-        ID3D11ShaderResourceView* texture_diffuse = nullptr;
-        HRESULT rs = CreateDDSTextureFromFile(device, texturewstr.c_str(), nullptr, &texture_diffuse);	//load tex into Shader resource
+        ID3D11ShaderResourceView* texture_diffuse = m_materialCache->LoadTexture(texturewstr);
 
         //if texture fails.  load error default
-        if (rs)
+        if (!texture_diffuse)
         {
-            CreateDDSTextureFromFile(device, L"database/data/Error.dds", nullptr, &texture_diffuse);	//load tex into Shader resource
+            texture_diffuse = m_materialCache->LoadTexture(L"database/data/Error.dds");
         }
 
-        // Texture is handled by RAII
+        // Texture is handled by RAII. Effects are shared between objects, they get the texture when the object is drawn
         newDisplayObject.m_texture_diffuse = texture_diffuse;
 
-        //apply new texture to models effect
-        newDisplayObject.m_model->UpdateEffects([&](IEffect* effect) //This uses a Lambda function,  if you dont understand it: Look it up.
-        {
-            auto lights = dynamic_cast<BasicEffect*>(effect);
-            if (lights)
-            {
-                lights->SetTexture(newDisplayObject.m_texture_diffuse.Get());
-            }
-        });
-
         //set position
         newDisplayObject.m_position.x = sceneObject.posX;
         newDisplayObject.m_position.y = sceneObject.posY;
@@ -424,12 +1483,327 @@ void Game::BuildDisplayList(std::vector<SceneObject> * SceneGraph)
         newDisplayObject.m_render = sceneObject.editor_render;
         newDisplayObject.m_wireframe = sceneObject.editor_wireframe;
 
+        //anything the game can pick up, break or move along stays its own object
+        newDisplayObject.m_static = !(sceneObject.collectable || sceneObject.destructable || sceneObject.camera || sceneObject.AINode || sceneObject.path_node);
+
+        //world bounds, merged over every mesh of the model
+        BoundingBox localBounds;
+        for (size_t m = 0; m < newDisplayObject.m_model->meshes.size(); m++)
+        {
+            if (m == 0)
+                localBounds = newDisplayObject.m_model->meshes[m]->boundingBox;
+            else
+                BoundingBox::CreateMerged(localBounds, localBounds, newDisplayObject.m_model->meshes[m]->boundingBox);
+        }
+        const Matrix world = m_world * ObjectTransform(newDisplayObject);
+        localBounds.Transform(newDisplayObject.m_worldBounds, world);
+        m_objectWorld.push_back(world);
+
+        const XMFLOAT3& centre = newDisplayObject.m_worldBounds.Center;
+        const XMFLOAT3& extents = newDisplayObject.m_worldBounds.Extents;
+        m_objectBounds.push_back({ centre.x - extents.x, centre.y - extents.y, centre.z - extents.z,
+                                   centre.x + extents.x, centre.y + extents.y, centre.z + extents.z });
+
+        //large, simple objects become occluders. Their geometry is read back once per model.
+        size_t numTriangles = 0;
+        for (const auto& mesh : newDisplayObject.m_model->meshes)
+        {
+            for (const auto& part : mesh->meshParts)
+                numTriangles += part->indexCount / 3;
+        }
+
+        if (std::max(std::max(extents.x, extents.y), extents.z) * 2.f >= OCCLUDER_MIN_SIZE && numTriangles <= OCCLUDER_MAX_TRIANGLES)
+        {
+            std::shared_ptr<OccluderMesh>& occluderMesh = m_occluderMeshes[sceneObject.model_path];
+            if (!occluderMesh)
+                occluderMesh = ReadOccluderMesh(device, devicecontext, *newDisplayObject.m_model);
+
+            OccluderInstance occluder;
+            occluder.mesh = occluderMesh.get();
+            std::copy(&world._11, &world._11 + 16, occluder.world);
+            m_occluders.push_back(occluder);
+        }
+
+        //static objects the instanced shaders can draw whole are merged with their neighbours
+        bool merged = m_staticMerging && m_instancedVS && newDisplayObject.m_static;
+        for (const auto& mesh : newDisplayObject.m_model->meshes)
+        {
+            for (const auto& part : mesh->meshParts)
+                merged = merged && GetInstancedLayout(*part) && GetInstanceMaterial(part->effect.get()) && HasStaticVertexFormat(*part);
+        }
+        objectMerged[i] = merged ? 1 : 0;
+
+        //merged geometry is full detail, the other objects switch models with their size on screen
+        const size_t numLevels = merged ? 1 : newDisplayObject.m_lodModels.size();
+        m_lodSelector.SetObject(i, newDisplayObject.m_worldBounds.Center.x, newDisplayObject.m_worldBounds.Center.y, newDisplayObject.m_worldBounds.Center.z,
+                                XMVectorGetX(XMVector3Length(XMLoadFloat3(&newDisplayObject.m_worldBounds.Extents))), uint32_t(numLevels));
+
+        //mesh parts the instanced shaders can't draw go through the render queue one object at a time
+        const uint32_t textureId = textureIds.emplace(newDisplayObject.m_texture_diffuse.Get(), uint32_t(textureIds.size())).first->second;
+        for (size_t level = 0; level < numLevels; level++)
+        {
+            for (const auto& mesh : newDisplayObject.m_lodModels[level]->meshes)
+            {
+                for (const auto& part : mesh->meshParts)
+                {
+                    if (GetInstancedLayout(*part) && GetInstanceMaterial(part->effect.get()))
+                        continue;
+
+                    DrawPart drawPart;
+                    drawPart.object = uint32_t(i);
+                    drawPart.batch = NO_BATCH;
+                    drawPart.merged = NO_GROUP;
+                    drawPart.lod = uint32_t(level);
+                    drawPart.mesh = mesh.get();
+                    drawPart.part = part.get();
+                    drawPart.state = (mesh->ccw ? 1 : 0) | (mesh->pmalpha ? 2 : 0);
+                    drawPart.effect = effectIds.emplace(part->effect.get(), uint32_t(effectIds.size()) + 1).first->second;
+                    drawPart.texture = textureId;
+                    drawPart.basicEffect = dynamic_cast<BasicEffect*>(part->effect.get());
+                    drawPart.instancedLayout = nullptr;
+                    drawPart.material = nullptr;
+                    m_drawParts.push_back(drawPart);
+                }
+            }
+        }
+        m_objectFirstPart.push_back(uint32_t(m_drawParts.size()));
+
         m_displayList.push_back(newDisplayObject);
     }
+
+    //group the other objects by model and texture, and draw the rest of their parts once per group
+    std::vector<uint64_t> modelKeys(numObjects);
+    std::vector<uint64_t> textureKeys(numObjects);
+    std::vector<uint8_t> objectBatched(numObjects);
+    for (int i = 0; i < numObjects; i++)
+    {
+        modelKeys[i] = uint64_t(uintptr_t(m_displayList[i].m_model.get()));
+        textureKeys[i] = uint64_t(uintptr_t(m_displayList[i].m_texture_diffuse.Get()));
+        objectBatched[i] = objectMerged[i] ? 0 : 1;
+    }
+    m_instanceBatcher.Build(modelKeys.data(), textureKeys.data(), numObjects ? &m_objectWorld[0]._11 : nullptr, numObjects, objectBatched.data());
+
+    m_batchFirstPart.assign(1, uint32_t(m_drawParts.size()));
+    for (uint32_t b = 0; b < m_instanceBatcher.GetNumBatches(); b++)
+    {
+        const uint32_t object = m_instanceBatcher.GetObjectOfInstance(m_instanceBatcher.GetBatch(b).firstInstance);
+        const DisplayObject& displayObject = m_displayList[object];
+        const uint32_t textureId = textureIds[displayObject.m_texture_diffuse.Get()];
+
+        //members share the whole chain of models, every level gets its parts
+        for (size_t level = 0; level < displayObject.m_lodModels.size(); level++)
+        {
+            for (const auto& mesh : displayObject.m_lodModels[level]->meshes)
+            {
+                for (const auto& part : mesh->meshParts)
+                {
+                    ID3D11InputLayout* layout = GetInstancedLayout(*part);
+                    const InstanceMaterial* material = GetInstanceMaterial(part->effect.get());
+                    if (!layout || !material)
+                        continue;
+
+                    DrawPart drawPart;
+                    drawPart.object = object;
+                    drawPart.batch = b;
+                    drawPart.merged = NO_GROUP;
+                    drawPart.lod = uint32_t(level);
+                    drawPart.mesh = mesh.get();
+                    drawPart.part = part.get();
+                    drawPart.state = (mesh->ccw ? 1 : 0) | (mesh->pmalpha ? 2 : 0);
+                    drawPart.effect = INSTANCED_EFFECT_ID;
+                    drawPart.texture = textureId;
+                    drawPart.basicEffect = nullptr;
+                    drawPart.instancedLayout = layout;
+                    drawPart.material = material;
+                    m_drawParts.push_back(drawPart);
+                }
+            }
+        }
+        m_batchFirstPart.push_back(uint32_t(m_drawParts.size()));
+    }
+
+    BuildMergedGeometry(SceneGraph, objectMerged, textureIds);
+
+    //every batch starts dirty, DrawDisplayList uploads the transforms. The identity transform merged
+    //geometry is drawn with goes after them.
+    if (m_instancedVS)
+    {
+        const size_t numInstances = m_instanceBatcher.GetNumInstances();
+        if (m_instanceBufferCapacity < numInstances + 1)
+        {
+            m_instanceBufferCapacity = numInstances + 1;
+            CD3D11_BUFFER_DESC desc(UINT(m_instanceBufferCapacity * InstanceBatcher::FLOATS_PER_INSTANCE * sizeof(float)), D3D11_BIND_VERTEX_BUFFER);
+            DX::ThrowIfFailed(device->CreateBuffer(&desc, nullptr, m_instanceBuffer.ReleaseAndGetAddressOf()));
+        }
+
+        float identity[InstanceBatcher::FLOATS_PER_INSTANCE];
+        InstanceBatcher::PackTransform(&Matrix::Identity._11, identity);
+        m_identityInstance = uint32_t(numInstances);
+
+        const UINT instanceSize = UINT(InstanceBatcher::FLOATS_PER_INSTANCE * sizeof(float));
+        const D3D11_BOX box = { m_identityInstance * instanceSize, 0, 0, (m_identityInstance + 1) * instanceSize, 1, 1 };
+        devicecontext->UpdateSubresource(m_instanceBuffer.Get(), 0, &box, identity, 0, 0);
+    }
+}
+
+void Game::BuildMergedGeometry(const std::vector<SceneObject>* SceneGraph, const std::vector<uint8_t>& objectMerged, std::unordered_map<const void*, uint32_t>& textureIds)
+{
+    PROFILE_SCOPE("Merge static geometry");
+
+    auto device = m_deviceResources->GetD3DDevice();
+    auto devicecontext = m_deviceResources->GetD3DDeviceContext();
+
+    //one baker material per instance material, texture and winding
+    struct BakeMaterial
+    {
+        const InstanceMaterial*			material;
+        ID3D11ShaderResourceView*		texture;
+        const ModelMesh*				mesh;		//a mesh using it, for the render state
+        uint32_t						object;		//an object using it, for the texture
+    };
+    std::vector<BakeMaterial> bakeMaterials;
+    std::vector<StaticGeometryBaker::Member> members;
+    std::vector<std::pair<const std::string*, size_t>> memberParts;	//model path and part index of each member
+    std::map<std::string, std::pair<int64_t, int64_t>> fileStamps;
+
+    const int numObjects = int(m_displayList.size());
+    for (int i = 0; i < numObjects; i++)
+    {
+        if (!objectMerged[i])
+            continue;
+
+        const SceneObject& sceneObject = (*SceneGraph)[i];
+        const DisplayObject& displayObject = m_displayList[i];
+
+        auto stamp = fileStamps.find(sceneObject.model_path);
+        if (stamp == fileStamps.end())
+            stamp = fileStamps.emplace(sceneObject.model_path, FileStamp(sceneObject.model_path)).first;
+
+        //everything the object's merged geometry depends on, except the model's materials, which are in its file
+        uint64_t objectHash = StaticGeometryBaker::Hash(&sceneObject.ID, sizeof(sceneObject.ID));
+        objectHash = StaticGeometryBaker::Hash(sceneObject.model_path.data(), sceneObject.model_path.size(), objectHash);
+        objectHash = StaticGeometryBaker::Hash(&stamp->second, sizeof(stamp->second), objectHash);
+        objectHash = StaticGeometryBaker::Hash(sceneObject.tex_diffuse_path.data(), sceneObject.tex_diffuse_path.size(), objectHash);
+        objectHash = StaticGeometryBaker::Hash(&m_objectWorld[i]._11, 16 * sizeof(float), objectHash);
+
+        size_t partIndex = 0;
+        for (const auto& mesh : displayObject.m_model->meshes)
+        {
+            for (const auto& part : mesh->meshParts)
+            {
+                const InstanceMaterial* material = GetInstanceMaterial(part->effect.get());
+                ID3D11ShaderResourceView* texture = displayObject.m_texture_diffuse.Get();
+
+                size_t m = 0;
+                while (m < bakeMaterials.size() && !(bakeMaterials[m].material == material && bakeMaterials[m].texture == texture && bakeMaterials[m].mesh->ccw == mesh->ccw))
+                    m++;
+                if (m == bakeMaterials.size())
+                    bakeMaterials.push_back({ material, texture, mesh.get(), uint32_t(i) });
+
+                StaticGeometryBaker::Member member;
+                member.object = uint32_t(i);
+                member.material = uint32_t(m);
+                member.hash = StaticGeometryBaker::Hash(&partIndex, sizeof(partIndex), objectHash);
+                std::copy(&m_objectWorld[i]._11, &m_objectWorld[i]._11 + 16, member.world);
+                members.push_back(member);
+                memberParts.emplace_back(&sceneObject.model_path, partIndex);
+                partIndex++;
+            }
+        }
+    }
+
+    //only the cells that changed read their models back
+    if (m_staticMerging)
+        m_staticBaker.SetCacheDirectory(m_staticCacheDirectory);
+
+    m_staticBaker.Bake(members.data(), members.size(), [&](size_t member) -> const StaticGeometryBaker::Mesh*
+    {
+        std::vector<std::shared_ptr<StaticGeometryBaker::Mesh>>& meshes = m_staticMeshes[*memberParts[member].first];
+        if (meshes.empty())
+            meshes = ReadStaticMeshes(device, devicecontext, *m_displayList[members[member].object].m_model);
+        return memberParts[member].second < meshes.size() ? meshes[memberParts[member].second].get() : nullptr;
+    });
+
+    //upload cells whose geometry is new, keep the buffers of the rest
+    static const auto vertexDecl = std::make_shared<std::vector<D3D11_INPUT_ELEMENT_DESC>>(VertexPositionNormalTexture::InputElements, VertexPositionNormalTexture::InputElements + VertexPositionNormalTexture::InputElementCount);
+
+    m_mergedGroups.clear();
+    std::map<std::pair<int, int>, MergedCell> mergedCells;
+    for (const auto& baked : m_staticBaker.GetCells())
+    {
+        const StaticGeometryBaker::Cell& cell = baked.second;
+        MergedCell& mergedCell = mergedCells[baked.first];
+
+        auto previous = m_mergedCells.find(baked.first);
+        if (previous != m_mergedCells.end() && previous->second.version == cell.version)
+        {
+            mergedCell = std::move(previous->second);
+        }
+        else
+        {
+            mergedCell.version = cell.version;
+            for (const StaticGeometryBaker::Group& group : cell.groups)
+            {
+                mergedCell.parts.emplace_back();
+                if (group.mesh.indices.empty())
+                    continue;
+
+                auto part = std::make_unique<ModelMeshPart>();
+                part->indexCount = uint32_t(group.mesh.indices.size());
+                part->startIndex = 0;
+                part->vertexOffset = 0;
+                part->vertexStride = sizeof(StaticGeometryBaker::Vertex);
+                part->primitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+                part->indexFormat = DXGI_FORMAT_R32_UINT;
+                part->vbDecl = vertexDecl;
+                part->isAlpha = false;
+
+                CD3D11_BUFFER_DESC vertexDesc(UINT(group.mesh.vertices.size() * sizeof(StaticGeometryBaker::Vertex)), D3D11_BIND_VERTEX_BUFFER, D3D11_USAGE_IMMUTABLE);
+                const D3D11_SUBRESOURCE_DATA vertexData = { group.mesh.vertices.data(), 0, 0 };
+                DX::ThrowIfFailed(device->CreateBuffer(&vertexDesc, &vertexData, part->vertexBuffer.GetAddressOf()));
+
+                CD3D11_BUFFER_DESC indexDesc(UINT(group.mesh.indices.size() * sizeof(uint32_t)), D3D11_BIND_INDEX_BUFFER, D3D11_USAGE_IMMUTABLE);
+                const D3D11_SUBRESOURCE_DATA indexData = { group.mesh.indices.data(), 0, 0 };
+                DX::ThrowIfFailed(device->CreateBuffer(&indexDesc, &indexData, part->indexBuffer.GetAddressOf()));
+
+                mergedCell.parts.back() = std::move(part);
+            }
+        }
+
+        for (size_t g = 0; g < cell.groups.size(); g++)
+        {
+            const ModelMeshPart* part = mergedCell.parts[g].get();
+            if (!part)
+                continue;
+
+            const BakeMaterial& material = bakeMaterials[cell.groups[g].material];
+
+            DrawPart drawPart;
+            drawPart.object = material.object;
+            drawPart.batch = NO_BATCH;
+            drawPart.merged = uint32_t(m_mergedGroups.size());
+            drawPart.lod = 0;
+            drawPart.mesh = material.mesh;
+            drawPart.part = part;
+            drawPart.state = (material.mesh->ccw ? 1 : 0) | (material.mesh->pmalpha ? 2 : 0);
+            drawPart.effect = INSTANCED_EFFECT_ID;
+            drawPart.texture = textureIds[material.texture];
+            drawPart.basicEffect = nullptr;
+            drawPart.instancedLayout = GetInstancedLayout(*part);
+            drawPart.material = material.material;
+            m_drawParts.push_back(drawPart);
+            m_mergedGroups.push_back(&cell.groups[g]);
+        }
+    }
+
+    //cells that are gone release their buffers
+    m_mergedCells = std::move(mergedCells);
 }
 
 void Game::BuildDisplayChunk(ChunkObject * SceneChunk)
 {
+    STARTUP_PHASE("Build terrain");
+
     //populate our local DISPLAYCHUNK with all the chunk info we need from the object stored in toolmain
     //which, to be honest, is almost all of it. Its mostly rendering related info so...
     m_displayChunk.PopulateChunkData(SceneChunk);		//migrate chunk data
@@ -442,7 +1816,54 @@ void Game::BuildDisplayChunk(ChunkObject * SceneChunk)
 
 void Game::SaveDisplayChunk(ChunkObject * SceneChunk)
 {
+    PROFILE_SCOPE("Save terrain");
     m_displayChunk.SaveHeightMap();			//save heightmap to file.
+    m_displayChunk.SaveSplatMap();			//save auto-painted splat weights
+    SceneChunk->tex_splat_alpha_path = m_displayChunk.GetSplatAlphaPath();
+}
+
+bool Game::ErodeDisplayChunk(bool hydraulic, const ErosionProgressCallback& progress)
+{
+    if (hydraulic)
+        return m_displayChunk.ApplyHydraulicErosion(HydraulicErosionSettings(), progress);
+
+    return m_displayChunk.ApplyThermalErosion(ThermalErosionSettings(), progress);
+}
+
+bool Game::ExportObj(const std::string& path, int selectedID, ObjIoStats* stats)
+{
+    ObjWriter writer;
+    if (!writer.Open(path))
+        return false;
+
+    writer.Comment("Exported by the World Of Flim-Flam Craft Editor");
+    m_displayChunk.ExportObj(writer);
+
+    for (const DisplayObject& displayObject : m_displayList)
+    {
+        if (displayObject.m_ID != selectedID || !displayObject.m_model)
+            continue;
+
+        const Matrix world = m_world * ObjectTransform(displayObject);
+
+        ExportModelObj(writer, m_deviceResources->GetD3DDevice(), m_deviceResources->GetD3DDeviceContext(), *displayObject.m_model, world, "object_" + std::to_string(displayObject.m_ID));
+    }
+
+    const bool written = writer.Close();
+    if (stats)
+        *stats = writer.GetStats();
+
+    return written;
+}
+
+bool Game::ImportTerrainObj(const std::string& path, ObjIoStats* stats)
+{
+    ObjMesh mesh;
+    if (!ObjReader::Read(path, mesh, stats))
+        return false;
+
+    m_displayChunk.ImportObjHeights(mesh);
+    return true;
 }
 
 void Game::InitialiseInput(Mouse::ButtonStateTracker& mouseTracker, Keyboard::KeyboardStateTracker& keyboardTracker)
@@ -469,17 +1890,34 @@ void Game::NewAudioDevice()
 // These are the resources that depend on the device.
 void Game::CreateDeviceDependentResources()
 {
+    STARTUP_PHASE("Create device resources");
+
+    if (m_deviceResources->IsPIXCapturing())
+        Profiler::SetForwarding(&PIXForwardBegin, &PIXForwardEnd, m_deviceResources.get());
+
     auto context = m_deviceResources->GetD3DDeviceContext();
     auto device = m_deviceResources->GetD3DDevice();
 
     m_states = std::make_unique<CommonStates>(device);
 
-    m_fxFactory = std::make_unique<EffectFactory>(device);
-    m_fxFactory->SetDirectory(L"database/data/"); //fx Factory will look in the database directory
-    m_fxFactory->SetSharing(false);	//we must set this to false otherwise it will share effects based on the initial tex loaded (When the model loads) rather than what we will change them to.
+    m_materialCache = std::make_unique<MaterialCache>(device);
+    m_materialCache->SetDirectory(L"database/data/"); //fx Factory will look in the database directory. Effects are shared by material, textures are set per object at draw time
 
     m_sprites = std::make_unique<SpriteBatch>(context);
 
+    // Instanced model drawing starts instances at an offset into the transform buffer, which needs feature level 10
+    if (m_deviceResources->GetDeviceFeatureLevel() >= D3D_FEATURE_LEVEL_10_0)
+    {
+        DX::ThrowIfFailed(device->CreateVertexShader(g_InstancedModelVS, sizeof(g_InstancedModelVS), nullptr, m_instancedVS.ReleaseAndGetAddressOf()));
+        DX::ThrowIfFailed(device->CreatePixelShader(g_InstancedModelPS, sizeof(g_InstancedModelPS), nullptr, m_instancedPS.ReleaseAndGetAddressOf()));
+
+        CD3D11_BUFFER_DESC frameDesc(sizeof(InstanceFrameConstants), D3D11_BIND_CONSTANT_BUFFER);
+        DX::ThrowIfFailed(device->CreateBuffer(&frameDesc, nullptr, m_instanceFrameConstants.ReleaseAndGetAddressOf()));
+
+        CD3D11_BUFFER_DESC materialDesc(sizeof(InstanceMaterial), D3D11_BIND_CONSTANT_BUFFER);
+        DX::ThrowIfFailed(device->CreateBuffer(&materialDesc, nullptr, m_instanceMaterialConstants.ReleaseAndGetAddressOf()));
+    }
+
     m_batch = std::make_unique<PrimitiveBatch<VertexPositionColor>>(context);
 
     m_batchEffect = std::make_unique<BasicEffect>(device);
@@ -499,28 +1937,53 @@ void Game::CreateDeviceDependentResources()
         );
     }
 
-    m_font = std::make_unique<SpriteFont>(device, L"SegoeUI_18.spritefont");
+    {
+        STARTUP_PHASE("SegoeUI font");
+        m_font = std::make_unique<SpriteFont>(device, L"SegoeUI_18.spritefont");
+    }
 
     //    m_shape = GeometricPrimitive::CreateTeapot(context, 4.f, 8);
 
         // SDKMESH has to use clockwise winding with right-handed coordinates, so textures are flipped in U
-    m_model = Model::CreateFromSDKMESH(device, L"tiny.sdkmesh", *m_fxFactory);
+    {
+        STARTUP_PHASE("tiny.sdkmesh");
+        m_model = Model::CreateFromSDKMESH(device, L"tiny.sdkmesh", *m_materialCache);
+    }
 
 
     // Load textures
-    DX::ThrowIfFailed(
-        CreateDDSTextureFromFile(device, L"seafloor.dds", nullptr, m_texture1.ReleaseAndGetAddressOf())
-    );
+    {
+        STARTUP_PHASE("seafloor.dds");
+        DX::ThrowIfFailed(
+            CreateDDSTextureFromFile(device, L"seafloor.dds", nullptr, m_texture1.ReleaseAndGetAddressOf())
+        );
+    }
 
-    DX::ThrowIfFailed(
-        CreateDDSTextureFromFile(device, L"windowslogo.dds", nullptr, m_texture2.ReleaseAndGetAddressOf())
-    );
+    {
+        STARTUP_PHASE("windowslogo.dds");
+        DX::ThrowIfFailed(
+            CreateDDSTextureFromFile(device, L"windowslogo.dds", nullptr, m_texture2.ReleaseAndGetAddressOf())
+        );
+    }
+
+    // One white texel for the stats overlay to tint and stretch
+    {
+        const uint32_t white = 0xFFFFFFFF;
+        const CD3D11_TEXTURE2D_DESC desc(DXGI_FORMAT_R8G8B8A8_UNORM, 1, 1, 1, 1);
+        const D3D11_SUBRESOURCE_DATA data = { &white, sizeof(white), 0 };
+        ComPtr<ID3D11Texture2D> texture;
+        DX::ThrowIfFailed(device->CreateTexture2D(&desc, &data, texture.GetAddressOf()));
+        DX::ThrowIfFailed(device->CreateShaderResourceView(texture.Get(), nullptr, m_whiteTexture.ReleaseAndGetAddressOf()));
+    }
 
 }
 
 // Allocate all memory resources that change on a window SizeChanged event.
 void Game::CreateWindowSizeDependentResources()
 {
+    //the update reads the projection
+    InvalidateSnapshots();
+
     auto size = m_deviceResources->GetOutputSize();
     float aspectRatio = float(size.right) / float(size.bottom);
     float fovAngleY = XMConvertToRadians(DEFAULT_FOV_DEG);
@@ -549,8 +2012,10 @@ void Game::CreateWindowSizeDependentResources()
 
 void Game::OnDeviceLost()
 {
+    Profiler::SetForwarding(nullptr, nullptr, nullptr);
     m_states.reset();
-    m_fxFactory.reset();
+    m_materialCache.reset();
+    m_instanceMaterials.clear();
     m_sprites.reset();
     m_batch.reset();
     m_batchEffect.reset();
@@ -559,7 +2024,19 @@ void Game::OnDeviceLost()
     m_model.reset();
     m_texture1.Reset();
     m_texture2.Reset();
+    m_whiteTexture.Reset();
     m_batchInputLayout.Reset();
+    m_instancedVS.Reset();
+    m_instancedPS.Reset();
+    m_instancedLayouts.clear();
+    m_instanceFrameConstants.Reset();
+    m_instanceMaterialConstants.Reset();
+    m_instanceBuffer.Reset();
+    m_instanceBufferCapacity = 0;
+    m_mergedCells.clear();		//the merged draw parts point into these
+    m_mergedGroups.clear();
+    if (!m_batchFirstPart.empty())
+        m_drawParts.resize(m_batchFirstPart.back());
 }
 
 void Game::OnDeviceRestored()
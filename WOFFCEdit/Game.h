@@ -9,9 +9,24 @@
 #include "DisplayObject.h"
 #include "DisplayChunk.h"
 #include "DeviceResources.h"
+#include "HorizonCuller.h"
+#include "MaskedOcclusionBuffer.h"
+#include "RenderQueue.h"
+#include "InstanceBatcher.h"
+#include "MaterialCache.h"
+#include "StaticGeometryBaker.h"
+#include "LodSelector.h"
+#include "FrameStats.h"
+#include "FrameArena.h"
+#include "JobSystem.h"
+#include <atomic>
+#include <map>
+#include <tuple>
+#include <unordered_map>
 
 struct ChunkObject;
 struct SceneObject;
+struct ObjIoStats;
 
 // A basic game implementation that creates a D3D11 device and
 // provides a game loop.
@@ -23,6 +38,13 @@ class Game : public DX::IDeviceNotify
 
     constexpr static float MOUSE_SENSITIVITY = 1.f;
     constexpr static float MOUSE_SMOOTH_FACTOR = 0.5f;
+    constexpr static float MOUSE_SETTLED_DELTA = 0.01f;	//degrees per frame the smoothed mouse still turns the camera by
+
+    constexpr static int CULLING_LOSS_FRAMES = 30;		//frames horizon culling may cost more than it saves before it is paused
+    constexpr static int CULLING_BACKOFF_FRAMES = 120;	//frames it stays paused
+
+    constexpr static float OCCLUDER_MIN_SIZE = 4.f;			//objects at least this large along an axis occlude others
+    constexpr static size_t OCCLUDER_MAX_TRIANGLES = 2000;	//more detailed models cost more to rasterise than they save
 
 public:
 
@@ -30,7 +52,7 @@ public:
     void Initialize(HWND window, int width, int height);
     void SetGridState(bool state);
 
-    // Basic game loop
+    // Basic game loop. Update of the next frame runs on a worker while Render draws this one.
     void Tick(DirectX::Mouse::State& mouse, DirectX::Keyboard::State& keyboard);
     void Render();
 
@@ -49,10 +71,34 @@ public:
     void OnWindowSizeChanged(int width, int height);
 
     //tool specific
-    void BuildDisplayList(std::vector<SceneObject> * SceneGraph); //note vector passed by reference 
+    void BuildDisplayList(const std::vector<SceneObject> * SceneGraph); //note vector passed by reference 
     void BuildDisplayChunk(ChunkObject *SceneChunk);
     void SaveDisplayChunk(ChunkObject *SceneChunk);	//saves geometry et al
+    bool ErodeDisplayChunk(bool hydraulic, const ErosionProgressCallback& progress);	//hydraulic or thermal erosion with default settings. false if cancelled
+    bool ExportObj(const std::string& path, int selectedID, ObjIoStats* stats);	//terrain plus the selected object, in world space
+    bool ImportTerrainObj(const std::string& path, ObjIoStats* stats);				//heights from an OBJ terrain mesh
     void ClearDisplayList();
+    void SetStaticMerging(bool enabled) { m_staticMerging = enabled; }	//takes effect with the next BuildDisplayList
+    bool GetStaticMerging() const { return m_staticMerging; }
+    void SetStaticCacheDirectory(const std::string& directory) { m_staticCacheDirectory = directory; }	//where merged cells are cached between runs, empty for nowhere
+
+    //frame pacing of the loop calling Tick, shown on the HUD
+    struct FramePacing
+    {
+        bool	onDemand = false;			//frames only drawn when something changed
+        float	framesPerSecond = 0.f;
+        float	waiting = 0.f;				//fraction of the time spent blocked waiting for messages
+        float	cpu = 0.f;					//process CPU time over wall time, 1 for a core kept busy
+        unsigned long long	loopAllocations = 0;	//heap allocations made by the idle loop, counted in debug builds only
+        unsigned long long	workingSetBytes = 0;	//process memory, for the stats overlay
+        unsigned long long	privateBytes = 0;		//committed and not shared
+    };
+    void SetFramePacing(const FramePacing& pacing) { m_framePacing = pacing; }
+    bool IsSettling() const;	//true while frames change without new input, as the camera does while mouse smoothing runs out, or an update waits to be drawn
+
+    //replays turn off what adapts to time rather than input, so each run of one makes the same frames
+    void SetAdaptiveCulling(bool enabled);		//pausing horizon culling while it costs more than it saves
+    const FrameStats& GetFrameStats() const { return m_frameStats; }
 
     //input
     void InitialiseInput(DirectX::Mouse::ButtonStateTracker& mouseTracker, DirectX::Keyboard::KeyboardStateTracker& keyboardTracker);
@@ -63,23 +109,169 @@ public:
 
 private:
 
-    void Update(DX::StepTimer const& timer, DirectX::Mouse::State& mouse, DirectX::Keyboard::State& keyboard);
+    //material of a model's BasicEffect, as the instanced shaders' constant buffer
+    struct InstanceMaterial
+    {
+        DirectX::XMFLOAT4				diffuseColor;	//alpha in w
+        DirectX::XMFLOAT3				emissiveColor;	//plus ambient light * diffuse
+        float							specularPower;
+        DirectX::XMFLOAT4				specularColor;
+    };
+
+    //what Render draws, written by Update for the frame after the one being drawn. A published snapshot isn't
+    //written to until the one after it is published, so Render reads it without locks. Its arrays are in the
+    //frame arena of the same index
+    struct FrameSnapshot
+    {
+        DirectX::SimpleMath::Matrix		view;
+        DirectX::SimpleMath::Matrix		projection;
+        DirectX::SimpleMath::Vector3	camPosition;
+        DirectX::SimpleMath::Vector3	camLookDirection;
+        size_t							numObjects = 0;
+        uint8_t*						objectVisible = nullptr;	//after horizon and occlusion culling, one per display object
+        uint8_t*						objectLevel = nullptr;		//level of detail of each display object
+        int								visibleObjects = 0;
+        bool							changed = true;		//draws differently from the snapshot before
+
+        //for the HUD
+        bool							horizonCulling = false;
+        bool							horizonPaused = false;		//cost more than it saved
+        HorizonCuller::Stats			horizonStats;
+        bool							occlusionCulling = false;
+        size_t							occlusionCulled = 0;
+        MaskedOcclusionBuffer::Stats	occlusionStats;
+        LodSelector::Stats				lodStats;
+        bool							statsOverlay = false;
+        float							sectionMs[FrameStats::MAX_SECTIONS];	//stats sections timed on the worker that ran the update
+    };
+
+    constexpr static uint32_t NO_SNAPSHOT = UINT32_MAX;
+
+    void Update(DX::StepTimer const& timer, DirectX::Mouse::State& mouse, DirectX::Keyboard::State& keyboard, double drawCostMs, FrameSnapshot& snapshot, FrameArena& arena);
+    void PublishSnapshot(uint32_t snapshot);
+    void InvalidateSnapshots();			//waits for the update, the next frame updates before it draws
 
     void CreateDeviceDependentResources();
     void CreateWindowSizeDependentResources();
 
+    void CullObjects(double drawCostMs, FrameSnapshot& snapshot);	//horizon occlusion culling of m_displayList into the snapshot's visible objects
+    void BeginOcclusionRender();		//starts rasterising occluders on worker threads with the current camera
+    void ApplyOcclusionCulling(FrameSnapshot& snapshot);	//waits for the occluders and hides the objects behind them
+    void DrawDisplayList(ID3D11DeviceContext* context, const FrameSnapshot& snapshot, FrameArena& arena);	//visible objects through the render queue
+    ID3D11InputLayout* GetInstancedLayout(const DirectX::ModelMeshPart& part);	//nullptr if the part can't use the instanced shaders
+    const InstanceMaterial* GetInstanceMaterial(const DirectX::IEffect* effect);	//nullptr if the instanced shaders can't stand in for the effect
+    void BuildMergedGeometry(const std::vector<SceneObject>* SceneGraph, const std::vector<uint8_t>& objectMerged, std::unordered_map<const void*, uint32_t>& textureIds);	//bakes the merged objects and adds their draw parts
+    void DrawStatsOverlay(const FrameSnapshot& snapshot, float top);	//within the HUD's sprite batch
+
     void XM_CALLCONV DrawGrid(DirectX::FXMVECTOR xAxis, DirectX::FXMVECTOR yAxis, DirectX::FXMVECTOR origin, size_t xdivs, size_t ydivs, DirectX::GXMVECTOR color);
 
     //tool specific
     std::vector<DisplayObject>			m_displayList;
     DisplayChunk						m_displayChunk;
 
+    //one mesh part of a display object or of an instance batch, as submitted through the render queue
+    struct DrawPart
+    {
+        uint32_t						object;		//index into m_displayList. For a batch, its first member
+        uint32_t						batch;		//instance batch drawn by this part, NO_BATCH when drawn per object
+        uint32_t						merged;		//index into m_mergedGroups for merged static geometry, NO_GROUP otherwise
+        uint32_t						lod;		//level of detail of the model the part is from, drawn while its object is at that level
+        const DirectX::ModelMesh*		mesh;
+        const DirectX::ModelMeshPart*	part;
+        uint32_t						state;		//render state bits of the sort key: culling and alpha mode of the mesh
+        uint32_t						effect;		//ids of the effect and diffuse texture, for the sort key
+        uint32_t						texture;
+        DirectX::BasicEffect*			basicEffect;		//per object draws: takes the object's texture, models are shared
+        ID3D11InputLayout*				instancedLayout;	//batch draws
+        const InstanceMaterial*			material;
+    };
+
+    constexpr static uint32_t NO_BATCH = UINT32_MAX;
+    constexpr static uint32_t NO_GROUP = UINT32_MAX;
+    constexpr static uint32_t INSTANCED_EFFECT_ID = 0;		//sort key effect id of the instanced shaders
+
+    std::vector<DrawPart>				m_drawParts;
+    std::vector<uint32_t>				m_objectFirstPart;			//per object m_drawParts of object i are [m_objectFirstPart[i], m_objectFirstPart[i + 1])
+    std::vector<uint32_t>				m_batchFirstPart;			//and those of instance batch b [m_batchFirstPart[b], m_batchFirstPart[b + 1])
+    std::vector<DirectX::SimpleMath::Matrix>	m_objectWorld;		//world matrix of each display object
+    RenderQueue							m_renderQueue;
+    uint32_t							m_drawCalls = 0;			//last frame
+    uint32_t							m_stateChanges = 0;			//state, buffer and effect switches issued for those draws
+    size_t								m_trianglesDrawn = 0;		//last frame, instances and merged geometry included
+
+    //level of detail per display object, from its size on screen
+    LodSelector							m_lodSelector;
+
+    //instanced drawing of objects that share a model and diffuse texture
+    InstanceBatcher						m_instanceBatcher;
+    std::unordered_map<const DirectX::IEffect*, InstanceMaterial>	m_instanceMaterials;	//model effects the instanced shaders can stand in for
+    std::map<std::tuple<UINT, DXGI_FORMAT, UINT, DXGI_FORMAT, UINT, DXGI_FORMAT>, Microsoft::WRL::ComPtr<ID3D11InputLayout>>	m_instancedLayouts;	//by position, normal and texcoord offset and format
+    Microsoft::WRL::ComPtr<ID3D11VertexShader>	m_instancedVS;		//null below feature level 10, where everything is drawn per object
+    Microsoft::WRL::ComPtr<ID3D11PixelShader>	m_instancedPS;
+    Microsoft::WRL::ComPtr<ID3D11Buffer>	m_instanceFrameConstants;
+    Microsoft::WRL::ComPtr<ID3D11Buffer>	m_instanceMaterialConstants;
+    Microsoft::WRL::ComPtr<ID3D11Buffer>	m_instanceBuffer;			//packed transforms of all batches
+    size_t								m_instanceBufferCapacity = 0;	//in instances, plus an identity transform after them
+    uint32_t							m_identityInstance = 0;		//the identity transform, used to draw merged geometry
+
+    //static objects merged per cell and material, optional
+    struct MergedCell
+    {
+        uint32_t						version;	//of the baker's cell these buffers hold
+        std::vector<std::unique_ptr<DirectX::ModelMeshPart>>	parts;	//one per group, null for empty groups
+    };
+
+    StaticGeometryBaker					m_staticBaker;
+    bool								m_staticMerging = false;	//Edit > Merge Static Geometry
+    std::string							m_staticCacheDirectory;
+    std::map<std::string, std::vector<std::shared_ptr<StaticGeometryBaker::Mesh>>>	m_staticMeshes;	//CPU copies of model parts, by model path, in mesh then part order
+    std::map<std::pair<int, int>, MergedCell>	m_mergedCells;		//GPU buffers of the baked cells
+    std::vector<const StaticGeometryBaker::Group*>	m_mergedGroups;	//drawn through the render queue
+
+    //horizon occlusion culling
+    HorizonCuller						m_horizonCuller;
+    std::vector<HorizonCuller::Bounds>	m_objectBounds;				//world bounds of m_displayList, same order
+    bool								m_horizonCulling = true;	//toggled with H
+    int									m_cullingLosses = 0;		//consecutive frames the pass cost more than it saved
+    int									m_cullingBackoff = 0;		//frames left before the pass is tried again
+    bool								m_adaptiveCulling = true;	//pause the pass while it loses
+    double								m_drawCostMs = 0.0;			//running average CPU time of one object draw, written by Render
+
+    //software occlusion culling against large objects
+    MaskedOcclusionBuffer				m_occlusionBuffer;
+    std::map<std::string, std::shared_ptr<OccluderMesh>>	m_occluderMeshes;	//CPU copies of occluder models, by model path
+    std::vector<OccluderInstance>		m_occluders;				//display objects selected as occluders
+    JobGroup							m_occlusionTask;			//rasterises m_occluders while Update carries on
+    bool								m_occlusionPending = false;	//m_occlusionTask was started this frame
+    bool								m_occlusionCulling = true;	//toggled with O
+
+    //pipelining of update and render, through two snapshots. The arena of a snapshot holds its arrays and is
+    //reset once the frame drawing it is over. A snapshot can be drawn again by frames that don't update, so the
+    //scratch data of drawing has its own arena, reset after every frame
+    FrameSnapshot						m_snapshots[2];
+    FrameArena							m_frameArenas[2];
+    FrameArena							m_renderArena;
+    FrameArena::Stats					m_retiredArena;				//of the last snapshot's arena before it was reset, for the stats overlay
+    FrameArena::Stats					m_retiredRenderArena;		//of the last frame's render arena
+    std::atomic<uint32_t>				m_frontSnapshot{ NO_SNAPSHOT };	//the one Render draws, NO_SNAPSHOT before the first update
+    JobGroup							m_updateTask;				//updates the other one while Render runs
+    bool								m_snapshotPending = false;	//the front snapshot changed and hasn't been drawn yet
+
     //functionality
     float								m_movespeed = 0.3f;
 
     //store last frame's cursor delta movement for smoothing
     DirectX::SimpleMath::Vector3        m_smoothDelta;
 
+    FramePacing							m_framePacing;
+
+    //stats overlay, toggled with F3
+    FrameStats							m_frameStats;
+    bool								m_statsOverlay = false;
+    size_t								m_modelRequests = 0;		//models the last BuildDisplayList asked for, one per object
+    size_t								m_modelLoads = 0;			//of those, read from file rather than shared
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_whiteTexture;		//stretched into the bars of the frame time graph
+
     //camera
     DirectX::SimpleMath::Vector3		m_camPosition{ 0.f, 3.7f, -3.5f };
     DirectX::SimpleMath::Vector3		m_camOrientation;
@@ -99,7 +291,7 @@ private:
     // DirectXTK objects.
     std::unique_ptr<DirectX::CommonStates>                                  m_states;
     std::unique_ptr<DirectX::BasicEffect>                                   m_batchEffect;
-    std::unique_ptr<DirectX::EffectFactory>                                 m_fxFactory;
+    std::unique_ptr<MaterialCache>                                          m_materialCache;
     std::unique_ptr<DirectX::GeometricPrimitive>                            m_shape;
     std::unique_ptr<DirectX::Model>                                         m_model;
     std::unique_ptr<DirectX::PrimitiveBatch<DirectX::VertexPositionColor>>  m_batch;
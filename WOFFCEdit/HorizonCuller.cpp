@@ -0,0 +1,211 @@
+#include "HorizonCuller.h"
+#include "TerrainMinMaxTree.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+    static_assert((HorizonCuller::NUM_BINS & (HorizonCuller::NUM_BINS - 1)) == 0, "NUM_BINS must be a power of two");
+
+    // Monotonic stand-in for atan2(dz, dx) in the range [0, 4), one unit per quadrant. Much cheaper
+    // than atan2 and only the ordering of directions matters for binning, as long as every caller
+    // uses the same mapping. Undefined for (0, 0).
+    float PseudoAngle(float dx, float dz)
+    {
+        if (dz >= 0.f)
+            return dx >= 0.f ? dz / (dx + dz) : 1.f - (dx / (dz - dx));
+
+        return dx < 0.f ? 2.f - (dz / (-dx - dz)) : 3.f + (dx / (dx - dz));
+    }
+
+    constexpr float BINS_PER_UNIT = HorizonCuller::NUM_BINS / 4.f;
+
+    // Horizontal distances from a point to the nearest and furthest points of a rectangle
+    float NearestDistance(float px, float pz, float minX, float minZ, float maxX, float maxZ)
+    {
+        const float dx = std::max(std::max(minX - px, px - maxX), 0.f);
+        const float dz = std::max(std::max(minZ - pz, pz - maxZ), 0.f);
+        return std::sqrt((dx * dx) + (dz * dz));
+    }
+
+    float FurthestDistance(float px, float pz, float minX, float minZ, float maxX, float maxZ)
+    {
+        const float dx = std::max(std::abs(minX - px), std::abs(maxX - px));
+        const float dz = std::max(std::abs(minZ - pz), std::abs(maxZ - pz));
+        return std::sqrt((dx * dx) + (dz * dz));
+    }
+}
+
+void HorizonCuller::Cull(const TerrainMinMaxTree& tree, float eyeX, float eyeY, float eyeZ, const Bounds* bounds, size_t count, uint8_t* visible)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    m_stats = Stats();
+    std::fill(visible, visible + count, uint8_t(1));
+
+    m_eyeX = eyeX;
+    m_eyeY = eyeY;
+    m_eyeZ = eyeZ;
+
+    // Only cull when the camera is over the chunk and above the terrain under it; from below or from
+    // outside, lines of sight can pass under the terrain sheet
+    const size_t numQuads = tree.GetNumQuads();
+    const float cellSize = tree.GetCellSize();
+    const float localX = (eyeX - tree.GetOriginX()) / cellSize;
+    const float localZ = (eyeZ - tree.GetOriginZ()) / cellSize;
+    if (numQuads == 0 || count == 0 || localX < 0.f || localZ < 0.f || localX >= numQuads || localZ >= numQuads)
+        return;
+
+    if (eyeY <= tree.GetNode(0, size_t(localX), size_t(localZ)).maxHeight)
+        return;
+
+    // Objects, nearest first by their nearest point. Objects over the camera can't be behind anything.
+    m_candidates.clear();
+    for (size_t i = 0; i < count; i++)
+    {
+        const float distance = NearestDistance(eyeX, eyeZ, bounds[i].minX, bounds[i].minZ, bounds[i].maxX, bounds[i].maxZ);
+        if (distance > 0.f)
+            m_candidates.push_back({ distance, uint32_t(i) });
+    }
+    std::sort(m_candidates.begin(), m_candidates.end(), [](const Candidate& a, const Candidate& b) { return a.distance < b.distance; });
+
+    if (m_candidates.empty())
+        return;
+
+    // Terrain nodes, nearest first by their furthest point. Nothing beyond the furthest object is needed.
+    m_maxDistance = m_candidates.back().distance;
+    m_occluders.clear();
+    GatherOccluders(tree, tree.GetNumLevels() - 1, 0, 0);
+    std::sort(m_occluders.begin(), m_occluders.end(), [](const Occluder& a, const Occluder& b) { return a.distance < b.distance; });
+
+    std::fill(m_horizon, m_horizon + NUM_BINS, -FLT_MAX);
+
+    // Walk both lists front to back, growing the horizon only with terrain entirely in front of the object under test
+    size_t nextOccluder = 0;
+    for (const Candidate& candidate : m_candidates)
+    {
+        while (nextOccluder < m_occluders.size() && m_occluders[nextOccluder].distance <= candidate.distance)
+            RasteriseOccluder(m_occluders[nextOccluder++]);
+
+        if (nextOccluder > 0 && IsHidden(bounds[candidate.index], candidate.distance))
+        {
+            visible[candidate.index] = 0;
+            m_stats.culled++;
+        }
+    }
+
+    m_stats.tested = m_candidates.size();
+    m_stats.terrainNodes = m_occluders.size();
+    m_stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void HorizonCuller::GatherOccluders(const TerrainMinMaxTree& tree, size_t level, size_t x, size_t z)
+{
+    float minX, minZ, maxX, maxZ;
+    tree.GetNodeBounds(level, x, z, minX, minZ, maxX, maxZ);
+
+    const float nearest = NearestDistance(m_eyeX, m_eyeZ, minX, minZ, maxX, maxZ);
+    if (nearest >= m_maxDistance)
+        return;
+
+    const float size = std::max(maxX - minX, maxZ - minZ);
+
+    // Nodes under the camera are refined down to the quads around it; the quad it is on is skipped
+    const bool underCamera = nearest <= 0.f;
+    if (level > 0 && (underCamera || size >= m_lodRatio * nearest))
+    {
+        const size_t childSize = tree.GetLevelSize(level - 1);
+        for (size_t cz = z * 2; cz < std::min(z * 2 + 2, childSize); cz++)
+        {
+            for (size_t cx = x * 2; cx < std::min(x * 2 + 2, childSize); cx++)
+                GatherOccluders(tree, level - 1, cx, cz);
+        }
+        return;
+    }
+
+    if (underCamera)
+        return;
+
+    float first, last;
+    if (!AzimuthRange(minX, minZ, maxX, maxZ, first, last))
+        return;
+
+    // The terrain crosses every line of sight in the node's span no lower than its minimum height.
+    // The smallest slope to that height is at the near side if it is below the eye, the far side if above.
+    const float furthest = FurthestDistance(m_eyeX, m_eyeZ, minX, minZ, maxX, maxZ);
+    const float height = tree.GetNode(level, x, z).minHeight - m_eyeY;
+    const float slope = height / (height >= 0.f ? furthest : nearest);
+
+    // Only bins the node covers completely are raised
+    Occluder occluder;
+    occluder.distance = furthest;
+    occluder.slope = slope;
+    occluder.firstBin = int32_t(std::ceil(first));
+    occluder.endBin = int32_t(std::floor(last));
+    if (occluder.endBin > occluder.firstBin)
+        m_occluders.push_back(occluder);
+}
+
+bool HorizonCuller::AzimuthRange(float minX, float minZ, float maxX, float maxZ, float& first, float& last) const
+{
+    // Corner directions relative to the centre's direction. The camera is outside the rectangle, so the
+    // corners span less than half a turn and the relative angles don't wrap.
+    const float centre = PseudoAngle(((minX + maxX) * 0.5f) - m_eyeX, ((minZ + maxZ) * 0.5f) - m_eyeZ);
+    const float cornersX[4] = { minX, maxX, minX, maxX };
+    const float cornersZ[4] = { minZ, minZ, maxZ, maxZ };
+
+    float lowest = 0.f, highest = 0.f;
+    for (int i = 0; i < 4; i++)
+    {
+        const float dx = cornersX[i] - m_eyeX;
+        const float dz = cornersZ[i] - m_eyeZ;
+        if (dx == 0.f && dz == 0.f)
+            return false;
+
+        float relative = PseudoAngle(dx, dz) - centre;
+        if (relative > 2.f)
+            relative -= 4.f;
+        else if (relative <= -2.f)
+            relative += 4.f;
+
+        lowest = std::min(lowest, relative);
+        highest = std::max(highest, relative);
+    }
+
+    first = (centre + lowest) * BINS_PER_UNIT;
+    last = (centre + highest) * BINS_PER_UNIT;
+    return true;
+}
+
+void HorizonCuller::RasteriseOccluder(const Occluder& occluder)
+{
+    for (int32_t bin = occluder.firstBin; bin < occluder.endBin; bin++)
+    {
+        float& horizon = m_horizon[bin & (NUM_BINS - 1)];
+        horizon = std::max(horizon, occluder.slope);
+    }
+}
+
+bool HorizonCuller::IsHidden(const Bounds& bounds, float nearest) const
+{
+    float first, last;
+    if (!AzimuthRange(bounds.minX, bounds.minZ, bounds.maxX, bounds.maxZ, first, last))
+        return false;
+
+    // Steepest slope to the top of the box: near side if it is above the eye, far side if below
+    const float furthest = FurthestDistance(m_eyeX, m_eyeZ, bounds.minX, bounds.minZ, bounds.maxX, bounds.maxZ);
+    const float height = bounds.maxY - m_eyeY;
+    const float slope = height / (height >= 0.f ? nearest : furthest);
+
+    // Every bin the box touches, even partially, has to be above it
+    const int32_t endBin = int32_t(std::floor(last));
+    for (int32_t bin = int32_t(std::floor(first)); bin <= endBin; bin++)
+    {
+        if (m_horizon[bin & (NUM_BINS - 1)] <= slope)
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class TerrainMinMaxTree;
+
+// CPU occlusion culling against the terrain horizon.
+//
+// Every frame the terrain min/max quadtree is walked around the camera, picking coarser nodes the
+// further away they are. Each node contributes a lower bound of the terrain's elevation (as a slope,
+// height over horizontal distance) to the azimuth bins it fully covers. Objects are tested front to
+// back, interleaved with the terrain nodes, so an object is only ever tested against terrain that is
+// entirely closer to the camera than it is. An object is culled when the top of its bounding box is
+// below the horizon in every bin it overlaps.
+//
+// The test is conservative: node minimum heights under-estimate the terrain and object maximum heights
+// over-estimate the object, so nothing visible is rejected. It assumes the camera is above the terrain
+// sheet; culling is skipped for frames where it is under the terrain or outside the chunk.
+class HorizonCuller
+{
+public:
+    static constexpr size_t NUM_BINS = 1024;	//azimuth resolution, must be a power of two
+
+    // World space axis aligned bounds of an object
+    struct Bounds
+    {
+        float minX, minY, minZ;
+        float maxX, maxY, maxZ;
+    };
+
+    struct Stats
+    {
+        size_t	tested = 0;			//objects tested this frame
+        size_t	culled = 0;			//objects found hidden
+        size_t	terrainNodes = 0;	//quadtree nodes rasterised into the horizon
+        double	milliseconds = 0.0;	//time taken by the whole pass
+    };
+
+    // Terrain nodes are used once their size is below 'lodRatio' times their distance to the camera.
+    // Lower values give a tighter horizon at the cost of more nodes.
+    void SetLodRatio(float lodRatio) { m_lodRatio = lodRatio; }
+
+    // Sets visible[i] to 0 for objects hidden behind the terrain and to 1 for the rest
+    void Cull(const TerrainMinMaxTree& tree, float eyeX, float eyeY, float eyeZ, const Bounds* bounds, size_t count, uint8_t* visible);
+
+    const Stats& GetStats() const { return m_stats; }
+
+private:
+    struct Occluder
+    {
+        float	distance;		//furthest horizontal distance from the camera
+        float	slope;			//lowest elevation of the terrain in the node
+        int32_t	firstBin;		//bins fully covered, firstBin <= bin < endBin, before wrapping
+        int32_t	endBin;
+    };
+
+    struct Candidate
+    {
+        float	distance;		//nearest horizontal distance from the camera
+        uint32_t index;
+    };
+
+    void GatherOccluders(const TerrainMinMaxTree& tree, size_t level, size_t x, size_t z);
+    bool AzimuthRange(float minX, float minZ, float maxX, float maxZ, float& first, float& last) const;
+    void RasteriseOccluder(const Occluder& occluder);
+    bool IsHidden(const Bounds& bounds, float nearest) const;
+
+    float					m_lodRatio = 0.4f;
+    float					m_eyeX = 0.f;
+    float					m_eyeY = 0.f;
+    float					m_eyeZ = 0.f;
+    float					m_maxDistance = 0.f;	//nearest distance of the furthest object tested
+
+    float					m_horizon[NUM_BINS];	//highest slope found so far per azimuth bin
+    std::vector<Occluder>	m_occluders;			//kept between frames to avoid reallocating
+    std::vector<Candidate>	m_candidates;
+    Stats					m_stats;
+};
@@ -0,0 +1,287 @@
+#include "InputRecording.h"
+#include "Platform.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    const char MAGIC[3] = { 'W', 'I', 'R' };
+    constexpr uint8_t VERSION = 1;
+
+    constexpr uint8_t RECORD_FRAME = 1;
+    constexpr uint8_t RECORD_COMMAND = 2;
+
+    constexpr uint8_t FRAME_MOUSE = 1;
+    constexpr uint8_t FRAME_KEYS = 2;
+
+    constexpr size_t MAX_ARGUMENT = 0xFFFF;
+}
+
+constexpr size_t InputFrame::KEY_BYTES;
+
+InputRecorder::~InputRecorder()
+{
+    Stop();
+}
+
+bool InputRecorder::Start(const std::string& path)
+{
+    Stop();
+
+    errno_t ret = fopen_s(&m_file, path.c_str(), "wb");
+    if (ret != 0 || m_file == nullptr)
+    {
+        m_file = nullptr;
+        return false;
+    }
+
+    m_last = InputFrame();
+    m_lastTime = std::chrono::steady_clock::now();
+    m_stats = Stats();
+
+    Write(MAGIC, sizeof(MAGIC));
+    Write(&VERSION, 1);
+    return true;
+}
+
+bool InputRecorder::Stop()
+{
+    if (!m_file)
+        return true;
+
+    const bool written = ferror(m_file) == 0;
+    const bool closed = fclose(m_file) == 0;
+    m_file = nullptr;
+    return written && closed;
+}
+
+void InputRecorder::RecordFrame(const InputFrame& frame)
+{
+    if (!m_file)
+        return;
+
+    const auto now = std::chrono::steady_clock::now();
+    const long long elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - m_lastTime).count();
+    const uint32_t microseconds = uint32_t(std::min<long long>(elapsed, UINT32_MAX));
+    m_lastTime = now;
+
+    const bool mouse = frame.mouseX != m_last.mouseX || frame.mouseY != m_last.mouseY || frame.scrollWheel != m_last.scrollWheel
+        || frame.buttons != m_last.buttons || frame.relative != m_last.relative;
+    const bool keys = memcmp(frame.keys, m_last.keys, InputFrame::KEY_BYTES) != 0;
+    const uint8_t flags = (mouse ? FRAME_MOUSE : 0) | (keys ? FRAME_KEYS : 0);
+
+    Write(&RECORD_FRAME, 1);
+    Write(&flags, 1);
+    Write(&microseconds, sizeof(microseconds));
+    if (mouse)
+    {
+        Write(&frame.mouseX, sizeof(frame.mouseX));
+        Write(&frame.mouseY, sizeof(frame.mouseY));
+        Write(&frame.scrollWheel, sizeof(frame.scrollWheel));
+        Write(&frame.buttons, 1);
+        Write(&frame.relative, 1);
+    }
+    if (keys)
+        Write(frame.keys, InputFrame::KEY_BYTES);
+
+    m_last = frame;
+    m_stats.frames++;
+}
+
+void InputRecorder::RecordCommand(uint32_t command, const std::string& argument)
+{
+    if (!m_file)
+        return;
+
+    const uint16_t length = uint16_t(std::min(argument.size(), MAX_ARGUMENT));
+    Write(&RECORD_COMMAND, 1);
+    Write(&command, sizeof(command));
+    Write(&length, sizeof(length));
+    Write(argument.data(), length);
+    m_stats.commands++;
+}
+
+void InputRecorder::Write(const void* data, size_t bytes)
+{
+    m_stats.bytes += fwrite(data, 1, bytes, m_file);
+}
+
+bool InputReplay::Open(const std::string& path)
+{
+    Close();
+
+    FILE* pFile = nullptr;
+    errno_t ret = fopen_s(&pFile, path.c_str(), "rb");
+    if (ret != 0 || pFile == nullptr)
+        return false;
+
+    uint8_t buffer[16 * 1024];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+        m_data.insert(m_data.end(), buffer, buffer + count);
+    const bool read = ferror(pFile) == 0;
+    fclose(pFile);
+
+    if (!read || m_data.size() < sizeof(MAGIC) + 1 || memcmp(m_data.data(), MAGIC, sizeof(MAGIC)) != 0 || m_data[sizeof(MAGIC)] != VERSION)
+    {
+        m_data.clear();
+        return false;
+    }
+
+    // Count the frames up front, for the progress of the replay and to size its timings
+    m_offset = sizeof(MAGIC) + 1;
+    m_playing = true;
+    while (Next() != RECORD_END)
+    {
+    }
+    m_numFrames = m_framesPlayed;
+
+    m_offset = sizeof(MAGIC) + 1;
+    m_playing = true;
+    m_framesPlayed = 0;
+    m_frame = InputFrame();
+    return true;
+}
+
+void InputReplay::Close()
+{
+    m_data.clear();
+    m_offset = 0;
+    m_playing = false;
+    m_numFrames = 0;
+    m_framesPlayed = 0;
+    m_frame = InputFrame();
+}
+
+InputReplay::Record InputReplay::Next()
+{
+    if (!m_playing)
+        return RECORD_END;
+
+    // A truncated record, as a recording that crashed leaves, ends the replay
+    uint8_t type = 0;
+    if (Read(&type, 1))
+    {
+        if (type == RECORD_FRAME)
+        {
+            InputFrame frame = m_frame;
+            uint8_t flags = 0;
+            bool complete = Read(&flags, 1) && Read(&frame.microseconds, sizeof(frame.microseconds));
+            if (complete && (flags & FRAME_MOUSE))
+            {
+                complete = Read(&frame.mouseX, sizeof(frame.mouseX)) && Read(&frame.mouseY, sizeof(frame.mouseY)) && Read(&frame.scrollWheel, sizeof(frame.scrollWheel))
+                    && Read(&frame.buttons, 1) && Read(&frame.relative, 1);
+            }
+            if (complete && (flags & FRAME_KEYS))
+                complete = Read(frame.keys, InputFrame::KEY_BYTES);
+
+            if (complete)
+            {
+                m_frame = frame;
+                m_framesPlayed++;
+                return RECORD_FRAME;
+            }
+        }
+        else if (type == RECORD_COMMAND)
+        {
+            uint16_t length = 0;
+            if (Read(&m_command, sizeof(m_command)) && Read(&length, sizeof(length)) && m_offset + length <= m_data.size())
+            {
+                m_argument.assign(reinterpret_cast<const char*>(m_data.data() + m_offset), length);
+                m_offset += length;
+                return RECORD_COMMAND;
+            }
+        }
+    }
+
+    m_playing = false;
+    return RECORD_END;
+}
+
+bool InputReplay::Read(void* data, size_t bytes)
+{
+    if (m_offset + bytes > m_data.size())
+        return false;
+
+    memcpy(data, m_data.data() + m_offset, bytes);
+    m_offset += bytes;
+    return true;
+}
+
+ReplayTimings::~ReplayTimings()
+{
+    if (m_file)
+        fclose(m_file);
+}
+
+bool ReplayTimings::Open(const std::string& path, const char* const* sectionNames, size_t numSections, size_t expectedFrames)
+{
+    if (m_file)
+        fclose(m_file);
+
+    errno_t ret = fopen_s(&m_file, path.c_str(), "w");
+    if (ret != 0 || m_file == nullptr)
+    {
+        m_file = nullptr;
+        return false;
+    }
+
+    m_numSections = numSections;
+    m_frameMs.clear();
+    m_frameMs.reserve(expectedFrames);
+
+    fprintf(m_file, "frame,recorded ms,frame ms");
+    for (size_t s = 0; s < numSections; s++)
+        fprintf(m_file, ",%s ms", sectionNames[s]);
+    fprintf(m_file, "\n");
+    return true;
+}
+
+void ReplayTimings::AddFrame(uint32_t recordedMicroseconds, float milliseconds, const float* sectionMs)
+{
+    if (!m_file)
+        return;
+
+    fprintf(m_file, "%zu,%.3f,%.3f", m_frameMs.size(), recordedMicroseconds * 1e-3, milliseconds);
+    for (size_t s = 0; s < m_numSections; s++)
+        fprintf(m_file, ",%.3f", sectionMs[s]);
+    fprintf(m_file, "\n");
+
+    m_frameMs.push_back(milliseconds);
+}
+
+bool ReplayTimings::Finish(const std::string& logPath, const std::string& name)
+{
+    if (!m_file)
+        return false;
+
+    const bool written = ferror(m_file) == 0;
+    const bool closed = fclose(m_file) == 0;
+    m_file = nullptr;
+
+    FILE* pFile = nullptr;
+    errno_t ret = fopen_s(&pFile, logPath.c_str(), "a");
+    if (ret != 0 || pFile == nullptr)
+        return false;
+
+    // Nearest rank percentiles, as the stats overlay works them out
+    std::vector<float> sorted(m_frameMs);
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0.0;
+    for (float milliseconds : sorted)
+        total += milliseconds;
+
+    if (sorted.empty())
+        fprintf(pFile, "Replay %s: no frames\n", name.c_str());
+    else
+    {
+        const size_t frames = sorted.size();
+        const size_t p50 = std::min(frames - 1, (frames * 50 + 99) / 100 - 1);
+        const size_t p99 = std::min(frames - 1, (frames * 99 + 99) / 100 - 1);
+        fprintf(pFile, "Replay %s: %zu frames in %.1f ms, min %.2f, avg %.2f, p50 %.2f, p99 %.2f, max %.2f ms\n", name.c_str(), frames, total,
+                sorted.front(), total / frames, sorted[p50], sorted[p99], sorted.back());
+    }
+
+    const bool logged = ferror(pFile) == 0;
+    return fclose(pFile) == 0 && logged && written && closed;
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Recording of the editor's input, frame by frame, and of the editor commands between frames, so a session
+// can be replayed exactly to measure it again on another build.
+//
+// A frame is the mouse and keyboard state one Tick read. Replays feed one recorded frame to each Tick and
+// run the commands in between where they were, so the frames see the same input in the same order whatever
+// the timing: camera motion is per update, not per second, which makes the timestep fixed by construction.
+//
+// File: "WIR" and a version byte, then records, little endian.
+//     frame:   1, flags (1 mouse changed, 2 keys changed), microseconds since the last frame (u32),
+//              [x, y, scroll wheel (i32 each), buttons (u8), relative mode (u8)], [keys (32 bytes)]
+//     command: 2, id (u32), argument length (u16), argument bytes
+// Frames only store what changed since the frame before, a few bytes each while nothing is pressed.
+
+// Mouse and keyboard state in the layout DirectX::Mouse and DirectX::Keyboard report it
+struct InputFrame
+{
+    enum Buttons : uint8_t
+    {
+        BUTTON_LEFT = 1,
+        BUTTON_MIDDLE = 2,
+        BUTTON_RIGHT = 4,
+        BUTTON_X1 = 8,
+        BUTTON_X2 = 16,
+    };
+
+    static constexpr size_t KEY_BYTES = 32;		//a bit per virtual key
+
+    uint32_t	microseconds = 0;		//since the frame before, as recorded
+    int32_t		mouseX = 0;				//position, or motion in relative mode
+    int32_t		mouseY = 0;
+    int32_t		scrollWheel = 0;
+    uint8_t		buttons = 0;
+    uint8_t		relative = 0;			//mouse in relative mode
+    uint8_t		keys[KEY_BYTES] = {};
+};
+
+class InputRecorder
+{
+public:
+    struct Stats
+    {
+        size_t		frames = 0;
+        size_t		commands = 0;
+        uint64_t	bytes = 0;			//written so far, header included
+    };
+
+    ~InputRecorder();
+
+    bool Start(const std::string& path);			//replaces the file. false if it can't be created
+    bool Stop();									//false if anything failed to write
+    bool IsRecording() const { return m_file != nullptr; }
+
+    void RecordFrame(const InputFrame& frame);		//timestamps it, the microseconds given are ignored
+    void RecordCommand(uint32_t command, const std::string& argument = std::string());	//arguments up to 64 KB
+
+    const Stats& GetStats() const { return m_stats; }
+
+private:
+    void Write(const void* data, size_t bytes);
+
+    FILE*		m_file = nullptr;
+    InputFrame	m_last;					//delta base for the next frame
+    std::chrono::steady_clock::time_point	m_lastTime;
+    Stats		m_stats;
+};
+
+class InputReplay
+{
+public:
+    enum Record
+    {
+        RECORD_END,
+        RECORD_FRAME,
+        RECORD_COMMAND,
+    };
+
+    // Reads the whole recording. false if it can't be read or isn't one; a recording cut short ends early.
+    bool Open(const std::string& path);
+    void Close();
+    bool IsPlaying() const { return m_playing; }
+
+    size_t GetNumFrames() const { return m_numFrames; }
+    size_t GetFramesPlayed() const { return m_framesPlayed; }
+
+    // Moves on to the next record and returns what it is. RECORD_END stops playing.
+    Record Next();
+    const InputFrame& GetFrame() const { return m_frame; }		//after RECORD_FRAME
+    uint32_t GetCommand() const { return m_command; }			//after RECORD_COMMAND
+    const std::string& GetArgument() const { return m_argument; }
+
+private:
+    bool Read(void* data, size_t bytes);
+
+    std::vector<uint8_t>	m_data;
+    size_t			m_offset = 0;
+    bool			m_playing = false;
+    size_t			m_numFrames = 0;
+    size_t			m_framesPlayed = 0;
+    InputFrame		m_frame;
+    uint32_t		m_command = 0;
+    std::string		m_argument;
+};
+
+// Per frame timings of a replay as CSV, one row per frame, for comparing builds frame by frame
+class ReplayTimings
+{
+public:
+    ~ReplayTimings();
+
+    // Section names are profiler scopes, as the stats overlay times them
+    bool Open(const std::string& path, const char* const* sectionNames, size_t numSections, size_t expectedFrames);
+    void AddFrame(uint32_t recordedMicroseconds, float milliseconds, const float* sectionMs);
+
+    // Closes the CSV and adds a summary line to the end of a log, so runs can be compared at a glance
+    bool Finish(const std::string& logPath, const std::string& name);
+
+private:
+    FILE*				m_file = nullptr;
+    size_t				m_numSections = 0;
+    std::vector<float>	m_frameMs;
+};
@@ -0,0 +1,140 @@
+#include "InstanceBatcher.h"
+#include <algorithm>
+#include <cfloat>
+#include <map>
+#include <utility>
+
+namespace
+{
+    // Spreads the low 16 bits of v over the even bits of the result
+    uint32_t SpreadBits(uint32_t v)
+    {
+        v &= 0xFFFF;
+        v = (v | (v << 8)) & 0x00FF00FF;
+        v = (v | (v << 4)) & 0x0F0F0F0F;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    }
+
+    uint32_t Quantise(float value, float minValue, float scale)
+    {
+        return uint32_t(std::min(std::max((value - minValue) * scale, 0.f), 65535.f));
+    }
+}
+
+constexpr uint32_t InstanceBatcher::NOT_BATCHED;
+
+void InstanceBatcher::PackTransform(const float* world, float* packed)
+{
+    // Column c of the 4x3 part, top to bottom, so a shader gets world.c as dot(float4(position, 1), packed[c])
+    for (int column = 0; column < 3; column++)
+    {
+        for (int row = 0; row < 4; row++)
+            packed[(column * 4) + row] = world[(row * 4) + column];
+    }
+}
+
+void InstanceBatcher::Build(const uint64_t* models, const uint64_t* textures, const float* worlds, size_t count, const uint8_t* included)
+{
+    m_batches.clear();
+    m_batchOfObject.assign(count, NOT_BATCHED);
+    m_instanceOfObject.assign(count, NOT_BATCHED);
+
+    // Group, in order of first appearance
+    std::map<std::pair<uint64_t, uint64_t>, uint32_t> batchOfKey;
+    size_t numInstances = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (included && !included[i])
+            continue;
+
+        numInstances++;
+        auto inserted = batchOfKey.emplace(std::make_pair(models[i], textures[i]), uint32_t(m_batches.size()));
+        if (inserted.second)
+            m_batches.push_back({ models[i], textures[i], 0, 0, true });
+
+        m_batchOfObject[i] = inserted.first->second;
+        m_batches[inserted.first->second].numInstances++;
+    }
+
+    m_objectOfInstance.resize(numInstances);
+    m_instanceData.resize(numInstances * FLOATS_PER_INSTANCE);
+
+    uint32_t firstInstance = 0;
+    for (Batch& batch : m_batches)
+    {
+        batch.firstInstance = firstInstance;
+        firstInstance += batch.numInstances;
+    }
+
+    // Members in object order first, counting sort by batch
+    std::vector<uint32_t> nextInstance(m_batches.size());
+    for (size_t b = 0; b < m_batches.size(); b++)
+        nextInstance[b] = m_batches[b].firstInstance;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (m_batchOfObject[i] != NOT_BATCHED)
+            m_objectOfInstance[nextInstance[m_batchOfObject[i]]++] = uint32_t(i);
+    }
+
+    // Then along a Z-order curve over x and z within each batch
+    std::vector<std::pair<uint32_t, uint32_t>> codes;
+    for (const Batch& batch : m_batches)
+    {
+        uint32_t* members = &m_objectOfInstance[batch.firstInstance];
+        if (batch.numInstances > 2)
+        {
+            float minX = FLT_MAX, minZ = FLT_MAX, maxX = -FLT_MAX, maxZ = -FLT_MAX;
+            for (uint32_t m = 0; m < batch.numInstances; m++)
+            {
+                const float* world = worlds + (size_t(members[m]) * 16);
+                minX = std::min(minX, world[12]);
+                maxX = std::max(maxX, world[12]);
+                minZ = std::min(minZ, world[14]);
+                maxZ = std::max(maxZ, world[14]);
+            }
+
+            const float scaleX = maxX > minX ? 65535.f / (maxX - minX) : 0.f;
+            const float scaleZ = maxZ > minZ ? 65535.f / (maxZ - minZ) : 0.f;
+
+            codes.resize(batch.numInstances);
+            for (uint32_t m = 0; m < batch.numInstances; m++)
+            {
+                const float* world = worlds + (size_t(members[m]) * 16);
+                codes[m].first = SpreadBits(Quantise(world[12], minX, scaleX)) | (SpreadBits(Quantise(world[14], minZ, scaleZ)) << 1);
+                codes[m].second = members[m];
+            }
+
+            // Ties keep object order, the second element
+            std::sort(codes.begin(), codes.end());
+            for (uint32_t m = 0; m < batch.numInstances; m++)
+                members[m] = codes[m].second;
+        }
+
+        for (uint32_t m = 0; m < batch.numInstances; m++)
+        {
+            const uint32_t instance = batch.firstInstance + m;
+            m_instanceOfObject[members[m]] = instance;
+            PackTransform(worlds + (size_t(members[m]) * 16), &m_instanceData[instance * FLOATS_PER_INSTANCE]);
+        }
+    }
+}
+
+bool InstanceBatcher::SetTransform(uint32_t object, const float* world)
+{
+    if (m_batchOfObject[object] == NOT_BATCHED)
+        return false;
+
+    float packed[FLOATS_PER_INSTANCE];
+    PackTransform(world, packed);
+
+    float* instanceData = &m_instanceData[m_instanceOfObject[object] * FLOATS_PER_INSTANCE];
+    if (std::equal(packed, packed + FLOATS_PER_INSTANCE, instanceData))
+        return false;
+
+    std::copy(packed, packed + FLOATS_PER_INSTANCE, instanceData);
+    m_batches[m_batchOfObject[object]].dirty = true;
+    return true;
+}
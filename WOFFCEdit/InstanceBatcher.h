@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Groups objects sharing a model and diffuse texture into instance batches, so each pair is drawn
+// with one instanced call instead of one call per object.
+//
+// The world transforms of all instances are packed into a single array, batch after batch, ready to
+// be copied into a per-instance vertex buffer. Each instance takes three float4s: the columns of its
+// 4x3 row-vector world matrix (the constant fourth column is dropped). A batch is only flagged dirty
+// when one of its members actually moves, so static scenes upload their transforms once.
+//
+// Members of a batch are ordered along a Z-order curve over their positions, so nearby objects are
+// next to each other in the buffer. Objects culled together then leave few gaps, and the visible
+// members of a batch can be drawn as a handful of contiguous instance ranges.
+class InstanceBatcher
+{
+public:
+    static constexpr size_t FLOATS_PER_INSTANCE = 12;
+    static constexpr uint32_t NOT_BATCHED = UINT32_MAX;
+
+    struct Batch
+    {
+        uint64_t	model;			//grouping keys, as given to Build
+        uint64_t	texture;
+        uint32_t	firstInstance;	//into the instance data and the member list
+        uint32_t	numInstances;
+        bool		dirty;			//transforms changed since ClearDirty
+    };
+
+    // Contiguous range of instances, relative to the start of the instance data
+    struct Range
+    {
+        uint32_t	firstInstance;
+        uint32_t	numInstances;
+    };
+
+    // Groups count objects. worlds holds a 4x4 row major, row-vector world matrix (16 floats) per object.
+    // Batches come out in order of first appearance, and every batch starts dirty. Objects with a zero in
+    // 'included', when given, are left out: their batch and instance are NOT_BATCHED.
+    void Build(const uint64_t* models, const uint64_t* textures, const float* worlds, size_t count, const uint8_t* included = nullptr);
+
+    // Repacks the world matrix of a batched object. Returns true, and dirties its batch, only if it changed.
+    bool SetTransform(uint32_t object, const float* world);
+
+    // Appends the ranges of instances in a batch whose objects are visible (non zero), merging neighbours
+    template<class Allocator>
+    void GetVisibleRanges(uint32_t batch, const uint8_t* objectVisible, std::vector<Range, Allocator>& ranges) const;
+
+    void ClearDirty(uint32_t batch) { m_batches[batch].dirty = false; }
+
+    size_t GetNumBatches() const { return m_batches.size(); }
+    const Batch& GetBatch(uint32_t batch) const { return m_batches[batch]; }
+    uint32_t GetBatchOfObject(uint32_t object) const { return m_batchOfObject[object]; }
+    uint32_t GetInstanceOfObject(uint32_t object) const { return m_instanceOfObject[object]; }
+    uint32_t GetObjectOfInstance(uint32_t instance) const { return m_objectOfInstance[instance]; }
+
+    size_t GetNumInstances() const { return m_objectOfInstance.size(); }
+    const float* GetInstanceData() const { return m_instanceData.data(); }
+
+    // Packs a 4x4 row-vector matrix into the three float4s of an instance
+    static void PackTransform(const float* world, float* packed);
+
+private:
+    std::vector<Batch>		m_batches;
+    std::vector<uint32_t>	m_batchOfObject;
+    std::vector<uint32_t>	m_instanceOfObject;
+    std::vector<uint32_t>	m_objectOfInstance;
+    std::vector<float>		m_instanceData;		//FLOATS_PER_INSTANCE per instance
+};
+
+template<class Allocator>
+void InstanceBatcher::GetVisibleRanges(uint32_t batch, const uint8_t* objectVisible, std::vector<Range, Allocator>& ranges) const
+{
+    const Batch& b = m_batches[batch];
+    const uint32_t endInstance = b.firstInstance + b.numInstances;
+    const size_t firstRange = ranges.size();
+
+    for (uint32_t instance = b.firstInstance; instance < endInstance; instance++)
+    {
+        if (!objectVisible[m_objectOfInstance[instance]])
+            continue;
+
+        if (ranges.size() > firstRange && ranges.back().firstInstance + ranges.back().numInstances == instance)
+            ranges.back().numInstances++;
+        else
+            ranges.push_back({ instance, 1 });
+    }
+}
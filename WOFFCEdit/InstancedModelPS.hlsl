@@ -0,0 +1,18 @@
+// Pixel shader for instanced model drawing, BasicEffect's textured vertex lit output
+
+Texture2D<float4> Texture : register(t0);
+sampler Sampler : register(s0);
+
+struct PSInput
+{
+    float4 Diffuse : COLOR0;
+    float4 Specular : COLOR1;
+    float2 TexCoord : TEXCOORD0;
+};
+
+float4 main(PSInput pin) : SV_Target0
+{
+    float4 color = Texture.Sample(Sampler, pin.TexCoord) * pin.Diffuse;
+    color.rgb += pin.Specular.rgb * color.a;
+    return color;
+}
@@ -0,0 +1,76 @@
+// Vertex shader for instanced model drawing. Matches BasicEffect's textured vertex lighting, with the
+// world matrix coming from a per-instance vertex stream instead of a constant buffer.
+
+cbuffer FrameConstants : register(b0)
+{
+    float4x4 ViewProjection;
+    float3 EyePosition;
+    float3 LightDirection[3];
+    float3 LightDiffuseColor[3];
+    float3 LightSpecularColor[3];
+};
+
+cbuffer MaterialConstants : register(b1)
+{
+    float4 DiffuseColor;
+    float3 EmissiveColor;		//includes ambient light * diffuse, as in BasicEffect
+    float SpecularPower;
+    float3 SpecularColor;
+};
+
+struct VSInput
+{
+    float4 Position : SV_Position;
+    float3 Normal : NORMAL;
+    float2 TexCoord : TEXCOORD0;
+    float4 World0 : WORLD0;		//columns of the 4x3 row-vector world matrix
+    float4 World1 : WORLD1;
+    float4 World2 : WORLD2;
+};
+
+struct VSOutput
+{
+    float4 Diffuse : COLOR0;
+    float4 Specular : COLOR1;
+    float2 TexCoord : TEXCOORD0;
+    float4 PositionPS : SV_Position;
+};
+
+VSOutput main(VSInput vin)
+{
+    VSOutput vout;
+
+    const float4 position = float4(vin.Position.xyz, 1);
+    const float3 positionWS = float3(dot(position, vin.World0), dot(position, vin.World1), dot(position, vin.World2));
+
+    // Normals go through the cofactor matrix of the linear part, which is the inverse transpose up to
+    // scale, so non uniform scales light correctly without a second matrix per instance
+    const float3 rowX = float3(vin.World0.x, vin.World1.x, vin.World2.x);
+    const float3 rowY = float3(vin.World0.y, vin.World1.y, vin.World2.y);
+    const float3 rowZ = float3(vin.World0.z, vin.World1.z, vin.World2.z);
+    const float3 normalWS = normalize((vin.Normal.x * cross(rowY, rowZ)) + (vin.Normal.y * cross(rowZ, rowX)) + (vin.Normal.z * cross(rowX, rowY)))
+                          * sign(dot(rowX, cross(rowY, rowZ)));
+
+    const float3 eyeVector = normalize(EyePosition - positionWS);
+
+    float3 diffuse = 0;
+    float3 specular = 0;
+
+    [unroll]
+    for (int i = 0; i < 3; i++)
+    {
+        const float dotL = dot(-LightDirection[i], normalWS);
+        const float zeroL = step(0, dotL);
+        const float dotH = dot(normalize(eyeVector - LightDirection[i]), normalWS);
+
+        diffuse += zeroL * dotL * LightDiffuseColor[i];
+        specular += pow(max(dotH, 0) * zeroL, SpecularPower) * dotL * LightSpecularColor[i];
+    }
+
+    vout.PositionPS = mul(float4(positionWS, 1), ViewProjection);
+    vout.Diffuse = float4((diffuse * DiffuseColor.rgb) + EmissiveColor, DiffuseColor.a);
+    vout.Specular = float4(specular * SpecularColor, 0);
+    vout.TexCoord = vin.TexCoord;
+
+    return vout;
+}
@@ -0,0 +1,594 @@
+#include "JobSystem.h"
+#include "Profiler.h"
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// What the implementation needs of the classes' private parts
+struct JobSystemInternal
+{
+    typedef JobSystem::Job Job;
+
+    // The job's work is done. The group can be gone as soon as its count drops.
+    static void Finish(JobGroup& group, std::exception_ptr exception)
+    {
+        if (exception && !group.m_failed.exchange(true, std::memory_order_relaxed))
+            group.m_exception = exception;
+        group.m_pending.fetch_sub(1, std::memory_order_release);
+    }
+};
+
+namespace
+{
+    typedef JobSystemInternal::Job Job;
+
+    constexpr size_t JOBS_PER_BLOCK = 64;		//jobs a thread's pool grows by
+    constexpr int SPINS_BEFORE_SLEEP = 64;		//empty searches a worker makes, yielding, before it sleeps
+    constexpr int EXTERNAL_THREAD = -1;
+
+    static_assert((JobSystem::DEQUE_CAPACITY & (JobSystem::DEQUE_CAPACITY - 1)) == 0, "deque indices wrap with a mask");
+
+    // Chase-Lev deque over a fixed ring, after Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models".
+    // The owner pushes and pops at the bottom, thieves take from the top; only the last job is contended.
+    struct JobDeque
+    {
+        std::atomic<int64_t>	top;
+        std::atomic<int64_t>	bottom;
+        std::atomic<void*>		slots[JobSystem::DEQUE_CAPACITY];
+
+        JobDeque() : top(0), bottom(0) {}
+
+        bool Push(void* job)
+        {
+            const int64_t b = bottom.load(std::memory_order_relaxed);
+            const int64_t t = top.load(std::memory_order_acquire);
+            if (b - t >= int64_t(JobSystem::DEQUE_CAPACITY))
+                return false;
+
+            slots[b & (JobSystem::DEQUE_CAPACITY - 1)].store(job, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_release);
+            return true;
+        }
+
+        void* Pop()
+        {
+            const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+
+            void* job = nullptr;
+            if (t <= b)
+            {
+                job = slots[b & (JobSystem::DEQUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+                if (t == b)
+                {
+                    // The last job, which a thief may be taking too
+                    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                        job = nullptr;
+                    bottom.store(b + 1, std::memory_order_relaxed);
+                }
+            }
+            else
+                bottom.store(b + 1, std::memory_order_relaxed);
+            return job;
+        }
+
+        void* Steal()
+        {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b)
+                return nullptr;
+
+            void* job = slots[t & (JobSystem::DEQUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return nullptr;		//lost to the owner or another thief
+            return job;
+        }
+
+        bool IsEmpty() const
+        {
+            return top.load(std::memory_order_relaxed) >= bottom.load(std::memory_order_relaxed);
+        }
+    };
+
+    // What the main thread and every worker own
+    struct ThreadState
+    {
+        JobDeque				deque;
+        Job*					freeJobs = nullptr;			//owner only
+        std::atomic<Job*>		returnedJobs;				//freed by other threads, taken back by the owner all at once
+        std::vector<std::unique_ptr<Job[]>>	blocks;			//owner only
+        uint32_t				random = 0;					//victim choice
+        std::atomic<uint64_t>	jobs;
+        std::atomic<uint64_t>	steals;
+        std::atomic<uint64_t>	sleeps;
+
+        ThreadState() : returnedJobs(nullptr), jobs(0), steals(0), sleeps(0) {}
+    };
+
+    struct System
+    {
+        std::vector<std::unique_ptr<ThreadState>>	threads;	//the main thread first
+        std::vector<std::thread>	workers;
+        std::atomic<bool>			stopping;
+        bool						shutDown = false;			//Start() may start it again
+
+        // Sleeping workers. 'epoch' changes whenever work is added, so a wakeup between a worker's last look and
+        // its wait isn't lost.
+        std::mutex					sleepMutex;
+        std::condition_variable		sleepCondition;
+        std::atomic<int>			sleepers;
+        uint64_t					epoch = 0;
+
+        // Jobs from threads that aren't part of the system
+        std::mutex					externalMutex;
+        std::deque<Job*>			externalJobs;
+        std::atomic<size_t>			numExternalJobs;
+
+        // Jobs for the main thread; pumping swaps the lists, so neither allocates once grown
+        std::mutex					mainMutex;
+        std::vector<Job*>			mainJobs;
+        std::vector<Job*>			mainRunning;				//main thread only
+        void						(*mainWake)(void*) = nullptr;
+        void*						mainWakeUser = nullptr;
+        std::atomic<uint64_t>		mainThreadJobs;
+
+        System() : stopping(false), sleepers(0), numExternalJobs(0), mainThreadJobs(0) {}
+        ~System() { JobSystem::Shutdown(); }
+    };
+
+    std::mutex s_startMutex;		//before s_system, which shuts down on destruction
+    System s_system;
+    std::atomic<bool> s_started(false);
+    thread_local int t_thread = EXTERNAL_THREAD;		//index into s_system.threads
+
+    void EnsureStarted()
+    {
+        if (!s_started.load(std::memory_order_acquire))
+            JobSystem::Start();
+    }
+
+    uint32_t NextRandom(uint32_t& state)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    void FreeJob(Job* job)
+    {
+        if (job->owner == EXTERNAL_THREAD)
+        {
+            delete job;
+            return;
+        }
+
+        ThreadState& owner = *s_system.threads[job->owner];
+        if (job->owner == t_thread)
+        {
+            job->next = owner.freeJobs;
+            owner.freeJobs = job;
+            return;
+        }
+
+        // Only the owner takes returned jobs, and all of them at once, so pushing can't suffer from ABA
+        Job* head = owner.returnedJobs.load(std::memory_order_relaxed);
+        do
+        {
+            job->next = head;
+        } while (!owner.returnedJobs.compare_exchange_weak(head, job, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    void Execute(Job* job)
+    {
+        JobGroup* group = job->group;
+        std::exception_ptr exception;
+        try
+        {
+            job->invoke(job);
+        }
+        catch (...)
+        {
+            exception = std::current_exception();
+        }
+        FreeJob(job);
+
+        if (t_thread != EXTERNAL_THREAD)
+            s_system.threads[t_thread]->jobs.fetch_add(1, std::memory_order_relaxed);
+
+        if (group)
+            JobSystemInternal::Finish(*group, exception);
+    }
+
+    void WakeWorker()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (s_system.sleepers.load(std::memory_order_relaxed) == 0)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(s_system.sleepMutex);
+            s_system.epoch++;
+        }
+        s_system.sleepCondition.notify_one();
+    }
+
+    Job* TakeExternalJob()
+    {
+        if (s_system.numExternalJobs.load(std::memory_order_relaxed) == 0)
+            return nullptr;
+
+        std::lock_guard<std::mutex> lock(s_system.externalMutex);
+        if (s_system.externalJobs.empty())
+            return nullptr;
+
+        Job* job = s_system.externalJobs.front();
+        s_system.externalJobs.pop_front();
+        s_system.numExternalJobs.fetch_sub(1, std::memory_order_relaxed);
+        return job;
+    }
+
+    // Runs one job from the thread's own deque, the external queue or another thread's deque
+    bool RunOneJob(int thread)
+    {
+        ThreadState& self = *s_system.threads[thread];
+        Job* job = static_cast<Job*>(self.deque.Pop());
+        if (!job)
+            job = TakeExternalJob();
+
+        if (!job)
+        {
+            const size_t count = s_system.threads.size();
+            const size_t first = NextRandom(self.random) % count;
+            for (size_t v = 0; v < count && !job; v++)
+            {
+                const size_t victim = (first + v) % count;
+                if (victim != size_t(thread))
+                    job = static_cast<Job*>(s_system.threads[victim]->deque.Steal());
+            }
+            if (job)
+                self.steals.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (!job)
+            return false;
+
+        Execute(job);
+        return true;
+    }
+
+    bool AnyWork()
+    {
+        if (s_system.numExternalJobs.load(std::memory_order_relaxed) > 0)
+            return true;
+
+        for (const auto& thread : s_system.threads)
+        {
+            if (!thread->deque.IsEmpty())
+                return true;
+        }
+        return false;
+    }
+
+    void WorkerMain(int thread)
+    {
+        t_thread = thread;
+
+        char name[32];
+        snprintf(name, sizeof(name), "Job worker %d", thread);
+        Profiler::SetThreadName(name);
+
+        ThreadState& self = *s_system.threads[thread];
+        int idle = 0;
+        while (!s_system.stopping.load(std::memory_order_relaxed))
+        {
+            if (RunOneJob(thread))
+            {
+                idle = 0;
+                continue;
+            }
+
+            if (++idle < SPINS_BEFORE_SLEEP)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // Announce the sleep before the last look for work, so a thread adding work either sees a sleeper to
+            // wake or had its work seen here
+            std::unique_lock<std::mutex> lock(s_system.sleepMutex);
+            s_system.sleepers.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!AnyWork() && !s_system.stopping.load(std::memory_order_relaxed))
+            {
+                const uint64_t epoch = s_system.epoch;
+                self.sleeps.fetch_add(1, std::memory_order_relaxed);
+                s_system.sleepCondition.wait(lock, [epoch]() { return s_system.epoch != epoch || s_system.stopping.load(std::memory_order_relaxed); });
+            }
+            s_system.sleepers.fetch_sub(1, std::memory_order_relaxed);
+            idle = 0;
+        }
+
+        // Whatever is left in this deque still has to run, others may be waiting on it
+        while (Job* job = static_cast<Job*>(self.deque.Pop()))
+            Execute(job);
+    }
+}
+
+constexpr size_t JobSystem::JOB_STORAGE;
+constexpr size_t JobSystem::DEQUE_CAPACITY;
+constexpr size_t JobSystem::CHUNKS_PER_THREAD;
+
+void JobSystem::Start(size_t workers)
+{
+    std::lock_guard<std::mutex> lock(s_startMutex);
+    if (s_started.load(std::memory_order_relaxed) && !s_system.shutDown)
+        return;
+
+    if (workers == SIZE_MAX)
+        workers = std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+    // A restart keeps the main thread's state, and the jobs in its pool
+    for (size_t t = s_system.threads.size(); t <= workers; t++)
+    {
+        s_system.threads.emplace_back(new ThreadState);
+        s_system.threads.back()->random = uint32_t(t * 2654435761u) | 1;
+    }
+    s_system.stopping = false;
+    s_system.shutDown = false;
+
+    t_thread = 0;
+    for (size_t t = 1; t <= workers; t++)
+        s_system.workers.emplace_back(WorkerMain, int(t));
+
+    s_started.store(true, std::memory_order_release);
+}
+
+void JobSystem::Shutdown()
+{
+    std::lock_guard<std::mutex> lock(s_startMutex);
+    s_system.shutDown = true;
+    if (s_system.workers.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(s_system.sleepMutex);
+        s_system.stopping = true;
+        s_system.epoch++;
+    }
+    s_system.sleepCondition.notify_all();
+
+    for (std::thread& worker : s_system.workers)
+        worker.join();
+    s_system.workers.clear();
+
+    // Only the main thread's state stays, so whatever is still queued runs now, main thread work included. Jobs
+    // from then on run where they are submitted.
+    if (!s_system.threads.empty())
+    {
+        while (Job* job = static_cast<Job*>(s_system.threads[0]->deque.Pop()))
+            Execute(job);
+        while (Job* job = TakeExternalJob())
+            Execute(job);
+        while (PumpMainThread() > 0)
+            ;
+        s_system.threads.resize(1);
+    }
+}
+
+size_t JobSystem::GetNumThreads()
+{
+    EnsureStarted();
+    return s_system.workers.size() + 1;
+}
+
+bool JobSystem::IsMainThread()
+{
+    EnsureStarted();
+    return t_thread == 0;
+}
+
+size_t JobSystem::PumpMainThread()
+{
+    if (t_thread != 0)
+        return 0;
+
+    {
+        std::lock_guard<std::mutex> lock(s_system.mainMutex);
+        if (s_system.mainJobs.empty())
+            return 0;
+        s_system.mainJobs.swap(s_system.mainRunning);
+    }
+
+    const size_t count = s_system.mainRunning.size();
+    for (Job* job : s_system.mainRunning)
+        Execute(job);
+    s_system.mainRunning.clear();
+
+    s_system.mainThreadJobs.fetch_add(count, std::memory_order_relaxed);
+    return count;
+}
+
+void JobSystem::SetMainThreadWake(void (*wake)(void* user), void* user)
+{
+    std::lock_guard<std::mutex> lock(s_system.mainMutex);
+    s_system.mainWake = wake;
+    s_system.mainWakeUser = user;
+}
+
+JobSystem::Stats JobSystem::GetStats()
+{
+    Stats stats;
+    for (const auto& thread : s_system.threads)
+    {
+        stats.jobs += thread->jobs.load(std::memory_order_relaxed);
+        stats.steals += thread->steals.load(std::memory_order_relaxed);
+        stats.sleeps += thread->sleeps.load(std::memory_order_relaxed);
+    }
+    stats.mainThreadJobs = s_system.mainThreadJobs.load(std::memory_order_relaxed);
+    return stats;
+}
+
+JobSystem::Job* JobSystem::AllocateJob()
+{
+    EnsureStarted();
+    if (t_thread == EXTERNAL_THREAD)
+    {
+        Job* job = new Job;
+        job->owner = EXTERNAL_THREAD;
+        return job;
+    }
+
+    ThreadState& self = *s_system.threads[t_thread];
+    if (!self.freeJobs)
+        self.freeJobs = self.returnedJobs.exchange(nullptr, std::memory_order_acquire);
+
+    if (!self.freeJobs)
+    {
+        self.blocks.emplace_back(new Job[JOBS_PER_BLOCK]);
+        Job* block = self.blocks.back().get();
+        for (size_t j = 0; j < JOBS_PER_BLOCK; j++)
+        {
+            block[j].owner = t_thread;
+            block[j].next = j + 1 < JOBS_PER_BLOCK ? &block[j + 1] : nullptr;
+        }
+        self.freeJobs = block;
+    }
+
+    Job* job = self.freeJobs;
+    self.freeJobs = job->next;
+    return job;
+}
+
+void JobSystem::Submit(Job* job)
+{
+    // Without workers nothing would ever take it
+    if (s_system.workers.empty())
+    {
+        Execute(job);
+        return;
+    }
+
+    if (t_thread == EXTERNAL_THREAD)
+    {
+        {
+            std::lock_guard<std::mutex> lock(s_system.externalMutex);
+            s_system.externalJobs.push_back(job);
+            s_system.numExternalJobs.fetch_add(1, std::memory_order_relaxed);
+        }
+        WakeWorker();
+        return;
+    }
+
+    if (!s_system.threads[t_thread]->deque.Push(job))
+    {
+        Execute(job);
+        return;
+    }
+    WakeWorker();
+}
+
+void JobSystem::SubmitToMainThread(Job* job)
+{
+    if (t_thread == 0)
+    {
+        Execute(job);
+        return;
+    }
+
+    void (*wake)(void*);
+    void* user;
+    {
+        std::lock_guard<std::mutex> lock(s_system.mainMutex);
+        s_system.mainJobs.push_back(job);
+        wake = s_system.mainWake;
+        user = s_system.mainWakeUser;
+    }
+
+    if (wake)
+        wake(user);
+}
+
+void JobSystem::Wait(JobGroup& group)
+{
+    while (!group.IsDone())
+    {
+        if (t_thread == EXTERNAL_THREAD)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // The group may be waiting on main thread work, which only the main thread can run
+        if (!RunOneJob(t_thread) && PumpMainThread() == 0)
+            std::this_thread::yield();
+    }
+}
+
+void JobGroup::Wait()
+{
+    JobSystem::Wait(*this);
+
+    if (m_failed.load(std::memory_order_acquire))
+    {
+        m_failed = false;
+        std::rethrow_exception(std::move(m_exception));
+    }
+}
+
+JobGraph::Node JobGraph::Add(std::function<void()> function)
+{
+    m_vertices.emplace_back(new Vertex);
+    m_vertices.back()->function = std::move(function);
+    return m_vertices.size() - 1;
+}
+
+void JobGraph::Precede(Node before, Node after)
+{
+    m_vertices[before]->successors.push_back(after);
+    m_vertices[after]->predecessors++;
+}
+
+void JobGraph::Run()
+{
+    for (auto& vertex : m_vertices)
+        vertex->waiting = vertex->predecessors;
+
+    JobGroup group;
+    for (Node node = 0; node < m_vertices.size(); node++)
+    {
+        if (m_vertices[node]->predecessors == 0)
+            Start(node, group);
+    }
+    group.Wait();
+}
+
+void JobGraph::Start(Node node, JobGroup& group)
+{
+    group.Run([this, node, &group]()
+    {
+        // Successors start even if this node throws, so the graph always finishes
+        struct Release
+        {
+            JobGraph* graph;
+            Node node;
+            JobGroup& group;
+            ~Release()
+            {
+                for (Node successor : graph->m_vertices[node]->successors)
+                {
+                    if (graph->m_vertices[successor]->waiting.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                        graph->Start(successor, group);
+                }
+            }
+        } release = { this, node, group };
+
+        m_vertices[node]->function();
+    });
+}
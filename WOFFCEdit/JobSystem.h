@@ -0,0 +1,224 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class JobGroup;
+struct JobSystemInternal;
+
+// Work-stealing job system shared by the editor's subsystems.
+//
+// Every worker thread, and the main thread, owns a deque of jobs. The owner pushes and pops at one end and idle
+// threads steal from the other, so work spreads out without a central queue to contend on. A thread waiting for
+// jobs runs other jobs meanwhile, which makes nested parallel loops safe. Jobs are fixed size blocks recycled per
+// thread, so frames that schedule the same work every time don't touch the heap.
+//
+// Work that has to happen on the main thread, D3D context calls and MFC, is queued with RunOnMainThread() and runs
+// when the main thread pumps: from its message loop, or while it waits for jobs itself.
+//
+//     JobSystem::ParallelFor(size_t(0), tiles.size(), [&](size_t t)
+//     {
+//         ErodeTile(tiles[t]);
+//     });
+//
+// Jobs may throw: the first exception a group's jobs throw is rethrown by its Wait(), and ParallelFor rethrows.
+class JobSystem
+{
+public:
+    static constexpr size_t JOB_STORAGE = 96;			//bytes a job's function object may take, captures included
+    static constexpr size_t DEQUE_CAPACITY = 4096;		//jobs queued per thread, past that they run right away
+    static constexpr size_t CHUNKS_PER_THREAD = 8;		//parallel loops are split this finely, to even out uneven iterations
+
+    struct Stats
+    {
+        uint64_t	jobs = 0;			//run since the start
+        uint64_t	steals = 0;			//of those, taken from another thread's deque
+        uint64_t	sleeps = 0;			//times a worker ran out of work and slept
+        uint64_t	mainThreadJobs = 0;	//run by PumpMainThread
+    };
+
+    // Starts a worker per core besides the calling thread, which becomes the main thread, or 'workers' of them.
+    // Optional, the first use starts the system from whichever thread makes it. After Shutdown(), starts it again.
+    static void Start(size_t workers = SIZE_MAX);
+    static void Shutdown();							//lets the workers finish their jobs and joins them. Jobs from then on run where they are submitted
+
+    static size_t GetNumThreads();					//workers and the main thread
+    static bool IsMainThread();
+
+    // function(i) for every i in [first, last), across all threads, returning when all are done
+    template<class Index, class Function>
+    static void ParallelFor(Index first, Index last, const Function& function);
+
+    // Queues a job for the main thread's next pump, counted in 'group' if there is one. On the main thread it
+    // runs right away.
+    template<class Function>
+    static void RunOnMainThread(Function&& function, JobGroup* group = nullptr);
+
+    static size_t PumpMainThread();					//runs the jobs queued for the main thread, on it, in the order they were queued. Returns how many ran
+    static void SetMainThreadWake(void (*wake)(void* user), void* user);	//called when main thread work is queued, to wake its message loop
+
+    static Stats GetStats();
+
+private:
+    friend class JobGroup;
+    friend struct JobSystemInternal;
+
+    struct Job
+    {
+        void		(*invoke)(Job* job);	//runs the function object and destroys it
+        JobGroup*	group;
+        Job*		next;					//in free lists
+        int			owner;					//thread whose pool it came from, -1 for the heap
+        alignas(std::max_align_t) unsigned char	storage[JOB_STORAGE];
+    };
+
+    template<class Function>
+    static void Invoke(Job* job)
+    {
+        Function& function = *reinterpret_cast<Function*>(job->storage);
+        struct Destroy
+        {
+            Function& function;
+            ~Destroy() { function.~Function(); }
+        } destroy = { function };
+        function();
+    }
+
+    template<class Function>
+    static Job* MakeJob(Function&& function, JobGroup* group)
+    {
+        typedef typename std::decay<Function>::type Stored;
+        static_assert(sizeof(Stored) <= JOB_STORAGE, "job captures too much, capture by reference or a pointer to the data");
+        static_assert(alignof(Stored) <= alignof(std::max_align_t), "job function is overaligned");
+
+        Job* job = AllocateJob();
+        new (job->storage) Stored(std::forward<Function>(function));
+        job->invoke = &Invoke<Stored>;
+        job->group = group;
+        return job;
+    }
+
+    static Job* AllocateJob();
+    static void Submit(Job* job);
+    static void SubmitToMainThread(Job* job);
+    static void Wait(JobGroup& group);				//runs jobs until the group's are done
+};
+
+// Jobs that can be waited for together, like concurrency::task_group
+class JobGroup
+{
+public:
+    JobGroup() : m_pending(0), m_failed(false) {}
+    ~JobGroup() { JobSystem::Wait(*this); }
+
+    JobGroup(const JobGroup&) = delete;
+    JobGroup& operator=(const JobGroup&) = delete;
+
+    template<class Function>
+    void Run(Function&& function)
+    {
+        m_pending.fetch_add(1, std::memory_order_relaxed);
+        JobSystem::Submit(JobSystem::MakeJob(std::forward<Function>(function), this));
+    }
+
+    // Runs other jobs until this group's are done, then rethrows the first exception one of them threw
+    void Wait();
+
+    bool IsDone() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+    friend struct JobSystemInternal;
+
+    std::atomic<int>	m_pending;		//jobs queued or running
+    std::atomic<bool>	m_failed;		//a job threw, m_exception is set
+    std::exception_ptr	m_exception;
+};
+
+// Jobs with dependencies between them. Nodes run once all the nodes before them have; Run() starts the
+// nodes that depend on nothing and returns when every node has run.
+//
+//     JobGraph graph;
+//     const JobGraph::Node heights = graph.Add([&]() { ErodeHeights(); });
+//     const JobGraph::Node normals = graph.Add([&]() { CalculateNormals(); });
+//     graph.Precede(heights, normals);
+//     graph.Run();
+class JobGraph
+{
+public:
+    typedef size_t Node;
+
+    Node Add(std::function<void()> function);
+    void Precede(Node before, Node after);		//'after' waits for 'before'
+
+    // Runs every node once, rethrowing the first exception one threw. Nodes after one that threw still run.
+    void Run();
+
+private:
+    struct Vertex
+    {
+        std::function<void()>	function;
+        std::vector<Node>		successors;
+        int						predecessors = 0;
+        std::atomic<int>		waiting;		//predecessors yet to run, during Run()
+    };
+
+    void Start(Node node, JobGroup& group);
+
+    std::vector<std::unique_ptr<Vertex>>	m_vertices;
+};
+
+template<class Index, class Function>
+void JobSystem::ParallelFor(Index first, Index last, const Function& function)
+{
+    if (!(first < last))
+        return;
+
+    const size_t count = size_t(last - first);
+    const size_t threads = GetNumThreads();
+    if (count == 1 || threads == 1)
+    {
+        for (Index i = first; i < last; ++i)
+            function(i);
+        return;
+    }
+
+    // Threads claim chunks of indices from a shared counter until none are left. Helpers that start late find
+    // nothing and return, while the calling thread works through whatever isn't taken.
+    const size_t chunk = std::max<size_t>(1, count / (threads * CHUNKS_PER_THREAD));
+    const size_t chunks = (count + chunk - 1) / chunk;
+    std::atomic<size_t> next(0);
+    auto claim = [&]()
+    {
+        for (size_t start = next.fetch_add(chunk, std::memory_order_relaxed); start < count; start = next.fetch_add(chunk, std::memory_order_relaxed))
+        {
+            const size_t end = std::min(start + chunk, count);
+            for (size_t i = start; i < end; i++)
+                function(Index(first + Index(i)));
+        }
+    };
+
+    JobGroup group;
+    const size_t helpers = std::min(threads, chunks) - 1;
+    for (size_t h = 0; h < helpers; h++)
+        group.Run([&claim]() { claim(); });
+
+    claim();
+    group.Wait();
+}
+
+template<class Function>
+void JobSystem::RunOnMainThread(Function&& function, JobGroup* group)
+{
+    if (group)
+        group->m_pending.fetch_add(1, std::memory_order_relaxed);
+    SubmitToMainThread(MakeJob(std::forward<Function>(function), group));
+}
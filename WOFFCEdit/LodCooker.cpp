@@ -0,0 +1,173 @@
+#include "LodCooker.h"
+#include "CmoFile.h"
+#include "MeshSimplifier.h"
+#include "Platform.h"
+#include "Profiler.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <chrono>
+#include <set>
+
+namespace
+{
+    constexpr float FIRST_LEVEL_ERROR = 0.01f;		//of a submesh's size, doubling every level
+    constexpr float MIN_REDUCTION = 0.85f;			//a level keeping more of the triangles before isn't worth drawing
+    constexpr size_t ATTRIBUTE_COUNT = 5;			//normal and texcoord
+}
+
+constexpr size_t LodCooker::MAX_LEVELS;
+
+std::string LodCooker::LodPath(const std::string& path, size_t level)
+{
+    const size_t dot = path.find_last_of('.');
+    const size_t slash = path.find_last_of("/\\");
+    const size_t split = dot != std::string::npos && (slash == std::string::npos || dot > slash) ? dot : path.size();
+    return path.substr(0, split) + "_lod" + std::to_string(level) + path.substr(split);
+}
+
+void LodCooker::Cook(const std::vector<std::string>& paths, bool force)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    const std::set<std::string> distinct(paths.begin(), paths.end());
+    const std::vector<std::string> assets(distinct.begin(), distinct.end());
+
+    std::vector<AssetStats> results(assets.size());
+    JobSystem::ParallelFor(size_t(0), assets.size(), [&](size_t i)
+    {
+        results[i] = CookAsset(assets[i], force);
+    });
+
+    m_stats = Stats();
+    m_stats.assets = assets.size();
+    for (const AssetStats& result : results)
+    {
+        switch (result.result)
+        {
+        case RESULT_COOKED:		m_stats.cooked++;	break;
+        case RESULT_UP_TO_DATE:	m_stats.upToDate++;	break;
+        case RESULT_FAILED:		m_stats.failed++;	break;
+        }
+
+        m_stats.levels += result.levels;
+        m_stats.trianglesIn += result.trianglesIn;
+        m_stats.trianglesOut += result.trianglesOut;
+    }
+    m_stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+LodCooker::AssetStats LodCooker::CookAsset(const std::string& path, bool force)
+{
+    PROFILE_SCOPE("Cook model");
+    AssetStats stats;
+
+    const int64_t sourceTime = Platform::FileTime(path);
+    if (sourceTime < 0)
+        return stats;
+
+    if (!force && Platform::FileTime(LodPath(path, 1)) >= sourceTime)
+    {
+        stats.result = RESULT_UP_TO_DATE;
+        return stats;
+    }
+
+    CmoFile model;
+    if (!model.Read(path))
+        return stats;
+
+    // Normals and texcoords keep split vertices apart, per vertex buffer of every mesh
+    std::vector<std::vector<std::vector<float>>> attributes(model.meshes.size());
+    for (size_t m = 0; m < model.meshes.size(); m++)
+    {
+        for (const auto& vertices : model.meshes[m].vertexBuffers)
+        {
+            std::vector<float> bufferAttributes;
+            bufferAttributes.reserve(vertices.size() * ATTRIBUTE_COUNT);
+            for (const CmoFile::Vertex& vertex : vertices)
+            {
+                bufferAttributes.insert(bufferAttributes.end(), vertex.normal, vertex.normal + 3);
+                bufferAttributes.insert(bufferAttributes.end(), vertex.texcoord, vertex.texcoord + 2);
+            }
+            attributes[m].push_back(std::move(bufferAttributes));
+        }
+    }
+
+    stats.trianglesIn = model.NumTriangles();
+    stats.trianglesOut = stats.trianglesIn;
+
+    MeshSimplifier simplifier;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> simplified;
+    CmoFile level = model;
+    size_t written = 0;
+
+    for (size_t l = 1; l < MAX_LEVELS; l++)
+    {
+        const CmoFile previous = level;
+        const float maxError = FIRST_LEVEL_ERROR * float(1 << (l - 1));
+
+        for (size_t m = 0; m < level.meshes.size(); m++)
+        {
+            const CmoFile::Mesh& source = previous.meshes[m];
+            CmoFile::Mesh& mesh = level.meshes[m];
+            for (auto& buffer : mesh.indexBuffers)
+                buffer.clear();
+
+            // Submeshes are simplified on their own and packed into their index buffer in order
+            for (CmoFile::SubMesh& subMesh : mesh.subMeshes)
+            {
+                const auto& sourceIndices = source.indexBuffers[subMesh.indexBuffer];
+                const auto& vertices = source.vertexBuffers[subMesh.vertexBuffer];
+                const size_t indexCount = size_t(subMesh.primCount) * 3;
+                indices.assign(sourceIndices.begin() + subMesh.startIndex, sourceIndices.begin() + subMesh.startIndex + indexCount);
+
+                simplified.clear();
+                if (!vertices.empty() && std::all_of(indices.begin(), indices.end(), [&](uint32_t index) { return index < vertices.size(); }))
+                {
+                    MeshSimplifier::Input input;
+                    input.indices = indices.data();
+                    input.indexCount = indices.size();
+                    input.positions = vertices[0].position;
+                    input.positionStride = sizeof(CmoFile::Vertex);
+                    input.vertexCount = vertices.size();
+                    input.attributes = attributes[m][subMesh.vertexBuffer].data();
+                    input.attributeCount = ATTRIBUTE_COUNT;
+                    simplifier.Simplify(input, ((indices.size() / 3) / 2) * 3, maxError, simplified);
+                }
+
+                // Submeshes that vanish or can't be read stay as they were
+                const std::vector<uint32_t>& kept = simplified.empty() ? indices : simplified;
+
+                auto& buffer = mesh.indexBuffers[subMesh.indexBuffer];
+                subMesh.startIndex = uint32_t(buffer.size());
+                subMesh.primCount = uint32_t(kept.size() / 3);
+                buffer.insert(buffer.end(), kept.begin(), kept.end());
+            }
+
+            // The device can't create empty buffers
+            for (auto& buffer : mesh.indexBuffers)
+            {
+                if (buffer.empty())
+                    buffer.assign(3, 0);
+            }
+        }
+
+        const size_t triangles = level.NumTriangles();
+        if (float(triangles) > MIN_REDUCTION * float(previous.NumTriangles()))
+            break;
+
+        if (!level.Write(LodPath(path, l)))
+            return stats;
+
+        written = l;
+        stats.trianglesOut = triangles;
+    }
+
+    // Levels left from an earlier cook of a more detailed source
+    for (size_t l = written + 1; l < MAX_LEVELS; l++)
+        Platform::RemoveFile(LodPath(path, l));
+
+    stats.result = RESULT_COOKED;
+    stats.levels = written;
+    return stats;
+}
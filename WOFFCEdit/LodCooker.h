@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Generates the coarser levels of detail of CMO models, next to each source as <name>_lod<N>.cmo, which
+// is where the renderer looks for them.
+//
+// Each level halves the triangles of the one before with MeshSimplifier, per submesh, within an error
+// that grows with the level. Vertex buffers are copied unchanged, so only the index buffers differ from
+// the source. A model whose first level is newer than the source is up to date and skipped; levels stop
+// early once simplifying barely removes anything. Assets cook in parallel, one per task.
+class LodCooker
+{
+public:
+    static constexpr size_t MAX_LEVELS = 4;		//the source counts as level 0
+
+    struct Stats
+    {
+        size_t	assets = 0;
+        size_t	cooked = 0;
+        size_t	upToDate = 0;
+        size_t	failed = 0;			//unreadable sources or unwritable levels
+        size_t	levels = 0;			//written, over all cooked assets
+        size_t	trianglesIn = 0;	//of the cooked sources
+        size_t	trianglesOut = 0;	//of their coarsest levels
+        double	milliseconds = 0.0;
+    };
+
+    // Cooks every distinct path in 'paths'. 'force' recooks models that are up to date.
+    void Cook(const std::vector<std::string>& paths, bool force = false);
+
+    const Stats& GetStats() const { return m_stats; }
+
+    // Where level 'level' of the model at 'path' is stored
+    static std::string LodPath(const std::string& path, size_t level);
+
+private:
+    enum Result
+    {
+        RESULT_COOKED,
+        RESULT_UP_TO_DATE,
+        RESULT_FAILED,
+    };
+
+    struct AssetStats
+    {
+        Result	result = RESULT_FAILED;
+        size_t	levels = 0;
+        size_t	trianglesIn = 0;
+        size_t	trianglesOut = 0;
+    };
+
+    static AssetStats CookAsset(const std::string& path, bool force);
+
+    Stats	m_stats;
+};
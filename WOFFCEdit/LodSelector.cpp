@@ -0,0 +1,129 @@
+#include "LodSelector.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define LOD_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    constexpr float MIN_DISTANCE = 1e-6f;	//keeps zero sized objects at the eye from dividing by zero
+
+    size_t Padded(size_t count)
+    {
+        return (count + 3) & ~size_t(3);
+    }
+}
+
+constexpr size_t LodSelector::MAX_LEVELS;
+
+void LodSelector::SetThresholds(const float* thresholds)
+{
+    std::copy(thresholds, thresholds + (MAX_LEVELS - 1), m_thresholds);
+}
+
+void LodSelector::Reset(size_t count)
+{
+    const size_t padded = Padded(count);
+    m_centreX.assign(padded, 0.f);
+    m_centreY.assign(padded, 0.f);
+    m_centreZ.assign(padded, 0.f);
+    m_radius.assign(padded, 0.f);
+    m_maxLevel.assign(padded, 0.f);
+    m_levels.assign(padded, 0);
+
+    m_stats = Stats();
+    m_stats.objects = count;
+}
+
+void LodSelector::SetObject(size_t object, float centreX, float centreY, float centreZ, float radius, uint32_t numLevels)
+{
+    m_centreX[object] = centreX;
+    m_centreY[object] = centreY;
+    m_centreZ[object] = centreZ;
+    m_radius[object] = radius;
+    m_maxLevel[object] = float(std::min<size_t>(std::max<uint32_t>(numLevels, 1), MAX_LEVELS) - 1);
+    m_levels[object] = 0;
+}
+
+void LodSelector::Select(float eyeX, float eyeY, float eyeZ, float projectionScale)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    // An object is allowed anywhere between the level its size asks for with the thresholds shrunk by
+    // the hysteresis (the finest it may keep, as it only coarsens past a threshold once well below it) and
+    // with them grown by it (the coarsest it may take, as it only refines once well above), and stays
+    // where it is if that is in between
+    float coarsenBelow[MAX_LEVELS - 1];
+    float refineAbove[MAX_LEVELS - 1];
+    for (size_t t = 0; t < MAX_LEVELS - 1; t++)
+    {
+        coarsenBelow[t] = m_thresholds[t] * (1.f - m_hysteresis);
+        refineAbove[t] = m_thresholds[t] * (1.f + m_hysteresis);
+    }
+
+    size_t switches = 0;
+    const size_t padded = m_levels.size();
+
+#ifdef LOD_SSE2
+    const __m128 eye[3] = { _mm_set1_ps(eyeX), _mm_set1_ps(eyeY), _mm_set1_ps(eyeZ) };
+    const __m128 scale = _mm_set1_ps(projectionScale);
+    const __m128 minDistance = _mm_set1_ps(MIN_DISTANCE);
+    const __m128 one = _mm_set1_ps(1.f);
+
+    for (size_t i = 0; i < padded; i += 4)
+    {
+        const __m128 dx = _mm_sub_ps(_mm_loadu_ps(&m_centreX[i]), eye[0]);
+        const __m128 dy = _mm_sub_ps(_mm_loadu_ps(&m_centreY[i]), eye[1]);
+        const __m128 dz = _mm_sub_ps(_mm_loadu_ps(&m_centreZ[i]), eye[2]);
+        const __m128 radius = _mm_loadu_ps(&m_radius[i]);
+
+        // Inside the sphere counts as touching it
+        __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+        distance = _mm_max_ps(_mm_max_ps(distance, radius), minDistance);
+        const __m128 size = _mm_div_ps(_mm_mul_ps(radius, scale), distance);
+
+        __m128 finest = _mm_setzero_ps();
+        __m128 coarsest = _mm_setzero_ps();
+        for (size_t t = 0; t < MAX_LEVELS - 1; t++)
+        {
+            finest = _mm_add_ps(finest, _mm_and_ps(_mm_cmplt_ps(size, _mm_set1_ps(coarsenBelow[t])), one));
+            coarsest = _mm_add_ps(coarsest, _mm_and_ps(_mm_cmplt_ps(size, _mm_set1_ps(refineAbove[t])), one));
+        }
+
+        const __m128 current = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_levels[i])));
+        const __m128 level = _mm_min_ps(_mm_min_ps(_mm_max_ps(current, finest), coarsest), _mm_loadu_ps(&m_maxLevel[i]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&m_levels[i]), _mm_cvttps_epi32(level));
+
+        const int changed = _mm_movemask_ps(_mm_cmpneq_ps(level, current));
+        switches += size_t((changed & 1) + ((changed >> 1) & 1) + ((changed >> 2) & 1) + ((changed >> 3) & 1));
+    }
+#else
+    for (size_t i = 0; i < padded; i++)
+    {
+        const float dx = m_centreX[i] - eyeX;
+        const float dy = m_centreY[i] - eyeY;
+        const float dz = m_centreZ[i] - eyeZ;
+        const float distance = std::max(std::max(std::sqrt((dx * dx) + (dy * dy) + (dz * dz)), m_radius[i]), MIN_DISTANCE);
+        const float size = (m_radius[i] * projectionScale) / distance;
+
+        int32_t finest = 0;
+        int32_t coarsest = 0;
+        for (size_t t = 0; t < MAX_LEVELS - 1; t++)
+        {
+            finest += size < coarsenBelow[t] ? 1 : 0;
+            coarsest += size < refineAbove[t] ? 1 : 0;
+        }
+
+        const int32_t level = std::min(std::min(std::max(m_levels[i], finest), coarsest), int32_t(m_maxLevel[i]));
+        switches += level != m_levels[i] ? 1 : 0;
+        m_levels[i] = level;
+    }
+#endif
+
+    m_stats.switches = switches;
+    m_stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
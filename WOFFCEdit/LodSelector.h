@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Picks a level of detail per object from how large its bounding sphere appears on screen.
+//
+// The screen size of an object is the projected diameter of its bounding sphere over the height of
+// the viewport. Level L + 1 is used once the size drops below threshold L, so each threshold should be
+// where the next model down stops being distinguishable. To keep objects sitting near a threshold from
+// popping back and forth, an object only moves to a coarser level once it is 'hysteresis' below the
+// threshold, and only back to a finer one once it is 'hysteresis' above it.
+//
+// Objects are kept as structures of arrays and processed four at a time.
+class LodSelector
+{
+public:
+    static constexpr size_t MAX_LEVELS = 4;
+
+    struct Stats
+    {
+        size_t	objects = 0;
+        size_t	switches = 0;		//objects whose level changed in the last Select
+        double	milliseconds = 0.0;
+    };
+
+    // MAX_LEVELS - 1 screen sizes, decreasing
+    void SetThresholds(const float* thresholds);
+    // Fraction of a threshold the screen size has to cross it by before the level changes
+    void SetHysteresis(float hysteresis) { m_hysteresis = hysteresis; }
+
+    // Sizes for 'count' objects, each with a single level, at level 0
+    void Reset(size_t count);
+    // Bounding sphere and number of levels of an object, which restarts at level 0
+    void SetObject(size_t object, float centreX, float centreY, float centreZ, float radius, uint32_t numLevels);
+
+    // projectionScale is the vertical scale of the projection, 1 / tan(fovY / 2)
+    void Select(float eyeX, float eyeY, float eyeZ, float projectionScale);
+
+    uint32_t GetLevel(size_t object) const { return uint32_t(m_levels[object]); }
+    const Stats& GetStats() const { return m_stats; }
+
+private:
+    float					m_thresholds[MAX_LEVELS - 1] = { 0.25f, 0.1f, 0.04f };
+    float					m_hysteresis = 0.15f;
+
+    // Padded to a multiple of four with single level objects
+    std::vector<float>		m_centreX;
+    std::vector<float>		m_centreY;
+    std::vector<float>		m_centreZ;
+    std::vector<float>		m_radius;
+    std::vector<float>		m_maxLevel;		//number of levels - 1
+    std::vector<int32_t>	m_levels;
+    Stats					m_stats;
+};
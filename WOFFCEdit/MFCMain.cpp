@@ -1,33 +1,96 @@
 #include "MFCMain.h"
 #include "resource.h"
 #include "MFCFrame.h"
+#include "ObjFile.h"
+#include "AllocationCounter.h"
+#include "StartupTimings.h"
+#include "JobSystem.h"
 
 BEGIN_MESSAGE_MAP(MFCMain, CWinApp)
     ON_COMMAND(ID_FILE_QUIT, &MFCMain::MenuFileQuit)
     ON_COMMAND(ID_FILE_SAVETERRAIN, &MFCMain::MenuFileSaveTerrain)
+    ON_COMMAND(ID_FILE_EXPORTOBJ, &MFCMain::MenuFileExportObj)
+    ON_COMMAND(ID_FILE_IMPORTTERRAINOBJ, &MFCMain::MenuFileImportTerrainObj)
+    ON_COMMAND(ID_FILE_COOKLODS, &MFCMain::MenuFileCookLods)
+    ON_COMMAND(ID_FILE_EXPORTTRACE, &MFCMain::MenuFileExportTrace)
+    ON_COMMAND(ID_TERRAIN_HYDRAULICEROSION, &MFCMain::MenuTerrainHydraulicErosion)
+    ON_COMMAND(ID_TERRAIN_THERMALEROSION, &MFCMain::MenuTerrainThermalErosion)
     ON_COMMAND(ID_EDIT_SELECT, &MFCMain::MenuEditSelect)
+    ON_COMMAND(ID_EDIT_MERGESTATIC, &MFCMain::MenuEditMergeStatic)
+    ON_COMMAND(ID_EDIT_RENDERONDEMAND, &MFCMain::MenuEditRenderOnDemand)
     ON_COMMAND(ID_BUTTON40001, &MFCMain::ToolBarButton1)
     ON_UPDATE_COMMAND_UI(ID_INDICATOR_TOOL, &CMyFrame::OnUpdatePage)
 END_MESSAGE_MAP()
 
+namespace
+{
+    // Frames drawn before debug builds hold drawing to no allocations, for caches and pools to fill
+    constexpr uint32_t ALLOCATION_FREE_AFTER_FRAMES = 60;
+
+    // Editor flags on top of MFC's: /record <file> records the session's input, /replay <file> plays it
+    // back, times every frame and quits
+    class EditorCommandLineInfo : public CCommandLineInfo
+    {
+    public:
+        CString	m_recordPath;
+        CString	m_replayPath;
+        CString	m_databasePath = _T("database/test.db");
+
+        void ParseParam(const TCHAR* pszParam, BOOL bFlag, BOOL bLast) override
+        {
+            if (bFlag && (_tcsicmp(pszParam, _T("record")) == 0 || _tcsicmp(pszParam, _T("replay")) == 0 || _tcsicmp(pszParam, _T("database")) == 0))
+            {
+                m_pathFor = _tcsicmp(pszParam, _T("record")) == 0 ? &m_recordPath : _tcsicmp(pszParam, _T("replay")) == 0 ? &m_replayPath : &m_databasePath;
+                return;
+            }
+
+            if (!bFlag && m_pathFor)
+            {
+                *m_pathFor = pszParam;
+                m_pathFor = nullptr;
+                return;
+            }
+
+            CCommandLineInfo::ParseParam(pszParam, bFlag, bLast);
+        }
+
+    private:
+        CString*	m_pathFor = nullptr;	//flag waiting for its path
+    };
+}
+
 BOOL MFCMain::InitInstance()
 {
+    STARTUP_PHASE("InitInstance");
+
+    //debug builds count allocations, the idle loop is meant to make none
+    AllocationCounter::Install();
+
+    //worker threads for the whole editor, this thread is the main one jobs can send work back to
+    {
+        STARTUP_PHASE("Start job system");
+        JobSystem::Start();
+    }
+
     //instanciate the mfc frame
-    m_frame = new CMyFrame;
-    m_pMainWnd = m_frame;
-
-    m_frame->Create(NULL,
-                    _T("World Of Flim-Flam Craft Editor"),
-                    WS_OVERLAPPEDWINDOW,
-                    CRect(100, 100, 1024, 768),
-                    NULL,
-                    NULL,
-                    0,
-                    NULL
-    );
-
-    m_frame->ShowWindow(SW_SHOW);
-    m_frame->UpdateWindow();
+    {
+        STARTUP_PHASE("Create window");
+        m_frame = new CMyFrame;
+        m_pMainWnd = m_frame;
+
+        m_frame->Create(NULL,
+                        _T("World Of Flim-Flam Craft Editor"),
+                        WS_OVERLAPPEDWINDOW,
+                        CRect(100, 100, 1024, 768),
+                        NULL,
+                        NULL,
+                        0,
+                        NULL
+        );
+
+        m_frame->ShowWindow(SW_SHOW);
+        m_frame->UpdateWindow();
+    }
 
     //get the rect from the MFC window so we can get its dimensions
     m_toolHandle = m_frame->m_DirXView.GetSafeHwnd();				//handle of directX child window
@@ -37,22 +100,61 @@ BOOL MFCMain::InitInstance()
 
     m_width = clientRect.Width();
     m_height = clientRect.Height();
-    m_ToolSystem.onActionInitialise(m_toolHandle, m_width, m_height);
+
+    //the scene to open, such as one SceneGen wrote, and input to record or replay
+    EditorCommandLineInfo commandLine;
+    ParseCommandLine(commandLine);
+    m_ToolSystem.onActionInitialise(m_toolHandle, m_width, m_height, std::string(CStringA(commandLine.m_databasePath)));
 
     m_frame->m_DirXView.toolSystem = &m_ToolSystem;
 
+    //record or replay input from the start, so replays begin from the scene and camera recordings did
+    if (!commandLine.m_replayPath.IsEmpty())
+    {
+        // Replays run unattended, a failed one quits with an error code rather than waiting on a message box
+        if (!m_ToolSystem.onActionReplayInput(std::string(CStringA(commandLine.m_replayPath)), true))
+        {
+            OutputDebugStringA("Could not replay " + CStringA(commandLine.m_replayPath) + "\n");
+            PostQuitMessage(1);
+        }
+    }
+    else if (!commandLine.m_recordPath.IsEmpty())
+    {
+        if (!m_ToolSystem.onActionRecordInput(std::string(CStringA(commandLine.m_recordPath))))
+            MessageBox(NULL, L"Could not record input", L"Error", MB_OK);
+    }
+
+    //main thread jobs are run from the message loop, which the tool's wake event gets out of its idle wait
+    JobSystem::SetMainThreadWake([](void* event) { SetEvent(static_cast<HANDLE>(event)); }, m_ToolSystem.GetWakeEvent());
+
     return TRUE;
 }
 
+int MFCMain::ExitInstance()
+{
+    JobSystem::SetMainThreadWake(nullptr, nullptr);
+    JobSystem::Shutdown();
+    return CWinApp::ExitInstance();
+}
+
 int MFCMain::Run()
 {
     MSG msg;
     BOOL bGotMsg;
+    int shownID = -1;				//selection on the status bar, which is only updated when it changes
+    wchar_t statusString[64];
+    uint32_t framesDrawn = 0;
+    bool allocationReported = false;	//the check below fires once, so ignoring it lets the session carry on
 
     PeekMessage(&msg, NULL, 0U, 0U, PM_NOREMOVE);
 
     while (WM_QUIT != msg.message)
     {
+        //work jobs handed back to this thread, every pass so a stream of messages can't hold it up. They finish
+        //asset loads and other changes that arrive without a message, so draw them.
+        if (JobSystem::PumpMainThread() > 0)
+            m_ToolSystem.RequestFrame();
+
         if (true)
         {
             bGotMsg = (PeekMessage(&msg, NULL, 0U, 0U, PM_REMOVE) != 0);
@@ -71,12 +173,42 @@ int MFCMain::Run()
         }
         else
         {
-            int ID = m_ToolSystem.getCurrentSelectionID();
-            std::wstring statusString = L"Selected Object: " + std::to_wstring(ID);
-            m_ToolSystem.Tick(&msg);
+            //all threads' allocations are shown with the frame pacing, the pipelined update task's and background
+            //work's included. Only this thread's are checked, workers may be loading assets meanwhile.
+            const uint64_t allocations = AllocationCounter::Count();
+            const uint64_t mainThreadAllocations = AllocationCounter::CountOnMainThread();
+
+            //draw when something changed, otherwise sleep until the next message
+            if (m_ToolSystem.NeedsFrame())
+            {
+                m_ToolSystem.Tick(&msg);
+                framesDrawn++;
+            }
+            else
+                m_ToolSystem.WaitForInput();
+
+#ifdef _DEBUG
+            //once the scene has drawn its first frames, drawing and idling don't allocate
+            if (framesDrawn > ALLOCATION_FREE_AFTER_FRAMES && !allocationReported)
+            {
+                const uint64_t drawAllocations = AllocationCounter::CountOnMainThread() - mainThreadAllocations;
+                allocationReported = drawAllocations > 0;
+                _ASSERTE(drawAllocations == 0);
+            }
+#endif
 
             //send current object ID to status bar in The main frame
-            m_frame->m_wndStatusBar.SetPaneText(1, statusString.c_str(), 1);
+            int ID = m_ToolSystem.getCurrentSelectionID();
+            if (ID != shownID)
+            {
+                swprintf_s(statusString, L"Selected Object: %d", ID);
+                m_frame->m_wndStatusBar.SetPaneText(1, statusString, 1);
+                shownID = ID;
+            }
+
+            const uint64_t loopAllocations = AllocationCounter::Count() - allocations;
+            if (loopAllocations > 0)
+                m_ToolSystem.AddLoopAllocations(loopAllocations);
         }
     }
 
@@ -94,6 +226,101 @@ void MFCMain::MenuFileSaveTerrain()
     m_ToolSystem.onActionSaveTerrain();
 }
 
+void MFCMain::MenuFileExportObj()
+{
+    CFileDialog dialog(FALSE, _T("obj"), _T("export.obj"), OFN_OVERWRITEPROMPT | OFN_NOCHANGEDIR, _T("Wavefront OBJ (*.obj)|*.obj||"));
+    if (dialog.DoModal() != IDOK)
+        return;
+
+    ObjIoStats stats;
+    CStringA path(dialog.GetPathName());
+    if (!m_ToolSystem.onActionExportObj(path.GetString(), &stats))
+    {
+        MessageBox(NULL, L"Could not export OBJ", L"Error", MB_OK);
+        return;
+    }
+
+    CString statusString;
+    statusString.Format(_T("Exported %.2f MB at %.1f MB/s"), stats.bytes / (1024.0 * 1024.0), stats.MegabytesPerSecond());
+    m_frame->m_wndStatusBar.SetPaneText(0, statusString);
+}
+
+void MFCMain::MenuFileImportTerrainObj()
+{
+    CFileDialog dialog(TRUE, _T("obj"), NULL, OFN_FILEMUSTEXIST | OFN_NOCHANGEDIR, _T("Wavefront OBJ (*.obj)|*.obj||"));
+    if (dialog.DoModal() != IDOK)
+        return;
+
+    ObjIoStats stats;
+    CStringA path(dialog.GetPathName());
+    if (!m_ToolSystem.onActionImportTerrainObj(path.GetString(), &stats))
+    {
+        MessageBox(NULL, L"Could not import OBJ", L"Error", MB_OK);
+        return;
+    }
+
+    CString statusString;
+    statusString.Format(_T("Imported %.2f MB at %.1f MB/s"), stats.bytes / (1024.0 * 1024.0), stats.MegabytesPerSecond());
+    m_frame->m_wndStatusBar.SetPaneText(0, statusString);
+}
+
+void MFCMain::MenuFileCookLods()
+{
+    m_frame->m_wndStatusBar.SetPaneText(0, _T("Cooking model LODs..."));
+    m_frame->m_wndStatusBar.UpdateWindow();
+
+    LodCooker::Stats stats;
+    if (!m_ToolSystem.onActionCookLods(&stats))
+        MessageBox(NULL, L"Some models could not be cooked", L"Error", MB_OK);
+
+    CString statusString;
+    statusString.Format(_T("Cooked %u of %u models (%u up to date) in %.0f ms, %u to %u triangles"), unsigned(stats.cooked), unsigned(stats.assets),
+                        unsigned(stats.upToDate), stats.milliseconds, unsigned(stats.trianglesIn), unsigned(stats.trianglesOut));
+    m_frame->m_wndStatusBar.SetPaneText(0, statusString);
+}
+
+void MFCMain::MenuFileExportTrace()
+{
+    CFileDialog dialog(FALSE, _T("json"), _T("trace.json"), OFN_OVERWRITEPROMPT | OFN_NOCHANGEDIR, _T("Chrome trace (*.json)|*.json||"));
+    if (dialog.DoModal() != IDOK)
+        return;
+
+    CStringA path(dialog.GetPathName());
+    if (!m_ToolSystem.onActionExportTrace(path.GetString()))
+    {
+        MessageBox(NULL, L"Could not export profiler trace", L"Error", MB_OK);
+        return;
+    }
+
+    m_frame->m_wndStatusBar.SetPaneText(0, _T("Exported profiler trace, open it in chrome://tracing"));
+}
+
+void MFCMain::MenuTerrainHydraulicErosion()
+{
+    ErodeTerrain(true);
+}
+
+void MFCMain::MenuTerrainThermalErosion()
+{
+    ErodeTerrain(false);
+}
+
+void MFCMain::ErodeTerrain(bool hydraulic)
+{
+    //erosion tiles run in parallel, progress is reported on this thread between passes. Escape cancels.
+    const bool completed = m_ToolSystem.onActionErodeTerrain(hydraulic, [this](float progress)
+    {
+        CString statusString;
+        statusString.Format(_T("Eroding terrain... %d%% (Esc to cancel)"), int(progress * 100.f));
+        m_frame->m_wndStatusBar.SetPaneText(0, statusString);
+        m_frame->m_wndStatusBar.UpdateWindow();
+
+        return (GetAsyncKeyState(VK_ESCAPE) & 0x8000) == 0;
+    });
+
+    m_frame->m_wndStatusBar.SetPaneText(0, completed ? _T("Erosion complete") : _T("Erosion cancelled"));
+}
+
 void MFCMain::MenuEditSelect()
 {
     //SelectDialogue m_ToolSelectDialogue(NULL, &m_ToolSystem.m_sceneGraph);		//create our dialoguebox //modal constructor
@@ -110,3 +337,15 @@ void MFCMain::ToolBarButton1()
 
     m_ToolSystem.onActionSave();
 }
+
+void MFCMain::MenuEditMergeStatic()
+{
+    const bool merging = m_ToolSystem.onActionToggleStaticMerging();
+    m_frame->m_wndStatusBar.SetPaneText(0, merging ? _T("Static geometry merged") : _T("Static geometry drawn per object"));
+}
+
+void MFCMain::MenuEditRenderOnDemand()
+{
+    const bool onDemand = m_ToolSystem.onActionToggleRenderOnDemand();
+    m_frame->m_wndStatusBar.SetPaneText(0, onDemand ? _T("Rendering on demand") : _T("Rendering continuously"));
+}
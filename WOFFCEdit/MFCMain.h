@@ -13,6 +13,7 @@ class MFCMain : public CWinApp
 public:
     BOOL InitInstance() override;
     int  Run() override;
+    int  ExitInstance() override;
 
 private:
 
@@ -27,9 +28,19 @@ private:
     //Interface funtions for menu and toolbar etc requires
     afx_msg void MenuFileQuit();
     afx_msg void MenuFileSaveTerrain();
+    afx_msg void MenuFileExportObj();
+    afx_msg void MenuFileImportTerrainObj();
+    afx_msg void MenuFileCookLods();
+    afx_msg void MenuFileExportTrace();
+    afx_msg void MenuTerrainHydraulicErosion();
+    afx_msg void MenuTerrainThermalErosion();
     afx_msg void MenuEditSelect();
+    afx_msg void MenuEditMergeStatic();
+    afx_msg void MenuEditRenderOnDemand();
     afx_msg	void ToolBarButton1();
 
+    void ErodeTerrain(bool hydraulic);
+
 
     DECLARE_MESSAGE_MAP()	// required macro for message map functionality  One per class
 };
@@ -0,0 +1,410 @@
+#include "MaskedOcclusionBuffer.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define OCCLUSION_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    static_assert(MaskedOcclusionBuffer::TILE_WIDTH * MaskedOcclusionBuffer::TILE_HEIGHT == 32, "tile coverage is a 32 bit mask");
+    static_assert(MaskedOcclusionBuffer::TILES_Y % MaskedOcclusionBuffer::TILE_ROWS_PER_BAND == 0, "bands must split the tile rows evenly");
+
+    constexpr uint32_t FULL_MASK = 0xFFFFFFFF;
+    constexpr float EDGE_INSET = 1.f / 64.f;	//pixels
+    constexpr float DEPTH_SCALE = 0.9999f;		//pushes stored depths back slightly to absorb float error in the depth planes
+
+    // r = a * b, row vector convention
+    void MultiplyMatrix(const float* a, const float* b, float* r)
+    {
+        for (int row = 0; row < 4; row++)
+        {
+            for (int col = 0; col < 4; col++)
+            {
+                r[(row * 4) + col] = (a[(row * 4) + 0] * b[col]) + (a[(row * 4) + 1] * b[4 + col])
+                                   + (a[(row * 4) + 2] * b[8 + col]) + (a[(row * 4) + 3] * b[12 + col]);
+            }
+        }
+    }
+
+    // Coverage of the pixel centres of one tile by the edge functions A * x + B * y + C > 0,
+    // evaluated at (originX + 0.5 + column, originY + 0.5 + row)
+    uint32_t TileCoverage(const float* A, const float* B, const float* C, float originX, float originY)
+    {
+        using Tile = MaskedOcclusionBuffer;
+        uint32_t coverage = 0;
+
+#ifdef OCCLUSION_SSE2
+        const __m128 columnsLo = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 columnsHi = _mm_setr_ps(4.5f, 5.5f, 6.5f, 7.5f);
+        const __m128 zero = _mm_setzero_ps();
+
+        __m128 rowLo[3], rowHi[3], step[3];
+        for (int e = 0; e < 3; e++)
+        {
+            const __m128 a = _mm_set1_ps(A[e]);
+            const __m128 base = _mm_set1_ps((A[e] * originX) + (B[e] * (originY + 0.5f)) + C[e]);
+            rowLo[e] = _mm_add_ps(base, _mm_mul_ps(a, columnsLo));
+            rowHi[e] = _mm_add_ps(base, _mm_mul_ps(a, columnsHi));
+            step[e] = _mm_set1_ps(B[e]);
+        }
+
+        for (int row = 0; row < Tile::TILE_HEIGHT; row++)
+        {
+            const __m128 insideLo = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(rowLo[0], zero), _mm_cmpgt_ps(rowLo[1], zero)), _mm_cmpgt_ps(rowLo[2], zero));
+            const __m128 insideHi = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(rowHi[0], zero), _mm_cmpgt_ps(rowHi[1], zero)), _mm_cmpgt_ps(rowHi[2], zero));
+            const uint32_t bits = uint32_t(_mm_movemask_ps(insideLo)) | (uint32_t(_mm_movemask_ps(insideHi)) << 4);
+            coverage |= bits << (row * Tile::TILE_WIDTH);
+
+            for (int e = 0; e < 3; e++)
+            {
+                rowLo[e] = _mm_add_ps(rowLo[e], step[e]);
+                rowHi[e] = _mm_add_ps(rowHi[e], step[e]);
+            }
+        }
+#else
+        for (int row = 0; row < Tile::TILE_HEIGHT; row++)
+        {
+            const float y = originY + row + 0.5f;
+            for (int column = 0; column < Tile::TILE_WIDTH; column++)
+            {
+                const float x = originX + column + 0.5f;
+                if ((A[0] * x) + (B[0] * y) + C[0] > 0.f && (A[1] * x) + (B[1] * y) + C[1] > 0.f && (A[2] * x) + (B[2] * y) + C[2] > 0.f)
+                    coverage |= 1u << ((row * Tile::TILE_WIDTH) + column);
+            }
+        }
+#endif
+
+        return coverage;
+    }
+}
+
+MaskedOcclusionBuffer::MaskedOcclusionBuffer()
+    : m_tiles(TILES_X * TILES_Y)
+{
+    std::fill(m_viewProjection, m_viewProjection + 16, 0.f);
+    Clear();
+}
+
+void MaskedOcclusionBuffer::Clear()
+{
+    for (Tile& tile : m_tiles)
+    {
+        tile.mask = 0;
+        tile.zMin0 = 0.f;
+        tile.zMin1 = 0.f;
+    }
+}
+
+void MaskedOcclusionBuffer::Render(const OccluderInstance* occluders, size_t count, const float* viewProjection)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    Clear();
+    std::copy(viewProjection, viewProjection + 16, m_viewProjection);
+    m_occluders = occluders;
+    m_numOccluders = count;
+
+    m_stats = Stats();
+    m_stats.occluders = count;
+
+    // Transform every occluder once, in parallel, into one shared array of clip space vertices
+    m_vertexOffsets.resize(count + 1);
+    m_vertexOffsets[0] = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        m_vertexOffsets[i + 1] = m_vertexOffsets[i] + (occluders[i].mesh->positions.size() / 3);
+        m_stats.triangles += occluders[i].mesh->indices.size() / 3;
+    }
+    m_clipVertices.resize(m_vertexOffsets[count]);
+
+    JobSystem::ParallelFor(size_t(0), count, [&](size_t i)
+    {
+        TransformOccluder(occluders[i], &m_clipVertices[m_vertexOffsets[i]]);
+    });
+
+    // Then rasterise bands of tile rows in parallel; every band sees every triangle but only writes its own tiles
+    JobSystem::ParallelFor(0, TILES_Y / TILE_ROWS_PER_BAND, [&](int band)
+    {
+        RasteriseBand(band * TILE_ROWS_PER_BAND, (band + 1) * TILE_ROWS_PER_BAND);
+    });
+
+    m_occluders = nullptr;
+    m_numOccluders = 0;
+    m_stats.renderMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void MaskedOcclusionBuffer::TransformOccluder(const OccluderInstance& occluder, ClipVertex* out) const
+{
+    float m[16];
+    MultiplyMatrix(occluder.world, m_viewProjection, m);
+
+    const std::vector<float>& positions = occluder.mesh->positions;
+    const size_t numVertices = positions.size() / 3;
+    for (size_t v = 0; v < numVertices; v++)
+    {
+        const float x = positions[(v * 3) + 0];
+        const float y = positions[(v * 3) + 1];
+        const float z = positions[(v * 3) + 2];
+
+        out[v].x = (x * m[0]) + (y * m[4]) + (z * m[8]) + m[12];
+        out[v].y = (x * m[1]) + (y * m[5]) + (z * m[9]) + m[13];
+        out[v].z = (x * m[2]) + (y * m[6]) + (z * m[10]) + m[14];
+        out[v].w = (x * m[3]) + (y * m[7]) + (z * m[11]) + m[15];
+    }
+}
+
+void MaskedOcclusionBuffer::RasteriseBand(int firstTileRow, int endTileRow)
+{
+    // Clip space extent of the band, to skip triangles entirely above or below it
+    const float bandTop = 1.f - ((2.f * firstTileRow * TILE_HEIGHT) / HEIGHT);
+    const float bandBottom = 1.f - ((2.f * endTileRow * TILE_HEIGHT) / HEIGHT);
+
+    for (size_t o = 0; o < m_numOccluders; o++)
+    {
+        const std::vector<uint32_t>& indices = m_occluders[o].mesh->indices;
+        const ClipVertex* vertices = &m_clipVertices[m_vertexOffsets[o]];
+
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            const ClipVertex& v0 = vertices[indices[i]];
+            const ClipVertex& v1 = vertices[indices[i + 1]];
+            const ClipVertex& v2 = vertices[indices[i + 2]];
+
+            // Trivially outside one of the frustum side planes, the band or in front of the near plane
+            if ((v0.x > v0.w && v1.x > v1.w && v2.x > v2.w) || (v0.x < -v0.w && v1.x < -v1.w && v2.x < -v2.w))
+                continue;
+            if ((v0.y > bandTop * v0.w && v1.y > bandTop * v1.w && v2.y > bandTop * v2.w) ||
+                (v0.y < bandBottom * v0.w && v1.y < bandBottom * v1.w && v2.y < bandBottom * v2.w))
+                continue;
+            if (v0.z < 0.f && v1.z < 0.f && v2.z < 0.f)
+                continue;
+
+            RasteriseTriangle(v0, v1, v2, firstTileRow, endTileRow);
+        }
+    }
+}
+
+void MaskedOcclusionBuffer::RasteriseTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, int firstTileRow, int endTileRow)
+{
+    // 1 / w as a plane over the screen, straight from the clip space vertices. In NDC, 1 / w = r . (u, v, 1)
+    // with r = (v1 x v2 + v2 x v0 + v0 x v1) / det[v0 v1 v2] over the (x, y, w) of each vertex. Going
+    // through projected vertices instead loses precision when near plane clipping puts them far off screen.
+    const float c0[3] = { (v1.y * v2.w) - (v1.w * v2.y), (v1.w * v2.x) - (v1.x * v2.w), (v1.x * v2.y) - (v1.y * v2.x) };
+    const float c1[3] = { (v2.y * v0.w) - (v2.w * v0.y), (v2.w * v0.x) - (v2.x * v0.w), (v2.x * v0.y) - (v2.y * v0.x) };
+    const float c2[3] = { (v0.y * v1.w) - (v0.w * v1.y), (v0.w * v1.x) - (v0.x * v1.w), (v0.x * v1.y) - (v0.y * v1.x) };
+    const float det = (v0.x * c0[0]) + (v0.y * c0[1]) + (v0.w * c0[2]);
+    if (std::abs(det) < 1e-12f)
+        return;		//seen edge on
+
+    // Convert from NDC to pixels: u = 2x / WIDTH - 1, v = 1 - 2y / HEIGHT
+    const float invDet = 1.f / det;
+    const float ru = (c0[0] + c1[0] + c2[0]) * invDet;
+    const float rv = (c0[1] + c1[1] + c2[1]) * invDet;
+    const float rw = (c0[2] + c1[2] + c2[2]) * invDet;
+    const float depthPlane[3] = { ru * (2.f / WIDTH), rv * (-2.f / HEIGHT), rw - ru + rv };
+
+    // Clip against the near plane (z = 0 in D3D clip space), which leaves up to four vertices
+    const ClipVertex in[3] = { v0, v1, v2 };
+    ClipVertex clipped[4];
+    int numClipped = 0;
+
+    for (int i = 0; i < 3; i++)
+    {
+        const ClipVertex& a = in[i];
+        const ClipVertex& b = in[(i + 1) % 3];
+
+        if (a.z >= 0.f)
+            clipped[numClipped++] = a;
+
+        if ((a.z >= 0.f) != (b.z >= 0.f))
+        {
+            const float t = a.z / (a.z - b.z);
+            clipped[numClipped++] = { a.x + ((b.x - a.x) * t), a.y + ((b.y - a.y) * t), 0.f, a.w + ((b.w - a.w) * t) };
+        }
+    }
+
+    // Project to pixels and draw as a fan
+    float x[4], y[4];
+    float minDepth = FLT_MAX;
+    for (int i = 0; i < numClipped; i++)
+    {
+        if (clipped[i].w <= 0.f)
+            return;
+
+        const float invW = 1.f / clipped[i].w;
+        x[i] = ((clipped[i].x * invW * 0.5f) + 0.5f) * WIDTH;
+        y[i] = (0.5f - (clipped[i].y * invW * 0.5f)) * HEIGHT;
+        minDepth = std::min(minDepth, invW);
+    }
+
+    for (int i = 2; i < numClipped; i++)
+    {
+        const float fanX[3] = { x[0], x[i - 1], x[i] };
+        const float fanY[3] = { y[0], y[i - 1], y[i] };
+        RasteriseScreenTriangle(fanX, fanY, depthPlane, minDepth, firstTileRow, endTileRow);
+    }
+}
+
+void MaskedOcclusionBuffer::RasteriseScreenTriangle(const float* x, const float* y, const float* depthPlane, float minDepth, int firstTileRow, int endTileRow)
+{
+    const float area = ((x[1] - x[0]) * (y[2] - y[0])) - ((x[2] - x[0]) * (y[1] - y[0]));
+    if (std::abs(area) < 1e-6f)
+        return;
+
+    // Pixel centres inside the bounding box, clamped to the band before converting to int
+    const float bandMinY = float(firstTileRow * TILE_HEIGHT);
+    const float bandMaxY = float(endTileRow * TILE_HEIGHT);
+    const float minX = std::max(std::min(std::min(x[0], x[1]), x[2]), 0.f);
+    const float maxX = std::min(std::max(std::max(x[0], x[1]), x[2]), float(WIDTH));
+    const float minY = std::max(std::min(std::min(y[0], y[1]), y[2]), bandMinY);
+    const float maxY = std::min(std::max(std::max(y[0], y[1]), y[2]), bandMaxY);
+
+    const int firstPixelX = int(std::ceil(minX - 0.5f));
+    const int lastPixelX = std::min(int(std::floor(maxX - 0.5f)), WIDTH - 1);
+    const int firstPixelY = int(std::ceil(minY - 0.5f));
+    const int lastPixelY = std::min(int(std::floor(maxY - 0.5f)), int(bandMaxY) - 1);
+    if (firstPixelX > lastPixelX || firstPixelY > lastPixelY)
+        return;
+
+    // Edge functions, positive inside whichever the winding. Occluders are drawn double sided. Edges are
+    // pulled in by a fraction of a pixel, so rounding never covers a pixel centre outside the triangle.
+    const float sign = area > 0.f ? 1.f : -1.f;
+    float A[3], B[3], C[3];
+    for (int e = 0; e < 3; e++)
+    {
+        const int a = e;
+        const int b = (e + 1) % 3;
+        A[e] = (y[a] - y[b]) * sign;
+        B[e] = (x[b] - x[a]) * sign;
+        C[e] = (((x[a] * y[b]) - (x[b] * y[a])) * sign) - ((std::abs(A[e]) + std::abs(B[e])) * EDGE_INSET);
+    }
+
+    const float zA = depthPlane[0];
+    const float zB = depthPlane[1];
+    const float zC = depthPlane[2];
+
+    for (int tileY = firstPixelY / TILE_HEIGHT; tileY <= lastPixelY / TILE_HEIGHT; tileY++)
+    {
+        for (int tileX = firstPixelX / TILE_WIDTH; tileX <= lastPixelX / TILE_WIDTH; tileX++)
+        {
+            const float originX = float(tileX * TILE_WIDTH);
+            const float originY = float(tileY * TILE_HEIGHT);
+
+            const uint32_t coverage = TileCoverage(A, B, C, originX, originY);
+            if (coverage == 0)
+                continue;
+
+            // Furthest depth over the covered pixel centres: the plane's minimum over the part of the
+            // tile inside the triangle's bounds, and never beyond the furthest vertex
+            const float left = std::max(originX + 0.5f, float(firstPixelX) + 0.5f);
+            const float right = std::min(originX + TILE_WIDTH - 0.5f, float(lastPixelX) + 0.5f);
+            const float top = std::max(originY + 0.5f, float(firstPixelY) + 0.5f);
+            const float bottom = std::min(originY + TILE_HEIGHT - 0.5f, float(lastPixelY) + 0.5f);
+            const float planeMinZ = zC + (zA * (zA < 0.f ? right : left)) + (zB * (zB < 0.f ? bottom : top));
+
+            MergeTile(m_tiles[(tileY * TILES_X) + tileX], coverage, std::max(planeMinZ, minDepth) * DEPTH_SCALE);
+        }
+    }
+}
+
+void MaskedOcclusionBuffer::MergeTile(Tile& tile, uint32_t coverage, float depth)
+{
+    if (depth <= tile.zMin0)
+        return;
+
+    // A triangle much closer than the working layer is worth more than what the layer holds: start the layer over from it
+    if (tile.mask != 0 && (depth - tile.zMin1) > (tile.zMin1 - tile.zMin0))
+        tile.mask = 0;
+
+    tile.zMin1 = tile.mask != 0 ? std::min(tile.zMin1, depth) : depth;
+    tile.mask |= coverage;
+
+    // Fully covered: the working layer becomes the base of the whole tile
+    if (tile.mask == FULL_MASK)
+    {
+        tile.zMin0 = tile.zMin1;
+        tile.zMin1 = 0.f;
+        tile.mask = 0;
+    }
+}
+
+bool MaskedOcclusionBuffer::IsVisible(const float boxMin[3], const float boxMax[3]) const
+{
+    const float* m = m_viewProjection;
+
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    float nearestZ = 0.f;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        const float x = (corner & 1) ? boxMax[0] : boxMin[0];
+        const float y = (corner & 2) ? boxMax[1] : boxMin[1];
+        const float z = (corner & 4) ? boxMax[2] : boxMin[2];
+
+        const float clipX = (x * m[0]) + (y * m[4]) + (z * m[8]) + m[12];
+        const float clipY = (x * m[1]) + (y * m[5]) + (z * m[9]) + m[13];
+        const float clipZ = (x * m[2]) + (y * m[6]) + (z * m[10]) + m[14];
+        const float clipW = (x * m[3]) + (y * m[7]) + (z * m[11]) + m[15];
+
+        if (clipW <= 0.f || clipZ < 0.f)
+            return true;
+
+        const float invW = 1.f / clipW;
+        const float screenX = ((clipX * invW * 0.5f) + 0.5f) * WIDTH;
+        const float screenY = (0.5f - (clipY * invW * 0.5f)) * HEIGHT;
+
+        minX = std::min(minX, screenX);
+        maxX = std::max(maxX, screenX);
+        minY = std::min(minY, screenY);
+        maxY = std::max(maxY, screenY);
+        nearestZ = std::max(nearestZ, invW);
+    }
+
+    if (maxX <= 0.f || maxY <= 0.f || minX >= WIDTH || minY >= HEIGHT)
+        return true;
+
+    // Every pixel the rectangle touches, not just the centres it contains
+    const int firstPixelX = std::max(int(std::floor(minX)), 0);
+    const int firstPixelY = std::max(int(std::floor(minY)), 0);
+    const int lastPixelX = std::min(std::max(int(std::ceil(maxX)) - 1, firstPixelX), WIDTH - 1);
+    const int lastPixelY = std::min(std::max(int(std::ceil(maxY)) - 1, firstPixelY), HEIGHT - 1);
+
+    for (int tileY = firstPixelY / TILE_HEIGHT; tileY <= lastPixelY / TILE_HEIGHT; tileY++)
+    {
+        const int firstRow = std::max(firstPixelY - (tileY * TILE_HEIGHT), 0);
+        const int lastRow = std::min(lastPixelY - (tileY * TILE_HEIGHT), TILE_HEIGHT - 1);
+
+        for (int tileX = firstPixelX / TILE_WIDTH; tileX <= lastPixelX / TILE_WIDTH; tileX++)
+        {
+            const Tile& tile = m_tiles[(tileY * TILES_X) + tileX];
+            if (nearestZ < tile.zMin0)
+                continue;
+
+            const int firstColumn = std::max(firstPixelX - (tileX * TILE_WIDTH), 0);
+            const int lastColumn = std::min(lastPixelX - (tileX * TILE_WIDTH), TILE_WIDTH - 1);
+            const uint32_t columns = ((1u << (lastColumn + 1)) - 1) & ~((1u << firstColumn) - 1);
+
+            uint32_t rect = 0;
+            for (int row = firstRow; row <= lastRow; row++)
+                rect |= columns << (row * TILE_WIDTH);
+
+            // Pixels outside the working layer are only bounded by the base layer
+            if ((rect & ~tile.mask) != 0 || nearestZ >= tile.zMin1)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+float MaskedOcclusionBuffer::GetPixelDepth(int x, int y) const
+{
+    const Tile& tile = m_tiles[((y / TILE_HEIGHT) * TILES_X) + (x / TILE_WIDTH)];
+    const uint32_t bit = 1u << (((y % TILE_HEIGHT) * TILE_WIDTH) + (x % TILE_WIDTH));
+    return (tile.mask & bit) ? std::max(tile.zMin0, tile.zMin1) : tile.zMin0;
+}
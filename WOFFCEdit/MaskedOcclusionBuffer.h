@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Object space triangle mesh used to draw an object into the occlusion buffer
+struct OccluderMesh
+{
+    std::vector<float>		positions;	//xyz
+    std::vector<uint32_t>	indices;	//three per triangle
+};
+
+// An occluder mesh placed in the world. Matrices are 4x4 row major, transforming row vectors (v * M)
+// like DirectXMath, so a SimpleMath::Matrix can be passed as &matrix._11.
+struct OccluderInstance
+{
+    const OccluderMesh*	mesh;
+    float				world[16];
+};
+
+// Low resolution software depth buffer for occlusion culling, in the style of masked occlusion culling.
+//
+// The screen is split into tiles of 8x4 pixels. Instead of a depth per pixel, each tile keeps two
+// conservative depth layers: a base depth valid for the whole tile, and a working layer with a
+// coverage mask of the pixels it applies to. Triangles merge into the working layer; once its mask
+// covers the whole tile it becomes the new base. That keeps the buffer 12 bytes per 32 pixels while
+// still resolving occluder edges at pixel precision. Coverage for a tile is computed with SSE2, four
+// pixels at a time.
+//
+// Depth is stored as 1 / w, the reciprocal of view depth, which like z / w is linear in screen space
+// but keeps its precision far from a close near plane. Larger is closer. Every stored depth is the
+// furthest an occluder can be over the pixels it covers, so object tests never reject anything visible.
+//
+// Render() rasterises on worker threads, each owning a band of tile rows. IsVisible() only reads the
+// buffer and can be called from any number of threads once Render() has returned.
+class MaskedOcclusionBuffer
+{
+public:
+    static constexpr int WIDTH = 320;
+    static constexpr int HEIGHT = 192;
+    static constexpr int TILE_WIDTH = 8;
+    static constexpr int TILE_HEIGHT = 4;
+    static constexpr int TILES_X = WIDTH / TILE_WIDTH;
+    static constexpr int TILES_Y = HEIGHT / TILE_HEIGHT;
+    static constexpr int TILE_ROWS_PER_BAND = 4;
+
+    struct Stats
+    {
+        size_t	occluders = 0;
+        size_t	triangles = 0;			//submitted, before clipping and culling
+        double	renderMilliseconds = 0.0;
+    };
+
+    MaskedOcclusionBuffer();
+
+    // Clears the buffer and draws every occluder with the given view * projection matrix
+    void Render(const OccluderInstance* occluders, size_t count, const float* viewProjection);
+
+    // False if the world space box is certainly hidden behind the occluders of the last Render().
+    // Boxes crossing the near plane or off screen count as visible.
+    bool IsVisible(const float boxMin[3], const float boxMax[3]) const;
+
+    // Furthest occluder depth at a pixel as 1 / w, 0 where nothing was drawn. For debugging and validation.
+    float GetPixelDepth(int x, int y) const;
+
+    const Stats& GetStats() const { return m_stats; }
+
+private:
+    struct Tile
+    {
+        uint32_t	mask;		//pixels covered by the working layer, bit (row * TILE_WIDTH) + column
+        float		zMin0;		//base layer, whole tile
+        float		zMin1;		//working layer, pixels in mask
+    };
+
+    struct ClipVertex
+    {
+        float x, y, z, w;
+    };
+
+    void Clear();
+    void TransformOccluder(const OccluderInstance& occluder, ClipVertex* out) const;
+    void RasteriseBand(int firstTileRow, int endTileRow);
+    void RasteriseTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, int firstTileRow, int endTileRow);
+    void RasteriseScreenTriangle(const float* x, const float* y, const float* depthPlane, float minDepth, int firstTileRow, int endTileRow);
+    static void MergeTile(Tile& tile, uint32_t coverage, float depth);
+
+    std::vector<Tile>		m_tiles;
+    float					m_viewProjection[16];
+
+    // Per Render(): occluders transformed to clip space, shared by all bands
+    std::vector<ClipVertex>	m_clipVertices;
+    std::vector<size_t>		m_vertexOffsets;	//first clip vertex of each occluder
+    const OccluderInstance*	m_occluders = nullptr;
+    size_t					m_numOccluders = 0;
+
+    Stats					m_stats;
+};
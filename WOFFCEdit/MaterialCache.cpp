@@ -0,0 +1,187 @@
+#include "MaterialCache.h"
+#include "DDSTextureLoader.h"
+#include "Profiler.h"
+#include <algorithm>
+
+using namespace DirectX;
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    // Roughly what one effect keeps on the GPU: BasicEffect's constant buffer, the largest of the
+    // effects the model loaders create
+    constexpr size_t EFFECT_CONSTANT_BYTES = 26 * 16;
+
+    // Bits per texel of the formats textures are usually stored in, 0 for anything else
+    size_t BitsPerTexel(DXGI_FORMAT format)
+    {
+        switch (format)
+        {
+            case DXGI_FORMAT_R32G32B32A32_FLOAT:	return 128;
+            case DXGI_FORMAT_R16G16B16A16_FLOAT:
+            case DXGI_FORMAT_R16G16B16A16_UNORM:	return 64;
+            case DXGI_FORMAT_R8G8B8A8_UNORM:
+            case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+            case DXGI_FORMAT_B8G8R8A8_UNORM:
+            case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+            case DXGI_FORMAT_B8G8R8X8_UNORM:
+            case DXGI_FORMAT_R10G10B10A2_UNORM:		return 32;
+            case DXGI_FORMAT_R8G8_UNORM:
+            case DXGI_FORMAT_B5G6R5_UNORM:
+            case DXGI_FORMAT_B5G5R5A1_UNORM:
+            case DXGI_FORMAT_R16_UNORM:				return 16;
+            case DXGI_FORMAT_R8_UNORM:
+            case DXGI_FORMAT_A8_UNORM:
+            case DXGI_FORMAT_BC2_UNORM:
+            case DXGI_FORMAT_BC2_UNORM_SRGB:
+            case DXGI_FORMAT_BC3_UNORM:
+            case DXGI_FORMAT_BC3_UNORM_SRGB:
+            case DXGI_FORMAT_BC5_UNORM:
+            case DXGI_FORMAT_BC5_SNORM:
+            case DXGI_FORMAT_BC6H_UF16:
+            case DXGI_FORMAT_BC6H_SF16:
+            case DXGI_FORMAT_BC7_UNORM:
+            case DXGI_FORMAT_BC7_UNORM_SRGB:		return 8;
+            case DXGI_FORMAT_BC1_UNORM:
+            case DXGI_FORMAT_BC1_UNORM_SRGB:
+            case DXGI_FORMAT_BC4_UNORM:
+            case DXGI_FORMAT_BC4_SNORM:				return 4;
+            default:								return 0;
+        }
+    }
+
+    bool IsBlockCompressed(DXGI_FORMAT format)
+    {
+        return (format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM)
+            || (format >= DXGI_FORMAT_BC6H_TYPELESS && format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+    }
+
+    // GPU memory of a 2D texture, every mip and array slice
+    size_t TextureBytes(ID3D11ShaderResourceView* view)
+    {
+        ComPtr<ID3D11Resource> resource;
+        view->GetResource(resource.GetAddressOf());
+
+        ComPtr<ID3D11Texture2D> texture;
+        if (FAILED(resource.As(&texture)))
+            return 0;
+
+        D3D11_TEXTURE2D_DESC desc;
+        texture->GetDesc(&desc);
+
+        const bool compressed = IsBlockCompressed(desc.Format);
+        size_t bytes = 0;
+        for (UINT mip = 0; mip < desc.MipLevels; mip++)
+        {
+            size_t width = std::max<size_t>(desc.Width >> mip, 1);
+            size_t height = std::max<size_t>(desc.Height >> mip, 1);
+            if (compressed)
+            {
+                //whole 4x4 blocks
+                width = (width + 3) & ~size_t(3);
+                height = (height + 3) & ~size_t(3);
+            }
+            bytes += (width * height * BitsPerTexel(desc.Format)) / 8;
+        }
+
+        return bytes * desc.ArraySize;
+    }
+}
+
+MaterialCache::MaterialCache(ID3D11Device* device) :
+    m_device(device),
+    m_factory(device)
+{
+    m_factory.SetSharing(false);
+}
+
+std::shared_ptr<IEffect> MaterialCache::CreateEffect(const EffectInfo& info, ID3D11DeviceContext* deviceContext)
+{
+    m_stats.requests++;
+
+    // The flags pick the effect class EffectFactory creates, the rest are its parameters. The material
+    // name is left out on purpose, models name their materials independently of what they contain.
+    const uint32_t flags = (info.perVertexColor ? 1 : 0) | (info.enableSkinning ? 2 : 0) | (info.enableDualTexture ? 4 : 0)
+                         | (info.enableNormalMaps ? 8 : 0) | (info.biasedVertexNormals ? 16 : 0);
+    const std::array<float, 14> parameters =
+    {
+        info.specularPower, info.alpha,
+        info.ambientColor.x, info.ambientColor.y, info.ambientColor.z,
+        info.diffuseColor.x, info.diffuseColor.y, info.diffuseColor.z,
+        info.specularColor.x, info.specularColor.y, info.specularColor.z,
+        info.emissiveColor.x, info.emissiveColor.y, info.emissiveColor.z,
+    };
+    const Key key(flags, parameters,
+                  info.diffuseTexture ? info.diffuseTexture : L"",
+                  info.specularTexture ? info.specularTexture : L"",
+                  info.normalTexture ? info.normalTexture : L"");
+
+    auto found = m_entries.find(key);
+    if (found != m_entries.end())
+        return found->second.effect;
+
+    Entry& entry = m_entries[key];
+    entry.effect = m_factory.CreateEffect(info, deviceContext);
+
+    Material& material = entry.material;
+    material.perVertexColor = info.perVertexColor;
+    material.enableSkinning = info.enableSkinning;
+    material.enableDualTexture = info.enableDualTexture;
+    material.enableNormalMaps = info.enableNormalMaps;
+    material.biasedVertexNormals = info.biasedVertexNormals;
+    material.specularPower = info.specularPower;
+    material.alpha = info.alpha;
+    material.ambientColor = info.ambientColor;
+    material.diffuseColor = info.diffuseColor;
+    material.specularColor = info.specularColor;
+    material.emissiveColor = info.emissiveColor;
+    material.diffuseTexture = std::get<2>(key);
+    material.specularTexture = std::get<3>(key);
+    material.normalTexture = std::get<4>(key);
+
+    m_materialOfEffect[entry.effect.get()] = &material;
+    m_stats.materials++;
+    m_stats.effectBytes += EFFECT_CONSTANT_BYTES;
+
+    return entry.effect;
+}
+
+void MaterialCache::CreateTexture(const wchar_t* name, ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView** textureView)
+{
+    m_factory.CreateTexture(name, deviceContext, textureView);
+}
+
+ID3D11ShaderResourceView* MaterialCache::LoadTexture(const std::wstring& path)
+{
+    m_stats.textureRequests++;
+    auto found = m_textures.find(path);
+    if (found != m_textures.end())
+    {
+        m_stats.textureHits++;
+        return found->second.Get();
+    }
+
+    PROFILE_SCOPE("Load texture");
+    ComPtr<ID3D11ShaderResourceView>& texture = m_textures[path];
+    if (SUCCEEDED(CreateDDSTextureFromFile(m_device, path.c_str(), nullptr, texture.GetAddressOf())))
+    {
+        m_stats.textures++;
+        m_stats.textureBytes += TextureBytes(texture.Get());
+    }
+
+    return texture.Get();
+}
+
+const MaterialCache::Material* MaterialCache::GetMaterial(const IEffect* effect) const
+{
+    auto found = m_materialOfEffect.find(effect);
+    return found != m_materialOfEffect.end() ? found->second : nullptr;
+}
+
+void MaterialCache::Clear()
+{
+    m_entries.clear();
+    m_materialOfEffect.clear();
+    m_textures.clear();
+    m_stats = Stats();
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <array>
+#include <unordered_map>
+#include <wrl/client.h>
+#include <d3d11_1.h>
+#include "Effects.h"
+
+// Effect factory that shares one effect between all model materials with the same shader, textures and
+// parameters, whichever model they come from.
+//
+// DirectXTK's EffectFactory can only share by material name, which would hand every object using a
+// model the texture of whichever loaded it first, so it runs with sharing off here and this cache does
+// the sharing on the full material instead. Per object textures are then set on the shared effect at
+// draw time rather than baked into a private copy of it.
+//
+// Object textures, loaded by path, are cached here as well so the stats cover everything the scene holds.
+class MaterialCache : public DirectX::IEffectFactory
+{
+public:
+    // What an effect was created from, with its texture names copied out of the EffectInfo
+    struct Material
+    {
+        bool				perVertexColor;
+        bool				enableSkinning;
+        bool				enableDualTexture;
+        bool				enableNormalMaps;
+        bool				biasedVertexNormals;
+        float				specularPower;
+        float				alpha;
+        DirectX::XMFLOAT3	ambientColor;
+        DirectX::XMFLOAT3	diffuseColor;
+        DirectX::XMFLOAT3	specularColor;
+        DirectX::XMFLOAT3	emissiveColor;
+        std::wstring		diffuseTexture;
+        std::wstring		specularTexture;
+        std::wstring		normalTexture;
+    };
+
+    struct Stats
+    {
+        size_t	requests = 0;			//CreateEffect calls, one per model material loaded
+        size_t	materials = 0;			//distinct effects created for them
+        size_t	textures = 0;			//object textures loaded by path
+        size_t	textureRequests = 0;	//LoadTexture calls
+        size_t	textureHits = 0;		//of those, for a path already loaded or already failed
+        size_t	textureBytes = 0;		//GPU memory of those, all mips
+        size_t	effectBytes = 0;		//constant buffer memory of the shared effects, estimated
+    };
+
+    explicit MaterialCache(ID3D11Device* device);
+
+    void SetDirectory(const wchar_t* path) { m_factory.SetDirectory(path); }
+
+    // IEffectFactory
+    std::shared_ptr<DirectX::IEffect> __cdecl CreateEffect(const EffectInfo& info, ID3D11DeviceContext* deviceContext) override;
+    void __cdecl CreateTexture(const wchar_t* name, ID3D11DeviceContext* deviceContext, ID3D11ShaderResourceView** textureView) override;
+
+    // DDS texture by path, loaded on first use. nullptr if it can't be loaded.
+    ID3D11ShaderResourceView* LoadTexture(const std::wstring& path);
+
+    // Material of an effect this cache created, nullptr for any other effect
+    const Material* GetMaterial(const DirectX::IEffect* effect) const;
+
+    // Releases every effect and texture, effects handed out stay alive as long as their users hold them
+    void Clear();
+
+    const Stats& GetStats() const { return m_stats; }
+
+private:
+    typedef std::tuple<uint32_t, std::array<float, 14>, std::wstring, std::wstring, std::wstring> Key;	//flags, parameters, texture names
+
+    struct Entry
+    {
+        std::shared_ptr<DirectX::IEffect>	effect;
+        Material							material;
+    };
+
+    ID3D11Device*								m_device;
+    DirectX::EffectFactory						m_factory;
+    std::map<Key, Entry>						m_entries;
+    std::unordered_map<const DirectX::IEffect*, const Material*>	m_materialOfEffect;
+    std::map<std::wstring, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>>	m_textures;		//by path, null for files that failed to load
+    Stats										m_stats;
+};
@@ -0,0 +1,519 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+    enum VertexKind : uint8_t
+    {
+        VERTEX_BORDER = 1,		//on an edge only one triangle uses
+        VERTEX_SEAM = 2,		//its triangles use more than one of the vertices at its position
+        VERTEX_LOCKED = 4,		//on a non-manifold edge, or where borders or seams meet
+    };
+
+    enum EdgeKind : uint8_t
+    {
+        EDGE_OPEN = 1,
+        EDGE_SEAM = 2,			//the triangles on either side use different vertices for its ends
+        EDGE_NONMANIFOLD = 4,
+    };
+
+    constexpr double BORDER_WEIGHT = 10.0;				//of the planes holding open borders in place
+    constexpr float MIN_NORMAL_DOT = 0.5f;				//collapses may turn a triangle by up to 60 degrees
+    constexpr float MIN_QUALITY = 0.1f;					//of the triangles a collapse makes, unless they were worse before
+    constexpr float COLLAPSES_PER_TRIANGLE = 0.5f;		//a collapse removes two triangles inside a mesh, one on its border
+
+    // Directed welded edge, and the vertices a triangle uses for its ends
+    struct Edge
+    {
+        uint64_t	key;		//from << 32 | to
+        uint32_t	vertexFrom;
+        uint32_t	vertexTo;
+    };
+
+    // Positions compare by their bits, so only exact copies weld
+    struct PositionBits
+    {
+        uint32_t	bits[3];
+
+        bool operator==(const PositionBits& other) const
+        {
+            return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+        }
+
+        struct Hash
+        {
+            size_t operator()(const PositionBits& position) const
+            {
+                return size_t((position.bits[0] * 73856093u) ^ (position.bits[1] * 19349663u) ^ (position.bits[2] * 83492791u));
+            }
+        };
+    };
+
+    uint64_t EdgeKey(uint32_t from, uint32_t to)
+    {
+        return (uint64_t(from) << 32) | to;
+    }
+
+    void Subtract(const float* a, const float* b, float* out)
+    {
+        out[0] = a[0] - b[0];
+        out[1] = a[1] - b[1];
+        out[2] = a[2] - b[2];
+    }
+
+    void Cross(const float* a, const float* b, float* out)
+    {
+        out[0] = (a[1] * b[2]) - (a[2] * b[1]);
+        out[1] = (a[2] * b[0]) - (a[0] * b[2]);
+        out[2] = (a[0] * b[1]) - (a[1] * b[0]);
+    }
+
+    float Dot(const float* a, const float* b)
+    {
+        return (a[0] * b[0]) + (a[1] * b[1]) + (a[2] * b[2]);
+    }
+
+    void TriangleNormal(const float* p0, const float* p1, const float* p2, float* normal)
+    {
+        float e1[3], e2[3];
+        Subtract(p1, p0, e1);
+        Subtract(p2, p0, e2);
+        Cross(e1, e2, normal);
+    }
+
+    // 1 for an equilateral triangle, falling to 0 as it degenerates
+    float Quality(const float* p0, const float* p1, const float* p2)
+    {
+        float e1[3], e2[3], e3[3], normal[3];
+        Subtract(p1, p0, e1);
+        Subtract(p2, p0, e2);
+        Subtract(p2, p1, e3);
+        Cross(e1, e2, normal);
+
+        const float edges = Dot(e1, e1) + Dot(e2, e2) + Dot(e3, e3);
+        return edges > 0.f ? (2.f * std::sqrt(3.f) * std::sqrt(Dot(normal, normal))) / edges : 0.f;
+    }
+}
+
+void MeshSimplifier::AddPlane(Quadric& quadric, double a, double b, double c, double d, double weight)
+{
+    quadric.a2 += a * a * weight;
+    quadric.b2 += b * b * weight;
+    quadric.c2 += c * c * weight;
+    quadric.ab += a * b * weight;
+    quadric.ac += a * c * weight;
+    quadric.bc += b * c * weight;
+    quadric.ad += a * d * weight;
+    quadric.bd += b * d * weight;
+    quadric.cd += c * d * weight;
+    quadric.d2 += d * d * weight;
+    quadric.weight += weight;
+}
+
+void MeshSimplifier::AddQuadric(Quadric& quadric, const Quadric& other)
+{
+    quadric.a2 += other.a2;
+    quadric.b2 += other.b2;
+    quadric.c2 += other.c2;
+    quadric.ab += other.ab;
+    quadric.ac += other.ac;
+    quadric.bc += other.bc;
+    quadric.ad += other.ad;
+    quadric.bd += other.bd;
+    quadric.cd += other.cd;
+    quadric.d2 += other.d2;
+    quadric.weight += other.weight;
+}
+
+double MeshSimplifier::Evaluate(const Quadric& q, const float* position)
+{
+    const double x = position[0];
+    const double y = position[1];
+    const double z = position[2];
+    const double error = (q.a2 * x * x) + (q.b2 * y * y) + (q.c2 * z * z)
+                       + 2.0 * ((q.ab * x * y) + (q.ac * x * z) + (q.bc * y * z))
+                       + 2.0 * ((q.ad * x) + (q.bd * y) + (q.cd * z)) + q.d2;
+    return std::max(error, 0.0);
+}
+
+const float* MeshSimplifier::Position(uint32_t vertex) const
+{
+    return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(m_input.positions) + (vertex * m_input.positionStride));
+}
+
+bool MeshSimplifier::FlipsTriangle(uint32_t from, uint32_t to) const
+{
+    const float* target = Position(to);
+
+    for (uint32_t t = m_firstTriangle[from]; t < m_firstTriangle[from + 1]; t++)
+    {
+        const uint32_t* corners = &m_indices[m_triangles[t] * 3];
+        uint32_t welded[3] = { m_weld[corners[0]], m_weld[corners[1]], m_weld[corners[2]] };
+
+        // Triangles on the edge disappear
+        if (welded[0] == to || welded[1] == to || welded[2] == to)
+            continue;
+
+        const float* before[3] = { Position(welded[0]), Position(welded[1]), Position(welded[2]) };
+        const float* after[3] = { before[0], before[1], before[2] };
+        for (int c = 0; c < 3; c++)
+        {
+            if (welded[c] == from)
+                after[c] = target;
+        }
+
+        float normalBefore[3], normalAfter[3];
+        TriangleNormal(before[0], before[1], before[2], normalBefore);
+        TriangleNormal(after[0], after[1], after[2], normalAfter);
+
+        const float lengths = std::sqrt(Dot(normalBefore, normalBefore) * Dot(normalAfter, normalAfter));
+        if (Dot(normalBefore, normalAfter) <= MIN_NORMAL_DOT * lengths)
+            return true;
+
+        // Slivers would turn over a little more every pass, so none are made that weren't there
+        const float quality = Quality(after[0], after[1], after[2]);
+        if (quality < MIN_QUALITY && quality < Quality(before[0], before[1], before[2]))
+            return true;
+    }
+
+    return false;
+}
+
+uint32_t MeshSimplifier::ClosestCopy(uint32_t vertex, uint32_t target) const
+{
+    if (!m_input.attributes)
+        return target;
+
+    const float* attributes = m_input.attributes + (vertex * m_input.attributeCount);
+    uint32_t closest = target;
+    float closestDistance = -1.f;
+
+    uint32_t copy = target;
+    do
+    {
+        const float* candidate = m_input.attributes + (copy * m_input.attributeCount);
+        float distance = 0.f;
+        for (size_t a = 0; a < m_input.attributeCount; a++)
+            distance += (attributes[a] - candidate[a]) * (attributes[a] - candidate[a]);
+
+        if (closestDistance < 0.f || distance < closestDistance)
+        {
+            closest = copy;
+            closestDistance = distance;
+        }
+        copy = m_nextCopy[copy];
+    } while (copy != target);
+
+    return closest;
+}
+
+void MeshSimplifier::Simplify(const Input& input, size_t targetIndexCount, float maxError, std::vector<uint32_t>& result)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    m_input = input;
+    m_stats = Stats();
+    m_stats.trianglesIn = input.indexCount / 3;
+    m_indices.assign(input.indices, input.indices + (m_stats.trianglesIn * 3));
+
+    const uint32_t numVertices = uint32_t(input.vertexCount);
+
+    // Weld by position, linking the vertices at each point into a ring
+    m_weld.resize(numVertices);
+    m_nextCopy.resize(numVertices);
+    {
+        std::unordered_map<PositionBits, uint32_t, PositionBits::Hash> firstAt;
+        firstAt.reserve(numVertices);
+        for (uint32_t v = 0; v < numVertices; v++)
+        {
+            PositionBits bits;
+            std::memcpy(bits.bits, Position(v), sizeof(bits.bits));
+            const uint32_t first = firstAt.emplace(bits, v).first->second;
+            m_weld[v] = first;
+            m_nextCopy[v] = v;
+            if (first != v)
+            {
+                m_nextCopy[v] = m_nextCopy[first];
+                m_nextCopy[first] = v;
+            }
+        }
+    }
+
+    // Errors are measured against the size of the mesh
+    float boundsMin[3] = { 0.f, 0.f, 0.f };
+    float boundsMax[3] = { 0.f, 0.f, 0.f };
+    for (size_t i = 0; i < m_indices.size(); i++)
+    {
+        const float* position = Position(m_indices[i]);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            boundsMin[axis] = i == 0 ? position[axis] : std::min(boundsMin[axis], position[axis]);
+            boundsMax[axis] = i == 0 ? position[axis] : std::max(boundsMax[axis], position[axis]);
+        }
+    }
+    float extent[3];
+    Subtract(boundsMax, boundsMin, extent);
+    const float scale = std::sqrt(Dot(extent, extent));
+    const double maxCost = double(maxError * scale) * double(maxError * scale);
+
+    std::vector<Edge> edges;
+    std::vector<uint8_t> edgeKinds;
+    std::vector<uint8_t> touched(numVertices);
+    std::vector<uint8_t> openEdges(numVertices);
+    std::vector<uint8_t> seamEdges(numVertices);
+    std::vector<uint32_t> firstUsed(numVertices, UINT32_MAX);
+    std::vector<uint32_t> remap(numVertices);
+    double largestCost = 0.0;
+
+    m_kind.assign(numVertices, 0);
+    m_quadrics.assign(numVertices, Quadric());
+
+    while (m_indices.size() > targetIndexCount)
+    {
+        // Drop triangles whose corners collapsed onto each other
+        size_t kept = 0;
+        for (size_t i = 0; i + 2 < m_indices.size(); i += 3)
+        {
+            const uint32_t a = m_weld[m_indices[i]], b = m_weld[m_indices[i + 1]], c = m_weld[m_indices[i + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+
+            m_indices[kept++] = m_indices[i];
+            m_indices[kept++] = m_indices[i + 1];
+            m_indices[kept++] = m_indices[i + 2];
+        }
+        m_indices.resize(kept);
+        if (m_indices.size() <= targetIndexCount)
+            break;
+
+        const uint32_t numTriangles = uint32_t(m_indices.size() / 3);
+
+        // Directed edges, sorted so the edge back along each one can be found
+        edges.resize(m_indices.size());
+        for (uint32_t t = 0; t < numTriangles; t++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                const uint32_t from = m_indices[(t * 3) + c];
+                const uint32_t to = m_indices[(t * 3) + ((c + 1) % 3)];
+                edges[(t * 3) + c] = { EdgeKey(m_weld[from], m_weld[to]), from, to };
+            }
+        }
+        std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) { return a.key < b.key; });
+
+        const auto FindEdge = [&](uint64_t key)
+        {
+            return std::lower_bound(edges.begin(), edges.end(), key, [](const Edge& edge, uint64_t k) { return edge.key < k; });
+        };
+
+        // Classify the edges, and the vertices by the edges they are on
+        edgeKinds.assign(edges.size(), 0);
+        std::fill(m_kind.begin(), m_kind.end(), uint8_t(0));
+        std::fill(openEdges.begin(), openEdges.end(), uint8_t(0));
+        std::fill(seamEdges.begin(), seamEdges.end(), uint8_t(0));
+        for (size_t e = 0; e < edges.size(); e++)
+        {
+            const uint32_t from = uint32_t(edges[e].key >> 32);
+            const uint32_t to = uint32_t(edges[e].key);
+            const auto back = FindEdge(EdgeKey(to, from));
+            const bool hasBack = back != edges.end() && back->key == EdgeKey(to, from);
+            const bool duplicated = (e > 0 && edges[e - 1].key == edges[e].key) || (e + 1 < edges.size() && edges[e + 1].key == edges[e].key)
+                                 || (hasBack && back + 1 != edges.end() && (back + 1)->key == back->key);
+
+            if (duplicated)
+                edgeKinds[e] = EDGE_NONMANIFOLD;
+            else if (!hasBack)
+                edgeKinds[e] = EDGE_OPEN;
+            else if (back->vertexFrom != edges[e].vertexTo || back->vertexTo != edges[e].vertexFrom)
+                edgeKinds[e] = EDGE_SEAM;
+
+            if (edgeKinds[e] & EDGE_NONMANIFOLD)
+            {
+                m_kind[from] |= VERTEX_LOCKED;
+                m_kind[to] |= VERTEX_LOCKED;
+            }
+            if (edgeKinds[e] & EDGE_OPEN)
+            {
+                m_kind[from] |= VERTEX_BORDER;
+                m_kind[to] |= VERTEX_BORDER;
+                openEdges[from] = uint8_t(std::min(openEdges[from] + 1, 255));
+                openEdges[to] = uint8_t(std::min(openEdges[to] + 1, 255));
+            }
+            if ((edgeKinds[e] & EDGE_SEAM) && from < to)
+            {
+                seamEdges[from] = uint8_t(std::min(seamEdges[from] + 1, 255));
+                seamEdges[to] = uint8_t(std::min(seamEdges[to] + 1, 255));
+            }
+            if (m_weld[edges[e].vertexFrom] != edges[e].vertexFrom || m_nextCopy[edges[e].vertexFrom] != edges[e].vertexFrom)
+            {
+                // Split only if the triangles here really use more than one of its copies
+                if (firstUsed[from] == UINT32_MAX)
+                    firstUsed[from] = edges[e].vertexFrom;
+                else if (firstUsed[from] != edges[e].vertexFrom)
+                    m_kind[from] |= VERTEX_SEAM;
+            }
+        }
+
+        // Where borders or seams meet or end, moving the vertex would bend one of them. A seam reaching a
+        // border would slide along it, taking the triangles of one side across to the other.
+        for (uint32_t v = 0; v < numVertices; v++)
+        {
+            const bool borderEnds = (m_kind[v] & VERTEX_BORDER) && openEdges[v] != 2;
+            const bool seamEnds = (m_kind[v] & VERTEX_SEAM) && ((m_kind[v] & VERTEX_BORDER) || seamEdges[v] != 2);
+            if (borderEnds || seamEnds)
+                m_kind[v] |= VERTEX_LOCKED;
+            firstUsed[v] = UINT32_MAX;
+        }
+
+        // Quadrics come from the input mesh, its faces and borders
+        if (m_stats.passes == 0)
+        {
+            for (uint32_t t = 0; t < numTriangles; t++)
+            {
+                const uint32_t* corners = &m_indices[t * 3];
+                const float* p[3] = { Position(corners[0]), Position(corners[1]), Position(corners[2]) };
+                float normal[3];
+                TriangleNormal(p[0], p[1], p[2], normal);
+                const float length = std::sqrt(Dot(normal, normal));
+                if (length <= 0.f)
+                    continue;
+
+                const double a = normal[0] / length, b = normal[1] / length, c = normal[2] / length;
+                const double d = -((a * p[0][0]) + (b * p[0][1]) + (c * p[0][2]));
+                for (int corner = 0; corner < 3; corner++)
+                    AddPlane(m_quadrics[m_weld[corners[corner]]], a, b, c, d, length * 0.5);
+
+                // Open edges also get the plane through them perpendicular to the triangle
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    const uint32_t from = m_weld[corners[corner]];
+                    const uint32_t to = m_weld[corners[(corner + 1) % 3]];
+                    const auto back = FindEdge(EdgeKey(to, from));
+                    if (back != edges.end() && back->key == EdgeKey(to, from))
+                        continue;
+
+                    float along[3], planeNormal[3];
+                    Subtract(Position(to), Position(from), along);
+                    Cross(along, normal, planeNormal);
+                    const float planeLength = std::sqrt(Dot(planeNormal, planeNormal));
+                    if (planeLength <= 0.f)
+                        continue;
+
+                    const double pa = planeNormal[0] / planeLength, pb = planeNormal[1] / planeLength, pc = planeNormal[2] / planeLength;
+                    const double pd = -((pa * Position(from)[0]) + (pb * Position(from)[1]) + (pc * Position(from)[2]));
+                    const double weight = BORDER_WEIGHT * Dot(along, along);
+                    AddPlane(m_quadrics[from], pa, pb, pc, pd, weight);
+                    AddPlane(m_quadrics[to], pa, pb, pc, pd, weight);
+                }
+            }
+        }
+
+        // Triangles around every welded vertex
+        m_firstTriangle.assign(numVertices + 1, 0);
+        for (uint32_t index : m_indices)
+            m_firstTriangle[m_weld[index] + 1]++;
+        for (uint32_t v = 0; v < numVertices; v++)
+            m_firstTriangle[v + 1] += m_firstTriangle[v];
+        m_triangles.resize(m_indices.size());
+        {
+            std::vector<uint32_t> next(m_firstTriangle.begin(), m_firstTriangle.end() - 1);
+            for (uint32_t t = 0; t < numTriangles; t++)
+            {
+                for (int c = 0; c < 3; c++)
+                    m_triangles[next[m_weld[m_indices[(t * 3) + c]]]++] = t;
+            }
+        }
+
+        // Cheapest allowed direction of every edge
+        m_collapses.clear();
+        for (size_t e = 0; e < edges.size(); e++)
+        {
+            const uint32_t a = uint32_t(edges[e].key >> 32);
+            const uint32_t b = uint32_t(edges[e].key);
+            if (a > b && !(edgeKinds[e] & EDGE_OPEN))
+                continue;		//the edge back along it covers this one
+
+            const auto Allowed = [&](uint32_t from)
+            {
+                const uint8_t kind = m_kind[from];
+                if (kind & VERTEX_LOCKED)
+                    return false;
+                if (kind & VERTEX_BORDER)
+                    return (edgeKinds[e] & EDGE_OPEN) != 0;
+                if (kind & VERTEX_SEAM)
+                    return (edgeKinds[e] & EDGE_SEAM) != 0;
+                return true;
+            };
+
+            Quadric sum = m_quadrics[a];
+            AddQuadric(sum, m_quadrics[b]);
+            const double weight = std::max(sum.weight, 1e-30);
+
+            Collapse collapse = { a, b, -1.f };
+            if (Allowed(a))
+                collapse.cost = float(Evaluate(sum, Position(b)) / weight);
+            if (Allowed(b))
+            {
+                const float cost = float(Evaluate(sum, Position(a)) / weight);
+                if (collapse.cost < 0.f || cost < collapse.cost)
+                    collapse = { b, a, cost };
+            }
+
+            if (collapse.cost >= 0.f && collapse.cost <= maxCost)
+                m_collapses.push_back(collapse);
+        }
+
+        std::sort(m_collapses.begin(), m_collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+        // Apply independent collapses until the target is in reach
+        const size_t wanted = size_t(float((m_indices.size() - targetIndexCount) / 3) * COLLAPSES_PER_TRIANGLE) + 1;
+        size_t collapsed = 0;
+        std::fill(touched.begin(), touched.end(), uint8_t(0));
+        for (uint32_t v = 0; v < numVertices; v++)
+            remap[v] = v;
+
+        for (const Collapse& collapse : m_collapses)
+        {
+            if (collapsed >= wanted)
+                break;
+            if (touched[collapse.from] || touched[collapse.to] || FlipsTriangle(collapse.from, collapse.to))
+                continue;
+
+            // Every vertex at the point moves to the copy of the target most like it
+            uint32_t copy = collapse.from;
+            do
+            {
+                remap[copy] = ClosestCopy(copy, collapse.to);
+                copy = m_nextCopy[copy];
+            } while (copy != collapse.from);
+
+            AddQuadric(m_quadrics[collapse.to], m_quadrics[collapse.from]);
+            largestCost = std::max(largestCost, double(collapse.cost));
+
+            // The triangles around it changed, nothing else there moves this pass
+            for (uint32_t t = m_firstTriangle[collapse.from]; t < m_firstTriangle[collapse.from + 1]; t++)
+            {
+                for (int c = 0; c < 3; c++)
+                    touched[m_weld[m_indices[(m_triangles[t] * 3) + c]]] = 1;
+            }
+            collapsed++;
+        }
+
+        m_stats.passes++;
+        if (collapsed == 0)
+            break;
+
+        for (uint32_t& index : m_indices)
+            index = remap[index];
+    }
+
+    result = m_indices;
+
+    m_stats.trianglesOut = result.size() / 3;
+    m_stats.error = scale > 0.f ? float(std::sqrt(largestCost)) / scale : 0.f;
+    m_stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
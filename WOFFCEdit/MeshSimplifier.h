@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Reduces the triangle count of an indexed triangle list by edge collapses ordered by quadric error
+// (Garland and Heckbert). Vertices are never moved or created: every collapse merges a vertex into one
+// of its neighbours, so the result indexes the input's vertex buffer and only the indices change.
+//
+// Vertices are welded by position first, so the same point split by its normals or texcoords moves as
+// one. Split points only collapse along edges that are split too, and pick the copy of the target whose
+// attributes are closest, which keeps texture seams and hard edges intact. Open borders only collapse
+// along themselves and carry extra planes in their quadrics so the outline holds its shape. Vertices on
+// non-manifold edges never move, and collapses that would flip a triangle are rejected.
+//
+// Collapses run in passes: every pass sorts the candidate edges by error and applies as many
+// independent collapses as it needs, cheapest first.
+class MeshSimplifier
+{
+public:
+    struct Input
+    {
+        const uint32_t*	indices = nullptr;
+        size_t			indexCount = 0;
+        const float*	positions = nullptr;		//xyz at the start of each vertex
+        size_t			positionStride = 3 * sizeof(float);	//bytes
+        size_t			vertexCount = 0;
+        const float*	attributes = nullptr;		//optional, attributeCount floats per vertex (normal and texcoord, say)
+        size_t			attributeCount = 0;
+    };
+
+    struct Stats
+    {
+        size_t	trianglesIn = 0;
+        size_t	trianglesOut = 0;
+        size_t	passes = 0;
+        float	error = 0.f;		//largest collapse error, relative to the size of the mesh
+        double	milliseconds = 0.0;
+    };
+
+    // Simplifies down to 'targetIndexCount' indices, or as far as it gets without a collapse costing more
+    // than 'maxError' (a distance, as a fraction of the mesh's bounding box diagonal)
+    void Simplify(const Input& input, size_t targetIndexCount, float maxError, std::vector<uint32_t>& result);
+
+    const Stats& GetStats() const { return m_stats; }
+
+private:
+    // Sum of squared distances to a set of planes, weighted by area
+    struct Quadric
+    {
+        double	a2, b2, c2, ab, ac, bc, ad, bd, cd, d2;
+        double	weight;
+    };
+
+    struct Collapse
+    {
+        uint32_t	from;		//welded vertices
+        uint32_t	to;
+        float		cost;
+    };
+
+    static void AddPlane(Quadric& quadric, double a, double b, double c, double d, double weight);
+    static void AddQuadric(Quadric& quadric, const Quadric& other);
+    static double Evaluate(const Quadric& quadric, const float* position);
+
+    const float* Position(uint32_t vertex) const;
+    bool FlipsTriangle(uint32_t from, uint32_t to) const;
+    uint32_t ClosestCopy(uint32_t vertex, uint32_t target) const;
+
+    Input						m_input;
+    std::vector<uint32_t>		m_weld;				//vertex to the first vertex with its position
+    std::vector<uint32_t>		m_nextCopy;			//circular list of the vertices sharing a position
+    std::vector<uint8_t>		m_kind;				//VertexKind of welded vertices
+    std::vector<Quadric>		m_quadrics;			//of welded vertices
+    std::vector<uint32_t>		m_indices;			//current triangles
+    std::vector<uint32_t>		m_firstTriangle;	//welded vertex to triangles around it, [m_firstTriangle[v], m_firstTriangle[v + 1])
+    std::vector<uint32_t>		m_triangles;
+    std::vector<Collapse>		m_collapses;
+    Stats						m_stats;
+};
@@ -0,0 +1,557 @@
+#include "ObjFile.h"
+#include "JobSystem.h"
+#include "Platform.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using Clock = std::chrono::high_resolution_clock;
+
+namespace
+{
+    // Decimals written per float. Matches what Maya and most DCC tools export.
+    constexpr int FLOAT_DECIMALS = 6;
+    constexpr double FLOAT_SCALE = 1000000.0;
+    // Beyond this the fixed point conversion would overflow, fall back to printf
+    constexpr double MAX_FIXED_POINT = 9.0e12;
+
+    double SecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+}
+
+#pragma region ObjWriter
+ObjWriter::~ObjWriter()
+{
+    Close();
+}
+
+bool ObjWriter::Open(const std::string& path)
+{
+    Close();
+
+    m_openTime = Clock::now();
+    m_stats = ObjIoStats();
+    m_failed = false;
+    m_used = 0;
+    m_positionCount = 0;
+    m_objectBase = 0;
+
+    errno_t ret = fopen_s(&m_file, path.c_str(), "wb");
+    return ret == 0 && m_file != nullptr;
+}
+
+bool ObjWriter::Close()
+{
+    Flush();
+    if (!m_file)
+        return !m_failed;
+
+    fclose(m_file);
+    m_file = nullptr;
+
+    m_stats.seconds = SecondsSince(m_openTime);
+    return !m_failed;
+}
+
+void ObjWriter::Comment(const char* text)
+{
+    Reserve(strlen(text) + 3);
+    PutString("# ");
+    PutString(text);
+    Put('\n');
+}
+
+void ObjWriter::BeginObject(const char* name)
+{
+    m_objectBase = m_positionCount;
+
+    Reserve(strlen(name) + 3);
+    PutString("o ");
+    PutString(name);
+    Put('\n');
+}
+
+void ObjWriter::Position(float x, float y, float z)
+{
+    Reserve(128);
+    PutString("v ");
+    PutFloat(x);
+    Put(' ');
+    PutFloat(y);
+    Put(' ');
+    PutFloat(z);
+    Put('\n');
+
+    ++m_positionCount;
+}
+
+void ObjWriter::TexCoord(float u, float v)
+{
+    Reserve(96);
+    PutString("vt ");
+    PutFloat(u);
+    Put(' ');
+    PutFloat(v);
+    Put('\n');
+}
+
+void ObjWriter::Normal(float x, float y, float z)
+{
+    Reserve(128);
+    PutString("vn ");
+    PutFloat(x);
+    Put(' ');
+    PutFloat(y);
+    Put(' ');
+    PutFloat(z);
+    Put('\n');
+}
+
+void ObjWriter::Triangle(uint32_t i0, uint32_t i1, uint32_t i2)
+{
+    Reserve(128);
+    Put('f');
+    PutVertexRef(i0);
+    PutVertexRef(i1);
+    PutVertexRef(i2);
+    Put('\n');
+}
+
+void ObjWriter::Reserve(size_t bytes)
+{
+    if (m_used + bytes > BUFFER_SIZE)
+        Flush();
+}
+
+void ObjWriter::PutString(const char* text)
+{
+    while (*text)
+    {
+        if (m_used == BUFFER_SIZE)
+            Flush();
+        Put(*text++);
+    }
+}
+
+void ObjWriter::PutUInt(uint32_t value)
+{
+    char digits[10];
+    int count = 0;
+    do
+    {
+        digits[count++] = char('0' + (value % 10));
+        value /= 10;
+    } while (value);
+
+    while (count)
+        Put(digits[--count]);
+}
+
+void ObjWriter::PutVertexRef(uint32_t index)
+{
+    // " v/vt/vn", 1-based
+    const uint32_t objIndex = m_objectBase + index + 1;
+    Put(' ');
+    PutUInt(objIndex);
+    Put('/');
+    PutUInt(objIndex);
+    Put('/');
+    PutUInt(objIndex);
+}
+
+void ObjWriter::PutFloat(float value)
+{
+    double v = value;
+    if (!(std::abs(v) < MAX_FIXED_POINT))	//also catches NaN
+    {
+        char text[32];
+        const int length = snprintf(text, sizeof(text), "%g", v);
+        for (int i = 0; i < length; i++)
+            Put(text[i]);
+        return;
+    }
+
+    // Round to a fixed number of decimals once, then print integer and fraction parts from integers
+    const bool negative = v < 0.0;
+    const uint64_t fixed = static_cast<uint64_t>((std::abs(v) * FLOAT_SCALE) + 0.5);
+    const uint64_t whole = fixed / static_cast<uint64_t>(FLOAT_SCALE);
+    uint64_t fraction = fixed % static_cast<uint64_t>(FLOAT_SCALE);
+
+    if (negative)
+        Put('-');
+
+    char digits[20];
+    int count = 0;
+    uint64_t w = whole;
+    do
+    {
+        digits[count++] = char('0' + (w % 10));
+        w /= 10;
+    } while (w);
+
+    while (count)
+        Put(digits[--count]);
+
+    Put('.');
+    for (int i = FLOAT_DECIMALS - 1; i >= 0; i--)
+    {
+        digits[i] = char('0' + (fraction % 10));
+        fraction /= 10;
+    }
+    for (int i = 0; i < FLOAT_DECIMALS; i++)
+        Put(digits[i]);
+}
+
+void ObjWriter::Flush()
+{
+    if (m_used == 0)
+        return;
+
+    //not open, or the open failed: what was buffered is lost, and the buffer must still empty for the next write
+    if (!m_file)
+    {
+        m_used = 0;
+        m_failed = true;
+        return;
+    }
+
+    if (fwrite(m_buffer, 1, m_used, m_file) != m_used)
+        m_failed = true;
+
+    m_stats.bytes += m_used;
+    m_used = 0;
+}
+#pragma endregion
+
+#pragma region ObjReader
+namespace
+{
+    // Everything parsed from one block of lines. Indices in 'corners' are already 0-based; the
+    // entries listed in 'relativeCorners' used negative (relative) OBJ indices and are relative to
+    // the start of the block until the blocks are stitched together.
+    struct ObjBlock
+    {
+        std::vector<float> positions;
+        std::vector<float> texcoords;
+        std::vector<float> normals;
+        std::vector<ObjMesh::Corner> corners;
+        std::vector<uint32_t> relativeCorners;	//corner index * 3 + component (0 = position, 1 = texcoord, 2 = normal)
+    };
+
+    const double POWERS_OF_TEN[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    inline bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t';
+    }
+
+    inline bool IsDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    inline const char* SkipSpaces(const char* p, const char* end)
+    {
+        while (p < end && IsSpace(*p))
+            ++p;
+        return p;
+    }
+
+    // Locale independent decimal float parser, faster than strtof for the simple numbers OBJ files hold
+    const char* ParseFloat(const char* p, const char* end, float& out)
+    {
+        p = SkipSpaces(p, end);
+
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = (*p++ == '-');
+
+        uint64_t mantissa = 0;
+        int exponent = 0;
+        int digits = 0;
+        for (; p < end && IsDigit(*p); ++p)
+        {
+            if (digits++ < 19)
+                mantissa = (mantissa * 10) + (*p - '0');
+            else
+                ++exponent;
+        }
+
+        if (p < end && *p == '.')
+        {
+            for (++p; p < end && IsDigit(*p); ++p)
+            {
+                if (digits++ < 19)
+                {
+                    mantissa = (mantissa * 10) + (*p - '0');
+                    --exponent;
+                }
+            }
+        }
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            ++p;
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+'))
+                negativeExponent = (*p++ == '-');
+
+            int e = 0;
+            for (; p < end && IsDigit(*p); ++p)
+                e = std::min((e * 10) + (*p - '0'), 10000);
+
+            exponent += negativeExponent ? -e : e;
+        }
+
+        double value = double(mantissa);
+        if (exponent < 0)
+            value = exponent >= -22 ? value / POWERS_OF_TEN[-exponent] : value * std::pow(10.0, exponent);
+        else if (exponent > 0)
+            value = exponent <= 22 ? value * POWERS_OF_TEN[exponent] : value * std::pow(10.0, exponent);
+
+        out = float(negative ? -value : value);
+        return p;
+    }
+
+    const char* ParseInt(const char* p, const char* end, int32_t& out, bool& present)
+    {
+        bool negative = false;
+        if (p < end && *p == '-')
+        {
+            negative = true;
+            ++p;
+        }
+
+        present = p < end && IsDigit(*p);
+        int32_t value = 0;
+        for (; p < end && IsDigit(*p); ++p)
+            value = (value * 10) + (*p - '0');
+
+        out = negative ? -value : value;
+        return p;
+    }
+
+    // Converts an OBJ index (1-based, or negative relative to 'count') to 0-based.
+    // Returns true if the result is relative to the start of the block.
+    inline bool ResolveIndex(int32_t objIndex, size_t count, int32_t& resolved)
+    {
+        if (objIndex < 0)
+        {
+            resolved = int32_t(count) + objIndex;
+            return true;
+        }
+
+        resolved = objIndex - 1;
+        return false;
+    }
+
+    void ParseFace(const char* p, const char* end, ObjBlock& block)
+    {
+        ObjMesh::Corner first = { -1, -1, -1 };
+        ObjMesh::Corner previous = { -1, -1, -1 };
+        bool relative[2][3] = {};	//relative flags of the first and previous corner
+        int numCorners = 0;
+
+        while (true)
+        {
+            p = SkipSpaces(p, end);
+            if (p >= end || !(IsDigit(*p) || *p == '-'))
+                break;
+
+            ObjMesh::Corner corner = { -1, -1, -1 };
+            bool cornerRelative[3] = {};
+            int32_t value;
+            bool present;
+
+            p = ParseInt(p, end, value, present);
+            if (present)
+                cornerRelative[0] = ResolveIndex(value, block.positions.size() / 3, corner.position);
+
+            if (p < end && *p == '/')
+            {
+                p = ParseInt(p + 1, end, value, present);
+                if (present)
+                    cornerRelative[1] = ResolveIndex(value, block.texcoords.size() / 2, corner.texcoord);
+
+                if (p < end && *p == '/')
+                {
+                    p = ParseInt(p + 1, end, value, present);
+                    if (present)
+                        cornerRelative[2] = ResolveIndex(value, block.normals.size() / 3, corner.normal);
+                }
+            }
+
+            // Triangle fan around the first corner
+            if (numCorners >= 2)
+            {
+                const ObjMesh::Corner triangle[3] = { first, previous, corner };
+                const bool* flags[3] = { relative[0], relative[1], cornerRelative };
+                for (int c = 0; c < 3; c++)
+                {
+                    for (int component = 0; component < 3; component++)
+                    {
+                        if (flags[c][component])
+                            block.relativeCorners.push_back(uint32_t((block.corners.size() * 3) + component));
+                    }
+                    block.corners.push_back(triangle[c]);
+                }
+            }
+
+            if (numCorners == 0)
+            {
+                first = corner;
+                std::copy(cornerRelative, cornerRelative + 3, relative[0]);
+            }
+            previous = corner;
+            std::copy(cornerRelative, cornerRelative + 3, relative[1]);
+            ++numCorners;
+
+            while (p < end && !IsSpace(*p))	//skip anything unexpected in the corner
+                ++p;
+        }
+    }
+
+    void ParseBlock(const char* p, const char* end, ObjBlock& block)
+    {
+        while (p < end)
+        {
+            const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+            if (!lineEnd)
+                lineEnd = end;
+
+            const char* q = SkipSpaces(p, lineEnd);
+            if (lineEnd - q >= 2)
+            {
+                float x, y, z;
+                if (q[0] == 'v' && IsSpace(q[1]))
+                {
+                    q = ParseFloat(q + 2, lineEnd, x);
+                    q = ParseFloat(q, lineEnd, y);
+                    ParseFloat(q, lineEnd, z);
+                    block.positions.push_back(x);
+                    block.positions.push_back(y);
+                    block.positions.push_back(z);
+                }
+                else if (q[0] == 'v' && q[1] == 't')
+                {
+                    q = ParseFloat(q + 2, lineEnd, x);
+                    ParseFloat(q, lineEnd, y);
+                    block.texcoords.push_back(x);
+                    block.texcoords.push_back(y);
+                }
+                else if (q[0] == 'v' && q[1] == 'n')
+                {
+                    q = ParseFloat(q + 2, lineEnd, x);
+                    q = ParseFloat(q, lineEnd, y);
+                    ParseFloat(q, lineEnd, z);
+                    block.normals.push_back(x);
+                    block.normals.push_back(y);
+                    block.normals.push_back(z);
+                }
+                else if (q[0] == 'f' && IsSpace(q[1]))
+                {
+                    ParseFace(q + 2, lineEnd, block);
+                }
+            }
+
+            p = lineEnd + 1;
+        }
+    }
+}
+
+void ObjReader::Parse(const char* data, size_t size, ObjMesh& mesh, size_t blockSize)
+{
+    // Split into blocks ending on a line break
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (size_t start = 0; start < size;)
+    {
+        size_t end = std::min(start + std::max<size_t>(blockSize, 1), size);
+        while (end < size && data[end - 1] != '\n')
+            ++end;
+
+        ranges.emplace_back(start, end);
+        start = end;
+    }
+
+    std::vector<ObjBlock> blocks(ranges.size());
+    JobSystem::ParallelFor(size_t(0), ranges.size(), [&](size_t b)
+    {
+        ParseBlock(data + ranges[b].first, data + ranges[b].second, blocks[b]);
+    });
+
+    // Element counts before each block, to rebase relative indices
+    size_t totalPositions = 0, totalTexcoords = 0, totalNormals = 0, totalCorners = 0;
+    std::vector<size_t> positionBase(blocks.size()), texcoordBase(blocks.size()), normalBase(blocks.size()), cornerBase(blocks.size());
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        positionBase[b] = totalPositions;
+        texcoordBase[b] = totalTexcoords;
+        normalBase[b] = totalNormals;
+        cornerBase[b] = totalCorners;
+
+        totalPositions += blocks[b].positions.size();
+        totalTexcoords += blocks[b].texcoords.size();
+        totalNormals += blocks[b].normals.size();
+        totalCorners += blocks[b].corners.size();
+    }
+
+    mesh.positions.resize(totalPositions);
+    mesh.texcoords.resize(totalTexcoords);
+    mesh.normals.resize(totalNormals);
+    mesh.corners.resize(totalCorners);
+
+    // Stitch the blocks together, also in parallel as every block writes its own range
+    JobSystem::ParallelFor(size_t(0), blocks.size(), [&](size_t b)
+    {
+        ObjBlock& block = blocks[b];
+        for (uint32_t relative : block.relativeCorners)
+        {
+            ObjMesh::Corner& corner = block.corners[relative / 3];
+            switch (relative % 3)
+            {
+                case 0: corner.position += int32_t(positionBase[b] / 3); break;
+                case 1: corner.texcoord += int32_t(texcoordBase[b] / 2); break;
+                case 2: corner.normal += int32_t(normalBase[b] / 3); break;
+            }
+        }
+
+        std::copy(block.positions.begin(), block.positions.end(), mesh.positions.begin() + positionBase[b]);
+        std::copy(block.texcoords.begin(), block.texcoords.end(), mesh.texcoords.begin() + texcoordBase[b]);
+        std::copy(block.normals.begin(), block.normals.end(), mesh.normals.begin() + normalBase[b]);
+        std::copy(block.corners.begin(), block.corners.end(), mesh.corners.begin() + cornerBase[b]);
+    });
+}
+
+bool ObjReader::Read(const std::string& path, ObjMesh& mesh, ObjIoStats* stats)
+{
+    const Clock::time_point start = Clock::now();
+
+    FILE* pFile = nullptr;
+    errno_t ret = fopen_s(&pFile, path.c_str(), "rb");
+    if (ret != 0 || pFile == nullptr)
+        return false;
+
+    fseek(pFile, 0, SEEK_END);
+    const long size = ftell(pFile);
+    fseek(pFile, 0, SEEK_SET);
+
+    std::vector<char> data(size > 0 ? size_t(size) : 0);
+    const size_t read = fread(data.data(), 1, data.size(), pFile);
+    fclose(pFile);
+
+    if (read != data.size())
+        return false;
+
+    Parse(data.data(), data.size(), mesh);
+
+    if (stats)
+    {
+        stats->bytes = data.size();
+        stats->seconds = SecondsSince(start);
+    }
+
+    return true;
+}
+#pragma endregion
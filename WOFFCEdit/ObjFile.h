@@ -0,0 +1,91 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Geometry read from a Wavefront OBJ file. Faces are triangulated as a fan; every corner refers to
+// 0-based position / texcoord / normal indices, with -1 where the file gave none.
+struct ObjMesh
+{
+    struct Corner
+    {
+        int32_t position;
+        int32_t texcoord;
+        int32_t normal;
+    };
+
+    std::vector<float> positions;	//xyz
+    std::vector<float> texcoords;	//uv
+    std::vector<float> normals;		//xyz
+    std::vector<Corner> corners;	//three per triangle
+};
+
+// Bytes moved and time taken by an OBJ read or write, for throughput reporting
+struct ObjIoStats
+{
+    size_t bytes = 0;
+    double seconds = 0.0;
+
+    double MegabytesPerSecond() const { return seconds > 0.0 ? (bytes / (1024.0 * 1024.0)) / seconds : 0.0; }
+};
+
+// Streams an OBJ file out through a fixed size buffer. Floats are formatted with a fixed number of
+// decimals by integer arithmetic instead of printf, which is the bottleneck of a naive writer.
+// Face indices are given 0-based relative to the vertices written since the last BeginObject(),
+// so several meshes can be appended one after the other.
+class ObjWriter
+{
+public:
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+    ObjWriter() = default;
+    ObjWriter(const ObjWriter&) = delete;
+    ObjWriter& operator=(const ObjWriter&) = delete;
+    ~ObjWriter();
+
+    bool Open(const std::string& path);
+    bool Close();	//flushes; false if any write failed
+
+    void Comment(const char* text);
+    void BeginObject(const char* name);
+    void Position(float x, float y, float z);
+    void TexCoord(float u, float v);
+    void Normal(float x, float y, float z);
+    // Triangle with matching position / texcoord / normal indices, as produced by an indexed vertex buffer
+    void Triangle(uint32_t i0, uint32_t i1, uint32_t i2);
+
+    const ObjIoStats& GetStats() const { return m_stats; }
+
+private:
+    void Reserve(size_t bytes);
+    void Put(char c) { m_buffer[m_used++] = c; }
+    void PutString(const char* text);
+    void PutFloat(float value);
+    void PutUInt(uint32_t value);
+    void PutVertexRef(uint32_t index);
+    void Flush();
+
+    FILE*		m_file = nullptr;
+    char		m_buffer[BUFFER_SIZE];
+    size_t		m_used = 0;
+    bool		m_failed = false;
+
+    uint32_t	m_positionCount = 0;	//positions written in total
+    uint32_t	m_objectBase = 0;		//positions written before the current object
+
+    ObjIoStats	m_stats;
+    std::chrono::high_resolution_clock::time_point m_openTime;
+};
+
+// Reads an OBJ file by loading it whole, splitting it into line aligned blocks and parsing the
+// blocks in parallel. Per-block results are concatenated in file order, so the output is identical
+// to a sequential parse. Only v / vt / vn / f statements are interpreted; everything else is skipped.
+namespace ObjReader
+{
+    bool Read(const std::string& path, ObjMesh& mesh, ObjIoStats* stats = nullptr);
+
+    // Parses an in-memory OBJ. 'blockSize' is the approximate number of bytes per parallel task.
+    void Parse(const char* data, size_t size, ObjMesh& mesh, size_t blockSize = 256 * 1024);
+}
@@ -0,0 +1,39 @@
+#include "Platform.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+int64_t Platform::FileTime(const std::string& path)
+{
+#ifdef _WIN32
+    struct _stat64 status;
+    if (_stat64(path.c_str(), &status) != 0)
+        return -1;
+#else
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0)
+        return -1;
+#endif
+
+    return int64_t(status.st_mtime);
+}
+
+bool Platform::MakeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+    _mkdir(path.c_str());
+    struct _stat64 status;
+    return _stat64(path.c_str(), &status) == 0 && (status.st_mode & _S_IFDIR) != 0;
+#else
+    mkdir(path.c_str(), 0755);
+    struct stat status;
+    return stat(path.c_str(), &status) == 0 && S_ISDIR(status.st_mode);
+#endif
+}
+
+bool Platform::RemoveFile(const std::string& path)
+{
+    return std::remove(path.c_str()) == 0 || FileTime(path) < 0;
+}
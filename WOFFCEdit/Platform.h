@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// The little the headless modules need from the operating system, so they build with MSVC for the
+// editor and with gcc or clang for tools and tests on Linux.
+
+#ifndef _WIN32
+#include <cerrno>
+
+typedef int errno_t;
+
+inline errno_t fopen_s(FILE** file, const char* path, const char* mode)
+{
+    *file = std::fopen(path, mode);
+    return *file ? 0 : errno;
+}
+#endif
+
+namespace Platform
+{
+    // Last modification time of a file in seconds since the epoch, -1 if it doesn't exist
+    int64_t FileTime(const std::string& path);
+
+    // Creates a directory, its parent must exist. True if it exists afterwards.
+    bool MakeDirectory(const std::string& path);
+
+    // True if the file is gone afterwards
+    bool RemoveFile(const std::string& path);
+}
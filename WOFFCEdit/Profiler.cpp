@@ -0,0 +1,211 @@
+#include "Profiler.h"
+#include "Platform.h"
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    static_assert((Profiler::EVENTS_PER_THREAD & (Profiler::EVENTS_PER_THREAD - 1)) == 0, "event indices wrap with a mask");
+
+    // Written by its own thread only. Readers take a snapshot and drop whatever was overwritten while they copied.
+    struct ThreadBuffer
+    {
+        uint32_t				id;
+        std::string				name;		//under s_mutex
+        std::atomic<uint64_t>	written;	//events ever written, the last EVENTS_PER_THREAD are kept
+        Profiler::Event			events[Profiler::EVENTS_PER_THREAD];
+    };
+
+    struct Forwarding
+    {
+        Profiler::BeginForward	begin;
+        Profiler::EndForward	end;
+        void*					user;
+    };
+
+    std::mutex									s_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>>	s_buffers;		//never freed, pool threads record until the process exits
+    std::atomic<bool>							s_enabled(true);
+    const std::chrono::steady_clock::time_point	s_epoch = std::chrono::steady_clock::now();
+
+    thread_local ThreadBuffer*	t_buffer = nullptr;
+    thread_local Forwarding		t_forwarding = { nullptr, nullptr, nullptr };
+
+    ThreadBuffer& LocalBuffer()
+    {
+        if (!t_buffer)
+        {
+            std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer);
+            buffer->written = 0;
+
+            std::lock_guard<std::mutex> lock(s_mutex);
+            buffer->id = uint32_t(s_buffers.size()) + 1;
+            t_buffer = buffer.get();
+            s_buffers.push_back(std::move(buffer));
+        }
+        return *t_buffer;
+    }
+
+    // Names are string literals in code, this only keeps odd ones from breaking the file
+    void WriteJsonString(FILE* file, const char* text)
+    {
+        fputc('"', file);
+        for (const char* c = text; *c; c++)
+        {
+            if (*c == '"' || *c == '\\')
+                fputc('\\', file);
+            if (static_cast<unsigned char>(*c) >= 0x20)
+                fputc(*c, file);
+        }
+        fputc('"', file);
+    }
+}
+
+Profiler::Scope::Scope(const char* name, const wchar_t* wideName)
+    : m_name(s_enabled.load(std::memory_order_relaxed) ? name : nullptr)
+    , m_start(0)
+    , m_end(t_forwarding.end)
+    , m_user(t_forwarding.user)
+{
+    if (t_forwarding.begin)
+        t_forwarding.begin(t_forwarding.user, wideName);
+
+    if (m_name)
+        m_start = Now();
+}
+
+Profiler::Scope::~Scope()
+{
+    if (m_name)
+    {
+        const int64_t end = Now();
+        ThreadBuffer& buffer = LocalBuffer();
+        const uint64_t index = buffer.written.load(std::memory_order_relaxed);
+        buffer.events[index & (EVENTS_PER_THREAD - 1)] = { m_name, m_start, end };
+        buffer.written.store(index + 1, std::memory_order_release);
+    }
+
+    if (m_end)
+        m_end(m_user);
+}
+
+void Profiler::SetEnabled(bool enabled)
+{
+    s_enabled = enabled;
+}
+
+bool Profiler::IsEnabled()
+{
+    return s_enabled;
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+    ThreadBuffer& buffer = LocalBuffer();
+    std::lock_guard<std::mutex> lock(s_mutex);
+    buffer.name = name;
+}
+
+void Profiler::SetForwarding(BeginForward begin, EndForward end, void* user)
+{
+    t_forwarding = { begin, begin ? end : nullptr, user };
+}
+
+int64_t Profiler::Now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_epoch).count();
+}
+
+uint64_t Profiler::GetThreadEventCount()
+{
+    return LocalBuffer().written.load(std::memory_order_relaxed);
+}
+
+size_t Profiler::ReadThreadEvents(uint64_t& cursor, Event* events, size_t capacity)
+{
+    // Only this thread writes to its buffer, so nothing can be overwritten while reading it
+    const ThreadBuffer& buffer = LocalBuffer();
+    const uint64_t written = buffer.written.load(std::memory_order_relaxed);
+    const uint64_t oldest = written > EVENTS_PER_THREAD ? written - EVENTS_PER_THREAD : 0;
+    if (cursor < oldest)
+        cursor = oldest;
+
+    const size_t count = size_t(std::min<uint64_t>(written - std::min(cursor, written), capacity));
+    for (size_t i = 0; i < count; i++)
+        events[i] = buffer.events[(cursor + i) & (EVENTS_PER_THREAD - 1)];
+
+    cursor += count;
+    return count;
+}
+
+bool Profiler::WriteChromeTrace(const std::string& path)
+{
+    // Snapshot every thread's buffer, keeping only events that weren't overwritten while copying
+    struct Snapshot
+    {
+        uint32_t			id;
+        std::string			name;
+        std::vector<Event>	events;
+    };
+    std::vector<Snapshot> snapshots;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        snapshots.resize(s_buffers.size());
+        for (size_t b = 0; b < s_buffers.size(); b++)
+        {
+            const ThreadBuffer& buffer = *s_buffers[b];
+            Snapshot& snapshot = snapshots[b];
+            snapshot.id = buffer.id;
+            snapshot.name = buffer.name;
+
+            const uint64_t before = buffer.written.load(std::memory_order_acquire);
+            const uint64_t first = before > EVENTS_PER_THREAD ? before - EVENTS_PER_THREAD : 0;
+            snapshot.events.reserve(size_t(before - first));
+            for (uint64_t i = first; i < before; i++)
+                snapshot.events.push_back(buffer.events[i & (EVENTS_PER_THREAD - 1)]);
+
+            // The fence keeps the copies above from moving past the load. The owner may already be writing
+            // event 'after', over event 'after' - EVENTS_PER_THREAD, before counting it, so that one is lost too.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t after = buffer.written.load(std::memory_order_relaxed);
+            const uint64_t overwritten = after + 1 > EVENTS_PER_THREAD ? after + 1 - EVENTS_PER_THREAD : 0;
+            if (overwritten > first)
+                snapshot.events.erase(snapshot.events.begin(), snapshot.events.begin() + size_t(std::min(overwritten, before) - first));
+        }
+    }
+
+    FILE* pFile = nullptr;
+    errno_t ret = fopen_s(&pFile, path.c_str(), "w");
+    if (ret != 0 || pFile == nullptr)
+        return false;
+
+    fprintf(pFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (const Snapshot& snapshot : snapshots)
+    {
+        if (!snapshot.name.empty())
+        {
+            fprintf(pFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", snapshot.id);
+            WriteJsonString(pFile, snapshot.name.c_str());
+            fprintf(pFile, "}}");
+            first = false;
+        }
+
+        // Complete events, microseconds
+        for (const Event& event : snapshot.events)
+        {
+            fprintf(pFile, "%s{\"name\":", first ? "" : ",\n");
+            WriteJsonString(pFile, event.name);
+            fprintf(pFile, ",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", snapshot.id, event.start * 1e-3, (event.end - event.start) * 1e-3);
+            first = false;
+        }
+    }
+    fprintf(pFile, "\n]}\n");
+
+    const bool written = ferror(pFile) == 0;
+    return fclose(pFile) == 0 && written;
+}
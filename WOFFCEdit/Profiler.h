@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Scoped CPU markers, recorded into a ring buffer per thread and exported as a Chrome trace
+// (chrome://tracing, or ui.perfetto.dev), where nested scopes show up as a call hierarchy per thread.
+//
+// A scope costs two clock reads and one write to its thread's buffer; no locks are taken after a
+// thread's first scope. Each buffer keeps the most recent events, so an export shows the last few
+// seconds before it. Markers on the thread that set up forwarding are also passed on, to PIX say,
+// which is what the wide name is for.
+//
+//     void Game::Update()
+//     {
+//         PROFILE_SCOPE("Update");
+//         ...
+//     }
+class Profiler
+{
+public:
+    static constexpr size_t EVENTS_PER_THREAD = 8192;	//power of two
+
+    // A finished scope, times in nanoseconds since the profiler started
+    struct Event
+    {
+        const char*	name;
+        int64_t		start;
+        int64_t		end;
+    };
+
+    typedef void (*BeginForward)(void* user, const wchar_t* name);
+    typedef void (*EndForward)(void* user);
+
+    class Scope
+    {
+    public:
+        Scope(const char* name, const wchar_t* wideName);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char*	m_name;		//nullptr while the profiler is disabled
+        int64_t		m_start;
+        EndForward	m_end;		//forwarding as it was when the scope began
+        void*		m_user;
+    };
+
+    static void SetEnabled(bool enabled);
+    static bool IsEnabled();
+
+    // Names the calling thread in exports
+    static void SetThreadName(const char* name);
+
+    // Passes the calling thread's markers on to 'begin' and 'end' as well, nullptr to stop
+    static void SetForwarding(BeginForward begin, EndForward end, void* user);
+
+    static int64_t Now();
+
+    static uint64_t GetThreadEventCount();		//events the calling thread has finished so far, a cursor to read the ones after from
+
+    // Events the calling thread finished from number 'cursor' on, oldest first, at most 'capacity' of them.
+    // Moves the cursor past what was read; events already overwritten are skipped.
+    static size_t ReadThreadEvents(uint64_t& cursor, Event* events, size_t capacity);
+
+    // Events of every thread as Chrome trace event JSON
+    static bool WriteChromeTrace(const std::string& path);
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// 'name' must be a string literal
+#define PROFILE_SCOPE(name) Profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(name, PROFILE_CONCAT(L, name))
@@ -0,0 +1,82 @@
+#include "RenderQueue.h"
+#include <algorithm>
+
+namespace
+{
+    constexpr uint64_t STATE_MASK = 0x3;
+    constexpr uint64_t ID_MASK = 0xFFFF;
+    constexpr uint64_t DEPTH_MASK = 0xFFFF;
+    constexpr size_t RADIX_BITS = 8;
+    constexpr size_t RADIX_BUCKETS = size_t(1) << RADIX_BITS;
+    constexpr size_t RADIX_PASSES = 64 / RADIX_BITS;
+}
+
+uint64_t RenderQueue::MakeOpaqueKey(uint32_t state, uint32_t effect, uint32_t texture, uint32_t depth)
+{
+    return (uint64_t(PASS_OPAQUE) << 62)
+        | ((state & STATE_MASK) << 60)
+        | ((effect & ID_MASK) << 44)
+        | ((texture & ID_MASK) << 28)
+        | ((depth & DEPTH_MASK) << 12);
+}
+
+uint64_t RenderQueue::MakeTransparentKey(uint32_t state, uint32_t effect, uint32_t texture, uint32_t depth)
+{
+    return (uint64_t(PASS_TRANSPARENT) << 62)
+        | (((DEPTH_MASK - depth) & DEPTH_MASK) << 46)
+        | ((state & STATE_MASK) << 44)
+        | ((effect & ID_MASK) << 28)
+        | ((texture & ID_MASK) << 12);
+}
+
+uint32_t RenderQueue::DepthBucket(float viewDepth, float farPlane)
+{
+    const float normalised = std::min(std::max(viewDepth / farPlane, 0.f), 1.f);
+    return uint32_t(normalised * DEPTH_MASK);
+}
+
+void RenderQueue::Sort()
+{
+    const size_t count = m_items.size();
+    if (count < 2)
+        return;
+
+    // One read over the keys builds the histograms of all eight bytes
+    uint32_t histograms[RADIX_PASSES][RADIX_BUCKETS] = {};
+    for (const Item& item : m_items)
+    {
+        for (size_t pass = 0; pass < RADIX_PASSES; pass++)
+            histograms[pass][(item.key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+    }
+
+    m_scratch.resize(count);
+    Item* source = m_items.data();
+    Item* destination = m_scratch.data();
+
+    for (size_t pass = 0; pass < RADIX_PASSES; pass++)
+    {
+        uint32_t* histogram = histograms[pass];
+        const size_t shift = pass * RADIX_BITS;
+
+        // Every key has the same byte here, this pass wouldn't move anything
+        if (histogram[(source[0].key >> shift) & (RADIX_BUCKETS - 1)] == count)
+            continue;
+
+        uint32_t offset = 0;
+        for (size_t bucket = 0; bucket < RADIX_BUCKETS; bucket++)
+        {
+            const uint32_t bucketCount = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketCount;
+        }
+
+        for (size_t i = 0; i < count; i++)
+            destination[histogram[(source[i].key >> shift) & (RADIX_BUCKETS - 1)]++] = source[i];
+
+        std::swap(source, destination);
+    }
+
+    // An odd number of passes leaves the result in the scratch buffer
+    if (source != m_items.data())
+        m_items.swap(m_scratch);
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Draws for one frame as 64 bit sort keys, each with a caller defined 32 bit value (usually an index
+// into the caller's draw list). Sorting the keys orders the draws so that consecutive ones share as
+// much state as possible.
+//
+// Opaque key:       | pass 2 | state 2 | effect 16 | texture 16 | depth 16 | unused 12 |
+// Transparent key:  | pass 2 | far to near depth 16 | state 2 | effect 16 | texture 16 | unused 12 |
+//
+// Opaque draws group by state, effect and texture and go front to back within a group. Transparent
+// draws have to go back to front, so depth comes first and state changes are only saved between
+// draws at the same depth.
+class RenderQueue
+{
+public:
+    enum Pass : uint64_t
+    {
+        PASS_OPAQUE = 0,
+        PASS_TRANSPARENT = 1,
+    };
+
+    struct Item
+    {
+        uint64_t	key;
+        uint32_t	value;
+    };
+
+    static uint64_t MakeOpaqueKey(uint32_t state, uint32_t effect, uint32_t texture, uint32_t depth);
+    static uint64_t MakeTransparentKey(uint32_t state, uint32_t effect, uint32_t texture, uint32_t depth);
+    static Pass GetPass(uint64_t key) { return Pass(key >> 62); }
+
+    // Quantises a view space depth in [0, farPlane] to 16 bits
+    static uint32_t DepthBucket(float viewDepth, float farPlane);
+
+    void Clear() { m_items.clear(); }
+    void Reserve(size_t count) { m_items.reserve(count); m_scratch.reserve(count); }
+    void Add(uint64_t key, uint32_t value) { m_items.push_back({ key, value }); }
+
+    // Stable LSD radix sort on the keys, one byte per pass. Passes where every key has the same byte
+    // are skipped, so unused and constant fields cost nothing.
+    void Sort();
+
+    size_t Size() const { return m_items.size(); }
+    const Item& operator[](size_t i) const { return m_items[i]; }
+    const Item* begin() const { return m_items.data(); }
+    const Item* end() const { return m_items.data() + m_items.size(); }
+
+private:
+    std::vector<Item> m_items;
+    std::vector<Item> m_scratch;
+};
@@ -0,0 +1,691 @@
+// Benchmarks of the headless scene core: loading and saving scenes, looking objects up, heightmap processing,
+// terrain normals, OBJ export and import and spatial queries, against the editor's database and against synthetic scenes;
+// occlusion culling against synthetic cities, sorting a frame's draws, and how the parallel cases scale with threads.
+// Runs from WOFFCEdit/, where the database's relative asset paths resolve.
+//
+//     SceneBench [database] [--synthetic count,count...] [--runs n] [--threads n] [--scratch path]
+//
+// Every case runs 'runs' times and reports its fastest, median and slowest run in milliseconds. Saves go to
+// a scratch database, the one measured is never written to.
+
+#include "SceneDatabase.h"
+#include "SceneGenerator.h"
+#include "SceneObjectMap.h"
+#include "TerrainHeightmap.h"
+#include "TerrainMinMaxTree.h"
+#include "SplatMapGenerator.h"
+#include "HorizonCuller.h"
+#include "LodSelector.h"
+#include "MaskedOcclusionBuffer.h"
+#include "RenderQueue.h"
+#include "JobSystem.h"
+#include "ObjFile.h"
+#include "Platform.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // Terrain as DisplayChunk places it: 128 samples a side over 512 metres, centred on the origin
+    constexpr size_t TERRAIN_RESOLUTION = 128;
+    constexpr float TERRAIN_SIZE = 512.f;
+    constexpr float TERRAIN_HEIGHT_SCALE = 0.25f;
+    constexpr float TERRAIN_CELL_SIZE = TERRAIN_SIZE / (TERRAIN_RESOLUTION - 1);
+    constexpr float TERRAIN_ORIGIN = -TERRAIN_SIZE * 0.5f;
+
+    constexpr float DEFAULT_FOV_DEG = 75.f;		//as Game's camera
+    constexpr size_t NUM_VIEWPOINTS = 16;		//camera positions each spatial query run is made from
+    constexpr float EYE_HEIGHT = 2.f;			//metres above the terrain
+    constexpr float NEAR_PLANE = 0.01f;			//as Game's camera
+    constexpr float FAR_PLANE = 1000.f;
+
+    constexpr size_t CITY_SIZES[] = { 20, 50 };	//blocks along each side of the synthetic cities
+    constexpr float CITY_BLOCK_SIZE = 20.f;		//metres between building centres
+    constexpr size_t SCALING_CITY_SIZE = 50;	//of the city rendered on every thread count
+
+    constexpr size_t QUEUED_DRAWS = 100000;		//sorted by the render queue cases
+    constexpr size_t QUEUED_EFFECTS = 64;
+    constexpr size_t QUEUED_TEXTURES = 512;
+
+    struct Options
+    {
+        std::string			database = "database/test.db";
+        std::vector<size_t>	synthetic = { 10000, 100000 };
+        size_t				runs = 5;
+        size_t				threads = SIZE_MAX;
+        std::string			scratch = "scenebench.db";
+    };
+
+    struct Scene
+    {
+        std::string					name;
+        std::vector<SceneObject>	objects;
+        ChunkObject					chunk = {};
+        std::string					database;		//loaded from, empty for synthetic scenes until saved
+        TerrainHeightmap			heightmap{ TERRAIN_RESOLUTION, TERRAIN_HEIGHT_SCALE, TERRAIN_CELL_SIZE };
+    };
+
+    double Milliseconds(std::chrono::high_resolution_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // Runs 'function' the given number of times and prints the fastest, median and slowest run
+    template<class Function>
+    void Measure(const Options& options, const std::string& scene, const char* name, const Function& function)
+    {
+        std::vector<double> runs;
+        runs.reserve(options.runs);
+        for (size_t r = 0; r < options.runs; r++)
+        {
+            const auto start = std::chrono::high_resolution_clock::now();
+            if (!function())
+            {
+                printf("%-24s %-28s failed\n", scene.c_str(), name);
+                return;
+            }
+            runs.push_back(Milliseconds(start));
+        }
+
+        std::sort(runs.begin(), runs.end());
+        printf("%-24s %-28s %10.3f %10.3f %10.3f\n", scene.c_str(), name, runs.front(), runs[runs.size() / 2], runs.back());
+    }
+
+    bool ParseCounts(const char* text, std::vector<size_t>& counts)
+    {
+        counts.clear();
+        for (const char* next = text; *next; )
+        {
+            char* end = nullptr;
+            const unsigned long long count = strtoull(next, &end, 10);
+            if (end == next)
+                return false;
+
+            counts.push_back(size_t(count));
+            next = *end == ',' ? end + 1 : end;
+        }
+        return true;
+    }
+
+    bool ParseOptions(int argc, char** argv, Options& options)
+    {
+        for (int a = 1; a < argc; a++)
+        {
+            const bool hasValue = a + 1 < argc;
+            if (strcmp(argv[a], "--synthetic") == 0 && hasValue)
+            {
+                if (!ParseCounts(argv[++a], options.synthetic))
+                    return false;
+            }
+            else if (strcmp(argv[a], "--runs") == 0 && hasValue)
+                options.runs = std::max<size_t>(1, strtoul(argv[++a], nullptr, 10));
+            else if (strcmp(argv[a], "--threads") == 0 && hasValue)
+                options.threads = strtoul(argv[++a], nullptr, 10);
+            else if (strcmp(argv[a], "--scratch") == 0 && hasValue)
+                options.scratch = argv[++a];
+            else if (argv[a][0] != '-')
+                options.database = argv[a];
+            else
+                return false;
+        }
+        return true;
+    }
+
+    // Objects from the scene generator with its defaults, standing on its heightmap, which is saved beside the
+    // scratch database for the chunk to point at
+    bool MakeSyntheticScene(const Options& options, size_t count, Scene& scene)
+    {
+        scene.name = "synthetic " + std::to_string(count);
+
+        SceneGenerator::Settings settings;
+        settings.objects = count;
+        SceneGenerator generator(settings);
+        generator.GenerateHeightmap(scene.heightmap);
+
+        scene.chunk = generator.MakeChunk();
+        scene.chunk.heightmap_path = options.scratch + ".heightmap.raw";
+        if (!scene.heightmap.Save(scene.chunk.heightmap_path))
+            return false;
+
+        Measure(options, scene.name, "generate objects", [&]()
+        {
+            scene.objects.clear();
+            scene.objects.reserve(count);
+            return generator.Generate(scene.heightmap, [&](const SceneObject& object) { scene.objects.push_back(object); return true; });
+        });
+        return scene.objects.size() == count;
+    }
+
+    float TerrainHeight(const TerrainHeightmap& heightmap, float x, float z)
+    {
+        const size_t last = heightmap.GetResolution() - 1;
+        const size_t sampleX = std::min(last, size_t(std::max(0.f, (x - TERRAIN_ORIGIN) / TERRAIN_CELL_SIZE + 0.5f)));
+        const size_t sampleZ = std::min(last, size_t(std::max(0.f, (z - TERRAIN_ORIGIN) / TERRAIN_CELL_SIZE + 0.5f)));
+        return heightmap.GetHeights()[(sampleZ * heightmap.GetResolution()) + sampleX] * TERRAIN_HEIGHT_SCALE;
+    }
+
+    void BenchPersistence(const Options& options, Scene& scene)
+    {
+        // Synthetic scenes are saved first, so they have a database to load from
+        Measure(options, scene.name, "save objects", [&]()
+        {
+            SceneDatabase database;
+            return database.Open(options.scratch, true) && database.SaveChunk(scene.chunk) && database.SaveObjects(scene.objects);
+        });
+
+        if (scene.database.empty())
+            scene.database = options.scratch;
+
+        Measure(options, scene.name, "load objects and chunk", [&]()
+        {
+            std::vector<SceneObject> objects;
+            ChunkObject chunk;
+            SceneDatabase database;
+            return database.Open(scene.database) && database.LoadObjects(objects) && database.LoadChunk(chunk) && objects.size() == scene.objects.size();
+        });
+    }
+
+    void BenchObjectMap(const Options& options, const Scene& scene)
+    {
+        SceneObjectMap objects;
+        Measure(options, scene.name, "object map from list", [&]()
+        {
+            objects.Assign(std::vector<SceneObject>(scene.objects));
+            return objects.Size() > 0 || scene.objects.empty();
+        });
+
+        Measure(options, scene.name, "find every ID", [&]()
+        {
+            size_t found = 0;
+            for (const SceneObject& object : scene.objects)
+                found += objects.Get(objects.Find(object.ID)) != nullptr;
+            return found == objects.Size();
+        });
+
+        // Every object out and back in, which moves each through the packed list and reuses its slot
+        Measure(options, scene.name, "erase and insert every ID", [&]()
+        {
+            for (const SceneObject& object : scene.objects)
+            {
+                const SceneObjectHandle handle = objects.Find(object.ID);
+                const SceneObject* erased = objects.Get(handle);
+                if (!erased)
+                    continue;
+
+                const SceneObject copy = *erased;
+                if (!objects.Erase(handle) || !objects.Insert(copy).IsValid())
+                    return false;
+            }
+            return true;
+        });
+    }
+
+    void BenchHeightmap(const Options& options, const Scene& scene)
+    {
+        const TerrainHeightmap& heightmap = scene.heightmap;
+
+        Measure(options, scene.name, "load heightmap", [&]()
+        {
+            TerrainHeightmap loaded(TERRAIN_RESOLUTION, TERRAIN_HEIGHT_SCALE, TERRAIN_CELL_SIZE);
+            return loaded.Load(scene.chunk.heightmap_path) || scene.chunk.heightmap_path.empty();
+        });
+
+        // Erosion alters the heights, so every run starts from a copy
+        Measure(options, scene.name, "thermal erosion", [&]()
+        {
+            TerrainHeightmap eroded = heightmap;
+            return eroded.ApplyThermalErosion(ThermalErosionSettings(), nullptr);
+        });
+
+        Measure(options, scene.name, "hydraulic erosion", [&]()
+        {
+            TerrainHeightmap eroded = heightmap;
+            return eroded.ApplyHydraulicErosion(HydraulicErosionSettings(), nullptr);
+        });
+
+        std::vector<float> normals(heightmap.GetNumSamples() * 3);
+        Measure(options, scene.name, "normals", [&]()
+        {
+            heightmap.CalculateNormals(normals.data(), sizeof(float) * 3);
+            return true;
+        });
+
+        Measure(options, scene.name, "min/max tree", [&]()
+        {
+            TerrainMinMaxTree tree;
+            tree.Build(heightmap.GetHeights(), heightmap.GetResolution(), TERRAIN_HEIGHT_SCALE, TERRAIN_CELL_SIZE, TERRAIN_ORIGIN, TERRAIN_ORIGIN);
+            return true;
+        });
+
+        Measure(options, scene.name, "splat map", [&]()
+        {
+            SplatMapGenerator splatMap;
+            splatMap.Initialise(heightmap.GetResolution(), TERRAIN_HEIGHT_SCALE, TERRAIN_CELL_SIZE);
+            splatMap.MarkAllDirty();
+            splatMap.Update(heightmap.GetHeights());
+            return true;
+        });
+    }
+
+    // The scene as the editor exports it: the terrain, then every object, standing in as a box of its scale.
+    // Written and parsed again, with the fastest run's throughput.
+    void BenchObj(const Options& options, const Scene& scene)
+    {
+        const std::string path = options.scratch + ".obj";
+        const TerrainHeightmap& heightmap = scene.heightmap;
+        const size_t resolution = heightmap.GetResolution();
+        std::vector<float> normals(heightmap.GetNumSamples() * 3);
+        heightmap.CalculateNormals(normals.data(), sizeof(float) * 3);
+
+        ObjIoStats fastestWrite;
+        Measure(options, scene.name, "write OBJ", [&]()
+        {
+            ObjWriter writer;
+            if (!writer.Open(path))
+                return false;
+
+            writer.BeginObject("terrain");
+            for (size_t i = 0; i < heightmap.GetNumSamples(); i++)
+                writer.Position(TERRAIN_ORIGIN + ((i % resolution) * TERRAIN_CELL_SIZE), heightmap.GetHeights()[i] * TERRAIN_HEIGHT_SCALE, TERRAIN_ORIGIN + ((i / resolution) * TERRAIN_CELL_SIZE));
+            for (size_t i = 0; i < heightmap.GetNumSamples(); i++)
+                writer.TexCoord(float(i % resolution) / (resolution - 1), float(i / resolution) / (resolution - 1));
+            for (size_t i = 0; i < heightmap.GetNumSamples(); i++)
+                writer.Normal(normals[i * 3], normals[(i * 3) + 1], normals[(i * 3) + 2]);
+            for (size_t z = 0; z + 1 < resolution; z++)
+            {
+                for (size_t x = 0; x + 1 < resolution; x++)
+                {
+                    const uint32_t corner = uint32_t((z * resolution) + x);
+                    writer.Triangle(corner, corner + 1, corner + uint32_t(resolution) + 1);
+                    writer.Triangle(corner, corner + uint32_t(resolution) + 1, corner + uint32_t(resolution));
+                }
+            }
+
+            static const uint32_t BOX_TRIANGLES[12][3] = {
+                { 0, 1, 3 }, { 0, 3, 2 }, { 4, 6, 7 }, { 4, 7, 5 }, { 0, 4, 5 }, { 0, 5, 1 },
+                { 2, 3, 7 }, { 2, 7, 6 }, { 0, 2, 6 }, { 0, 6, 4 }, { 1, 5, 7 }, { 1, 7, 3 },
+            };
+            for (const SceneObject& object : scene.objects)
+            {
+                writer.BeginObject(object.name.c_str());
+                for (int corner = 0; corner < 8; corner++)
+                {
+                    writer.Position(object.posX + (((corner & 1) ? 0.5f : -0.5f) * object.scaX), object.posY + ((corner & 2) ? object.scaY : 0.f), object.posZ + (((corner & 4) ? 0.5f : -0.5f) * object.scaZ));
+                    writer.TexCoord((corner & 1) ? 1.f : 0.f, (corner & 2) ? 1.f : 0.f);
+                    writer.Normal(0.f, 1.f, 0.f);
+                }
+                for (const uint32_t* triangle : BOX_TRIANGLES)
+                    writer.Triangle(triangle[0], triangle[1], triangle[2]);
+            }
+
+            if (!writer.Close())
+                return false;
+            if (fastestWrite.seconds == 0.0 || writer.GetStats().seconds < fastestWrite.seconds)
+                fastestWrite = writer.GetStats();
+            return true;
+        });
+        printf("%-24s %-28s %.1f MB at %.0f MB/s\n", scene.name.c_str(), "", fastestWrite.bytes / (1024.0 * 1024.0), fastestWrite.MegabytesPerSecond());
+
+        const size_t expectedTriangles = ((resolution - 1) * (resolution - 1) * 2) + (scene.objects.size() * 12);
+        ObjIoStats fastestRead;
+        Measure(options, scene.name, "read OBJ", [&]()
+        {
+            ObjMesh mesh;
+            ObjIoStats stats;
+            if (!ObjReader::Read(path, mesh, &stats) || mesh.corners.size() != expectedTriangles * 3)
+                return false;
+            if (fastestRead.seconds == 0.0 || stats.seconds < fastestRead.seconds)
+                fastestRead = stats;
+            return true;
+        });
+        printf("%-24s %-28s %.1f MB at %.0f MB/s\n", scene.name.c_str(), "", fastestRead.bytes / (1024.0 * 1024.0), fastestRead.MegabytesPerSecond());
+
+        Platform::RemoveFile(path);
+    }
+
+    void BenchSpatialQueries(const Options& options, const Scene& scene)
+    {
+        const TerrainHeightmap& heightmap = scene.heightmap;
+
+        // Unit boxes scaled as the objects are, standing on their positions
+        std::vector<HorizonCuller::Bounds> bounds(scene.objects.size());
+        for (size_t i = 0; i < scene.objects.size(); i++)
+        {
+            const SceneObject& object = scene.objects[i];
+            const float extent = 0.5f * std::max(std::max(std::fabs(object.scaX), std::fabs(object.scaY)), std::fabs(object.scaZ));
+            bounds[i] = { object.posX - extent, object.posY, object.posZ - extent, object.posX + extent, object.posY + (extent * 2.f), object.posZ + extent };
+        }
+
+        TerrainMinMaxTree tree;
+        tree.Build(heightmap.GetHeights(), heightmap.GetResolution(), TERRAIN_HEIGHT_SCALE, TERRAIN_CELL_SIZE, TERRAIN_ORIGIN, TERRAIN_ORIGIN);
+
+        // Viewpoints on a ring inside the chunk, just above the ground
+        float eyes[NUM_VIEWPOINTS][3];
+        for (size_t v = 0; v < NUM_VIEWPOINTS; v++)
+        {
+            const float angle = 6.2831853f * v / NUM_VIEWPOINTS;
+            eyes[v][0] = std::cos(angle) * TERRAIN_SIZE * 0.3f;
+            eyes[v][2] = std::sin(angle) * TERRAIN_SIZE * 0.3f;
+            eyes[v][1] = TerrainHeight(heightmap, eyes[v][0], eyes[v][2]) + EYE_HEIGHT;
+        }
+
+        HorizonCuller culler;
+        std::vector<uint8_t> visible(bounds.size());
+        size_t culled = 0;
+        Measure(options, scene.name, "horizon culling x16", [&]()
+        {
+            culled = 0;
+            for (const float* eye : eyes)
+            {
+                culler.Cull(tree, eye[0], eye[1], eye[2], bounds.data(), bounds.size(), visible.data());
+                culled += culler.GetStats().culled;
+            }
+            return true;
+        });
+        printf("%-24s %-28s %zu of %zu objects culled per viewpoint\n", scene.name.c_str(), "", culled / NUM_VIEWPOINTS, bounds.size());
+
+        LodSelector selector;
+        selector.Reset(bounds.size());
+        for (size_t i = 0; i < bounds.size(); i++)
+        {
+            const HorizonCuller::Bounds& box = bounds[i];
+            selector.SetObject(i, (box.minX + box.maxX) * 0.5f, (box.minY + box.maxY) * 0.5f, (box.minZ + box.maxZ) * 0.5f, (box.maxX - box.minX) * 0.866f, LodSelector::MAX_LEVELS);
+        }
+
+        const float projectionScale = 1.f / std::tan(DEFAULT_FOV_DEG * 3.14159265f / 360.f);
+        Measure(options, scene.name, "level of detail x16", [&]()
+        {
+            for (const float* eye : eyes)
+                selector.Select(eye[0], eye[1], eye[2], projectionScale);
+            return true;
+        });
+    }
+
+    // view * projection for row vectors, as XMMatrixLookAtLH * XMMatrixPerspectiveFovLH with Game's field of view
+    void ViewProjection(const float* eye, const float* target, float aspect, float* out)
+    {
+        float forward[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+        const float length = std::sqrt((forward[0] * forward[0]) + (forward[1] * forward[1]) + (forward[2] * forward[2]));
+        for (float& f : forward)
+            f /= length;
+
+        const float horizontal = std::sqrt((forward[0] * forward[0]) + (forward[2] * forward[2]));
+        const float right[3] = { forward[2] / horizontal, 0.f, -forward[0] / horizontal };
+        const float up[3] = { (forward[1] * right[2]) - (forward[2] * right[1]), (forward[2] * right[0]) - (forward[0] * right[2]), (forward[0] * right[1]) - (forward[1] * right[0]) };
+
+        const float yScale = 1.f / std::tan(DEFAULT_FOV_DEG * 3.14159265f / 360.f);
+        const float range = FAR_PLANE / (FAR_PLANE - NEAR_PLANE);
+        const float* axes[3] = { right, up, forward };
+        const float scales[3] = { yScale / aspect, yScale, range };
+        for (int row = 0; row < 3; row++)
+        {
+            for (int col = 0; col < 3; col++)
+                out[(row * 4) + col] = axes[col][row] * scales[col];
+            out[(row * 4) + 3] = forward[row];
+        }
+        for (int col = 0; col < 3; col++)
+        {
+            const float viewPosition = -((axes[col][0] * eye[0]) + (axes[col][1] * eye[1]) + (axes[col][2] * eye[2]));
+            out[12 + col] = (viewPosition * scales[col]) - (col == 2 ? NEAR_PLANE * range : 0.f);
+        }
+        out[15] = -((forward[0] * eye[0]) + (forward[1] * eye[1]) + (forward[2] * eye[2]));
+    }
+
+    // A grid of box buildings of random footprints and heights, each an occluder, with a small box in every
+    // street corner to test against them, seen from street level on a ring around the middle
+    struct City
+    {
+        std::string							name;
+        OccluderMesh						cube;
+        std::vector<OccluderInstance>		buildings;	//pointing at cube, so a city stays where it is made
+        std::vector<HorizonCuller::Bounds>	boxes;
+        float								viewProjections[NUM_VIEWPOINTS][16];
+
+        explicit City(size_t blocksPerSide)
+            : name("city " + std::to_string(blocksPerSide * blocksPerSide))
+            , buildings(blocksPerSide * blocksPerSide)
+        {
+            for (int corner = 0; corner < 8; corner++)
+            {
+                cube.positions.push_back((corner & 1) ? 0.5f : -0.5f);
+                cube.positions.push_back((corner & 2) ? 0.5f : -0.5f);
+                cube.positions.push_back((corner & 4) ? 0.5f : -0.5f);
+            }
+            cube.indices = { 0, 2, 3, 0, 3, 1,  4, 5, 7, 4, 7, 6,  0, 1, 5, 0, 5, 4,  2, 6, 7, 2, 7, 3,  0, 4, 6, 0, 6, 2,  1, 3, 7, 1, 7, 5 };
+
+            uint32_t random = 12345;
+            const auto next = [&random]() { random = (random * 1664525u) + 1013904223u; return (random >> 8) / float(1 << 24); };
+            for (size_t b = 0; b < buildings.size(); b++)
+            {
+                const float x = (b % blocksPerSide) * CITY_BLOCK_SIZE;
+                const float z = (b / blocksPerSide) * CITY_BLOCK_SIZE;
+                const float width = 8.f + (next() * 8.f);
+                const float depth = 8.f + (next() * 8.f);
+                const float height = 5.f + (next() * 55.f);
+
+                float* world = buildings[b].world;
+                std::fill(world, world + 16, 0.f);
+                world[0] = width;
+                world[5] = height;
+                world[10] = depth;
+                world[12] = x;
+                world[13] = height * 0.5f;
+                world[14] = z;
+                world[15] = 1.f;
+                buildings[b].mesh = &cube;
+
+                const float cornerX = x + (CITY_BLOCK_SIZE * 0.5f);
+                const float cornerZ = z + (CITY_BLOCK_SIZE * 0.5f);
+                boxes.push_back({ cornerX - 1.f, 0.f, cornerZ - 1.f, cornerX + 1.f, 2.f, cornerZ + 1.f });
+            }
+
+            const float middle = CITY_BLOCK_SIZE * (blocksPerSide - 1) * 0.5f;
+            for (size_t v = 0; v < NUM_VIEWPOINTS; v++)
+            {
+                const float angle = 6.2831853f * v / NUM_VIEWPOINTS;
+                const float radius = middle * 0.5f;
+                const float eye[3] = { middle + (std::cos(angle) * radius) + (CITY_BLOCK_SIZE * 0.5f), EYE_HEIGHT, middle + (std::sin(angle) * radius) + (CITY_BLOCK_SIZE * 0.5f) };
+                const float target[3] = { middle, EYE_HEIGHT, middle };
+                ViewProjection(eye, target, float(MaskedOcclusionBuffer::WIDTH) / MaskedOcclusionBuffer::HEIGHT, viewProjections[v]);
+            }
+        }
+
+        City(const City&) = delete;
+        City& operator=(const City&) = delete;
+    };
+
+    void BenchOcclusionCity(const Options& options, const City& city)
+    {
+        MaskedOcclusionBuffer buffer;
+        Measure(options, city.name, "occlusion render x16", [&]()
+        {
+            for (const float* viewProjection : city.viewProjections)
+                buffer.Render(city.buildings.data(), city.buildings.size(), viewProjection);
+            return true;
+        });
+        printf("%-24s %-28s %zu occluder triangles\n", city.name.c_str(), "", buffer.GetStats().triangles);
+
+        // Against the buffer of every viewpoint in turn; only the tests are timed
+        std::vector<MaskedOcclusionBuffer> buffers(NUM_VIEWPOINTS);
+        for (size_t v = 0; v < NUM_VIEWPOINTS; v++)
+            buffers[v].Render(city.buildings.data(), city.buildings.size(), city.viewProjections[v]);
+
+        size_t culled = 0;
+        Measure(options, city.name, "occlusion tests x16", [&]()
+        {
+            culled = 0;
+            for (const MaskedOcclusionBuffer& viewBuffer : buffers)
+            {
+                for (const HorizonCuller::Bounds& box : city.boxes)
+                    culled += !viewBuffer.IsVisible(&box.minX, &box.maxX);
+            }
+            return true;
+        });
+        printf("%-24s %-28s %zu of %zu boxes culled per viewpoint\n", city.name.c_str(), "", culled / NUM_VIEWPOINTS, city.boxes.size());
+    }
+
+    // A frame's worth of draws, mostly opaque, over a few dozen effects and a few hundred textures at random depths,
+    // sorted by RenderQueue's radix sort and by std::stable_sort on the same keys, which must agree
+    void BenchRenderQueue(const Options& options)
+    {
+        const std::string name = "draws " + std::to_string(QUEUED_DRAWS);
+
+        std::vector<RenderQueue::Item> items(QUEUED_DRAWS);
+        uint32_t random = 54321;
+        const auto next = [&random](uint32_t range) { random = (random * 1664525u) + 1013904223u; return uint32_t((uint64_t(random >> 8) * range) >> 24); };
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            const uint32_t state = next(4);
+            const uint32_t effect = next(QUEUED_EFFECTS);
+            const uint32_t texture = next(QUEUED_TEXTURES);
+            const uint32_t depth = next(0x10000);
+            const bool transparent = next(10) == 0;
+            items[i].key = transparent ? RenderQueue::MakeTransparentKey(state, effect, texture, depth) : RenderQueue::MakeOpaqueKey(state, effect, texture, depth);
+            items[i].value = uint32_t(i);
+        }
+
+        // Both fill from the unsorted items every run, as a frame does
+        RenderQueue queue;
+        queue.Reserve(items.size());
+        Measure(options, name, "radix sort", [&]()
+        {
+            queue.Clear();
+            for (const RenderQueue::Item& item : items)
+                queue.Add(item.key, item.value);
+            queue.Sort();
+            return true;
+        });
+
+        std::vector<RenderQueue::Item> sorted;
+        sorted.reserve(items.size());
+        Measure(options, name, "std::stable_sort", [&]()
+        {
+            sorted.assign(items.begin(), items.end());
+            std::stable_sort(sorted.begin(), sorted.end(), [](const RenderQueue::Item& a, const RenderQueue::Item& b) { return a.key < b.key; });
+            return std::equal(sorted.begin(), sorted.end(), queue.begin(), [](const RenderQueue::Item& a, const RenderQueue::Item& b) { return a.key == b.key && a.value == b.value; });
+        });
+    }
+
+    // The parallel cases again on 1, 2, 4... threads up to every core, or --threads, restarting the job system
+    // for each. Leaves it running on the most threads.
+    void BenchThreadScaling(const Options& options, const City& city, const TerrainHeightmap& heightmap)
+    {
+        const size_t maxThreads = options.threads != SIZE_MAX ? std::max<size_t>(options.threads, 1) : std::max(1u, std::thread::hardware_concurrency());
+        for (size_t threads = 1; ; threads = std::min(threads * 2, maxThreads))
+        {
+            JobSystem::Shutdown();
+            JobSystem::Start(threads - 1);
+            const std::string threadCount = std::to_string(threads) + (threads == 1 ? " thread" : " threads");
+            const std::string cityName = city.name + ", " + threadCount;
+            const std::string terrainName = "terrain, " + threadCount;
+
+            MaskedOcclusionBuffer buffer;
+            Measure(options, cityName, "occlusion render x16", [&]()
+            {
+                for (const float* viewProjection : city.viewProjections)
+                    buffer.Render(city.buildings.data(), city.buildings.size(), viewProjection);
+                return true;
+            });
+
+            Measure(options, terrainName, "hydraulic erosion", [&]()
+            {
+                TerrainHeightmap eroded = heightmap;
+                return eroded.ApplyHydraulicErosion(HydraulicErosionSettings(), nullptr);
+            });
+
+            std::vector<float> normals(heightmap.GetNumSamples() * 3);
+            Measure(options, terrainName, "normals", [&]()
+            {
+                heightmap.CalculateNormals(normals.data(), sizeof(float) * 3);
+                return true;
+            });
+
+            if (threads == maxThreads)
+                break;
+        }
+    }
+
+    void BenchScene(const Options& options, Scene& scene)
+    {
+        BenchPersistence(options, scene);
+        BenchObjectMap(options, scene);
+        BenchHeightmap(options, scene);
+        BenchObj(options, scene);
+        BenchSpatialQueries(options, scene);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        fprintf(stderr, "usage: SceneBench [database] [--synthetic count,count...] [--runs n] [--threads n] [--scratch path]\n");
+        return 2;
+    }
+
+    JobSystem::Start(options.threads == SIZE_MAX ? SIZE_MAX : (options.threads > 0 ? options.threads - 1 : 0));
+    printf("%zu threads, %zu runs per case\n\n", JobSystem::GetNumThreads(), options.runs);
+    printf("%-24s %-28s %10s %10s %10s\n", "scene", "case", "min ms", "median ms", "max ms");
+
+    int result = 0;
+    {
+        Scene scene;
+        scene.name = options.database;
+        scene.database = options.database;
+
+        SceneDatabase database;
+        if (database.Open(options.database) && database.LoadObjects(scene.objects) && database.LoadChunk(scene.chunk))
+        {
+            if (!scene.heightmap.Load(scene.chunk.heightmap_path))
+            {
+                printf("%-24s %s can't be read, using generated heights\n", scene.name.c_str(), scene.chunk.heightmap_path.c_str());
+                SceneGenerator(SceneGenerator::Settings()).GenerateHeightmap(scene.heightmap);
+            }
+            BenchScene(options, scene);
+        }
+        else
+        {
+            fprintf(stderr, "Can't load %s: %s\n", options.database.c_str(), database.GetError().c_str());
+            result = 1;
+        }
+    }
+
+    for (size_t count : options.synthetic)
+    {
+        Scene scene;
+        if (MakeSyntheticScene(options, count, scene))
+            BenchScene(options, scene);
+        else
+        {
+            fprintf(stderr, "Can't make the synthetic scene of %zu objects\n", count);
+            result = 1;
+        }
+    }
+
+    BenchRenderQueue(options);
+    for (size_t blocksPerSide : CITY_SIZES)
+    {
+        const City city(blocksPerSide);
+        BenchOcclusionCity(options, city);
+    }
+
+    {
+        const City city(SCALING_CITY_SIZE);
+        TerrainHeightmap heightmap(TERRAIN_RESOLUTION, TERRAIN_HEIGHT_SCALE, TERRAIN_CELL_SIZE);
+        SceneGenerator(SceneGenerator::Settings()).GenerateHeightmap(heightmap);
+        BenchThreadScaling(options, city, heightmap);
+    }
+
+    Platform::RemoveFile(options.scratch);
+    Platform::RemoveFile(options.scratch + ".heightmap.raw");
+    JobSystem::Shutdown();
+    return result;
+}
@@ -0,0 +1,377 @@
+#include "SceneDatabase.h"
+#include "sqlite3.h"
+
+namespace
+{
+    // As in database/test.db
+    const char* const CREATE_TABLES =
+        "CREATE TABLE IF NOT EXISTS Chunks (ID INT, name STRING, chunk_x_size_metres REAL, chunk_z_size_metres REAL, chunk_base_resolution INTEGER, "
+        "heightmap STRING, tex_diffuse STRING, tex_spat_alpha STRING, tex_splat_1 STRING, tex_splat_2 STRING, tex_splat_3 STRING, tex_splat_4 STRING, "
+        "render_wireframe BOOLEAN, render_normals BOOLEAN, diffuse_tiling INTEGER, tex_splat_1_tiling INTEGER, tex_splat_2_tiling INTEGER, "
+        "tex_splat_3_tiling INTEGER, tex_splat_4_tiling INTEGER);"
+        "CREATE TABLE IF NOT EXISTS Objects (ID INTEGER, chunk_ID INTEGER, mesh STRING, tex_diffuse STRING, position_x REAL, position_y REAL, "
+        "position_z REAL, rotation_x REAL, rotation_y REAL, rotation_z REAL, scale_x REAL, scale_y REAL, scale_z REAL, render BOOLEAN, "
+        "collision BOOLEAN, collision_mesh STRING, collectable BOOLEAN, destructable BOOLEAN, health_amount INT, editor_render BOOLEAN, "
+        "editor_texture_vis BOOLEAN, editor_normals_vis BOOLEAN, editor_collision_vis, editor_pivot_vis, pivot_x REAL, pivot_y REAL, pivot_z REAL, "
+        "snap_to_ground BOOLEAN, AI_node BOOLEAN, audio_file STRING, volume REAL, pitch REAL, pan REAL, one_shot BOOLEAN, play_on_init BOOLEAN, "
+        "play_in_editor BOOLEAN, min_dist INTEGER, max_dist INTEGER, camera BOOLEAN, path_node BOOLEAN, path_node_start BOOLEAN, "
+        "path_node_end BOOLEAN, parent_ID INTEGER, editor_wireframe BOOLEAN DEFAULT (0), name STRING DEFAULT Name);";
+
+    const char* const INSERT_OBJECT = "INSERT INTO Objects VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+    const char* const INSERT_CHUNK = "INSERT INTO Chunks VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+
+    // NULL reads as empty, where the tables have no default
+    std::string Text(sqlite3_stmt* statement, int column)
+    {
+        const unsigned char* text = sqlite3_column_text(statement, column);
+        return text ? reinterpret_cast<const char*>(text) : std::string();
+    }
+
+    bool Bool(sqlite3_stmt* statement, int column)
+    {
+        return sqlite3_column_int(statement, column) != 0;
+    }
+
+    float Float(sqlite3_stmt* statement, int column)
+    {
+        return static_cast<float>(sqlite3_column_double(statement, column));
+    }
+
+    // Binds in column order, counting from the first
+    class Binder
+    {
+    public:
+        explicit Binder(sqlite3_stmt* statement) : m_statement(statement) {}
+
+        void Int(int value) { Check(sqlite3_bind_int(m_statement, m_column++, value)); }
+        void Bool(bool value) { Int(value ? 1 : 0); }
+        void Float(float value) { Check(sqlite3_bind_double(m_statement, m_column++, value)); }
+        void Text(const std::string& value) { Check(sqlite3_bind_text(m_statement, m_column++, value.c_str(), int(value.size()), SQLITE_STATIC)); }	//must outlive the step
+
+        bool IsOk() const { return m_ok; }
+
+    private:
+        void Check(int rc) { m_ok = m_ok && rc == SQLITE_OK; }
+
+        sqlite3_stmt*	m_statement;
+        int				m_column = 1;
+        bool			m_ok = true;
+    };
+}
+
+SceneDatabase::~SceneDatabase()
+{
+    Close();
+}
+
+bool SceneDatabase::Open(const std::string& path, bool create)
+{
+    Close();
+
+    const int flags = SQLITE_OPEN_READWRITE | (create ? SQLITE_OPEN_CREATE : 0);
+    if (sqlite3_open_v2(path.c_str(), &m_connection, flags, nullptr) != SQLITE_OK || (create && !Execute(CREATE_TABLES)))
+    {
+        //a connection is made even when opening fails, it holds the error
+        Fail();
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void SceneDatabase::Close()
+{
+    EndSaveObjects(false);
+    sqlite3_close(m_connection);
+    m_connection = nullptr;
+}
+
+bool SceneDatabase::LoadObjects(std::vector<SceneObject>& objects)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+    objects.clear();
+    m_stats = Stats();
+
+    // Count first, large scenes would otherwise copy every object a few times over as the vector grows
+    sqlite3_stmt* pResults = nullptr;
+    if (sqlite3_prepare_v2(m_connection, "SELECT count(*) FROM Objects", -1, &pResults, nullptr) != SQLITE_OK)
+        return Fail();
+    if (sqlite3_step(pResults) == SQLITE_ROW)
+        objects.reserve(size_t(sqlite3_column_int64(pResults, 0)));
+    sqlite3_finalize(pResults);
+
+    if (sqlite3_prepare_v2(m_connection, "SELECT * FROM Objects", -1, &pResults, nullptr) != SQLITE_OK)
+        return Fail();
+
+    int rc;
+    while ((rc = sqlite3_step(pResults)) == SQLITE_ROW)
+    {
+        objects.emplace_back();
+        SceneObject& newSceneObject = objects.back();
+        newSceneObject.ID = sqlite3_column_int(pResults, 0);
+        newSceneObject.chunk_ID = sqlite3_column_int(pResults, 1);
+        newSceneObject.model_path = Text(pResults, 2);
+        newSceneObject.tex_diffuse_path = Text(pResults, 3);
+        newSceneObject.posX = Float(pResults, 4);
+        newSceneObject.posY = Float(pResults, 5);
+        newSceneObject.posZ = Float(pResults, 6);
+        newSceneObject.rotX = Float(pResults, 7);
+        newSceneObject.rotY = Float(pResults, 8);
+        newSceneObject.rotZ = Float(pResults, 9);
+        newSceneObject.scaX = Float(pResults, 10);
+        newSceneObject.scaY = Float(pResults, 11);
+        newSceneObject.scaZ = Float(pResults, 12);
+        newSceneObject.render = Bool(pResults, 13);
+        newSceneObject.collision = Bool(pResults, 14);
+        newSceneObject.collision_mesh = Text(pResults, 15);
+        newSceneObject.collectable = Bool(pResults, 16);
+        newSceneObject.destructable = Bool(pResults, 17);
+        newSceneObject.health_amount = sqlite3_column_int(pResults, 18);
+        newSceneObject.editor_render = Bool(pResults, 19);
+        newSceneObject.editor_texture_vis = Bool(pResults, 20);
+        newSceneObject.editor_normals_vis = Bool(pResults, 21);
+        newSceneObject.editor_collision_vis = Bool(pResults, 22);
+        newSceneObject.editor_pivot_vis = Bool(pResults, 23);
+        newSceneObject.pivotX = Float(pResults, 24);
+        newSceneObject.pivotY = Float(pResults, 25);
+        newSceneObject.pivotZ = Float(pResults, 26);
+        newSceneObject.snapToGround = Bool(pResults, 27);
+        newSceneObject.AINode = Bool(pResults, 28);
+        newSceneObject.audio_path = Text(pResults, 29);
+        newSceneObject.volume = Float(pResults, 30);
+        newSceneObject.pitch = Float(pResults, 31);
+        newSceneObject.pan = Float(pResults, 32);
+        newSceneObject.one_shot = Bool(pResults, 33);
+        newSceneObject.play_on_init = Bool(pResults, 34);
+        newSceneObject.play_in_editor = Bool(pResults, 35);
+        newSceneObject.min_dist = static_cast<int>(sqlite3_column_double(pResults, 36));
+        newSceneObject.max_dist = static_cast<int>(sqlite3_column_double(pResults, 37));
+        newSceneObject.camera = Bool(pResults, 38);
+        newSceneObject.path_node = Bool(pResults, 39);
+        newSceneObject.path_node_start = Bool(pResults, 40);
+        newSceneObject.path_node_end = Bool(pResults, 41);
+        newSceneObject.parent_id = sqlite3_column_int(pResults, 42);
+        newSceneObject.editor_wireframe = Bool(pResults, 43);
+        newSceneObject.name = Text(pResults, 44);
+    }
+    sqlite3_finalize(pResults);
+
+    if (rc != SQLITE_DONE)
+        return Fail();
+
+    m_stats.objects = objects.size();
+    m_stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return true;
+}
+
+bool SceneDatabase::LoadChunk(ChunkObject& chunk)
+{
+    sqlite3_stmt* pResultsChunk = nullptr;
+    if (sqlite3_prepare_v2(m_connection, "SELECT * FROM Chunks", -1, &pResultsChunk, nullptr) != SQLITE_OK)
+        return Fail();
+
+    const int rc = sqlite3_step(pResultsChunk);
+    if (rc == SQLITE_ROW)
+    {
+        chunk.ID = sqlite3_column_int(pResultsChunk, 0);
+        chunk.name = Text(pResultsChunk, 1);
+        chunk.chunk_x_size_metres = sqlite3_column_int(pResultsChunk, 2);
+        chunk.chunk_y_size_metres = sqlite3_column_int(pResultsChunk, 3);
+        chunk.chunk_base_resolution = sqlite3_column_int(pResultsChunk, 4);
+        chunk.heightmap_path = Text(pResultsChunk, 5);
+        chunk.tex_diffuse_path = Text(pResultsChunk, 6);
+        chunk.tex_splat_alpha_path = Text(pResultsChunk, 7);
+        chunk.tex_splat_1_path = Text(pResultsChunk, 8);
+        chunk.tex_splat_2_path = Text(pResultsChunk, 9);
+        chunk.tex_splat_3_path = Text(pResultsChunk, 10);
+        chunk.tex_splat_4_path = Text(pResultsChunk, 11);
+        chunk.render_wireframe = Bool(pResultsChunk, 12);
+        chunk.render_normals = Bool(pResultsChunk, 13);
+        chunk.tex_diffuse_tiling = sqlite3_column_int(pResultsChunk, 14);
+        chunk.tex_splat_1_tiling = sqlite3_column_int(pResultsChunk, 15);
+        chunk.tex_splat_2_tiling = sqlite3_column_int(pResultsChunk, 16);
+        chunk.tex_splat_3_tiling = sqlite3_column_int(pResultsChunk, 17);
+        chunk.tex_splat_4_tiling = sqlite3_column_int(pResultsChunk, 18);
+    }
+    sqlite3_finalize(pResultsChunk);
+
+    if (rc == SQLITE_ROW)
+        return true;
+
+    if (rc == SQLITE_DONE)
+    {
+        m_error = "no chunk";
+        return false;
+    }
+    return Fail();
+}
+
+bool SceneDatabase::SaveObjects(const std::vector<SceneObject>& objects)
+{
+    if (!BeginSaveObjects())
+        return false;
+
+    for (const SceneObject& object : objects)
+    {
+        if (!SaveObject(object))
+            break;
+    }
+    return EndSaveObjects();
+}
+
+bool SceneDatabase::BeginSaveObjects()
+{
+    EndSaveObjects(false);
+    m_saveStart = std::chrono::high_resolution_clock::now();
+    m_stats = Stats();
+
+    if (!Execute("BEGIN") || !Execute("DELETE FROM Objects"))
+        return EndTransaction(false);
+
+    if (sqlite3_prepare_v2(m_connection, INSERT_OBJECT, -1, &m_insertObject, nullptr) != SQLITE_OK)
+    {
+        Fail();
+        return EndTransaction(false);
+    }
+
+    m_saveFailed = false;
+    return true;
+}
+
+bool SceneDatabase::SaveObject(const SceneObject& object)
+{
+    if (!m_insertObject || m_saveFailed)
+        return false;
+
+    Binder bind(m_insertObject);
+    bind.Int(object.ID);
+    bind.Int(object.chunk_ID);
+    bind.Text(object.model_path);
+    bind.Text(object.tex_diffuse_path);
+    bind.Float(object.posX);
+    bind.Float(object.posY);
+    bind.Float(object.posZ);
+    bind.Float(object.rotX);
+    bind.Float(object.rotY);
+    bind.Float(object.rotZ);
+    bind.Float(object.scaX);
+    bind.Float(object.scaY);
+    bind.Float(object.scaZ);
+    bind.Bool(object.render);
+    bind.Bool(object.collision);
+    bind.Text(object.collision_mesh);
+    bind.Bool(object.collectable);
+    bind.Bool(object.destructable);
+    bind.Int(object.health_amount);
+    bind.Bool(object.editor_render);
+    bind.Bool(object.editor_texture_vis);
+    bind.Bool(object.editor_normals_vis);
+    bind.Bool(object.editor_collision_vis);
+    bind.Bool(object.editor_pivot_vis);
+    bind.Float(object.pivotX);
+    bind.Float(object.pivotY);
+    bind.Float(object.pivotZ);
+    bind.Bool(object.snapToGround);
+    bind.Bool(object.AINode);
+    bind.Text(object.audio_path);
+    bind.Float(object.volume);
+    bind.Float(object.pitch);
+    bind.Float(object.pan);
+    bind.Bool(object.one_shot);
+    bind.Bool(object.play_on_init);
+    bind.Bool(object.play_in_editor);
+    bind.Int(object.min_dist);
+    bind.Int(object.max_dist);
+    bind.Bool(object.camera);
+    bind.Bool(object.path_node);
+    bind.Bool(object.path_node_start);
+    bind.Bool(object.path_node_end);
+    bind.Int(object.parent_id);
+    bind.Bool(object.editor_wireframe);
+    bind.Text(object.name);
+
+    if (!bind.IsOk() || sqlite3_step(m_insertObject) != SQLITE_DONE)
+    {
+        m_saveFailed = true;
+        return Fail();
+    }
+
+    sqlite3_reset(m_insertObject);
+    m_stats.objects++;
+    return true;
+}
+
+bool SceneDatabase::EndSaveObjects(bool commit)
+{
+    if (!m_insertObject)
+        return false;
+
+    sqlite3_finalize(m_insertObject);
+    m_insertObject = nullptr;
+
+    if (!EndTransaction(commit && !m_saveFailed))
+        return false;
+
+    m_stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_saveStart).count();
+    return true;
+}
+
+bool SceneDatabase::SaveChunk(const ChunkObject& chunk)
+{
+    if (!Execute("BEGIN") || !Execute("DELETE FROM Chunks"))
+        return EndTransaction(false);
+
+    sqlite3_stmt* pInsert = nullptr;
+    if (sqlite3_prepare_v2(m_connection, INSERT_CHUNK, -1, &pInsert, nullptr) != SQLITE_OK)
+    {
+        Fail();
+        return EndTransaction(false);
+    }
+
+    Binder bind(pInsert);
+    bind.Int(chunk.ID);
+    bind.Text(chunk.name);
+    bind.Int(chunk.chunk_x_size_metres);
+    bind.Int(chunk.chunk_y_size_metres);
+    bind.Int(chunk.chunk_base_resolution);
+    bind.Text(chunk.heightmap_path);
+    bind.Text(chunk.tex_diffuse_path);
+    bind.Text(chunk.tex_splat_alpha_path);
+    bind.Text(chunk.tex_splat_1_path);
+    bind.Text(chunk.tex_splat_2_path);
+    bind.Text(chunk.tex_splat_3_path);
+    bind.Text(chunk.tex_splat_4_path);
+    bind.Bool(chunk.render_wireframe);
+    bind.Bool(chunk.render_normals);
+    bind.Int(chunk.tex_diffuse_tiling);
+    bind.Int(chunk.tex_splat_1_tiling);
+    bind.Int(chunk.tex_splat_2_tiling);
+    bind.Int(chunk.tex_splat_3_tiling);
+    bind.Int(chunk.tex_splat_4_tiling);
+
+    const bool saved = (bind.IsOk() && sqlite3_step(pInsert) == SQLITE_DONE) || Fail();
+    sqlite3_finalize(pInsert);
+    return EndTransaction(saved);
+}
+
+bool SceneDatabase::Execute(const char* sql)
+{
+    return sqlite3_exec(m_connection, sql, nullptr, nullptr, nullptr) == SQLITE_OK || Fail();
+}
+
+bool SceneDatabase::EndTransaction(bool commit)
+{
+    if (commit && Execute("COMMIT"))
+        return true;
+
+    //the error that made it roll back is the one worth keeping
+    sqlite3_exec(m_connection, "ROLLBACK", nullptr, nullptr, nullptr);
+    return false;
+}
+
+bool SceneDatabase::Fail()
+{
+    m_error = m_connection ? sqlite3_errmsg(m_connection) : "database not open";
+    return false;
+}
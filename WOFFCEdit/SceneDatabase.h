@@ -0,0 +1,62 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "SceneObject.h"
+#include "ChunkObject.h"
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+// The editor's SQLite database: scene objects in the Objects table, one row each, and the terrain chunk
+// in the Chunks table. Columns are read and written by position, in the order of the tables in
+// database/test.db, which CreateTables also follows.
+//
+// Saves replace the whole table inside one transaction with a single prepared insert, so a save that
+// fails part way leaves the table as it was. Scenes too large to hold at once are saved a few objects at
+// a time, with BeginSaveObjects, SaveObject for each and EndSaveObjects.
+class SceneDatabase
+{
+public:
+    struct Stats
+    {
+        size_t	objects = 0;			//loaded or saved by the last call
+        double	milliseconds = 0.0;		//taken by the last load or save
+    };
+
+    SceneDatabase() = default;
+    ~SceneDatabase();
+
+    SceneDatabase(const SceneDatabase&) = delete;
+    SceneDatabase& operator=(const SceneDatabase&) = delete;
+
+    // An existing database, or with 'create' a new one where missing, with empty tables where missing
+    bool Open(const std::string& path, bool create = false);
+    void Close();
+    bool IsOpen() const { return m_connection != nullptr; }
+    sqlite3* GetConnection() const { return m_connection; }
+    const std::string& GetError() const { return m_error; }		//of the last call that failed
+
+    bool LoadObjects(std::vector<SceneObject>& objects);			//replaces 'objects' with every row
+    bool LoadChunk(ChunkObject& chunk);								//the first row, false if there is none
+    bool SaveObjects(const std::vector<SceneObject>& objects);		//replaces every row
+    bool BeginSaveObjects();										//starts replacing every row
+    bool SaveObject(const SceneObject& object);
+    bool EndSaveObjects(bool commit = true);						//false if anything failed, which leaves the rows as they were
+    bool SaveChunk(const ChunkObject& chunk);						//replaces every row with this one
+
+    const Stats& GetStats() const { return m_stats; }
+
+private:
+    bool Execute(const char* sql);
+    bool EndTransaction(bool commit);		//commits, or rolls back if 'commit' is false or committing fails
+    bool Fail();							//keeps the connection's error message, returns false
+
+    sqlite3*		m_connection = nullptr;
+    sqlite3_stmt*	m_insertObject = nullptr;	//between BeginSaveObjects and EndSaveObjects
+    bool			m_saveFailed = false;
+    std::chrono::high_resolution_clock::time_point	m_saveStart;
+    std::string		m_error;
+    Stats			m_stats;
+};
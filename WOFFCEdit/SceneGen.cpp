@@ -0,0 +1,85 @@
+// Writes a synthetic scene database for load and render scaling tests, with its heightmap and the copies of the
+// placeholder assets it uses. Runs from WOFFCEdit/, so the paths written resolve for the editor, which opens it with
+// /database <path>.
+//
+//     SceneGen path [--objects n] [--seed n] [--assets n] [--skew s] [--depth n] [--children fraction]
+//                   [--clusters n] [--clustered fraction] [--spread metres] [--octaves n] [--roughness r]
+//
+// Anything not given keeps SceneGenerator's default.
+
+#include "SceneGenerator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace
+{
+    bool ParseOptions(int argc, char** argv, std::string& path, SceneGenerator::Settings& settings)
+    {
+        for (int a = 1; a < argc; a++)
+        {
+            const bool hasValue = a + 1 < argc;
+            const char* value = hasValue ? argv[a + 1] : nullptr;
+            if (argv[a][0] != '-')
+            {
+                path = argv[a];
+                continue;
+            }
+            if (!hasValue)
+                return false;
+
+            if (strcmp(argv[a], "--objects") == 0)
+                settings.objects = strtoull(value, nullptr, 10);
+            else if (strcmp(argv[a], "--seed") == 0)
+                settings.seed = uint32_t(strtoul(value, nullptr, 10));
+            else if (strcmp(argv[a], "--assets") == 0)
+                settings.assets = strtoull(value, nullptr, 10);
+            else if (strcmp(argv[a], "--skew") == 0)
+                settings.assetSkew = strtof(value, nullptr);
+            else if (strcmp(argv[a], "--depth") == 0)
+                settings.hierarchyDepth = strtoull(value, nullptr, 10);
+            else if (strcmp(argv[a], "--children") == 0)
+                settings.childFraction = strtof(value, nullptr);
+            else if (strcmp(argv[a], "--clusters") == 0)
+                settings.clusters = strtoull(value, nullptr, 10);
+            else if (strcmp(argv[a], "--clustered") == 0)
+                settings.clusteredFraction = strtof(value, nullptr);
+            else if (strcmp(argv[a], "--spread") == 0)
+                settings.clusterSpread = strtof(value, nullptr);
+            else if (strcmp(argv[a], "--octaves") == 0)
+                settings.terrainOctaves = strtoull(value, nullptr, 10);
+            else if (strcmp(argv[a], "--roughness") == 0)
+                settings.terrainRoughness = strtof(value, nullptr);
+            else
+                return false;
+            a++;
+        }
+        return !path.empty();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string path;
+    SceneGenerator::Settings settings;
+    if (!ParseOptions(argc, argv, path, settings))
+    {
+        fprintf(stderr, "usage: SceneGen path [--objects n] [--seed n] [--assets n] [--skew s] [--depth n] [--children fraction]\n"
+                        "                     [--clusters n] [--clustered fraction] [--spread metres] [--octaves n] [--roughness r]\n");
+        return 2;
+    }
+
+    SceneGenerator generator(settings);
+    if (!generator.Write(path))
+    {
+        fprintf(stderr, "Can't write %s: %s\n", path.c_str(), generator.GetError().c_str());
+        return 1;
+    }
+
+    const SceneGenerator::Stats& stats = generator.GetStats();
+    printf("%s: %zu objects on %zu assets, %zu with a parent, chains up to %zu deep, in %.1f ms (%.0f objects/s)\n",
+        path.c_str(), stats.objects, stats.assetsUsed, stats.children, stats.maxDepth, stats.milliseconds,
+        stats.milliseconds > 0.0 ? stats.objects * 1000.0 / stats.milliseconds : 0.0);
+    return 0;
+}
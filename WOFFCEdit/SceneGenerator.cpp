@@ -0,0 +1,363 @@
+#include "SceneGenerator.h"
+#include "SceneDatabase.h"
+#include "TerrainHeightmap.h"
+#include "Platform.h"
+#include "sqlite3.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+    // The chunk as DisplayChunk places it, centred on the origin
+    constexpr float TERRAIN_SIZE = 512.f;
+    constexpr float TERRAIN_ORIGIN = -TERRAIN_SIZE * 0.5f;
+    constexpr size_t TERRAIN_RESOLUTION = 128;
+    constexpr float TERRAIN_HEIGHT_SCALE = 0.25f;
+    constexpr size_t TERRAIN_BASE_CELLS = 4;			//lattice cells across the chunk of the coarsest octave
+
+    constexpr float CLUSTER_INSET = 0.1f;				//of the chunk kept clear of cluster centres along each edge
+    constexpr float MIN_SCALE = 0.5f;
+    constexpr float MAX_SCALE = 2.f;
+
+    // Kinds of random numbers, so each only depends on the seed, the kind and the item it is for
+    enum Stream : uint64_t
+    {
+        STREAM_TERRAIN,
+        STREAM_CLUSTER,
+        STREAM_ASSET,
+        STREAM_PARENT,
+        STREAM_PLACEMENT,
+        STREAM_TRANSFORM,
+    };
+
+    inline uint64_t SplitMix64(uint64_t x)
+    {
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    // The 'n'th random number of item 'index' of a stream, [0, 1)
+    inline double Random(uint32_t seed, Stream stream, uint64_t index, uint32_t n)
+    {
+        const uint64_t key = (uint64_t(stream) << 56) ^ (index << 8) ^ n;
+        const uint64_t bits = SplitMix64(SplitMix64(seed) ^ SplitMix64(key));
+        return double(bits >> 11) * (1.0 / 9007199254740992.0);	//top 53 bits
+    }
+
+    // Standard normal from two uniform numbers, by Box-Muller
+    inline double Gaussian(double u1, double u2)
+    {
+        return std::sqrt(-2.0 * std::log(1.0 - u1)) * std::cos(6.283185307179586 * u2);
+    }
+
+    inline float ClampToChunk(double position)
+    {
+        return float(std::min(std::max(position, double(TERRAIN_ORIGIN)), double(-TERRAIN_ORIGIN)));
+    }
+
+    // Bilinear height of the terrain under a point
+    float TerrainHeight(const TerrainHeightmap& heightmap, float x, float z)
+    {
+        const size_t last = heightmap.GetResolution() - 1;
+        const float sampleX = std::min(std::max((x - TERRAIN_ORIGIN) / heightmap.GetCellSize(), 0.f), float(last));
+        const float sampleZ = std::min(std::max((z - TERRAIN_ORIGIN) / heightmap.GetCellSize(), 0.f), float(last));
+        const size_t x0 = std::min(size_t(sampleX), last > 0 ? last - 1 : 0);
+        const size_t z0 = std::min(size_t(sampleZ), last > 0 ? last - 1 : 0);
+        const size_t x1 = std::min(x0 + 1, last);
+        const size_t z1 = std::min(z0 + 1, last);
+        const float fx = sampleX - x0;
+        const float fz = sampleZ - z0;
+
+        const uint8_t* heights = heightmap.GetHeights();
+        const size_t resolution = heightmap.GetResolution();
+        const float top = (heights[(z0 * resolution) + x0] * (1.f - fx)) + (heights[(z0 * resolution) + x1] * fx);
+        const float bottom = (heights[(z1 * resolution) + x0] * (1.f - fx)) + (heights[(z1 * resolution) + x1] * fx);
+        return ((top * (1.f - fz)) + (bottom * fz)) * heightmap.GetHeightScale();
+    }
+
+    bool CopyAsset(const std::string& source, const std::string& destination)
+    {
+        // Copies from an earlier run are kept while the source hasn't changed since
+        const int64_t sourceTime = Platform::FileTime(source);
+        if (sourceTime >= 0 && Platform::FileTime(destination) >= sourceTime)
+            return true;
+
+        FILE* pSource = nullptr;
+        errno_t ret = fopen_s(&pSource, source.c_str(), "rb");
+        if (ret != 0 || pSource == nullptr)
+            return false;
+
+        FILE* pDestination = nullptr;
+        ret = fopen_s(&pDestination, destination.c_str(), "wb");
+        if (ret != 0 || pDestination == nullptr)
+        {
+            fclose(pSource);
+            return false;
+        }
+
+        char buffer[16 * 1024];
+        size_t count;
+        bool copied = true;
+        while ((count = fread(buffer, 1, sizeof(buffer), pSource)) > 0)
+            copied = copied && fwrite(buffer, 1, count, pDestination) == count;
+
+        copied = copied && ferror(pSource) == 0;
+        fclose(pSource);
+        return fclose(pDestination) == 0 && copied;
+    }
+
+    std::string Numbered(const std::string& directory, const char* name, size_t number, const std::string& source)
+    {
+        char digits[24];
+        snprintf(digits, sizeof(digits), "%04zu", number);
+
+        const size_t dot = source.find_last_of('.');
+        const size_t slash = source.find_last_of("/\\");
+        const std::string extension = dot != std::string::npos && (slash == std::string::npos || dot > slash) ? source.substr(dot) : std::string();
+        return directory + "/" + name + digits + extension;
+    }
+}
+
+SceneGenerator::SceneGenerator(const Settings& settings)
+    : m_settings(settings)
+{
+    m_settings.assets = std::max<size_t>(1, m_settings.assets);
+
+    // Zipf weights, accumulated and normalised so a uniform number picks an asset by binary search
+    m_assetCdf.resize(m_settings.assets);
+    double total = 0.0;
+    for (size_t k = 0; k < m_settings.assets; k++)
+    {
+        total += 1.0 / std::pow(double(k + 1), double(m_settings.assetSkew));
+        m_assetCdf[k] = total;
+    }
+    for (double& weight : m_assetCdf)
+        weight /= total;
+    m_assetCdf.back() = 1.0;
+}
+
+void SceneGenerator::GenerateHeightmap(TerrainHeightmap& heightmap) const
+{
+    // Value noise, summed over octaves of doubling frequency and falling amplitude
+    const size_t resolution = heightmap.GetResolution();
+    std::vector<float> heights(heightmap.GetNumSamples(), 0.f);
+    float amplitude = 1.f;
+    float totalAmplitude = 0.f;
+
+    for (size_t octave = 0; octave < m_settings.terrainOctaves; octave++)
+    {
+        const size_t cells = TERRAIN_BASE_CELLS << octave;
+        const uint64_t octaveKey = uint64_t(octave) << 40;
+        const auto lattice = [&](size_t x, size_t z)
+        {
+            return float(Random(m_settings.seed, STREAM_TERRAIN, octaveKey | (uint64_t(z) << 20) | x, 0));
+        };
+
+        for (size_t z = 0; z < resolution; z++)
+        {
+            const float v = resolution > 1 ? float(z) * cells / (resolution - 1) : 0.f;
+            const size_t z0 = std::min(size_t(v), cells - 1);
+            float fz = v - z0;
+            fz = fz * fz * (3.f - (2.f * fz));
+
+            for (size_t x = 0; x < resolution; x++)
+            {
+                const float u = resolution > 1 ? float(x) * cells / (resolution - 1) : 0.f;
+                const size_t x0 = std::min(size_t(u), cells - 1);
+                float fx = u - x0;
+                fx = fx * fx * (3.f - (2.f * fx));
+
+                const float top = lattice(x0, z0) + ((lattice(x0 + 1, z0) - lattice(x0, z0)) * fx);
+                const float bottom = lattice(x0, z0 + 1) + ((lattice(x0 + 1, z0 + 1) - lattice(x0, z0 + 1)) * fx);
+                heights[(z * resolution) + x] += (top + ((bottom - top) * fz)) * amplitude;
+            }
+        }
+
+        totalAmplitude += amplitude;
+        amplitude *= m_settings.terrainRoughness;
+    }
+
+    uint8_t* output = heightmap.GetHeights();
+    for (size_t i = 0; i < heights.size(); i++)
+    {
+        const float height = totalAmplitude > 0.f ? heights[i] / totalAmplitude : 0.f;
+        output[i] = uint8_t(std::min(std::max((height * 255.f) + 0.5f, 0.f), 255.f));
+    }
+}
+
+ChunkObject SceneGenerator::MakeChunk() const
+{
+    ChunkObject chunk = {};
+    chunk.ID = 0;
+    chunk.name = "Generated";
+    chunk.chunk_x_size_metres = int(TERRAIN_SIZE);
+    chunk.chunk_y_size_metres = int(TERRAIN_SIZE);
+    chunk.chunk_base_resolution = int(TERRAIN_RESOLUTION);
+    chunk.heightmap_path = GetHeightmapPath();
+    chunk.tex_diffuse_path = "database/data/rock.dds";		//as test.db's chunk
+    chunk.tex_diffuse_tiling = 16;
+    chunk.tex_splat_1_tiling = 1;
+    chunk.tex_splat_2_tiling = 1;
+    chunk.tex_splat_3_tiling = 1;
+    chunk.tex_splat_4_tiling = 1;
+    return chunk;
+}
+
+bool SceneGenerator::Generate(const TerrainHeightmap& heightmap, const std::function<bool(const SceneObject&)>& output)
+{
+    const Settings& settings = m_settings;
+    const uint32_t seed = settings.seed;
+    m_stats = Stats();
+
+    // Where every object went, for the children placed around it, and how deep it is
+    std::vector<float> positionX(settings.objects);
+    std::vector<float> positionZ(settings.objects);
+    std::vector<uint32_t> parents(settings.objects);		//index + 1, 0 for none
+    std::vector<uint32_t> depths(settings.objects);
+    std::vector<uint8_t> assetUsed(settings.assets, 0);
+
+    const double clusterRange = TERRAIN_SIZE * (1.0 - (2.0 * CLUSTER_INSET));
+    std::vector<float> clusterX(settings.clusters);
+    std::vector<float> clusterZ(settings.clusters);
+    for (size_t c = 0; c < settings.clusters; c++)
+    {
+        clusterX[c] = float(TERRAIN_ORIGIN + (TERRAIN_SIZE * CLUSTER_INSET) + (Random(seed, STREAM_CLUSTER, c, 0) * clusterRange));
+        clusterZ[c] = float(TERRAIN_ORIGIN + (TERRAIN_SIZE * CLUSTER_INSET) + (Random(seed, STREAM_CLUSTER, c, 1) * clusterRange));
+    }
+
+    SceneObject object;
+    for (size_t i = 0; i < settings.objects; i++)
+    {
+        const size_t asset = size_t(std::lower_bound(m_assetCdf.begin(), m_assetCdf.end(), Random(seed, STREAM_ASSET, i, 0)) - m_assetCdf.begin());
+        assetUsed[std::min(asset, settings.assets - 1)] = 1;
+
+        // A parent from the objects so far, or its parent where it is as deep as chains go
+        uint32_t parent = 0;
+        if (settings.hierarchyDepth > 0 && i > 0 && Random(seed, STREAM_PARENT, i, 0) < settings.childFraction)
+        {
+            size_t candidate = std::min(i - 1, size_t(Random(seed, STREAM_PARENT, i, 1) * i));
+            if (depths[candidate] >= settings.hierarchyDepth)
+                candidate = parents[candidate] - 1;
+
+            parent = uint32_t(candidate + 1);
+            depths[i] = depths[candidate] + 1;
+            m_stats.children++;
+            m_stats.maxDepth = std::max<size_t>(m_stats.maxDepth, depths[i]);
+        }
+        parents[i] = parent;
+
+        const double u = Random(seed, STREAM_PLACEMENT, i, 0);
+        const double v = Random(seed, STREAM_PLACEMENT, i, 1);
+        if (parent > 0)
+        {
+            positionX[i] = ClampToChunk(positionX[parent - 1] + ((u - 0.5) * 2.0 * settings.childSpread));
+            positionZ[i] = ClampToChunk(positionZ[parent - 1] + ((v - 0.5) * 2.0 * settings.childSpread));
+        }
+        else if (settings.clusters > 0 && Random(seed, STREAM_PLACEMENT, i, 2) < settings.clusteredFraction)
+        {
+            const size_t cluster = std::min(settings.clusters - 1, size_t(Random(seed, STREAM_PLACEMENT, i, 3) * settings.clusters));
+            const double spreadX = Gaussian(u, v);
+            const double spreadZ = Gaussian(u, v + 0.25 < 1.0 ? v + 0.25 : v - 0.75);	//a quarter turn on, the other Box-Muller output
+            positionX[i] = ClampToChunk(clusterX[cluster] + (spreadX * settings.clusterSpread));
+            positionZ[i] = ClampToChunk(clusterZ[cluster] + (spreadZ * settings.clusterSpread));
+        }
+        else
+        {
+            positionX[i] = float(TERRAIN_ORIGIN + (u * TERRAIN_SIZE));
+            positionZ[i] = float(TERRAIN_ORIGIN + (v * TERRAIN_SIZE));
+        }
+
+        const float scale = float(MIN_SCALE + (Random(seed, STREAM_TRANSFORM, i, 1) * (MAX_SCALE - MIN_SCALE)));
+
+        object.ID = int(i + 1);
+        object.model_path = GetModelPath(asset);
+        object.tex_diffuse_path = GetTexturePath(asset);
+        object.posX = positionX[i];
+        object.posY = TerrainHeight(heightmap, positionX[i], positionZ[i]);
+        object.posZ = positionZ[i];
+        object.rotY = float(Random(seed, STREAM_TRANSFORM, i, 0) * 360.0);
+        object.scaX = object.scaY = object.scaZ = scale;
+        object.parent_id = int(parent);
+        object.name = "Object " + std::to_string(i + 1);
+
+        if (!output(object))
+            return false;
+        m_stats.objects++;
+    }
+
+    m_stats.assetsUsed = size_t(std::count(assetUsed.begin(), assetUsed.end(), uint8_t(1)));
+    return true;
+}
+
+std::string SceneGenerator::GetModelPath(size_t asset) const
+{
+    return m_settings.assets == 1 ? m_settings.sourceModel : Numbered(m_settings.assetDirectory, "model_", asset, m_settings.sourceModel);
+}
+
+std::string SceneGenerator::GetTexturePath(size_t asset) const
+{
+    return m_settings.assets == 1 ? m_settings.sourceTexture : Numbered(m_settings.assetDirectory, "texture_", asset, m_settings.sourceTexture);
+}
+
+std::string SceneGenerator::GetHeightmapPath() const
+{
+    return m_settings.assetDirectory + "/heightmap.raw";
+}
+
+bool SceneGenerator::WriteAssets(const TerrainHeightmap& heightmap) const
+{
+    if (!Platform::MakeDirectory(m_settings.assetDirectory))
+        return false;
+
+    if (m_settings.assets > 1)
+    {
+        for (size_t asset = 0; asset < m_settings.assets; asset++)
+        {
+            if (!CopyAsset(m_settings.sourceModel, GetModelPath(asset)) || !CopyAsset(m_settings.sourceTexture, GetTexturePath(asset)))
+                return false;
+        }
+    }
+
+    return heightmap.Save(GetHeightmapPath());
+}
+
+bool SceneGenerator::Write(const std::string& path)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+    m_error.clear();
+
+    TerrainHeightmap heightmap(TERRAIN_RESOLUTION, TERRAIN_HEIGHT_SCALE, TERRAIN_SIZE / (TERRAIN_RESOLUTION - 1));
+    GenerateHeightmap(heightmap);
+    if (!WriteAssets(heightmap))
+    {
+        m_error = "can't write the assets or heightmap to " + m_settings.assetDirectory;
+        return false;
+    }
+
+    // A fixture is made again rather than recovered after a crash, so the journal is kept in memory and nothing
+    // is synced to disk. The journal still lets a failed save roll back, and a failed write removes the file
+    // rather than leave part of a scene behind.
+    SceneDatabase database;
+    const auto fail = [&](const std::string& error)
+    {
+        m_error = error;
+        database.Close();
+        Platform::RemoveFile(path);
+        return false;
+    };
+
+    if (!Platform::RemoveFile(path) || !database.Open(path, true)
+        || sqlite3_exec(database.GetConnection(), "PRAGMA journal_mode = MEMORY; PRAGMA synchronous = OFF", nullptr, nullptr, nullptr) != SQLITE_OK
+        || !database.SaveChunk(MakeChunk()) || !database.BeginSaveObjects())
+        return fail(database.GetError().empty() ? "can't replace " + path : database.GetError());
+
+    const bool generated = Generate(heightmap, [&](const SceneObject& object) { return database.SaveObject(object); });
+    if (!database.EndSaveObjects(generated))
+        return fail(database.GetError().empty() ? "can't write the objects to " + path : database.GetError());
+
+    m_stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return true;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include "SceneObject.h"
+#include "ChunkObject.h"
+
+class TerrainHeightmap;
+
+// Synthetic scenes for load and render scaling tests: a fractal heightmap, and any number of objects standing
+// on it, with a chosen spread of assets, depth of hierarchy and amount of spatial clustering.
+//
+// The same settings always make the same scene, on any platform: every random number comes from a hash of
+// the seed and what it is for, rather than from a stream shared between objects.
+//
+//  - Assets are picked with a Zipf distribution: asset k (from 0) is picked in proportion to 1 / (k + 1)^skew,
+//    so 0 is uniform and larger skews put most objects on a few models, as real scenes do.
+//  - Objects are either scattered around cluster centres with a normal distribution, or uniformly over the
+//    chunk, and are placed on the terrain.
+//  - Children are placed around their parent. A parent always comes before its children, and chains are
+//    never more than 'hierarchyDepth' parents long.
+class SceneGenerator
+{
+public:
+    struct Settings
+    {
+        size_t		objects = 10000;
+        uint32_t	seed = 1;
+
+        size_t		assets = 16;				//distinct model and texture pairs
+        float		assetSkew = 1.f;
+        std::string	sourceModel = "database/data/placeholder.cmo";		//copied for every asset by WriteAssets
+        std::string	sourceTexture = "database/data/placeholder.dds";
+        std::string	assetDirectory = "database/data/generated";			//where the copies, and the heightmap, go
+
+        size_t		hierarchyDepth = 0;			//0 for a flat scene
+        float		childFraction = 0.5f;		//of objects that get a parent, when there can be any
+        float		childSpread = 4.f;			//metres children are placed within around their parent
+
+        size_t		clusters = 32;				//0 to scatter everything uniformly
+        float		clusteredFraction = 0.8f;	//of objects around a cluster, the rest are uniform
+        float		clusterSpread = 16.f;		//standard deviation around a cluster centre, metres
+
+        size_t		terrainOctaves = 6;
+        float		terrainRoughness = 0.5f;	//amplitude kept from one octave to the next
+    };
+
+    struct Stats
+    {
+        size_t		objects = 0;
+        size_t		assetsUsed = 0;				//distinct assets that ended up with at least one object
+        size_t		maxDepth = 0;				//longest parent chain
+        size_t		children = 0;				//objects with a parent
+        double		milliseconds = 0.0;			//of the last Write
+    };
+
+    explicit SceneGenerator(const Settings& settings);
+
+    // Heights for a heightmap of any resolution, the chunk is fixed at 512 metres as DisplayChunk places it
+    void GenerateHeightmap(TerrainHeightmap& heightmap) const;
+
+    // The chunk pointing at the generated heightmap
+    ChunkObject MakeChunk() const;
+
+    // Objects in ID order, from 1, standing on 'heightmap'. Stops early, returning false, if 'output' does.
+    bool Generate(const TerrainHeightmap& heightmap, const std::function<bool(const SceneObject&)>& output);
+
+    // Model and texture paths of an asset, the source files themselves for a single asset
+    std::string GetModelPath(size_t asset) const;
+    std::string GetTexturePath(size_t asset) const;
+
+    // Copies the source model and texture for every asset and writes the heightmap, so the editor can load the scene
+    bool WriteAssets(const TerrainHeightmap& heightmap) const;
+
+    // The whole scene as a new database, replacing 'path': assets, heightmap, chunk and objects
+    bool Write(const std::string& path);
+
+    const Stats& GetStats() const { return m_stats; }
+    const std::string& GetError() const { return m_error; }
+
+private:
+    std::string GetHeightmapPath() const;
+
+    Settings				m_settings;
+    std::vector<double>		m_assetCdf;			//cumulative Zipf weights, the last is 1
+    Stats					m_stats;
+    std::string				m_error;
+};
@@ -0,0 +1,206 @@
+#include "SceneObjectMap.h"
+#include <utility>
+
+namespace
+{
+    constexpr size_t MIN_TABLE_SIZE = 16;
+
+    // Spreads IDs over the table, which only takes the low bits, whatever pattern they were given out in
+    inline size_t HashId(int id)
+    {
+        uint32_t x = uint32_t(id);
+        x = (x ^ (x >> 16)) * 0x85EBCA6Bu;
+        x = (x ^ (x >> 13)) * 0xC2B2AE35u;
+        return x ^ (x >> 16);
+    }
+}
+
+constexpr uint32_t SceneObjectMap::NO_SLOT;
+constexpr uint32_t SceneObjectMap::EMPTY_ENTRY;
+
+void SceneObjectMap::Clear()
+{
+    m_objects.clear();
+    m_objectSlots.clear();
+    m_idTable.clear();
+
+    // Slots are kept, a generation on, so handles from before never find what is inserted after
+    for (Slot& slot : m_slots)
+        slot.generation += slot.generation & 1;
+    FreeSlotsFrom(0);
+}
+
+void SceneObjectMap::Reserve(size_t count)
+{
+    m_objects.reserve(count);
+    m_objectSlots.reserve(count);
+    m_slots.reserve(count);
+    GrowTable(count);
+}
+
+void SceneObjectMap::Assign(std::vector<SceneObject>&& objects)
+{
+    Clear();
+    m_objects = std::move(objects);
+    m_objectSlots.reserve(m_objects.size());
+    m_slots.reserve(m_objects.size());
+    GrowTable(m_objects.size());
+
+    // Every object gets the slot of its place, closing up behind any dropped for reusing an ID
+    size_t kept = 0;
+    for (size_t i = 0; i < m_objects.size(); i++)
+    {
+        const size_t entry = FindEntry(m_objects[i].ID);
+        if (m_idTable[entry].slot != EMPTY_ENTRY)
+            continue;
+
+        const uint32_t slot = uint32_t(kept);
+        if (slot < m_slots.size())
+            m_slots[slot] = { slot, m_slots[slot].generation + 1 };
+        else
+            m_slots.push_back({ slot, 1 });
+        m_objectSlots.push_back(slot);
+        m_idTable[entry] = { m_objects[i].ID, slot };
+        if (kept != i)
+            m_objects[kept] = std::move(m_objects[i]);
+        kept++;
+    }
+    m_objects.erase(m_objects.begin() + kept, m_objects.end());
+    FreeSlotsFrom(kept);
+}
+
+SceneObjectHandle SceneObjectMap::Insert(const SceneObject& object)
+{
+    if (Find(object.ID).IsValid())
+        return SceneObjectHandle();
+
+    GrowTable(m_objects.size() + 1);
+
+    uint32_t slot = m_freeSlot;
+    if (slot != NO_SLOT)
+        m_freeSlot = m_slots[slot].index;
+    else
+    {
+        slot = uint32_t(m_slots.size());
+        m_slots.push_back({ 0, 0 });
+    }
+
+    m_slots[slot].index = uint32_t(m_objects.size());
+    m_slots[slot].generation++;
+    m_objects.push_back(object);
+    m_objectSlots.push_back(slot);
+    InsertEntry(object.ID, slot);
+    return { slot, m_slots[slot].generation };
+}
+
+bool SceneObjectMap::Erase(SceneObjectHandle handle)
+{
+    const SceneObject* object = Get(handle);
+    if (!object)
+        return false;
+
+    EraseEntry(FindEntry(object->ID));
+
+    // The last object fills the gap
+    const uint32_t index = m_slots[handle.slot].index;
+    const size_t last = m_objects.size() - 1;
+    if (index != last)
+    {
+        m_objects[index] = std::move(m_objects[last]);
+        m_objectSlots[index] = m_objectSlots[last];
+        m_slots[m_objectSlots[index]].index = index;
+    }
+    m_objects.pop_back();
+    m_objectSlots.pop_back();
+
+    m_slots[handle.slot].generation++;
+    m_slots[handle.slot].index = m_freeSlot;
+    m_freeSlot = handle.slot;
+    return true;
+}
+
+SceneObjectHandle SceneObjectMap::Find(int id) const
+{
+    if (m_idTable.empty())
+        return SceneObjectHandle();
+
+    const uint32_t slot = m_idTable[FindEntry(id)].slot;
+    if (slot == EMPTY_ENTRY)
+        return SceneObjectHandle();
+
+    return { slot, m_slots[slot].generation };
+}
+
+SceneObject* SceneObjectMap::Get(SceneObjectHandle handle)
+{
+    return const_cast<SceneObject*>(static_cast<const SceneObjectMap*>(this)->Get(handle));
+}
+
+const SceneObject* SceneObjectMap::Get(SceneObjectHandle handle) const
+{
+    if (handle.slot >= m_slots.size() || (handle.generation & 1) == 0 || m_slots[handle.slot].generation != handle.generation)
+        return nullptr;
+
+    return &m_objects[m_slots[handle.slot].index];
+}
+
+void SceneObjectMap::FreeSlotsFrom(size_t first)
+{
+    // Linked last to first, so the lowest is reused first
+    m_freeSlot = NO_SLOT;
+    for (size_t slot = m_slots.size(); slot > first; slot--)
+    {
+        m_slots[slot - 1].index = m_freeSlot;
+        m_freeSlot = uint32_t(slot - 1);
+    }
+}
+
+size_t SceneObjectMap::FindEntry(int id) const
+{
+    const size_t mask = m_idTable.size() - 1;
+    size_t entry = HashId(id) & mask;
+    while (m_idTable[entry].slot != EMPTY_ENTRY && m_idTable[entry].id != id)
+        entry = (entry + 1) & mask;
+
+    return entry;
+}
+
+void SceneObjectMap::InsertEntry(int id, uint32_t slot)
+{
+    m_idTable[FindEntry(id)] = { id, slot };
+}
+
+void SceneObjectMap::EraseEntry(size_t entry)
+{
+    // Entries after the hole that would be found through it move back into it, until an empty entry ends the run
+    const size_t mask = m_idTable.size() - 1;
+    size_t hole = entry;
+    for (size_t next = (hole + 1) & mask; m_idTable[next].slot != EMPTY_ENTRY; next = (next + 1) & mask)
+    {
+        const size_t home = HashId(m_idTable[next].id) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            m_idTable[hole] = m_idTable[next];
+            hole = next;
+        }
+    }
+    m_idTable[hole].slot = EMPTY_ENTRY;
+}
+
+void SceneObjectMap::GrowTable(size_t count)
+{
+    if (m_idTable.size() >= count * 2 && !m_idTable.empty())
+        return;
+
+    size_t size = MIN_TABLE_SIZE;
+    while (size < count * 2)
+        size *= 2;
+
+    std::vector<IdEntry> entries(size, IdEntry{ 0, EMPTY_ENTRY });
+    entries.swap(m_idTable);
+    for (const IdEntry& entry : entries)
+    {
+        if (entry.slot != EMPTY_ENTRY)
+            InsertEntry(entry.id, entry.slot);
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "SceneObject.h"
+
+// Refers to an object in a SceneObjectMap for as long as it is there. A handle to an object that has been
+// erased never finds anything, even once its slot holds another object.
+struct SceneObjectHandle
+{
+    uint32_t	slot = 0;
+    uint32_t	generation = 0;		//0 in a handle to nothing, always odd in one to an object
+
+    bool IsValid() const { return generation != 0; }
+    bool operator==(const SceneObjectHandle& other) const { return slot == other.slot && generation == other.generation; }
+    bool operator!=(const SceneObjectHandle& other) const { return !(*this == other); }
+};
+
+// The scene's objects, by handle and by database ID, both in constant time. The objects themselves are kept
+// packed in a vector for iterating, saving and building the display list; erasing one moves the last into its
+// place, so the order isn't kept and pointers and indices into the objects only last until the next insert or
+// erase. Hold handles, or IDs, across edits instead.
+//
+//  - Slots map handles to places in the packed vector, and count their generation up every time their
+//    object is erased, which is what tells a stale handle from a current one. Free slots are reused.
+//  - IDs map to slots through an open addressed table with linear probing, kept at most half full, and
+//    erased from by shifting the entries after them back, so lookups never wade through tombstones.
+class SceneObjectMap
+{
+public:
+    void Clear();									//handles from before stay stale, whatever is inserted after
+    void Reserve(size_t count);
+
+    // Replaces the contents, e.g. with a freshly loaded scene. Objects after the first with an ID are dropped.
+    void Assign(std::vector<SceneObject>&& objects);
+
+    // A handle to nothing if an object already has the ID
+    SceneObjectHandle Insert(const SceneObject& object);
+    bool Erase(SceneObjectHandle handle);			//false if the handle is stale
+
+    SceneObjectHandle Find(int id) const;			//a handle to nothing if no object has the ID
+    SceneObject* Get(SceneObjectHandle handle);		//nullptr if the handle is stale
+    const SceneObject* Get(SceneObjectHandle handle) const;
+
+    // The packed objects, with the handle of each. Change IDs through Erase and Insert, not through these.
+    size_t Size() const { return m_objects.size(); }
+    bool Empty() const { return m_objects.empty(); }
+    SceneObject& operator[](size_t index) { return m_objects[index]; }
+    const SceneObject& operator[](size_t index) const { return m_objects[index]; }
+    SceneObjectHandle GetHandle(size_t index) const { return { m_objectSlots[index], m_slots[m_objectSlots[index]].generation }; }
+    const std::vector<SceneObject>& GetObjects() const { return m_objects; }
+
+    std::vector<SceneObject>::iterator begin() { return m_objects.begin(); }
+    std::vector<SceneObject>::iterator end() { return m_objects.end(); }
+    std::vector<SceneObject>::const_iterator begin() const { return m_objects.begin(); }
+    std::vector<SceneObject>::const_iterator end() const { return m_objects.end(); }
+
+private:
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+    static constexpr uint32_t EMPTY_ENTRY = UINT32_MAX;
+
+    struct Slot
+    {
+        uint32_t	index;			//into m_objects while in use, the next free slot while free
+        uint32_t	generation;		//odd while in use
+    };
+
+    struct IdEntry
+    {
+        int			id;
+        uint32_t	slot;			//EMPTY_ENTRY if the entry is unused
+    };
+
+    void FreeSlotsFrom(size_t first);			//every slot from 'first' on, which must not be in use
+    size_t FindEntry(int id) const;			//the entry with the ID, or the empty one it would go in
+    void InsertEntry(int id, uint32_t slot);
+    void EraseEntry(size_t entry);
+    void GrowTable(size_t count);			//so 'count' IDs keep it at most half full
+
+    std::vector<SceneObject>	m_objects;		//packed
+    std::vector<uint32_t>		m_objectSlots;	//slot of each object
+    std::vector<Slot>			m_slots;
+    uint32_t					m_freeSlot = NO_SLOT;	//first of the free slots
+    std::vector<IdEntry>		m_idTable;		//power of two in size
+};
@@ -3,7 +3,6 @@
 
 #include "SelectDialogue.h"
 #include "resource.h"
-#include "SceneObject.h"
 
 // SelectDialogue dialog
 
@@ -17,7 +16,7 @@ BEGIN_MESSAGE_MAP(SelectDialogue, CDialogEx)
 END_MESSAGE_MAP()
 
 
-SelectDialogue::SelectDialogue(CWnd* pParent, std::vector<SceneObject>* SceneGraph)		//constructor used in modal
+SelectDialogue::SelectDialogue(CWnd* pParent, SceneObjectMap* SceneGraph)		//constructor used in modal
     : CDialogEx(IDD_DIALOG1, pParent)
 {
     m_sceneGraph = SceneGraph;
@@ -29,18 +28,20 @@ SelectDialogue::SelectDialogue(CWnd * pParent)			//constructor used in modeless
 }
 
 ///pass through pointers to the data in the tool we want to manipulate
-void SelectDialogue::SetObjectData(std::vector<SceneObject>* SceneGraph, int * selection)
+void SelectDialogue::SetObjectData(SceneObjectMap* SceneGraph, SceneObjectHandle * selection)
 {
     m_sceneGraph = SceneGraph;
     m_currentSelection = selection;
 
-    //roll through all the objects in the scene graph and put an entry for each in the listbox
-    int numSceneObjects = m_sceneGraph->size();
-    for (int i = 0; i < numSceneObjects; i++)
+    //roll through all the objects in the scene graph and put an entry for each in the listbox, keeping the ID with it
+    const size_t numSceneObjects = m_sceneGraph->Size();
+    for (size_t i = 0; i < numSceneObjects; i++)
     {
         //easily possible to make the data string presented more complex. showing other columns.
-        std::wstring listBoxEntry = std::to_wstring(m_sceneGraph->at(i).ID);
-        m_listBox.AddString(listBoxEntry.c_str());
+        const int ID = (*m_sceneGraph)[i].ID;
+        std::wstring listBoxEntry = std::to_wstring(ID);
+        const int entry = m_listBox.AddString(listBoxEntry.c_str());
+        m_listBox.SetItemData(entry, DWORD_PTR(ID));
     }
 }
 
@@ -59,11 +60,11 @@ void SelectDialogue::End()
 void SelectDialogue::Select()
 {
     int index = m_listBox.GetCurSel();
-    CString currentSelectionValue;
-
-    m_listBox.GetText(index, currentSelectionValue);
+    if (index == LB_ERR)
+        return;
 
-    *m_currentSelection = _ttoi(currentSelectionValue);
+    //straight to the object from its ID, which is valid for as long as the object is there
+    *m_currentSelection = m_sceneGraph->Find(int(m_listBox.GetItemData(index)));
 
 }
 
@@ -73,11 +74,11 @@ BOOL SelectDialogue::OnInitDialog()
 
     //uncomment for modal only
 /*	//roll through all the objects in the scene graph and put an entry for each in the listbox
-    int numSceneObjects = m_sceneGraph->size();
+    size_t numSceneObjects = m_sceneGraph->Size();
     for (size_t i = 0; i < numSceneObjects; i++)
     {
         //easily possible to make the data string presented more complex. showing other columns.
-        std::wstring listBoxEntry = std::to_wstring(m_sceneGraph->at(i).ID);
+        std::wstring listBoxEntry = std::to_wstring((*m_sceneGraph)[i].ID);
         m_listBox.AddString(listBoxEntry.c_str());
     }*/
 
@@ -1,8 +1,6 @@
 #pragma once
 #include "afxdialogex.h"
-#include <vector>
-
-struct SceneObject;
+#include "SceneObjectMap.h"
 
 // SelectDialogue dialog
 
@@ -11,12 +9,12 @@ class SelectDialogue : public CDialogEx
     DECLARE_DYNAMIC(SelectDialogue)
 
 public:
-    SelectDialogue(CWnd* pParent, std::vector<SceneObject>* SceneGraph);   // modal // takes in out scenegraph in the constructor
+    SelectDialogue(CWnd* pParent, SceneObjectMap* SceneGraph);   // modal // takes in out scenegraph in the constructor
     explicit SelectDialogue(CWnd* pParent = NULL);
 
     virtual ~SelectDialogue() = default;
 
-    void SetObjectData(std::vector<SceneObject>* SceneGraph, int * Selection);	//passing in pointers to the data the class will operate on.
+    void SetObjectData(SceneObjectMap* SceneGraph, SceneObjectHandle * Selection);	//passing in pointers to the data the class will operate on.
 
 // Dialog Data
 #ifdef AFX_DESIGN_TIME
@@ -28,8 +26,8 @@ protected:
     afx_msg void End();		//kill the dialogue
     afx_msg void Select();	//Item has been selected
 
-    std::vector<SceneObject> * m_sceneGraph;
-    int * m_currentSelection;
+    SceneObjectMap * m_sceneGraph;
+    SceneObjectHandle * m_currentSelection;
 
 
     DECLARE_MESSAGE_MAP()
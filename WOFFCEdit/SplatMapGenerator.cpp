@@ -0,0 +1,229 @@
+#include "SplatMapGenerator.h"
+#include "JobSystem.h"
+#include "Platform.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+    constexpr float RAD_TO_DEG = 57.2957795f;
+
+    inline float Saturate(float v)
+    {
+        return std::min(std::max(v, 0.f), 1.f);
+    }
+
+    // 1 inside [min, max], fading linearly to 0 over 'falloff' either side
+    inline float Band(float v, float min, float max, float falloff)
+    {
+        const float invFalloff = 1.f / std::max(falloff, 1e-4f);
+        return Saturate((v - min) * invFalloff + 1.f) * Saturate((max - v) * invFalloff + 1.f);
+    }
+}
+
+SplatMapGenerator::SplatMapGenerator()
+{
+    // Default rules: grass on low, gentle ground; rock on steep slopes; snow on high, gentle ground;
+    // dirt collecting in valleys and creases.
+    SplatRule& grass = m_rules[0];
+    grass.maxHeight = 40.f;
+    grass.heightFalloff = 5.f;
+    grass.maxSlope = 25.f;
+    grass.slopeFalloff = 8.f;
+
+    SplatRule& rock = m_rules[1];
+    rock.minSlope = 30.f;
+    rock.slopeFalloff = 8.f;
+
+    SplatRule& snow = m_rules[2];
+    snow.minHeight = 45.f;
+    snow.heightFalloff = 6.f;
+    snow.maxSlope = 40.f;
+    snow.slopeFalloff = 10.f;
+
+    SplatRule& dirt = m_rules[3];
+    dirt.maxSlope = 35.f;
+    dirt.slopeFalloff = 8.f;
+    dirt.curvatureWeight = 4.f;
+}
+
+void SplatMapGenerator::Initialise(size_t resolution, float heightScale, float cellSize)
+{
+    m_resolution = resolution;
+    m_tilesPerSide = (resolution + TILE_SIZE - 1) / TILE_SIZE;
+    m_heightScale = heightScale;
+    m_cellSize = cellSize;
+
+    m_weights.assign(resolution * resolution * NUM_LAYERS, 0);
+    m_dirtyTiles.assign(m_tilesPerSide * m_tilesPerSide, 0);
+    m_numDirtyTiles = 0;
+}
+
+void SplatMapGenerator::MarkDirty(size_t minX, size_t minZ, size_t maxX, size_t maxZ)
+{
+    if (m_resolution == 0)
+        return;
+
+    // Slope and curvature read the neighbouring samples, so a change also affects the texels around it
+    minX = minX > 0 ? minX - 1 : 0;
+    minZ = minZ > 0 ? minZ - 1 : 0;
+    maxX = std::min(maxX + 1, m_resolution - 1);
+    maxZ = std::min(maxZ + 1, m_resolution - 1);
+
+    for (size_t tz = minZ / TILE_SIZE; tz <= maxZ / TILE_SIZE; tz++)
+    {
+        for (size_t tx = minX / TILE_SIZE; tx <= maxX / TILE_SIZE; tx++)
+        {
+            uint8_t& dirty = m_dirtyTiles[(tz * m_tilesPerSide) + tx];
+            if (!dirty)
+            {
+                dirty = 1;
+                ++m_numDirtyTiles;
+            }
+        }
+    }
+}
+
+void SplatMapGenerator::MarkAllDirty()
+{
+    std::fill(m_dirtyTiles.begin(), m_dirtyTiles.end(), 1);
+    m_numDirtyTiles = m_dirtyTiles.size();
+}
+
+void SplatMapGenerator::Update(const uint8_t* heightMap)
+{
+    if (m_numDirtyTiles == 0)
+        return;
+
+    std::vector<size_t> dirtyTiles;
+    dirtyTiles.reserve(m_numDirtyTiles);
+    for (size_t i = 0; i < m_dirtyTiles.size(); i++)
+    {
+        if (m_dirtyTiles[i])
+            dirtyTiles.push_back(i);
+    }
+
+    // Tiles write disjoint texels and only read the heightmap, so they can be evaluated in any order
+    JobSystem::ParallelFor(size_t(0), dirtyTiles.size(), [&](size_t i)
+    {
+        EvaluateTile(heightMap, dirtyTiles[i] % m_tilesPerSide, dirtyTiles[i] / m_tilesPerSide);
+    });
+
+    std::fill(m_dirtyTiles.begin(), m_dirtyTiles.end(), 0);
+    m_numDirtyTiles = 0;
+}
+
+void SplatMapGenerator::EvaluateTile(const uint8_t* heightMap, size_t tileX, size_t tileZ)
+{
+    const size_t res = m_resolution;
+    const size_t startX = tileX * TILE_SIZE;
+    const size_t startZ = tileZ * TILE_SIZE;
+    const size_t endX = std::min(startX + TILE_SIZE, res);
+    const size_t endZ = std::min(startZ + TILE_SIZE, res);
+
+    const float invTwoCells = 1.f / (2.f * m_cellSize);
+    const float invCellSq = 1.f / (m_cellSize * m_cellSize);
+
+    const auto HeightAt = [&](size_t x, size_t z)
+    {
+        return heightMap[(z * res) + x] * m_heightScale;
+    };
+
+    for (size_t z = startZ; z < endZ; z++)
+    {
+        // Clamp neighbours at the chunk border
+        const size_t zDown = z > 0 ? z - 1 : z;
+        const size_t zUp = z + 1 < res ? z + 1 : z;
+
+        for (size_t x = startX; x < endX; x++)
+        {
+            const size_t xLeft = x > 0 ? x - 1 : x;
+            const size_t xRight = x + 1 < res ? x + 1 : x;
+
+            const float h = HeightAt(x, z);
+            const float hLeft = HeightAt(xLeft, z);
+            const float hRight = HeightAt(xRight, z);
+            const float hDown = HeightAt(x, zDown);
+            const float hUp = HeightAt(x, zUp);
+
+            const float dx = (hRight - hLeft) * invTwoCells;
+            const float dz = (hUp - hDown) * invTwoCells;
+            const float slope = std::atan(std::sqrt((dx * dx) + (dz * dz))) * RAD_TO_DEG;
+
+            // Laplacian, positive in concave areas
+            const float curvature = (hLeft + hRight + hDown + hUp - (4.f * h)) * invCellSq;
+
+            float weights[NUM_LAYERS];
+            float total = 0.f;
+            for (size_t layer = 0; layer < NUM_LAYERS; layer++)
+            {
+                const SplatRule& rule = m_rules[layer];
+                float w = Band(h, rule.minHeight, rule.maxHeight, rule.heightFalloff)
+                    * Band(slope, rule.minSlope, rule.maxSlope, rule.slopeFalloff);
+
+                if (rule.curvatureWeight != 0.f)
+                    w *= Saturate(0.5f + (rule.curvatureWeight * curvature));
+
+                weights[layer] = w;
+                total += w;
+            }
+
+            uint8_t* texel = &m_weights[((z * res) + x) * NUM_LAYERS];
+            if (total <= 0.f)
+            {
+                // No rule matched, fall back to the first layer
+                texel[0] = 255;
+                texel[1] = texel[2] = texel[3] = 0;
+                continue;
+            }
+
+            // Normalise so the weights sum to exactly 255, giving the rounding error to the dominant layer
+            const float normalise = 255.f / total;
+            size_t dominant = 0;
+            int sum = 0;
+            for (size_t layer = 0; layer < NUM_LAYERS; layer++)
+            {
+                texel[layer] = static_cast<uint8_t>((weights[layer] * normalise) + 0.5f);
+                sum += texel[layer];
+
+                if (weights[layer] > weights[dominant])
+                    dominant = layer;
+            }
+            texel[dominant] = static_cast<uint8_t>(texel[dominant] + (255 - sum));
+        }
+    }
+}
+
+bool SplatMapGenerator::Load(const std::string& path)
+{
+    FILE* pFile = NULL;
+    errno_t ret = fopen_s(&pFile, path.c_str(), "rb");
+    if (ret != 0 || pFile == NULL)
+        return false;
+
+    //one byte more than the map, so a file that is too long is caught as well as one that is too short
+    std::vector<uint8_t> weights(m_weights.size() + 1);
+    const size_t read = fread(weights.data(), 1, weights.size(), pFile);
+    fclose(pFile);
+
+    if (read != m_weights.size())
+        return false;
+
+    weights.pop_back();
+    m_weights.swap(weights);
+    return true;
+}
+
+bool SplatMapGenerator::Save(const std::string& path) const
+{
+    FILE* pFile = NULL;
+    errno_t ret = fopen_s(&pFile, path.c_str(), "wb+");
+    if (ret != 0 || pFile == NULL)
+        return false;
+
+    const size_t written = fwrite(m_weights.data(), 1, m_weights.size(), pFile);
+    fclose(pFile);
+
+    return written == m_weights.size();
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Rule deciding how strongly one splat layer covers a texel. Each term is a band with a soft edge:
+// full weight inside [min, max], fading to nothing over 'falloff' outside of it.
+struct SplatRule
+{
+    float minHeight = 0.f;			//metres
+    float maxHeight = 1000.f;
+    float heightFalloff = 1.f;
+
+    float minSlope = 0.f;			//degrees
+    float maxSlope = 90.f;
+    float slopeFalloff = 1.f;
+
+    // How strongly curvature gates the rule. Positive favours concave ground (valleys, creases),
+    // negative favours convex ground (ridges). 0 ignores curvature.
+    float curvatureWeight = 0.f;
+};
+
+// Computes the RGBA splat alpha map of a chunk from its heightmap. Channel n holds the weight of
+// splat layer n + 1; the four weights of a texel always sum to 255.
+//
+// The map has one texel per heightmap sample and is split into square tiles. Only tiles that have
+// been marked dirty are re-evaluated, so after sculpting only the affected region is recomputed.
+// Dirty tiles are evaluated in parallel; each texel only depends on the (read only) heightmap so
+// no synchronisation between tiles is needed.
+class SplatMapGenerator
+{
+public:
+    static constexpr size_t TILE_SIZE = 32;
+    static constexpr size_t NUM_LAYERS = 4;
+
+    SplatMapGenerator();
+
+    // 'heightScale' converts heightmap values to metres, 'cellSize' is the distance between samples in metres
+    void Initialise(size_t resolution, float heightScale, float cellSize);
+
+    // Marks the tiles overlapping the inclusive texel rectangle as needing re-evaluation
+    void MarkDirty(size_t minX, size_t minZ, size_t maxX, size_t maxZ);
+    void MarkAllDirty();
+    bool IsDirty() const { return m_numDirtyTiles > 0; }
+
+    // Re-evaluates all dirty tiles against 'heightMap' (resolution * resolution samples)
+    void Update(const uint8_t* heightMap);
+
+    bool Load(const std::string& path);		//false unless the file is exactly the size of the map, which is then left as it was
+    bool Save(const std::string& path) const;
+
+    const uint8_t* GetData() const { return m_weights.data(); }	//RGBA8, row major
+    size_t GetResolution() const { return m_resolution; }
+
+    SplatRule m_rules[NUM_LAYERS];
+
+private:
+    void EvaluateTile(const uint8_t* heightMap, size_t tileX, size_t tileZ);
+
+    size_t m_resolution = 0;
+    size_t m_tilesPerSide = 0;
+    float m_heightScale = 1.f;
+    float m_cellSize = 1.f;
+
+    std::vector<uint8_t> m_weights;
+    std::vector<uint8_t> m_dirtyTiles;		//one flag per tile
+    size_t m_numDirtyTiles = 0;
+};
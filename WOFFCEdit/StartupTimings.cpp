@@ -0,0 +1,81 @@
+#include "StartupTimings.h"
+#include "Platform.h"
+
+namespace
+{
+    StartupTimings::Phase	s_phases[StartupTimings::MAX_PHASES];
+    size_t					s_numPhases = 0;
+    int						s_depth = 0;			//phases open
+    int64_t					s_finished = -1;		//profiler time of Finish()
+}
+
+constexpr size_t StartupTimings::MAX_PHASES;
+
+StartupTimings::Scope::Scope(const char* name)
+    : m_phase(MAX_PHASES)
+{
+    if (s_finished >= 0 || s_numPhases == MAX_PHASES)
+        return;
+
+    m_phase = s_numPhases++;
+    s_phases[m_phase] = { name, s_depth++, Profiler::Now(), -1 };
+}
+
+StartupTimings::Scope::~Scope()
+{
+    if (m_phase == MAX_PHASES)
+        return;
+
+    s_phases[m_phase].end = Profiler::Now();
+    s_depth--;
+}
+
+void StartupTimings::Finish()
+{
+    if (s_finished < 0)
+        s_finished = Profiler::Now();
+}
+
+bool StartupTimings::IsFinished()
+{
+    return s_finished >= 0;
+}
+
+double StartupTimings::GetTotalMilliseconds()
+{
+    return (s_finished >= 0 ? s_finished : Profiler::Now()) * 1e-6;
+}
+
+size_t StartupTimings::GetNumPhases()
+{
+    return s_numPhases;
+}
+
+const StartupTimings::Phase& StartupTimings::GetPhase(size_t phase)
+{
+    return s_phases[phase];
+}
+
+bool StartupTimings::AppendLog(const std::string& path)
+{
+    FILE* pFile = nullptr;
+    errno_t ret = fopen_s(&pFile, path.c_str(), "a");
+    if (ret != 0 || pFile == nullptr)
+        return false;
+
+    // Start and length of every phase, indented by depth. Phases still open have no length yet.
+    fprintf(pFile, "Startup: %.1f ms to first frame\n", GetTotalMilliseconds());
+    fprintf(pFile, "%12s %12s  %s\n", "start", "length", "phase");
+    for (size_t p = 0; p < s_numPhases; p++)
+    {
+        const Phase& phase = s_phases[p];
+        if (phase.end >= 0)
+            fprintf(pFile, "%9.1f ms %9.1f ms  %*s%s\n", phase.start * 1e-6, (phase.end - phase.start) * 1e-6, phase.depth * 2, "", phase.name);
+        else
+            fprintf(pFile, "%9.1f ms %12s  %*s%s\n", phase.start * 1e-6, "...", phase.depth * 2, "", phase.name);
+    }
+    fprintf(pFile, "\n");
+
+    const bool written = ferror(pFile) == 0;
+    return fclose(pFile) == 0 && written;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "Profiler.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Times the phases of startup, from static initialisation to the first frame on screen, so regressions show
+// up and phases can be made lazy or moved off the critical path.
+//
+// Phases nest, and are profiler scopes as well so they show in traces. Only phases begun before Finish() are
+// kept: code that also runs later, on a device reset or a reload, costs nothing from then on. Startup runs on
+// the main thread, and so must every phase.
+//
+//     {
+//         STARTUP_PHASE("Open database");
+//         ...
+//     }
+class StartupTimings
+{
+public:
+    static constexpr size_t MAX_PHASES = 32;
+
+    // Times in nanoseconds on the profiler's clock
+    struct Phase
+    {
+        const char*	name;
+        int			depth;		//0 for phases not inside another
+        int64_t		start;
+        int64_t		end;
+    };
+
+    class Scope
+    {
+    public:
+        explicit Scope(const char* name);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        size_t		m_phase;	//MAX_PHASES when not recorded
+    };
+
+    // Ends startup with the first frame shown
+    static void Finish();
+    static bool IsFinished();
+    static double GetTotalMilliseconds();			//to Finish(), or so far
+
+    static size_t GetNumPhases();
+    static const Phase& GetPhase(size_t phase);		//in the order they began
+
+    // Adds a report of this run to the end of a log, so runs can be compared
+    static bool AppendLog(const std::string& path);
+};
+
+// 'name' must be a string literal
+#define STARTUP_PHASE(name) PROFILE_SCOPE(name); StartupTimings::Scope PROFILE_CONCAT(startupPhase, __LINE__)(name)
@@ -0,0 +1,375 @@
+#include "StaticGeometryBaker.h"
+#include "Platform.h"
+#include "Profiler.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    const char CACHE_MAGIC[4] = { 'S', 'G', 'C', 'B' };
+    constexpr uint32_t CACHE_FORMAT = 2;		//bump when the file layout or merge output changes
+
+    struct CacheHeader
+    {
+        char		magic[4];
+        uint32_t	format;
+        uint64_t	hash;
+        uint64_t	checksum;		//of everything after the header
+        uint32_t	numGroups;
+        uint32_t	padding;		//0
+    };
+
+    struct CacheGroupHeader
+    {
+        uint32_t	numVertices;
+        uint32_t	numIndices;
+        float		boundsMin[3];
+        float		boundsMax[3];
+    };
+
+    // Work for one cell of a bake
+    struct CellBake
+    {
+        std::pair<int, int>					key;
+        StaticGeometryBaker::Cell			cell;
+        std::vector<size_t>					members;	//into the Bake input, in input order
+        std::vector<uint32_t>				materials;	//distinct, in order of first appearance, one group each
+        std::vector<const StaticGeometryBaker::Mesh*>	meshes;	//per member, only when merging
+        bool								reused = false;
+        bool								loaded = false;
+    };
+
+    void Cross(const float* a, const float* b, float* out)
+    {
+        out[0] = (a[1] * b[2]) - (a[2] * b[1]);
+        out[1] = (a[2] * b[0]) - (a[0] * b[2]);
+        out[2] = (a[0] * b[1]) - (a[1] * b[0]);
+    }
+
+    size_t GroupOfMaterial(const std::vector<uint32_t>& materials, uint32_t material)
+    {
+        return std::find(materials.begin(), materials.end(), material) - materials.begin();
+    }
+}
+
+uint64_t StaticGeometryBaker::Hash(const void* data, size_t size, uint64_t hash)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void StaticGeometryBaker::SetCacheDirectory(const std::string& directory)
+{
+    m_cacheDirectory = directory;
+    if (!m_cacheDirectory.empty())
+        Platform::MakeDirectory(m_cacheDirectory);
+}
+
+std::string StaticGeometryBaker::CachePath(int x, int z) const
+{
+    return m_cacheDirectory + "/cell_" + std::to_string(x) + "_" + std::to_string(z) + ".bin";
+}
+
+void StaticGeometryBaker::Bake(const Member* members, size_t count, const MeshSource& meshSource)
+{
+    const Clock::time_point start = Clock::now();
+
+    // Members go to the cell their origin is in
+    std::map<std::pair<int, int>, std::vector<size_t>> membersOfCell;
+    for (size_t i = 0; i < count; i++)
+    {
+        const int x = int(std::floor(members[i].world[12] / m_cellSize));
+        const int z = int(std::floor(members[i].world[14] / m_cellSize));
+        membersOfCell[std::make_pair(x, z)].push_back(i);
+    }
+
+    std::vector<CellBake> bakes(membersOfCell.size());
+    size_t b = 0;
+    for (auto& cellMembers : membersOfCell)
+    {
+        CellBake& bake = bakes[b++];
+        bake.key = cellMembers.first;
+        bake.members = std::move(cellMembers.second);
+
+        uint64_t hash = Hash(&CACHE_FORMAT, sizeof(CACHE_FORMAT));
+        for (size_t m : bake.members)
+        {
+            hash = Hash(&members[m].hash, sizeof(members[m].hash), hash);
+            if (GroupOfMaterial(bake.materials, members[m].material) == bake.materials.size())
+                bake.materials.push_back(members[m].material);
+        }
+
+        // Unchanged since the last bake, keep its geometry
+        auto previous = m_cells.find(bake.key);
+        if (previous != m_cells.end() && previous->second.hash == hash && previous->second.groups.size() == bake.materials.size())
+        {
+            bake.cell = std::move(previous->second);
+            bake.reused = true;
+            continue;
+        }
+
+        bake.cell.x = bake.key.first;
+        bake.cell.z = bake.key.second;
+        bake.cell.hash = hash;
+        bake.cell.version = m_nextVersion++;
+    }
+
+    // Changed cells come from the disk cache where it has them
+    if (!m_cacheDirectory.empty())
+    {
+        JobSystem::ParallelFor(size_t(0), bakes.size(), [&](size_t i)
+        {
+            PROFILE_SCOPE("Read cell cache");
+            if (!bakes[i].reused)
+                bakes[i].loaded = ReadCache(bakes[i].cell, bakes[i].materials);
+        });
+    }
+
+    // The rest are merged from source geometry, fetched here as the source may not be thread safe
+    for (CellBake& bake : bakes)
+    {
+        if (bake.reused || bake.loaded)
+            continue;
+
+        bake.meshes.resize(bake.members.size());
+        for (size_t m = 0; m < bake.members.size(); m++)
+            bake.meshes[m] = meshSource(bake.members[m]);
+    }
+
+    JobSystem::ParallelFor(size_t(0), bakes.size(), [&](size_t i)
+    {
+        PROFILE_SCOPE("Merge cell");
+        CellBake& bake = bakes[i];
+        if (bake.reused || bake.loaded)
+            return;
+
+        Merge(bake.cell, members, bake.members, bake.meshes);
+
+        if (!m_cacheDirectory.empty())
+            WriteCache(bake.cell);
+    });
+
+    // Material ids and object lists aren't part of the geometry, they follow the members every bake
+    m_cells.clear();
+    m_stats = Stats();
+    for (CellBake& bake : bakes)
+    {
+        for (size_t g = 0; g < bake.cell.groups.size(); g++)
+        {
+            bake.cell.groups[g].material = bake.materials[g];
+            bake.cell.groups[g].objects.clear();
+        }
+
+        for (size_t m : bake.members)
+        {
+            std::vector<uint32_t>& objects = bake.cell.groups[GroupOfMaterial(bake.materials, members[m].material)].objects;
+            if (std::find(objects.begin(), objects.end(), members[m].object) == objects.end())
+                objects.push_back(members[m].object);
+        }
+
+        m_stats.merged += !bake.reused && !bake.loaded ? 1 : 0;
+        m_stats.loaded += bake.loaded ? 1 : 0;
+        m_stats.reused += bake.reused ? 1 : 0;
+        m_stats.groups += bake.cell.groups.size();
+        for (const Group& group : bake.cell.groups)
+        {
+            m_stats.vertices += group.mesh.vertices.size();
+            m_stats.triangles += group.mesh.indices.size() / 3;
+        }
+
+        m_cells[bake.key] = std::move(bake.cell);
+    }
+
+    m_stats.cells = m_cells.size();
+    m_stats.milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void StaticGeometryBaker::Merge(Cell& cell, const Member* members, const std::vector<size_t>& cellMembers, const std::vector<const Mesh*>& meshes)
+{
+    std::vector<uint32_t> materials;
+    cell.groups.clear();
+
+    for (size_t m = 0; m < cellMembers.size(); m++)
+    {
+        const Member& member = members[cellMembers[m]];
+        size_t g = GroupOfMaterial(materials, member.material);
+        if (g == materials.size())
+        {
+            materials.push_back(member.material);
+            cell.groups.emplace_back();
+            Group& group = cell.groups.back();
+            group.material = member.material;
+            std::fill(group.boundsMin, group.boundsMin + 3, FLT_MAX);
+            std::fill(group.boundsMax, group.boundsMax + 3, -FLT_MAX);
+        }
+
+        const Mesh* source = meshes[m];
+        if (!source)
+            continue;
+
+        Group& group = cell.groups[g];
+        const float* w = member.world;
+
+        // Normals through the cofactor matrix, which handles non uniform scale, flipped along with the
+        // winding when the transform mirrors
+        const float rowX[3] = { w[0], w[1], w[2] };
+        const float rowY[3] = { w[4], w[5], w[6] };
+        const float rowZ[3] = { w[8], w[9], w[10] };
+        float cofactor[3][3];
+        Cross(rowY, rowZ, cofactor[0]);
+        Cross(rowZ, rowX, cofactor[1]);
+        Cross(rowX, rowY, cofactor[2]);
+        const float determinant = (rowX[0] * cofactor[0][0]) + (rowX[1] * cofactor[0][1]) + (rowX[2] * cofactor[0][2]);
+        const bool mirrored = determinant < 0.f;
+
+        const uint32_t firstVertex = uint32_t(group.mesh.vertices.size());
+        group.mesh.vertices.reserve(group.mesh.vertices.size() + source->vertices.size());
+        for (const Vertex& in : source->vertices)
+        {
+            Vertex out;
+            const float* p = in.position;
+            const float* n = in.normal;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                out.position[axis] = (p[0] * w[axis]) + (p[1] * w[4 + axis]) + (p[2] * w[8 + axis]) + w[12 + axis];
+                out.normal[axis] = (n[0] * cofactor[0][axis]) + (n[1] * cofactor[1][axis]) + (n[2] * cofactor[2][axis]);
+                group.boundsMin[axis] = std::min(group.boundsMin[axis], out.position[axis]);
+                group.boundsMax[axis] = std::max(group.boundsMax[axis], out.position[axis]);
+            }
+
+            const float length = std::sqrt((out.normal[0] * out.normal[0]) + (out.normal[1] * out.normal[1]) + (out.normal[2] * out.normal[2]));
+            const float scale = length > 0.f ? (mirrored ? -1.f : 1.f) / length : 0.f;
+            for (int axis = 0; axis < 3; axis++)
+                out.normal[axis] *= scale;
+
+            out.texcoord[0] = in.texcoord[0];
+            out.texcoord[1] = in.texcoord[1];
+            group.mesh.vertices.push_back(out);
+        }
+
+        group.mesh.indices.reserve(group.mesh.indices.size() + source->indices.size());
+        for (size_t i = 0; i + 2 < source->indices.size(); i += 3)
+        {
+            group.mesh.indices.push_back(firstVertex + source->indices[i]);
+            group.mesh.indices.push_back(firstVertex + source->indices[mirrored ? i + 2 : i + 1]);
+            group.mesh.indices.push_back(firstVertex + source->indices[mirrored ? i + 1 : i + 2]);
+        }
+    }
+}
+
+bool StaticGeometryBaker::ReadCache(Cell& cell, const std::vector<uint32_t>& materials) const
+{
+    FILE* pFile = nullptr;
+    errno_t ret = fopen_s(&pFile, CachePath(cell.x, cell.z).c_str(), "rb");
+    if (ret != 0 || pFile == nullptr)
+        return false;
+
+    // Counts in a damaged file are checked against what the file holds before anything is allocated for them
+    fseek(pFile, 0, SEEK_END);
+    const long fileSize = ftell(pFile);
+    fseek(pFile, 0, SEEK_SET);
+
+    CacheHeader header;
+    uint64_t checksum = Hash(nullptr, 0);
+    size_t remaining = fileSize > long(sizeof(header)) ? size_t(fileSize) - sizeof(header) : 0;
+    bool ok = fread(&header, sizeof(header), 1, pFile) == 1
+        && std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0
+        && header.format == CACHE_FORMAT
+        && header.hash == cell.hash
+        && header.numGroups == materials.size()
+        && header.padding == 0;
+
+    std::vector<Group> groups(ok ? header.numGroups : 0);
+    for (size_t g = 0; ok && g < groups.size(); g++)
+    {
+        CacheGroupHeader groupHeader;
+        ok = remaining >= sizeof(groupHeader) && fread(&groupHeader, sizeof(groupHeader), 1, pFile) == 1;
+        if (ok)
+        {
+            remaining -= sizeof(groupHeader);
+            const uint64_t payload = (uint64_t(groupHeader.numVertices) * sizeof(Vertex)) + (uint64_t(groupHeader.numIndices) * sizeof(uint32_t));
+            ok = payload <= remaining;
+            remaining -= ok ? size_t(payload) : 0;
+        }
+        if (!ok)
+            break;
+
+        Group& group = groups[g];
+        group.material = materials[g];
+        std::copy(groupHeader.boundsMin, groupHeader.boundsMin + 3, group.boundsMin);
+        std::copy(groupHeader.boundsMax, groupHeader.boundsMax + 3, group.boundsMax);
+        group.mesh.vertices.resize(groupHeader.numVertices);
+        group.mesh.indices.resize(groupHeader.numIndices);
+
+        ok = fread(group.mesh.vertices.data(), sizeof(Vertex), group.mesh.vertices.size(), pFile) == group.mesh.vertices.size()
+            && fread(group.mesh.indices.data(), sizeof(uint32_t), group.mesh.indices.size(), pFile) == group.mesh.indices.size();
+
+        checksum = Hash(&groupHeader, sizeof(groupHeader), checksum);
+        checksum = Hash(group.mesh.vertices.data(), group.mesh.vertices.size() * sizeof(Vertex), checksum);
+        checksum = Hash(group.mesh.indices.data(), group.mesh.indices.size() * sizeof(uint32_t), checksum);
+
+        // A damaged file must not index out of its vertices
+        for (size_t i = 0; ok && i < group.mesh.indices.size(); i++)
+            ok = group.mesh.indices[i] < groupHeader.numVertices;
+    }
+
+    // Nothing may follow the last group, and what came before must be what was written
+    ok = ok && remaining == 0 && checksum == header.checksum;
+    fclose(pFile);
+
+    if (ok)
+        cell.groups = std::move(groups);
+    return ok;
+}
+
+void StaticGeometryBaker::WriteCache(const Cell& cell) const
+{
+    FILE* pFile = nullptr;
+    errno_t ret = fopen_s(&pFile, CachePath(cell.x, cell.z).c_str(), "wb");
+    if (ret != 0 || pFile == nullptr)
+        return;
+
+    std::vector<CacheGroupHeader> groupHeaders(cell.groups.size());
+    CacheHeader header = {};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.format = CACHE_FORMAT;
+    header.hash = cell.hash;
+    header.checksum = Hash(nullptr, 0);
+    header.numGroups = uint32_t(cell.groups.size());
+    for (size_t g = 0; g < cell.groups.size(); g++)
+    {
+        const Group& group = cell.groups[g];
+        CacheGroupHeader& groupHeader = groupHeaders[g];
+        groupHeader.numVertices = uint32_t(group.mesh.vertices.size());
+        groupHeader.numIndices = uint32_t(group.mesh.indices.size());
+        std::copy(group.boundsMin, group.boundsMin + 3, groupHeader.boundsMin);
+        std::copy(group.boundsMax, group.boundsMax + 3, groupHeader.boundsMax);
+
+        header.checksum = Hash(&groupHeader, sizeof(groupHeader), header.checksum);
+        header.checksum = Hash(group.mesh.vertices.data(), group.mesh.vertices.size() * sizeof(Vertex), header.checksum);
+        header.checksum = Hash(group.mesh.indices.data(), group.mesh.indices.size() * sizeof(uint32_t), header.checksum);
+    }
+    fwrite(&header, sizeof(header), 1, pFile);
+
+    for (size_t g = 0; g < cell.groups.size(); g++)
+    {
+        const Group& group = cell.groups[g];
+        fwrite(&groupHeaders[g], sizeof(groupHeaders[g]), 1, pFile);
+        fwrite(group.mesh.vertices.data(), sizeof(Vertex), group.mesh.vertices.size(), pFile);
+        fwrite(group.mesh.indices.data(), sizeof(uint32_t), group.mesh.indices.size(), pFile);
+    }
+
+    fclose(pFile);
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Bakes static mesh parts into one world space mesh per spatial cell and material, so a cell full of
+// props draws with one call per material instead of one per prop.
+//
+// Each cell carries a hash of its members' inputs (which the caller computes from whatever identifies
+// a member: object, files, transform). Bake() only merges cells whose hash changed since the last bake;
+// before merging it looks for a cache file with the same hash on disk, and after merging it writes one,
+// so an unchanged level bakes from disk on the next run. Loading and merging run on worker threads,
+// one cell per task.
+class StaticGeometryBaker
+{
+public:
+    // Same layout as DirectX::VertexPositionNormalTexture
+    struct Vertex
+    {
+        float	position[3];
+        float	normal[3];
+        float	texcoord[2];
+    };
+
+    // Triangle list geometry: object space for the source parts, world space once merged
+    struct Mesh
+    {
+        std::vector<Vertex>		vertices;
+        std::vector<uint32_t>	indices;
+    };
+
+    // One static mesh part placed in the world
+    struct Member
+    {
+        uint32_t	object;		//caller's object index, listed in the groups it ends up in
+        uint32_t	material;	//members merge with others of the same material in their cell
+        uint64_t	hash;		//of everything the member's merged geometry depends on
+        float		world[16];	//4x4 row major, row vectors
+    };
+
+    struct Group
+    {
+        uint32_t				material;
+        Mesh					mesh;
+        float					boundsMin[3];
+        float					boundsMax[3];
+        std::vector<uint32_t>	objects;	//distinct, in member order
+    };
+
+    struct Cell
+    {
+        int					x;
+        int					z;
+        uint64_t			hash;
+        uint32_t			version;	//unique to every geometry the cell has had
+        std::vector<Group>	groups;
+    };
+
+    struct Stats
+    {
+        size_t	cells = 0;
+        size_t	groups = 0;
+        size_t	merged = 0;		//cells merged from source geometry by the last Bake
+        size_t	loaded = 0;		//cells read from the disk cache
+        size_t	reused = 0;		//cells unchanged since the bake before
+        size_t	vertices = 0;
+        size_t	triangles = 0;
+        double	milliseconds = 0.0;
+    };
+
+    // Source geometry of a member, called on the calling thread and only for members of cells that have
+    // to be merged. The mesh must stay valid until Bake returns.
+    typedef std::function<const Mesh*(size_t member)> MeshSource;
+
+    explicit StaticGeometryBaker(float cellSize = 64.f) : m_cellSize(cellSize) {}
+
+    // Where cell files are cached, created if missing. Empty disables the disk cache.
+    void SetCacheDirectory(const std::string& directory);
+
+    // Rebakes cells from 'members', which should come in a stable order (by object ID, say)
+    void Bake(const Member* members, size_t count, const MeshSource& meshSource);
+
+    const std::map<std::pair<int, int>, Cell>& GetCells() const { return m_cells; }
+    const Stats& GetStats() const { return m_stats; }
+
+    // FNV-1a, for building member hashes
+    static uint64_t Hash(const void* data, size_t size, uint64_t hash = 14695981039346656037ull);
+
+private:
+    std::string CachePath(int x, int z) const;
+    bool ReadCache(Cell& cell, const std::vector<uint32_t>& materials) const;
+    void WriteCache(const Cell& cell) const;
+    static void Merge(Cell& cell, const Member* members, const std::vector<size_t>& cellMembers, const std::vector<const Mesh*>& meshes);
+
+    float								m_cellSize;
+    std::string							m_cacheDirectory;
+    std::map<std::pair<int, int>, Cell>	m_cells;
+    uint32_t							m_nextVersion = 1;
+    Stats								m_stats;
+};
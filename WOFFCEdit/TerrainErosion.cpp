@@ -0,0 +1,344 @@
+#include "TerrainErosion.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    constexpr float DEG_TO_RAD = 0.0174532925f;
+
+    // Neighbour offsets for thermal erosion, in the order left, right, down, up.
+    // OPPOSITE[i] is the direction pointing back from neighbour i.
+    const int NEIGHBOUR_X[4] = { -1, 1, 0, 0 };
+    const int NEIGHBOUR_Z[4] = { 0, 0, -1, 1 };
+    const int OPPOSITE[4] = { 1, 0, 3, 2 };
+
+    inline bool InRange(int x, int z, int resolution)
+    {
+        return x >= 0 && z >= 0 && x < resolution && z < resolution;
+    }
+
+    struct Tile
+    {
+        size_t minX, minZ;	//inclusive
+        size_t maxX, maxZ;	//exclusive
+    };
+
+    std::vector<Tile> BuildTiles(size_t resolution)
+    {
+        std::vector<Tile> tiles;
+        for (size_t z = 0; z < resolution; z += TerrainErosion::TILE_SIZE)
+        {
+            for (size_t x = 0; x < resolution; x += TerrainErosion::TILE_SIZE)
+            {
+                tiles.push_back({ x, z, std::min(x + TerrainErosion::TILE_SIZE, resolution), std::min(z + TerrainErosion::TILE_SIZE, resolution) });
+            }
+        }
+        return tiles;
+    }
+
+    // Counter based random numbers, so a droplet's random stream only depends on the seed and its index
+    inline uint64_t SplitMix64(uint64_t x)
+    {
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    inline float UnitFloat(uint64_t bits)
+    {
+        return float(bits >> 40) * (1.f / 16777216.f);	//top 24 bits -> [0, 1)
+    }
+
+    struct BrushEntry
+    {
+        int dx, dz;
+        float weight;
+    };
+
+    std::vector<BrushEntry> BuildErosionBrush(int radius)
+    {
+        std::vector<BrushEntry> brush;
+        for (int dz = -radius; dz <= radius; dz++)
+        {
+            for (int dx = -radius; dx <= radius; dx++)
+            {
+                const float distance = std::sqrt(float(dx * dx + dz * dz));
+                if (distance < radius)
+                    brush.push_back({ dx, dz, 1.f - (distance / radius) });
+            }
+        }
+        return brush;
+    }
+
+    // Height and gradient at a position, bilinearly interpolated from the four surrounding samples
+    inline void SampleHeightAndGradient(const float* heights, size_t resolution, float posX, float posZ, float& height, float& gradX, float& gradZ)
+    {
+        const int cellX = int(posX);
+        const int cellZ = int(posZ);
+        const float u = posX - cellX;
+        const float v = posZ - cellZ;
+
+        const size_t index = (size_t(cellZ) * resolution) + cellX;
+        const float h00 = heights[index];
+        const float h10 = heights[index + 1];
+        const float h01 = heights[index + resolution];
+        const float h11 = heights[index + resolution + 1];
+
+        gradX = ((h10 - h00) * (1.f - v)) + ((h11 - h01) * v);
+        gradZ = ((h01 - h00) * (1.f - u)) + ((h11 - h10) * u);
+        height = (h00 * (1.f - u) * (1.f - v)) + (h10 * u * (1.f - v)) + (h01 * (1.f - u) * v) + (h11 * u * v);
+    }
+
+    // Region a droplet spawned in a tile may move through. Everything it writes (erosion brush and
+    // deposits) stays within HYDRAULIC_REACH cells of the tile, so tiles at least 2 * HYDRAULIC_REACH
+    // apart never touch the same samples.
+    constexpr int HYDRAULIC_REACH = int(TerrainErosion::TILE_SIZE / 2);
+    constexpr int HYDRAULIC_HALO = HYDRAULIC_REACH - TerrainErosion::MAX_EROSION_RADIUS - 1;
+
+    void SimulateDroplet(float* heights, size_t resolution, const Tile& tile, const HydraulicErosionSettings& settings,
+                         const std::vector<BrushEntry>& brush, uint64_t dropletKey)
+    {
+        const uint64_t r0 = SplitMix64(dropletKey);
+        const uint64_t r1 = SplitMix64(r0);
+
+        float posX = tile.minX + (UnitFloat(r0) * (tile.maxX - tile.minX));
+        float posZ = tile.minZ + (UnitFloat(r1) * (tile.maxZ - tile.minZ));
+
+        // Keep a one sample margin at the far edges of the map for bilinear sampling
+        const float limit = float(resolution - 1);
+        const float minX = std::max(float(tile.minX) - HYDRAULIC_HALO, 0.f);
+        const float minZ = std::max(float(tile.minZ) - HYDRAULIC_HALO, 0.f);
+        const float maxX = std::min(float(tile.maxX) + HYDRAULIC_HALO, limit);
+        const float maxZ = std::min(float(tile.maxZ) + HYDRAULIC_HALO, limit);
+
+        // Bounds for brush writes
+        const int writeMinX = std::max(int(tile.minX) - HYDRAULIC_REACH, 0);
+        const int writeMinZ = std::max(int(tile.minZ) - HYDRAULIC_REACH, 0);
+        const int writeMaxX = std::min(int(tile.maxX) + HYDRAULIC_REACH, int(resolution));
+        const int writeMaxZ = std::min(int(tile.maxZ) + HYDRAULIC_REACH, int(resolution));
+
+        if (posX >= maxX || posZ >= maxZ)
+            return;
+
+        float dirX = 0.f;
+        float dirZ = 0.f;
+        float speed = 1.f;
+        float water = 1.f;
+        float sediment = 0.f;
+
+        for (int lifetime = 0; lifetime < settings.maxLifetime; lifetime++)
+        {
+            const int cellX = int(posX);
+            const int cellZ = int(posZ);
+            const float u = posX - cellX;
+            const float v = posZ - cellZ;
+
+            float height, gradX, gradZ;
+            SampleHeightAndGradient(heights, resolution, posX, posZ, height, gradX, gradZ);
+
+            // Move downhill, blending with the previous direction
+            dirX = (dirX * settings.inertia) - (gradX * (1.f - settings.inertia));
+            dirZ = (dirZ * settings.inertia) - (gradZ * (1.f - settings.inertia));
+
+            const float length = std::sqrt((dirX * dirX) + (dirZ * dirZ));
+            if (length <= 1e-6f)
+                break;
+
+            dirX /= length;
+            dirZ /= length;
+            posX += dirX;
+            posZ += dirZ;
+
+            if (posX < minX || posZ < minZ || posX >= maxX || posZ >= maxZ)
+                break;
+
+            float newHeight, unusedX, unusedZ;
+            SampleHeightAndGradient(heights, resolution, posX, posZ, newHeight, unusedX, unusedZ);
+            const float deltaHeight = newHeight - height;
+
+            const float capacity = std::max(-deltaHeight * speed * water * settings.sedimentCapacityFactor, settings.minSedimentCapacity);
+            const size_t cellIndex = (size_t(cellZ) * resolution) + cellX;
+
+            if (sediment > capacity || deltaHeight > 0.f)
+            {
+                // Going uphill fills the pit behind the droplet, otherwise drop the excess sediment
+                const float amount = deltaHeight > 0.f ? std::min(deltaHeight, sediment) : (sediment - capacity) * settings.depositSpeed;
+                sediment -= amount;
+
+                heights[cellIndex] += amount * (1.f - u) * (1.f - v);
+                heights[cellIndex + 1] += amount * u * (1.f - v);
+                heights[cellIndex + resolution] += amount * (1.f - u) * v;
+                heights[cellIndex + resolution + 1] += amount * u * v;
+            }
+            else
+            {
+                // Erode over the brush, never digging deeper than the height difference travelled
+                const float amount = std::min((capacity - sediment) * settings.erodeSpeed, -deltaHeight);
+
+                float totalWeight = 0.f;
+                for (const BrushEntry& entry : brush)
+                {
+                    const int x = cellX + entry.dx;
+                    const int z = cellZ + entry.dz;
+                    if (x >= writeMinX && z >= writeMinZ && x < writeMaxX && z < writeMaxZ)
+                        totalWeight += entry.weight;
+                }
+
+                const float scale = amount / totalWeight;
+                for (const BrushEntry& entry : brush)
+                {
+                    const int x = cellX + entry.dx;
+                    const int z = cellZ + entry.dz;
+                    if (x < writeMinX || z < writeMinZ || x >= writeMaxX || z >= writeMaxZ)
+                        continue;
+
+                    float& h = heights[(size_t(z) * resolution) + x];
+                    const float eroded = std::min(h, entry.weight * scale);
+                    h -= eroded;
+                    sediment += eroded;
+                }
+            }
+
+            speed = std::sqrt(std::max((speed * speed) - (deltaHeight * settings.gravity), 0.f));
+            water *= (1.f - settings.evaporateSpeed);
+        }
+    }
+}
+
+bool TerrainErosion::Thermal(float* heights, size_t resolution, float cellSize, const ThermalErosionSettings& settings, const ErosionProgressCallback& progress)
+{
+    const std::vector<Tile> tiles = BuildTiles(resolution);
+    const float talus = std::tan(settings.talusAngle * DEG_TO_RAD) * cellSize;
+    const int res = int(resolution);
+    const ptrdiff_t neighbourOffset[4] = { -1, 1, -ptrdiff_t(resolution), ptrdiff_t(resolution) };
+
+    // Material leaving each cell towards each of its four neighbours
+    std::vector<float> outflow(resolution * resolution * 4);
+
+    for (int iteration = 0; iteration < settings.iterations; iteration++)
+    {
+        // Pass 1: outflow from every cell, reading only the heights of the previous iteration
+        JobSystem::ParallelFor(size_t(0), tiles.size(), [&](size_t t)
+        {
+            const Tile& tile = tiles[t];
+            for (size_t z = tile.minZ; z < tile.maxZ; z++)
+            {
+                for (size_t x = tile.minX; x < tile.maxX; x++)
+                {
+                    const size_t index = (z * resolution) + x;
+                    const float h = heights[index];
+
+                    // Only cells on the border of the map need their neighbours range checked
+                    const bool border = x == 0 || z == 0 || x + 1 == resolution || z + 1 == resolution;
+
+                    float excess[4];
+                    float totalExcess = 0.f;
+                    float maxExcess = 0.f;
+                    for (int n = 0; n < 4; n++)
+                    {
+                        excess[n] = 0.f;
+                        if (border && !InRange(int(x) + NEIGHBOUR_X[n], int(z) + NEIGHBOUR_Z[n], res))
+                            continue;
+
+                        const float difference = h - heights[index + neighbourOffset[n]];
+                        if (difference > talus)
+                        {
+                            excess[n] = difference - talus;
+                            totalExcess += excess[n];
+                            maxExcess = std::max(maxExcess, excess[n]);
+                        }
+                    }
+
+                    // Move enough to (at most) halve the steepest excess, shared out by excess
+                    const float amount = settings.rate * maxExcess * 0.5f;
+                    for (int n = 0; n < 4; n++)
+                        outflow[(index * 4) + n] = totalExcess > 0.f ? amount * (excess[n] / totalExcess) : 0.f;
+                }
+            }
+        });
+
+        // Pass 2: every cell gathers its new height. Reads the outflow of the tile's halo,
+        // which pass 1 has fully computed, and only ever writes cells inside the tile.
+        JobSystem::ParallelFor(size_t(0), tiles.size(), [&](size_t t)
+        {
+            const Tile& tile = tiles[t];
+            for (size_t z = tile.minZ; z < tile.maxZ; z++)
+            {
+                for (size_t x = tile.minX; x < tile.maxX; x++)
+                {
+                    const size_t index = (z * resolution) + x;
+                    const bool border = x == 0 || z == 0 || x + 1 == resolution || z + 1 == resolution;
+
+                    float delta = 0.f;
+                    for (int n = 0; n < 4; n++)
+                    {
+                        delta -= outflow[(index * 4) + n];
+
+                        if (border && !InRange(int(x) + NEIGHBOUR_X[n], int(z) + NEIGHBOUR_Z[n], res))
+                            continue;
+
+                        delta += outflow[((index + neighbourOffset[n]) * 4) + OPPOSITE[n]];
+                    }
+                    heights[index] += delta;
+                }
+            }
+        });
+
+        if (progress && !progress(float(iteration + 1) / settings.iterations))
+            return false;
+    }
+
+    return true;
+}
+
+bool TerrainErosion::Hydraulic(float* heights, size_t resolution, const HydraulicErosionSettings& settings, const ErosionProgressCallback& progress)
+{
+    const std::vector<Tile> tiles = BuildTiles(resolution);
+    const size_t tilesPerSide = (resolution + TILE_SIZE - 1) / TILE_SIZE;
+    const std::vector<BrushEntry> brush = BuildErosionBrush(std::min(std::max(settings.erosionRadius, 1), MAX_EROSION_RADIUS));
+
+    // Tiles of the same colour are at least one full tile apart, so they can run at the same time
+    std::vector<size_t> phases[4];
+    for (size_t t = 0; t < tiles.size(); t++)
+    {
+        const size_t tileX = t % tilesPerSide;
+        const size_t tileZ = t / tilesPerSide;
+        phases[(tileX & 1) + ((tileZ & 1) * 2)].push_back(t);
+    }
+
+    // Split each tile's droplets over several rounds so the erosion of neighbouring tiles interleaves
+    // rather than each tile being eroded completely in one go.
+    const int ROUNDS = 4;
+    const uint64_t seed = SplitMix64(settings.seed);
+
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        for (int phase = 0; phase < 4; phase++)
+        {
+            const std::vector<size_t>& phaseTiles = phases[phase];
+            JobSystem::ParallelFor(size_t(0), phaseTiles.size(), [&](size_t i)
+            {
+                const size_t t = phaseTiles[i];
+                const Tile& tile = tiles[t];
+
+                const size_t numDroplets = size_t(settings.dropletsPerCell * float((tile.maxX - tile.minX) * (tile.maxZ - tile.minZ)));
+                const size_t first = (numDroplets * round) / ROUNDS;
+                const size_t last = (numDroplets * (round + 1)) / ROUNDS;
+
+                for (size_t droplet = first; droplet < last; droplet++)
+                {
+                    const uint64_t key = seed ^ SplitMix64((uint64_t(t) << 32) | droplet);
+                    SimulateDroplet(heights, resolution, tile, settings, brush, key);
+                }
+            });
+
+            if (progress && !progress(float((round * 4) + phase + 1) / (ROUNDS * 4)))
+                return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+// Called between passes with the fraction of work done so far (0-1). Return false to cancel;
+// the heightmap is left in whatever state the last completed pass produced.
+using ErosionProgressCallback = std::function<bool(float progress)>;
+
+struct ThermalErosionSettings
+{
+    int		iterations = 50;
+    float	talusAngle = 35.f;		//degrees. Material slides down any slope steeper than this
+    float	rate = 0.5f;			//fraction of the excess height moved per iteration, 0-1
+};
+
+struct HydraulicErosionSettings
+{
+    float		dropletsPerCell = 0.5f;		//total droplets = dropletsPerCell * resolution^2
+    int			maxLifetime = 30;			//steps a droplet takes before it evaporates completely
+    float		inertia = 0.05f;			//0 = droplet follows the gradient exactly, 1 = never changes direction
+    float		sedimentCapacityFactor = 4.f;
+    float		minSedimentCapacity = 0.01f;
+    float		erodeSpeed = 0.3f;
+    float		depositSpeed = 0.3f;
+    float		evaporateSpeed = 0.01f;
+    float		gravity = 4.f;
+    int			erosionRadius = 3;			//cells. Must be no greater than MAX_EROSION_RADIUS
+    uint32_t	seed = 0;
+};
+
+// Erosion simulations operating in place on a square float heightmap.
+//
+// Both simulations are split into square tiles that run in parallel, and both give bit-identical
+// results regardless of how many threads are used or in which order tiles are scheduled:
+//
+//  - Thermal erosion is double buffered. Each iteration first computes, for every cell, how much
+//    material leaves it towards each neighbour, then every cell gathers its new height from its own
+//    outflow and the inflow of its neighbours. Tiles read the cells bordering them (their halo) from
+//    the previous pass, so no tile observes another tile's partial results.
+//
+//  - Hydraulic erosion simulates droplets sequentially within a tile. A droplet is confined to its
+//    tile plus a halo, and tiles are processed in four phases (a 2x2 colouring) so that tiles running
+//    at the same time are far enough apart that their haloes never overlap. Changes made in a halo
+//    are picked up by the neighbouring tile in a later phase. Every droplet gets its own random
+//    stream derived from the seed and its index, so scheduling never affects where it spawns.
+namespace TerrainErosion
+{
+    constexpr size_t TILE_SIZE = 64;
+    constexpr int MAX_EROSION_RADIUS = 4;
+
+    // 'cellSize' is the horizontal distance between samples, in the same units as the heights
+    bool Thermal(float* heights, size_t resolution, float cellSize, const ThermalErosionSettings& settings, const ErosionProgressCallback& progress = nullptr);
+    bool Hydraulic(float* heights, size_t resolution, const HydraulicErosionSettings& settings, const ErosionProgressCallback& progress = nullptr);
+}
@@ -0,0 +1,148 @@
+#include "TerrainHeightmap.h"
+#include "ObjFile.h"
+#include "JobSystem.h"
+#include "Platform.h"
+#include <algorithm>
+#include <cmath>
+
+TerrainHeightmap::TerrainHeightmap(size_t resolution, float heightScale, float cellSize)
+    : m_resolution(resolution)
+    , m_heightScale(heightScale)
+    , m_cellSize(cellSize)
+    , m_heights(resolution * resolution, 0)
+{
+}
+
+bool TerrainHeightmap::Load(const std::string& path)
+{
+    FILE* pFile = nullptr;
+    errno_t ret = fopen_s(&pFile, path.c_str(), "rb");
+    if (ret != 0 || pFile == nullptr)
+        return false;
+
+    std::vector<uint8_t> heights(m_heights.size());
+    const bool read = fread(heights.data(), 1, heights.size(), pFile) == heights.size();
+    fclose(pFile);
+
+    if (!read)
+        return false;
+
+    m_heights.swap(heights);
+    return true;
+}
+
+bool TerrainHeightmap::Save(const std::string& path) const
+{
+    FILE* pFile = nullptr;
+    errno_t ret = fopen_s(&pFile, path.c_str(), "wb");
+    if (ret != 0 || pFile == nullptr)
+        return false;
+
+    const bool written = fwrite(m_heights.data(), 1, m_heights.size(), pFile) == m_heights.size();
+    return fclose(pFile) == 0 && written;
+}
+
+bool TerrainHeightmap::ApplyHydraulicErosion(const HydraulicErosionSettings& settings, const ErosionProgressCallback& progress)
+{
+    //erosion works on normalised float heights, the byte heightmap can't hold the small amounts moved per droplet
+    std::vector<float> heights(m_heights.begin(), m_heights.end());
+    for (float& height : heights)
+        height /= 255.f;
+
+    const bool completed = TerrainErosion::Hydraulic(heights.data(), m_resolution, settings, progress);
+
+    for (size_t i = 0; i < m_heights.size(); ++i)
+        m_heights[i] = static_cast<uint8_t>(std::min(std::max((heights[i] * 255.f) + 0.5f, 0.f), 255.f));
+
+    return completed;
+}
+
+bool TerrainHeightmap::ApplyThermalErosion(const ThermalErosionSettings& settings, const ErosionProgressCallback& progress)
+{
+    std::vector<float> heights(m_heights.begin(), m_heights.end());
+
+    //heights stay in heightmap units, so express the distance between samples in those units too
+    const float cellSize = m_cellSize / m_heightScale;
+    const bool completed = TerrainErosion::Thermal(heights.data(), m_resolution, cellSize, settings, progress);
+
+    for (size_t i = 0; i < m_heights.size(); ++i)
+        m_heights[i] = static_cast<uint8_t>(std::min(std::max(heights[i] + 0.5f, 0.f), 255.f));
+
+    return completed;
+}
+
+void TerrainHeightmap::ImportObjHeights(const ObjMesh& mesh, float originX, float originZ)
+{
+    //the mesh may be a different resolution to ours, so average every vertex into its nearest heightmap sample
+    std::vector<float> heightSum(m_heights.size(), 0.f);
+    std::vector<int> heightCount(m_heights.size(), 0);
+
+    for (size_t i = 0; i + 2 < mesh.positions.size(); i += 3)
+    {
+        const int x = int(std::floor(((mesh.positions[i] - originX) / m_cellSize) + 0.5f));
+        const int z = int(std::floor(((mesh.positions[i + 2] - originZ) / m_cellSize) + 0.5f));
+        if (x < 0 || z < 0 || x >= int(m_resolution) || z >= int(m_resolution))
+            continue;
+
+        const size_t index = (m_resolution * z) + x;
+        heightSum[index] += mesh.positions[i + 1];
+        ++heightCount[index];
+    }
+
+    for (size_t i = 0; i < m_heights.size(); ++i)
+    {
+        if (heightCount[i] == 0)
+            continue;
+
+        const float height = (heightSum[i] / heightCount[i]) / m_heightScale;
+        m_heights[i] = static_cast<uint8_t>(std::min(std::max(height + 0.5f, 0.f), 255.f));
+    }
+}
+
+void TerrainHeightmap::CalculateNormals(float* normals, size_t stride) const
+{
+    // Central differences between the neighbours on either side, one sided along the edges. The normal is
+    // (left - right) x (up - down) of the sample positions, worked out from the height differences alone.
+    const int resolution = int(m_resolution);
+    unsigned char* output = reinterpret_cast<unsigned char*>(normals);
+
+    JobSystem::ParallelFor(0, resolution, [&](int z)
+    {
+        const int down = std::max(z - 1, 0);
+        const int up = std::min(z + 1, resolution - 1);
+        const uint8_t* rowDown = &m_heights[size_t(down) * m_resolution];
+        const uint8_t* rowUp = &m_heights[size_t(up) * m_resolution];
+        const uint8_t* row = &m_heights[size_t(z) * m_resolution];
+        const float alongZ = (up - down) * m_cellSize;
+
+        for (int x = 0; x < resolution; x++)
+        {
+            const int left = std::max(x - 1, 0);
+            const int right = std::min(x + 1, resolution - 1);
+
+            const float acrossX = (left - right) * m_cellSize;
+            const float slopeX = (float(row[left]) - float(row[right])) * m_heightScale;
+            const float slopeZ = (float(rowUp[x]) - float(rowDown[x])) * m_heightScale;
+
+            float normal[3] = { slopeX * alongZ, -acrossX * alongZ, acrossX * slopeZ };
+            const float length = std::sqrt((normal[0] * normal[0]) + (normal[1] * normal[1]) + (normal[2] * normal[2]));
+            if (length > 0.f)
+            {
+                normal[0] /= length;
+                normal[1] /= length;
+                normal[2] /= length;
+            }
+            else
+            {
+                normal[0] = 0.f;
+                normal[1] = 1.f;
+                normal[2] = 0.f;
+            }
+
+            float* destination = reinterpret_cast<float*>(output + (((size_t(z) * m_resolution) + x) * stride));
+            destination[0] = normal[0];
+            destination[1] = normal[1];
+            destination[2] = normal[2];
+        }
+    });
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "TerrainErosion.h"
+
+struct ObjMesh;
+
+// Heights of a square terrain chunk, one byte per sample as the chunk's .raw heightmap stores them, and
+// the processing done to them that doesn't need a device: loading and saving, erosion, importing heights
+// from a mesh, and surface normals.
+//
+// Sample (x, z) is at index (z * resolution) + x, at world (originX + x * cellSize, height * heightScale,
+// originZ + z * cellSize), where the origin is whatever the caller places the chunk at.
+class TerrainHeightmap
+{
+public:
+    TerrainHeightmap(size_t resolution, float heightScale, float cellSize);
+
+    bool Load(const std::string& path);			//false if it can't be read or is too short, leaving the heights as they were
+    bool Save(const std::string& path) const;	//false if anything failed to write
+
+    size_t GetResolution() const { return m_resolution; }
+    size_t GetNumSamples() const { return m_heights.size(); }
+    uint8_t* GetHeights() { return m_heights.data(); }
+    const uint8_t* GetHeights() const { return m_heights.data(); }
+    float GetHeightScale() const { return m_heightScale; }
+    float GetCellSize() const { return m_cellSize; }
+
+    // Both return false if cancelled, the heights keep the partial result
+    bool ApplyHydraulicErosion(const HydraulicErosionSettings& settings, const ErosionProgressCallback& progress);
+    bool ApplyThermalErosion(const ThermalErosionSettings& settings, const ErosionProgressCallback& progress);
+
+    // Sets heights from the vertices of a terrain mesh covering the chunk, whose sample (0, 0) is at
+    // (originX, originZ). Samples no vertex lands near keep their height.
+    void ImportObjHeights(const ObjMesh& mesh, float originX, float originZ);
+
+    // Unit surface normal of every sample from the slope to its neighbours, as three floats each, 'stride'
+    // bytes apart so they can go straight into vertices
+    void CalculateNormals(float* normals, size_t stride) const;
+
+private:
+    size_t					m_resolution;
+    float					m_heightScale;
+    float					m_cellSize;
+    std::vector<uint8_t>	m_heights;
+};
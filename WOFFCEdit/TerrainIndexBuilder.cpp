@@ -0,0 +1,105 @@
+#include "TerrainIndexBuilder.h"
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+    // Index pattern for a patch of 'quadsX' x 'quadsZ' quads, relative to the patch's bottom left vertex
+    struct PatchPattern
+    {
+        size_t quadsX = 0;
+        size_t quadsZ = 0;
+        std::vector<uint16_t> indices;
+    };
+
+    void BuildPattern(PatchPattern& pattern, size_t quadsX, size_t quadsZ, size_t stride)
+    {
+        pattern.quadsX = quadsX;
+        pattern.quadsZ = quadsZ;
+        pattern.indices.resize(quadsX * quadsZ * 6);
+
+        uint16_t* out = pattern.indices.data();
+        for (size_t z = 0; z < quadsZ; z++)
+        {
+            for (size_t x = 0; x < quadsX; x++)
+            {
+                const uint16_t bottomL = static_cast<uint16_t>((stride * z) + x);
+                const uint16_t bottomR = static_cast<uint16_t>((stride * z) + x + 1);
+                const uint16_t topR = static_cast<uint16_t>((stride * (z + 1)) + x + 1);
+                const uint16_t topL = static_cast<uint16_t>((stride * (z + 1)) + x);
+
+                // Same winding as the original row-order terrain
+                *out++ = bottomL;
+                *out++ = bottomR;
+                *out++ = topR;
+
+                *out++ = bottomL;
+                *out++ = topR;
+                *out++ = topL;
+            }
+        }
+    }
+}
+
+void TerrainIndexBuilder::BuildGridIndices(std::vector<uint16_t>& indices, size_t resolution)
+{
+    assert(resolution * resolution <= 0x10000 && "Grid too large for 16-bit indices");
+
+    const size_t quads = resolution - 1;
+    indices.resize(IndexCount(resolution));
+
+    // A grid that isn't a multiple of the patch size has a narrower last column and row of patches,
+    // so there are at most four distinct patch shapes: full, right edge, top edge and corner.
+    PatchPattern patterns[4];
+    const auto GetPattern = [&](size_t quadsX, size_t quadsZ) -> const PatchPattern&
+    {
+        const int slot = (quadsX == PATCH_QUADS ? 0 : 1) + (quadsZ == PATCH_QUADS ? 0 : 2);
+        if (patterns[slot].indices.empty())
+            BuildPattern(patterns[slot], quadsX, quadsZ, resolution);
+
+        return patterns[slot];
+    };
+
+    uint16_t* out = indices.data();
+    for (size_t pz = 0; pz < quads; pz += PATCH_QUADS)
+    {
+        const size_t quadsZ = std::min(PATCH_QUADS, quads - pz);
+
+        for (size_t px = 0; px < quads; px += PATCH_QUADS)
+        {
+            const size_t quadsX = std::min(PATCH_QUADS, quads - px);
+            const PatchPattern& pattern = GetPattern(quadsX, quadsZ);
+
+            // Rebase the shared pattern onto this patch
+            const uint16_t base = static_cast<uint16_t>((pz * resolution) + px);
+            for (uint16_t index : pattern.indices)
+                *out++ = base + index;
+        }
+    }
+
+    assert(out == indices.data() + indices.size());
+}
+
+float TerrainIndexBuilder::ComputeACMR(const uint16_t* indices, size_t indexCount, size_t numVertices, size_t cacheSize)
+{
+    if (indexCount < 3 || cacheSize == 0)
+        return 0.f;
+
+    // Simulate a FIFO cache. Each vertex remembers the 'time' it entered the cache, it is still cached
+    // as long as fewer than 'cacheSize' other vertices have been inserted since.
+    std::vector<size_t> insertedAt(numVertices, 0);
+    size_t clock = 0;
+    size_t misses = 0;
+
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        const uint16_t index = indices[i];
+        if (insertedAt[index] == 0 || clock - insertedAt[index] >= cacheSize)
+        {
+            ++misses;
+            insertedAt[index] = ++clock;
+        }
+    }
+
+    return float(misses) / float(indexCount / 3);
+}
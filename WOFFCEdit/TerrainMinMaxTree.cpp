@@ -0,0 +1,78 @@
+#include "TerrainMinMaxTree.h"
+#include <algorithm>
+
+void TerrainMinMaxTree::Build(const uint8_t* heightMap, size_t resolution, float heightScale, float cellSize, float originX, float originZ)
+{
+    m_cellSize = cellSize;
+    m_originX = originX;
+    m_originZ = originZ;
+    m_levels.clear();
+    m_levelSizes.clear();
+
+    if (resolution < 2)
+        return;
+
+    // Level 0: one node per quad, from its four corner samples
+    size_t size = resolution - 1;
+    std::vector<Node> level(size * size);
+    for (size_t z = 0; z < size; z++)
+    {
+        for (size_t x = 0; x < size; x++)
+        {
+            const uint8_t h00 = heightMap[(z * resolution) + x];
+            const uint8_t h10 = heightMap[(z * resolution) + x + 1];
+            const uint8_t h01 = heightMap[((z + 1) * resolution) + x];
+            const uint8_t h11 = heightMap[((z + 1) * resolution) + x + 1];
+
+            Node& node = level[(z * size) + x];
+            node.minHeight = std::min(std::min(h00, h10), std::min(h01, h11)) * heightScale;
+            node.maxHeight = std::max(std::max(h00, h10), std::max(h01, h11)) * heightScale;
+        }
+    }
+
+    m_levels.push_back(std::move(level));
+    m_levelSizes.push_back(size);
+
+    // Merge 2x2 blocks until a single root remains. Odd sizes leave a last row / column of
+    // nodes that only merge the children that exist.
+    while (size > 1)
+    {
+        const std::vector<Node>& children = m_levels.back();
+        const size_t childSize = size;
+        size = (size + 1) / 2;
+
+        std::vector<Node> parents(size * size);
+        for (size_t z = 0; z < size; z++)
+        {
+            for (size_t x = 0; x < size; x++)
+            {
+                Node merged = children[(z * 2 * childSize) + (x * 2)];
+                for (size_t cz = z * 2; cz < std::min(z * 2 + 2, childSize); cz++)
+                {
+                    for (size_t cx = x * 2; cx < std::min(x * 2 + 2, childSize); cx++)
+                    {
+                        const Node& child = children[(cz * childSize) + cx];
+                        merged.minHeight = std::min(merged.minHeight, child.minHeight);
+                        merged.maxHeight = std::max(merged.maxHeight, child.maxHeight);
+                    }
+                }
+                parents[(z * size) + x] = merged;
+            }
+        }
+
+        m_levels.push_back(std::move(parents));
+        m_levelSizes.push_back(size);
+    }
+}
+
+void TerrainMinMaxTree::GetNodeBounds(size_t level, size_t x, size_t z, float& minX, float& minZ, float& maxX, float& maxZ) const
+{
+    // A node at 'level' covers 2^level quads per side, clipped to the terrain
+    const size_t quadsPerNode = size_t(1) << level;
+    const size_t numQuads = m_levelSizes[0];
+
+    minX = m_originX + (x * quadsPerNode) * m_cellSize;
+    minZ = m_originZ + (z * quadsPerNode) * m_cellSize;
+    maxX = m_originX + std::min((x + 1) * quadsPerNode, numQuads) * m_cellSize;
+    maxZ = m_originZ + std::min((z + 1) * quadsPerNode, numQuads) * m_cellSize;
+}
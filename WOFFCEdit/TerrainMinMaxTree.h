@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Quadtree of minimum and maximum terrain heights, stored as a pyramid of grids. Level 0 has one
+// node per terrain quad; every level above halves the resolution, each node covering (up to) 2x2
+// nodes of the level below, until a single root node covers the whole chunk.
+//
+// Used for conservative spatial queries against the terrain, such as horizon occlusion culling.
+class TerrainMinMaxTree
+{
+public:
+    struct Node
+    {
+        float minHeight;
+        float maxHeight;
+    };
+
+    // 'heightMap' holds resolution x resolution samples, 'heightScale' converts them to world units.
+    // Sample (x, z) is at world (originX + x * cellSize, originZ + z * cellSize).
+    void Build(const uint8_t* heightMap, size_t resolution, float heightScale, float cellSize, float originX, float originZ);
+
+    size_t GetNumLevels() const { return m_levels.size(); }
+    size_t GetLevelSize(size_t level) const { return m_levelSizes[level]; }	//nodes along one side
+    const Node& GetNode(size_t level, size_t x, size_t z) const { return m_levels[level][(z * m_levelSizes[level]) + x]; }
+
+    // World space XZ rectangle covered by a node
+    void GetNodeBounds(size_t level, size_t x, size_t z, float& minX, float& minZ, float& maxX, float& maxZ) const;
+
+    float GetCellSize() const { return m_cellSize; }
+    float GetOriginX() const { return m_originX; }
+    float GetOriginZ() const { return m_originZ; }
+    size_t GetNumQuads() const { return m_levelSizes.empty() ? 0 : m_levelSizes[0]; }
+
+private:
+    std::vector<std::vector<Node>> m_levels;
+    std::vector<size_t> m_levelSizes;
+    float m_cellSize = 1.f;
+    float m_originX = 0.f;
+    float m_originZ = 0.f;
+};
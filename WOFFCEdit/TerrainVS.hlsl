@@ -0,0 +1,80 @@
+// Vertex shader for the terrain, drawn straight from DisplayChunk's compact vertices: a height and an
+// octahedral normal each, with X/Z and texture coordinates following from the vertex's place in the grid.
+// Lit as BasicEffect's textured vertex lighting, for InstancedModelPS.hlsl to finish.
+
+cbuffer FrameConstants : register(b0)
+{
+    float4x4 ViewProjection;
+    float3 EyePosition;
+    float3 LightDirection[3];
+    float3 LightDiffuseColor[3];
+    float3 LightSpecularColor[3];
+};
+
+cbuffer TerrainConstants : register(b1)
+{
+    float4 DiffuseColor;
+    float3 EmissiveColor;		//includes ambient light * diffuse, as in BasicEffect
+    float SpecularPower;
+    float3 SpecularColor;
+    float MaxHeight;			//of a height of 1
+    float2 Origin;				//world X/Z of the first vertex
+    float CellSize;
+    float TexCoordStep;			//per cell, tiling included
+    uint Resolution;			//vertices along a side
+};
+
+struct VSInput
+{
+    float Height : HEIGHT;		//R16_UNORM
+    float2 Normal : NORMAL;		//R8G8_UNORM
+    uint VertexId : SV_VertexID;
+};
+
+struct VSOutput
+{
+    float4 Diffuse : COLOR0;
+    float4 Specular : COLOR1;
+    float2 TexCoord : TEXCOORD0;
+    float4 PositionPS : SV_Position;
+};
+
+VSOutput main(VSInput vin)
+{
+    VSOutput vout;
+
+    const uint x = vin.VertexId % Resolution;
+    const uint z = vin.VertexId / Resolution;
+    const float3 positionWS = float3(Origin.x + (x * CellSize), vin.Height * MaxHeight, Origin.y + (z * CellSize));
+
+    // Unfold the octahedron as TerrainVertexCodec::DecodeNormals does, Y up
+    float3 normalWS;
+    normalWS.xz = (vin.Normal * (255.0 / 127.5)) - 1;
+    normalWS.y = 1 - abs(normalWS.x) - abs(normalWS.z);
+    const float t = max(-normalWS.y, 0);
+    normalWS.xz += (normalWS.xz >= 0) ? -t : t;
+    normalWS = normalize(normalWS);
+
+    const float3 eyeVector = normalize(EyePosition - positionWS);
+
+    float3 diffuse = 0;
+    float3 specular = 0;
+
+    [unroll]
+    for (int i = 0; i < 3; i++)
+    {
+        const float dotL = dot(-LightDirection[i], normalWS);
+        const float zeroL = step(0, dotL);
+        const float dotH = dot(normalize(eyeVector - LightDirection[i]), normalWS);
+
+        diffuse += zeroL * dotL * LightDiffuseColor[i];
+        specular += pow(max(dotH, 0) * zeroL, SpecularPower) * dotL * LightSpecularColor[i];
+    }
+
+    vout.PositionPS = mul(float4(positionWS, 1), ViewProjection);
+    vout.Diffuse = float4((diffuse * DiffuseColor.rgb) + EmissiveColor, DiffuseColor.a);
+    vout.Specular = float4(specular * SpecularColor, 0);
+    vout.TexCoord = float2(x, z) * TexCoordStep;
+
+    return vout;
+}
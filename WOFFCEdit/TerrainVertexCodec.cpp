@@ -0,0 +1,225 @@
+#include "TerrainVertexCodec.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define TERRAIN_CODEC_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    constexpr float HEIGHT_STEPS = 65535.f;
+    constexpr float NORMAL_HALF_RANGE = 127.5f;
+
+    // Strided float access
+    inline const float& At(const float* base, size_t strideBytes, size_t i)
+    {
+        return *reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(base) + (i * strideBytes));
+    }
+
+    inline float& At(float* base, size_t strideBytes, size_t i)
+    {
+        return *reinterpret_cast<float*>(reinterpret_cast<uint8_t*>(base) + (i * strideBytes));
+    }
+
+    inline float SignNotZero(float v)
+    {
+        return v >= 0.f ? 1.f : -1.f;
+    }
+
+    inline uint8_t QuantiseSnorm8(float v)
+    {
+        const float q = std::floor((v * NORMAL_HALF_RANGE) + NORMAL_HALF_RANGE + 0.5f);
+        return static_cast<uint8_t>(std::min(std::max(q, 0.f), 255.f));
+    }
+
+    void EncodeNormalScalar(float x, float y, float z, TerrainVertexCompact& out)
+    {
+        // Project onto the octahedron, then fold the lower hemisphere over the upper one.
+        // Y is the up axis so the octahedron is unfolded onto the XZ plane.
+        const float invL1 = 1.f / (std::abs(x) + std::abs(y) + std::abs(z));
+        float u = x * invL1;
+        float v = z * invL1;
+
+        if (y < 0.f)
+        {
+            const float foldedU = (1.f - std::abs(v)) * SignNotZero(u);
+            const float foldedV = (1.f - std::abs(u)) * SignNotZero(v);
+            u = foldedU;
+            v = foldedV;
+        }
+
+        out.normalU = QuantiseSnorm8(u);
+        out.normalV = QuantiseSnorm8(v);
+    }
+
+    void DecodeNormalScalar(const TerrainVertexCompact& in, float& x, float& y, float& z)
+    {
+        x = (in.normalU / NORMAL_HALF_RANGE) - 1.f;
+        z = (in.normalV / NORMAL_HALF_RANGE) - 1.f;
+        y = 1.f - std::abs(x) - std::abs(z);
+
+        // Unfold the lower hemisphere
+        const float t = std::max(-y, 0.f);
+        x += x >= 0.f ? -t : t;
+        z += z >= 0.f ? -t : t;
+
+        const float invLength = 1.f / std::sqrt((x * x) + (y * y) + (z * z));
+        x *= invLength;
+        y *= invLength;
+        z *= invLength;
+    }
+
+#ifdef TERRAIN_CODEC_SSE2
+    inline __m128 Gather4(const float* base, size_t strideBytes, size_t i)
+    {
+        return _mm_setr_ps(At(base, strideBytes, i), At(base, strideBytes, i + 1), At(base, strideBytes, i + 2), At(base, strideBytes, i + 3));
+    }
+
+    inline void Scatter4(__m128 v, float* base, size_t strideBytes, size_t i)
+    {
+        alignas(16) float values[4];
+        _mm_store_ps(values, v);
+        for (size_t k = 0; k < 4; k++)
+            At(base, strideBytes, i + k) = values[k];
+    }
+
+    inline __m128 Abs(__m128 v)
+    {
+        return _mm_andnot_ps(_mm_set1_ps(-0.f), v);
+    }
+
+    // +1 or -1 with the sign of v
+    inline __m128 SignNotZero(__m128 v)
+    {
+        return _mm_or_ps(_mm_and_ps(v, _mm_set1_ps(-0.f)), _mm_set1_ps(1.f));
+    }
+
+    inline __m128 Select(__m128 mask, __m128 ifTrue, __m128 ifFalse)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, ifTrue), _mm_andnot_ps(mask, ifFalse));
+    }
+#endif
+}
+
+void TerrainVertexCodec::EncodeHeights(const float* heights, size_t strideBytes, size_t count, float maxHeight, TerrainVertexCompact* out)
+{
+    const float scale = maxHeight > 0.f ? HEIGHT_STEPS / maxHeight : 0.f;
+    size_t i = 0;
+
+#ifdef TERRAIN_CODEC_SSE2
+    const __m128 vScale = _mm_set1_ps(scale);
+    const __m128 vMax = _mm_set1_ps(HEIGHT_STEPS);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 q = _mm_mul_ps(Gather4(heights, strideBytes, i), vScale);
+        q = _mm_min_ps(_mm_max_ps(q, _mm_setzero_ps()), vMax);
+
+        alignas(16) int32_t values[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(values), _mm_cvtps_epi32(q));	//round to nearest
+        for (size_t k = 0; k < 4; k++)
+            out[i + k].height = static_cast<uint16_t>(values[k]);
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        const float q = std::floor((At(heights, strideBytes, i) * scale) + 0.5f);
+        out[i].height = static_cast<uint16_t>(std::min(std::max(q, 0.f), HEIGHT_STEPS));
+    }
+}
+
+void TerrainVertexCodec::DecodeHeights(const TerrainVertexCompact* in, size_t count, float maxHeight, float* heights, size_t strideBytes)
+{
+    const float scale = maxHeight / HEIGHT_STEPS;
+    size_t i = 0;
+
+#ifdef TERRAIN_CODEC_SSE2
+    const __m128 vScale = _mm_set1_ps(scale);
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i q = _mm_setr_epi32(in[i].height, in[i + 1].height, in[i + 2].height, in[i + 3].height);
+        Scatter4(_mm_mul_ps(_mm_cvtepi32_ps(q), vScale), heights, strideBytes, i);
+    }
+#endif
+
+    for (; i < count; i++)
+        At(heights, strideBytes, i) = in[i].height * scale;
+}
+
+void TerrainVertexCodec::EncodeNormals(const float* normals, size_t strideBytes, size_t count, TerrainVertexCompact* out)
+{
+    size_t i = 0;
+
+#ifdef TERRAIN_CODEC_SSE2
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 halfRange = _mm_set1_ps(NORMAL_HALF_RANGE);
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128 x = Gather4(normals, strideBytes, i);
+        const __m128 y = Gather4(normals + 1, strideBytes, i);
+        const __m128 z = Gather4(normals + 2, strideBytes, i);
+
+        const __m128 invL1 = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(Abs(x), Abs(y)), Abs(z)));
+        __m128 u = _mm_mul_ps(x, invL1);
+        __m128 v = _mm_mul_ps(z, invL1);
+
+        const __m128 lowerHemisphere = _mm_cmplt_ps(y, _mm_setzero_ps());
+        const __m128 foldedU = _mm_mul_ps(_mm_sub_ps(one, Abs(v)), SignNotZero(u));
+        const __m128 foldedV = _mm_mul_ps(_mm_sub_ps(one, Abs(u)), SignNotZero(v));
+        u = Select(lowerHemisphere, foldedU, u);
+        v = Select(lowerHemisphere, foldedV, v);
+
+        // [-1, 1] -> [0, 255], round to nearest and saturate while packing down to bytes
+        const __m128i qu = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(u, halfRange), halfRange));
+        const __m128i qv = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(v, halfRange), halfRange));
+        const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(qu, qv), _mm_setzero_si128());
+
+        alignas(16) uint8_t bytes[16];
+        _mm_store_si128(reinterpret_cast<__m128i*>(bytes), packed);
+        for (size_t k = 0; k < 4; k++)
+        {
+            out[i + k].normalU = bytes[k];
+            out[i + k].normalV = bytes[k + 4];
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+        EncodeNormalScalar(At(normals, strideBytes, i), At(normals + 1, strideBytes, i), At(normals + 2, strideBytes, i), out[i]);
+}
+
+void TerrainVertexCodec::DecodeNormals(const TerrainVertexCompact* in, size_t count, float* normals, size_t strideBytes)
+{
+    size_t i = 0;
+
+#ifdef TERRAIN_CODEC_SSE2
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 invHalfRange = _mm_set1_ps(1.f / NORMAL_HALF_RANGE);
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i qu = _mm_setr_epi32(in[i].normalU, in[i + 1].normalU, in[i + 2].normalU, in[i + 3].normalU);
+        const __m128i qv = _mm_setr_epi32(in[i].normalV, in[i + 1].normalV, in[i + 2].normalV, in[i + 3].normalV);
+
+        __m128 x = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(qu), invHalfRange), one);
+        __m128 z = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(qv), invHalfRange), one);
+        __m128 y = _mm_sub_ps(_mm_sub_ps(one, Abs(x)), Abs(z));
+
+        // Unfold the lower hemisphere: move x/z towards zero by max(-y, 0)
+        const __m128 t = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), y), _mm_setzero_ps());
+        x = _mm_sub_ps(x, _mm_mul_ps(SignNotZero(x), t));
+        z = _mm_sub_ps(z, _mm_mul_ps(SignNotZero(z), t));
+
+        const __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+        const __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+
+        Scatter4(_mm_mul_ps(x, invLength), normals, strideBytes, i);
+        Scatter4(_mm_mul_ps(y, invLength), normals + 1, strideBytes, i);
+        Scatter4(_mm_mul_ps(z, invLength), normals + 2, strideBytes, i);
+    }
+#endif
+
+    for (; i < count; i++)
+        DecodeNormalScalar(in[i], At(normals, strideBytes, i), At(normals + 1, strideBytes, i), At(normals + 2, strideBytes, i));
+}
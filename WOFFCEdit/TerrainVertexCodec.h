@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// Compact terrain vertex. X/Z and texture coordinates are implied by the vertex's position in
+// the terrain grid, so all that needs storing per vertex is the height and the normal.
+// 4 bytes against the 32 of a VertexPositionNormalTexture.
+struct TerrainVertexCompact
+{
+    uint16_t height;	//quantised height, 0-65535 maps linearly onto 0-maxHeight
+    uint8_t normalU;	//octahedral encoded normal, Y up
+    uint8_t normalV;
+};
+
+static_assert(sizeof(TerrainVertexCompact) == 4, "TerrainVertexCompact must stay 4 bytes");
+
+// Encoders / decoders between full precision vertex data and TerrainVertexCompact.
+// Source and destination floats are read/written with a byte stride, so they can operate directly
+// on the members of an array of VertexPositionNormalTexture. Four vertices are processed per
+// iteration using SSE2; the remainder, and non-x86 targets, go through the scalar path.
+namespace TerrainVertexCodec
+{
+    // 'heights' points at the first height, each subsequent one is 'strideBytes' further on
+    void EncodeHeights(const float* heights, size_t strideBytes, size_t count, float maxHeight, TerrainVertexCompact* out);
+    void DecodeHeights(const TerrainVertexCompact* in, size_t count, float maxHeight, float* heights, size_t strideBytes);
+
+    // 'normals' points at the x component of the first unit length normal, followed by y and z
+    void EncodeNormals(const float* normals, size_t strideBytes, size_t count, TerrainVertexCompact* out);
+    void DecodeNormals(const TerrainVertexCompact* in, size_t count, float* normals, size_t strideBytes);
+}
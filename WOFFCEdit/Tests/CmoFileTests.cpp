@@ -0,0 +1,84 @@
+#include "Tests.h"
+#include "CmoFile.h"
+#include "Platform.h"
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+    const char* SCRATCH_CMO = "scenetests_model.cmo";
+
+    std::vector<uint8_t> ReadBytes(const std::string& path)
+    {
+        std::vector<uint8_t> bytes;
+        FILE* pFile = nullptr;
+        if (fopen_s(&pFile, path.c_str(), "rb") != 0 || !pFile)
+            return bytes;
+
+        uint8_t buffer[4096];
+        for (size_t read; (read = fread(buffer, 1, sizeof(buffer), pFile)) > 0; )
+            bytes.insert(bytes.end(), buffer, buffer + read);
+        fclose(pFile);
+        return bytes;
+    }
+
+    void WriteBytes(const std::string& path, const uint8_t* bytes, size_t count)
+    {
+        FILE* pFile = nullptr;
+        if (fopen_s(&pFile, path.c_str(), "wb") != 0 || !pFile)
+            return;
+
+        fwrite(bytes, 1, count, pFile);
+        fclose(pFile);
+    }
+}
+
+TEST(CmoFile, ReadsPlaceholder)
+{
+    CmoFile model;
+    CHECK(model.Read(Tests::SourcePath("database/data/placeholder.cmo")));
+    CHECK(model.meshes.size() == 1);
+    CHECK(model.NumTriangles() == 192);
+    if (model.meshes.size() == 1)
+    {
+        const CmoFile::Mesh& mesh = model.meshes[0];
+        CHECK(mesh.subMeshes.size() == 1 && mesh.indexBuffers.size() == 1 && mesh.vertexBuffers.size() == 1);
+        CHECK(mesh.vertexBuffers[0].size() == 404);
+
+        bool inRange = true;
+        for (uint16_t index : mesh.indexBuffers[0])
+            inRange = inRange && index < mesh.vertexBuffers[0].size();
+        CHECK(inRange);
+    }
+}
+
+TEST(CmoFile, RewritesByteForByte)
+{
+    const std::string source = Tests::SourcePath("database/data/placeholder.cmo");
+    CmoFile model;
+    CHECK(model.Read(source));
+    CHECK(model.Write(SCRATCH_CMO));
+
+    const std::vector<uint8_t> original = ReadBytes(source);
+    CHECK(!original.empty());
+    CHECK(ReadBytes(SCRATCH_CMO) == original);
+
+    Platform::RemoveFile(SCRATCH_CMO);
+}
+
+TEST(CmoFile, RejectsTruncatedFiles)
+{
+    const std::vector<uint8_t> original = ReadBytes(Tests::SourcePath("database/data/placeholder.cmo"));
+    CmoFile model;
+
+    // Cut inside the header, the index buffer, the vertex buffer and the trailer
+    const size_t lengths[] = { 0, 3, 64, original.size() / 2, original.size() - 1 };
+    for (size_t length : lengths)
+    {
+        WriteBytes(SCRATCH_CMO, original.data(), std::min(length, original.size()));
+        CHECK(!model.Read(SCRATCH_CMO));
+    }
+    CHECK(!model.Read("scenetests_missing.cmo"));
+
+    Platform::RemoveFile(SCRATCH_CMO);
+}
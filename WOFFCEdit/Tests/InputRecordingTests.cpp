@@ -0,0 +1,240 @@
+#include "Tests.h"
+#include "InputRecording.h"
+#include "Platform.h"
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const char* SCRATCH_RECORDING = "scenetests_input.wir";
+    const char* SCRATCH_DAMAGED = "scenetests_damaged.wir";
+
+    // A record as replayed, microseconds aside, which are the recorder's own timing
+    struct Played
+    {
+        InputReplay::Record	type;
+        InputFrame			frame;
+        uint32_t			command;
+        std::string			argument;
+    };
+
+    bool SameFrame(const InputFrame& a, const InputFrame& b)
+    {
+        return a.mouseX == b.mouseX && a.mouseY == b.mouseY && a.scrollWheel == b.scrollWheel && a.buttons == b.buttons
+            && a.relative == b.relative && memcmp(a.keys, b.keys, InputFrame::KEY_BYTES) == 0;
+    }
+
+    bool SameRecord(const Played& a, const Played& b)
+    {
+        if (a.type != b.type)
+            return false;
+        return a.type == InputReplay::RECORD_FRAME ? SameFrame(a.frame, b.frame) : a.command == b.command && a.argument == b.argument;
+    }
+
+    // Frames that often repeat the one before, in part or whole, with commands between some of them
+    std::vector<Played> MakeSession(unsigned seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<Played> session;
+        InputFrame frame;
+        for (int f = 0; f < 60; f++)
+        {
+            if (random() % 2)
+            {
+                frame.mouseX += int32_t(random() % 21) - 10;
+                frame.mouseY -= int32_t(random() % 7);
+                frame.scrollWheel += random() % 4 == 0 ? 120 : 0;
+                frame.buttons = uint8_t(random() % 32);
+                frame.relative = uint8_t(random() % 2);
+            }
+            if (random() % 3 == 0)
+                frame.keys[random() % InputFrame::KEY_BYTES] ^= uint8_t(1u << (random() % 8));
+            session.push_back({ InputReplay::RECORD_FRAME, frame, 0, std::string() });
+
+            if (random() % 5 == 0)
+            {
+                std::string argument(random() % 40, '\0');
+                for (char& c : argument)
+                    c = char(random());
+                session.push_back({ InputReplay::RECORD_COMMAND, InputFrame(), uint32_t(random() % 16), argument });
+            }
+        }
+        return session;
+    }
+
+    bool Record(const std::string& path, const std::vector<Played>& session, InputRecorder::Stats& stats)
+    {
+        InputRecorder recorder;
+        if (!recorder.Start(path))
+            return false;
+
+        for (const Played& record : session)
+        {
+            if (record.type == InputReplay::RECORD_FRAME)
+                recorder.RecordFrame(record.frame);
+            else
+                recorder.RecordCommand(record.command, record.argument);
+        }
+        stats = recorder.GetStats();
+        return recorder.Stop();
+    }
+
+    std::vector<Played> Replay(InputReplay& replay)
+    {
+        std::vector<Played> played;
+        for (InputReplay::Record type = replay.Next(); type != InputReplay::RECORD_END; type = replay.Next())
+            played.push_back({ type, replay.GetFrame(), replay.GetCommand(), replay.GetArgument() });
+        return played;
+    }
+
+    std::vector<uint8_t> ReadBytes(const std::string& path)
+    {
+        std::vector<uint8_t> bytes;
+        FILE* pFile = nullptr;
+        if (fopen_s(&pFile, path.c_str(), "rb") != 0 || !pFile)
+            return bytes;
+
+        uint8_t buffer[4096];
+        for (size_t read; (read = fread(buffer, 1, sizeof(buffer), pFile)) > 0; )
+            bytes.insert(bytes.end(), buffer, buffer + read);
+        fclose(pFile);
+        return bytes;
+    }
+
+    void WriteBytes(const std::string& path, const std::vector<uint8_t>& bytes, size_t count)
+    {
+        FILE* pFile = nullptr;
+        if (fopen_s(&pFile, path.c_str(), "wb") != 0 || !pFile)
+            return;
+
+        fwrite(bytes.data(), 1, count, pFile);
+        fclose(pFile);
+    }
+}
+
+TEST(InputRecording, RoundTrip)
+{
+    std::vector<Played> session = MakeSession(1);
+    session.push_back({ InputReplay::RECORD_COMMAND, InputFrame(), 7, std::string(0xFFFF, 'x') });	//the longest argument there is
+    session.push_back({ InputReplay::RECORD_FRAME, InputFrame(), 0, std::string() });				//back to nothing held
+
+    InputRecorder::Stats stats;
+    CHECK(Record(SCRATCH_RECORDING, session, stats));
+
+    size_t frames = 0;
+    for (const Played& record : session)
+        frames += record.type == InputReplay::RECORD_FRAME;
+    CHECK(stats.frames == frames);
+    CHECK(stats.commands == session.size() - frames);
+    CHECK(stats.bytes == ReadBytes(SCRATCH_RECORDING).size());
+
+    InputReplay replay;
+    CHECK(replay.Open(SCRATCH_RECORDING));
+    CHECK(replay.IsPlaying());
+    CHECK(replay.GetNumFrames() == frames);
+
+    const std::vector<Played> played = Replay(replay);
+    CHECK(played.size() == session.size());
+    bool same = played.size() == session.size();
+    for (size_t r = 0; same && r < played.size(); r++)
+        same = SameRecord(played[r], session[r]);
+    CHECK(same);
+    CHECK(!replay.IsPlaying());
+    CHECK(replay.GetFramesPlayed() == frames);
+    CHECK(replay.Next() == InputReplay::RECORD_END);
+
+    // Longer arguments are cut to what the length field holds
+    InputRecorder recorder;
+    CHECK(recorder.Start(SCRATCH_RECORDING));
+    recorder.RecordCommand(1, std::string(0x10005, 'y'));
+    CHECK(recorder.Stop());
+    CHECK(replay.Open(SCRATCH_RECORDING) && replay.Next() == InputReplay::RECORD_COMMAND && replay.GetArgument() == std::string(0xFFFF, 'y'));
+
+    Platform::RemoveFile(SCRATCH_RECORDING);
+}
+
+TEST(InputRecording, TruncatedFileEndsEarly)
+{
+    // As a recording left by a crash: every cut plays back the records before it, and nothing after
+    const std::vector<Played> session = MakeSession(2);
+    InputRecorder::Stats stats;
+    CHECK(Record(SCRATCH_RECORDING, session, stats));
+    const std::vector<uint8_t> bytes = ReadBytes(SCRATCH_RECORDING);
+
+    const size_t header = 4;
+    bool prefixes = true;
+    bool counted = true;
+    bool growing = true;
+    size_t lastCount = 0;
+    InputReplay replay;
+    for (size_t length = header; length < bytes.size(); length++)
+    {
+        WriteBytes(SCRATCH_DAMAGED, bytes, length);
+        if (!replay.Open(SCRATCH_DAMAGED))
+        {
+            prefixes = false;
+            continue;
+        }
+
+        const std::vector<Played> played = Replay(replay);
+        prefixes = prefixes && played.size() < session.size();
+        for (size_t r = 0; prefixes && r < played.size(); r++)
+            prefixes = SameRecord(played[r], session[r]);
+
+        size_t frames = 0;
+        for (const Played& record : played)
+            frames += record.type == InputReplay::RECORD_FRAME;
+        counted = counted && replay.GetNumFrames() == frames && replay.GetFramesPlayed() == frames;
+
+        growing = growing && played.size() >= lastCount && (length != header || played.empty());
+        lastCount = played.size();
+    }
+    CHECK(prefixes);
+    CHECK(counted);
+    CHECK(growing);
+    CHECK(lastCount == session.size() - 1);		//one byte short loses the last record alone
+
+    Platform::RemoveFile(SCRATCH_RECORDING);
+    Platform::RemoveFile(SCRATCH_DAMAGED);
+}
+
+TEST(InputRecording, RejectsBadHeaders)
+{
+    InputRecorder::Stats stats;
+    CHECK(Record(SCRATCH_RECORDING, MakeSession(3), stats));
+    const std::vector<uint8_t> bytes = ReadBytes(SCRATCH_RECORDING);
+
+    InputRecorder recorder;
+    CHECK(!recorder.Start("scenetests_missing/input.wir"));
+    CHECK(!recorder.IsRecording());
+
+    InputReplay replay;
+    CHECK(!replay.Open("scenetests_missing.wir"));
+    CHECK(!replay.IsPlaying() && replay.Next() == InputReplay::RECORD_END);
+
+    // Cut inside the header
+    for (size_t length = 0; length < 4; length++)
+    {
+        WriteBytes(SCRATCH_DAMAGED, bytes, length);
+        CHECK(!replay.Open(SCRATCH_DAMAGED));
+    }
+
+    // Another magic, or another version
+    for (size_t b = 0; b < 4; b++)
+    {
+        std::vector<uint8_t> damaged(bytes);
+        damaged[b] ^= 0x20;
+        WriteBytes(SCRATCH_DAMAGED, damaged, damaged.size());
+        CHECK(!replay.Open(SCRATCH_DAMAGED));
+        CHECK(!replay.IsPlaying() && replay.GetNumFrames() == 0);
+    }
+
+    // A good one still opens after them
+    CHECK(replay.Open(SCRATCH_RECORDING) && replay.IsPlaying());
+
+    Platform::RemoveFile(SCRATCH_RECORDING);
+    Platform::RemoveFile(SCRATCH_DAMAGED);
+}
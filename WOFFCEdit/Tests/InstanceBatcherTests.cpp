@@ -0,0 +1,243 @@
+#include "Tests.h"
+#include "InstanceBatcher.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+    constexpr size_t NUM_MODELS = 5;
+    constexpr size_t NUM_TEXTURES = 3;
+
+    // Objects of random models and textures, scattered and rotated about Y, with one in eight left out
+    struct Scene
+    {
+        std::vector<uint64_t>	models;
+        std::vector<uint64_t>	textures;
+        std::vector<float>		worlds;
+        std::vector<uint8_t>	included;
+
+        Scene(size_t count, unsigned seed)
+        {
+            std::mt19937 random(seed);
+            std::uniform_int_distribution<int> model(0, NUM_MODELS - 1);
+            std::uniform_int_distribution<int> texture(0, NUM_TEXTURES - 1);
+            std::uniform_real_distribution<float> position(-200.f, 200.f);
+            std::uniform_real_distribution<float> angle(0.f, 6.2831853f);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                models.push_back(1000 + model(random));
+                textures.push_back(2000 + texture(random));
+                included.push_back(random() % 8 != 0);
+
+                const float a = angle(random);
+                const float world[16] = { std::cos(a), 0.f, -std::sin(a), 0.f,  0.f, 1.f, 0.f, 0.f,  std::sin(a), 0.f, std::cos(a), 0.f,  position(random), position(random) * 0.1f, position(random), 1.f };
+                worlds.insert(worlds.end(), world, world + 16);
+            }
+        }
+
+        size_t Size() const { return models.size(); }
+    };
+}
+
+TEST(InstanceBatcher, BatchMembership)
+{
+    const Scene scene(1000, 1);
+    InstanceBatcher batcher;
+    batcher.Build(scene.models.data(), scene.textures.data(), scene.worlds.data(), scene.Size(), scene.included.data());
+
+    CHECK(batcher.GetNumBatches() == NUM_MODELS * NUM_TEXTURES);
+    CHECK(batcher.GetNumInstances() == size_t(std::count(scene.included.begin(), scene.included.end(), 1)));
+
+    // Batches tile the instances in order, each starting dirty, with keys appearing in the order of the objects
+    uint32_t nextInstance = 0;
+    size_t lastFirstObject = 0;
+    for (uint32_t b = 0; b < batcher.GetNumBatches(); b++)
+    {
+        const InstanceBatcher::Batch& batch = batcher.GetBatch(b);
+        CHECK(batch.firstInstance == nextInstance);
+        CHECK(batch.numInstances > 0);
+        CHECK(batch.dirty);
+        nextInstance += batch.numInstances;
+
+        size_t firstObject = 0;
+        while (firstObject < scene.Size() && !(scene.included[firstObject] && scene.models[firstObject] == batch.model && scene.textures[firstObject] == batch.texture))
+            firstObject++;
+        CHECK(b == 0 || firstObject > lastFirstObject);
+        lastFirstObject = firstObject;
+    }
+    CHECK(nextInstance == batcher.GetNumInstances());
+
+    // Every included object is an instance of the batch of its model and texture, and only that
+    for (uint32_t i = 0; i < scene.Size(); i++)
+    {
+        const uint32_t b = batcher.GetBatchOfObject(i);
+        const uint32_t instance = batcher.GetInstanceOfObject(i);
+        if (!scene.included[i])
+        {
+            CHECK(b == InstanceBatcher::NOT_BATCHED && instance == InstanceBatcher::NOT_BATCHED);
+            continue;
+        }
+
+        CHECK(b < batcher.GetNumBatches());
+        if (b < batcher.GetNumBatches())
+        {
+            const InstanceBatcher::Batch& batch = batcher.GetBatch(b);
+            CHECK(batch.model == scene.models[i] && batch.texture == scene.textures[i]);
+            CHECK(instance >= batch.firstInstance && instance < batch.firstInstance + batch.numInstances);
+            CHECK(batcher.GetObjectOfInstance(instance) == i);
+        }
+    }
+}
+
+TEST(InstanceBatcher, PacksTransforms)
+{
+    // Packed columns give the same point as transforming the row vector by the full matrix
+    const float world[16] = { 1.f, 2.f, 3.f, 0.f,  4.f, 5.f, 6.f, 0.f,  7.f, 8.f, 9.f, 0.f,  10.f, 11.f, 12.f, 1.f };
+    float packed[InstanceBatcher::FLOATS_PER_INSTANCE];
+    InstanceBatcher::PackTransform(world, packed);
+
+    const float point[4] = { 0.5f, -2.f, 3.f, 1.f };
+    for (int column = 0; column < 3; column++)
+    {
+        float byMatrix = 0.f;
+        float byPacked = 0.f;
+        for (int row = 0; row < 4; row++)
+        {
+            byMatrix += point[row] * world[(row * 4) + column];
+            byPacked += point[row] * packed[(column * 4) + row];
+        }
+        CHECK(byMatrix == byPacked);
+    }
+
+    // And every instance holds its object's transform, packed
+    const Scene scene(300, 2);
+    InstanceBatcher batcher;
+    batcher.Build(scene.models.data(), scene.textures.data(), scene.worlds.data(), scene.Size(), scene.included.data());
+
+    bool matches = true;
+    for (uint32_t instance = 0; instance < batcher.GetNumInstances(); instance++)
+    {
+        InstanceBatcher::PackTransform(&scene.worlds[size_t(batcher.GetObjectOfInstance(instance)) * 16], packed);
+        const float* data = batcher.GetInstanceData() + (size_t(instance) * InstanceBatcher::FLOATS_PER_INSTANCE);
+        matches = matches && std::equal(packed, packed + InstanceBatcher::FLOATS_PER_INSTANCE, data);
+    }
+    CHECK(matches);
+}
+
+TEST(InstanceBatcher, DirtiesOnlyMovedBatches)
+{
+    Scene scene(200, 3);
+    InstanceBatcher batcher;
+    batcher.Build(scene.models.data(), scene.textures.data(), scene.worlds.data(), scene.Size(), scene.included.data());
+    for (uint32_t b = 0; b < batcher.GetNumBatches(); b++)
+        batcher.ClearDirty(b);
+
+    const uint32_t object = uint32_t(std::find(scene.included.begin(), scene.included.end(), 1) - scene.included.begin());
+    const uint32_t excluded = uint32_t(std::find(scene.included.begin(), scene.included.end(), 0) - scene.included.begin());
+    float* world = &scene.worlds[size_t(object) * 16];
+
+    // The same transform again changes nothing, nor does moving an object that isn't batched
+    CHECK(!batcher.SetTransform(object, world));
+    CHECK(!batcher.SetTransform(excluded, &scene.worlds[size_t(excluded) * 16]));
+    for (uint32_t b = 0; b < batcher.GetNumBatches(); b++)
+        CHECK(!batcher.GetBatch(b).dirty);
+
+    // Moving one object dirties its batch alone and repacks its instance
+    world[13] += 1.f;
+    CHECK(batcher.SetTransform(object, world));
+    for (uint32_t b = 0; b < batcher.GetNumBatches(); b++)
+        CHECK(batcher.GetBatch(b).dirty == (b == batcher.GetBatchOfObject(object)));
+
+    float packed[InstanceBatcher::FLOATS_PER_INSTANCE];
+    InstanceBatcher::PackTransform(world, packed);
+    const float* data = batcher.GetInstanceData() + (size_t(batcher.GetInstanceOfObject(object)) * InstanceBatcher::FLOATS_PER_INSTANCE);
+    CHECK(std::equal(packed, packed + InstanceBatcher::FLOATS_PER_INSTANCE, data));
+
+    batcher.ClearDirty(batcher.GetBatchOfObject(object));
+    CHECK(!batcher.SetTransform(object, world));
+    CHECK(!batcher.GetBatch(batcher.GetBatchOfObject(object)).dirty);
+}
+
+TEST(InstanceBatcher, VisibleRanges)
+{
+    const Scene scene(1000, 4);
+    InstanceBatcher batcher;
+    batcher.Build(scene.models.data(), scene.textures.data(), scene.worlds.data(), scene.Size(), scene.included.data());
+
+    std::mt19937 random(5);
+    std::vector<uint8_t> visible(scene.Size());
+    for (uint8_t& v : visible)
+        v = random() % 3 != 0;
+
+    // Ranges are appended per batch, never merged across batches, and cover exactly the visible instances
+    std::vector<InstanceBatcher::Range> ranges = { { 12345, 1 } };
+    for (uint32_t b = 0; b < batcher.GetNumBatches(); b++)
+    {
+        const InstanceBatcher::Batch& batch = batcher.GetBatch(b);
+        const size_t firstRange = ranges.size();
+        batcher.GetVisibleRanges(b, visible.data(), ranges);
+
+        std::vector<uint8_t> covered(batch.numInstances, 0);
+        bool valid = true;
+        for (size_t r = firstRange; r < ranges.size(); r++)
+        {
+            const InstanceBatcher::Range& range = ranges[r];
+            valid = valid && range.numInstances > 0 && range.firstInstance >= batch.firstInstance && range.firstInstance + range.numInstances <= batch.firstInstance + batch.numInstances;
+            valid = valid && (r == firstRange || range.firstInstance > ranges[r - 1].firstInstance + ranges[r - 1].numInstances);	//merged with neighbours
+            for (uint32_t instance = range.firstInstance; valid && instance < range.firstInstance + range.numInstances; instance++)
+                covered[instance - batch.firstInstance] = 1;
+        }
+        CHECK(valid);
+
+        for (uint32_t m = 0; valid && m < batch.numInstances; m++)
+            CHECK(covered[m] == visible[batcher.GetObjectOfInstance(batch.firstInstance + m)]);
+    }
+    CHECK(ranges[0].firstInstance == 12345 && ranges[0].numInstances == 1);
+
+    // All visible, each batch is one range
+    std::fill(visible.begin(), visible.end(), 1);
+    ranges.clear();
+    for (uint32_t b = 0; b < batcher.GetNumBatches(); b++)
+        batcher.GetVisibleRanges(b, visible.data(), ranges);
+    CHECK(ranges.size() == batcher.GetNumBatches());
+}
+
+TEST(InstanceBatcher, NearbyObjectsShareRanges)
+{
+    // A 64 x 64 grid of one model, in row order. A square of it in view is 16 ranges in that order,
+    // and far fewer along the Z-order curve.
+    constexpr size_t SIDE = 64;
+    std::vector<uint64_t> models(SIDE * SIDE, 1);
+    std::vector<uint64_t> textures(SIDE * SIDE, 1);
+    std::vector<float> worlds;
+    for (size_t z = 0; z < SIDE; z++)
+    {
+        for (size_t x = 0; x < SIDE; x++)
+        {
+            const float world[16] = { 1.f, 0.f, 0.f, 0.f,  0.f, 1.f, 0.f, 0.f,  0.f, 0.f, 1.f, 0.f,  x * 4.f, 0.f, z * 4.f, 1.f };
+            worlds.insert(worlds.end(), world, world + 16);
+        }
+    }
+
+    InstanceBatcher batcher;
+    batcher.Build(models.data(), textures.data(), worlds.data(), models.size());
+    CHECK(batcher.GetNumBatches() == 1);
+
+    std::vector<uint8_t> visible(models.size(), 0);
+    for (size_t z = 16; z < 32; z++)
+    {
+        for (size_t x = 16; x < 32; x++)
+            visible[(z * SIDE) + x] = 1;
+    }
+
+    std::vector<InstanceBatcher::Range> ranges;
+    batcher.GetVisibleRanges(0, visible.data(), ranges);
+    size_t instances = 0;
+    for (const InstanceBatcher::Range& range : ranges)
+        instances += range.numInstances;
+    CHECK(instances == 16 * 16);
+    CHECK(ranges.size() <= 8);
+}
@@ -0,0 +1,317 @@
+#include "Tests.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr size_t WORKERS = 3;		//whatever the machine has, so there is always someone to steal
+
+    void Restart(size_t workers)
+    {
+        JobSystem::Shutdown();
+        JobSystem::Start(workers);
+    }
+
+    // Splits itself in two until 'depth' runs out, from whichever thread runs it
+    void Fork(JobGroup& group, std::atomic<int>& count, int depth)
+    {
+        count.fetch_add(1, std::memory_order_relaxed);
+        if (depth == 0)
+            return;
+
+        group.Run([&group, &count, depth]() { Fork(group, count, depth - 1); });
+        group.Run([&group, &count, depth]() { Fork(group, count, depth - 1); });
+    }
+}
+
+TEST(JobSystem, ParallelForRunsEveryIndexOnce)
+{
+    Restart(WORKERS);
+    CHECK(JobSystem::GetNumThreads() == WORKERS + 1);
+
+    // Counts below, at and far past the number of chunks
+    const size_t counts[] = { 0, 1, 2, 7, 31, 32, 33, 1000, 100003 };
+    for (size_t count : counts)
+    {
+        std::unique_ptr<std::atomic<int>[]> runs(new std::atomic<int>[count + 1]);
+        for (size_t i = 0; i <= count; i++)
+            runs[i] = 0;
+
+        JobSystem::ParallelFor(size_t(0), count, [&](size_t i) { runs[i].fetch_add(1, std::memory_order_relaxed); });
+
+        bool once = true;
+        for (size_t i = 0; i < count; i++)
+            once = once && runs[i] == 1;
+        CHECK(once);
+        CHECK(runs[count] == 0);
+    }
+
+    // Signed indices not starting at zero
+    std::atomic<long long> sum(0);
+    JobSystem::ParallelFor(-500, 1500, [&](int i) { sum.fetch_add(i, std::memory_order_relaxed); });
+    CHECK(sum == (1499LL * 1500 / 2) - (500LL * 501 / 2));
+}
+
+TEST(JobSystem, NestedParallelFor)
+{
+    Restart(WORKERS);
+
+    // Threads waiting on an inner loop run other iterations meanwhile, so nesting can't deadlock
+    constexpr size_t OUTER = 64;
+    constexpr size_t INNER = 257;
+    std::unique_ptr<std::atomic<int>[]> runs(new std::atomic<int>[OUTER * INNER]);
+    for (size_t round = 0; round < 20; round++)
+    {
+        for (size_t i = 0; i < OUTER * INNER; i++)
+            runs[i] = 0;
+
+        JobSystem::ParallelFor(size_t(0), OUTER, [&](size_t o)
+        {
+            JobSystem::ParallelFor(size_t(0), INNER, [&](size_t i) { runs[(o * INNER) + i].fetch_add(1, std::memory_order_relaxed); });
+        });
+
+        bool once = true;
+        for (size_t i = 0; i < OUTER * INNER; i++)
+            once = once && runs[i] == 1;
+        CHECK(once);
+    }
+}
+
+TEST(JobSystem, WorkersStealQueuedJobs)
+{
+    Restart(WORKERS);
+
+    // Jobs queued by the main thread only reach the workers by stealing. The main thread keeps away for a
+    // while, so they have to.
+    constexpr int JOBS = 2000;
+    const JobSystem::Stats before = JobSystem::GetStats();
+    std::atomic<int> ran(0);
+    std::atomic<int> onWorkers(0);
+    {
+        JobGroup group;
+        for (int j = 0; j < JOBS; j++)
+        {
+            group.Run([&ran, &onWorkers]()
+            {
+                ran.fetch_add(1, std::memory_order_relaxed);
+                onWorkers.fetch_add(JobSystem::IsMainThread() ? 0 : 1, std::memory_order_relaxed);
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        group.Wait();
+    }
+    const JobSystem::Stats after = JobSystem::GetStats();
+
+    CHECK(ran == JOBS);
+    CHECK(onWorkers > 0);
+    CHECK(after.steals - before.steals >= uint64_t(onWorkers.load()));
+    CHECK(after.jobs - before.jobs >= uint64_t(JOBS));
+}
+
+TEST(JobSystem, JobsQueueJobs)
+{
+    Restart(WORKERS);
+
+    // A tree of jobs queued from every thread, past the capacity of a deque
+    constexpr int DEPTH = 13;
+    for (int round = 0; round < 5; round++)
+    {
+        std::atomic<int> count(0);
+        JobGroup group;
+        Fork(group, count, DEPTH);
+        group.Wait();
+        CHECK(count == (1 << (DEPTH + 1)) - 1);
+    }
+}
+
+TEST(JobSystem, RethrowsAndCarriesOn)
+{
+    Restart(WORKERS);
+
+    bool thrown = false;
+    std::atomic<int> ran(0);
+    try
+    {
+        JobSystem::ParallelFor(0, 10000, [&](int i)
+        {
+            ran.fetch_add(1, std::memory_order_relaxed);
+            if (i == 5000)
+                throw std::runtime_error("job failed");
+        });
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(ran > 0);
+
+    // The group's other jobs still finish, and the group can be used again
+    JobGroup group;
+    std::atomic<int> finished(0);
+    for (int j = 0; j < 100; j++)
+    {
+        group.Run([&finished, j]()
+        {
+            if (j == 50)
+                throw std::runtime_error("job failed");
+            finished.fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+
+    thrown = false;
+    try
+    {
+        group.Wait();
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(finished == 99);
+
+    group.Run([&finished]() { finished.fetch_add(1, std::memory_order_relaxed); });
+    group.Wait();
+    CHECK(finished == 100);
+}
+
+TEST(JobSystem, GraphRunsAfterPredecessors)
+{
+    Restart(WORKERS);
+
+    // A diamond: 'first' before two middles, both before 'last'. Each node records when it ran.
+    for (int round = 0; round < 100; round++)
+    {
+        std::atomic<int> clock(0);
+        int order[4] = {};
+        JobGraph graph;
+        const JobGraph::Node first = graph.Add([&]() { order[0] = clock++; });
+        const JobGraph::Node left = graph.Add([&]() { order[1] = clock++; });
+        const JobGraph::Node right = graph.Add([&]() { order[2] = clock++; });
+        const JobGraph::Node last = graph.Add([&]() { order[3] = clock++; });
+        graph.Precede(first, left);
+        graph.Precede(first, right);
+        graph.Precede(left, last);
+        graph.Precede(right, last);
+        graph.Run();
+
+        CHECK(clock == 4);
+        CHECK(order[0] == 0 && order[3] == 3);
+    }
+}
+
+TEST(JobSystem, Restarts)
+{
+    // Down to the main thread alone, where jobs run as they are queued, and back up again
+    JobSystem::Shutdown();
+    CHECK(JobSystem::GetNumThreads() == 1);
+
+    int ranInline = 0;
+    {
+        JobGroup group;
+        group.Run([&ranInline]() { ranInline++; });
+        CHECK(ranInline == 1);
+    }
+
+    const size_t workerCounts[] = { 1, 0, WORKERS };
+    for (size_t workers : workerCounts)
+    {
+        Restart(workers);
+        CHECK(JobSystem::GetNumThreads() == workers + 1);
+        CHECK(JobSystem::IsMainThread());
+
+        std::atomic<int> sum(0);
+        JobSystem::ParallelFor(0, 1000, [&](int i) { sum.fetch_add(i, std::memory_order_relaxed); });
+        CHECK(sum == 999 * 1000 / 2);
+    }
+
+    // Starting again while running changes nothing
+    JobSystem::Start(WORKERS + 2);
+    CHECK(JobSystem::GetNumThreads() == WORKERS + 1);
+}
+
+TEST(JobSystem, MainThreadJobsWaitForThePump)
+{
+    Restart(WORKERS);
+
+    // A worker queues jobs for the main thread, which busy waits rather than run jobs itself, so a worker has
+    // to be the one that took it. Nothing queued runs before the pump, then all of it in order, on this thread.
+    constexpr int JOBS = 100;
+    std::atomic<int> wakes(0);
+    JobSystem::SetMainThreadWake([](void* user) { static_cast<std::atomic<int>*>(user)->fetch_add(1); }, &wakes);
+
+    const JobSystem::Stats before = JobSystem::GetStats();
+    std::vector<int> order;
+    bool onMain = true;
+    std::atomic<bool> fromWorker(false);
+    {
+        JobGroup group;
+        group.Run([&]()
+        {
+            fromWorker = !JobSystem::IsMainThread();
+            for (int j = 0; j < JOBS; j++)
+            {
+                JobSystem::RunOnMainThread([&order, &onMain, j]()
+                {
+                    onMain = onMain && JobSystem::IsMainThread();
+                    order.push_back(j);
+                });
+            }
+        });
+        while (!group.IsDone())
+            std::this_thread::yield();
+
+        CHECK(fromWorker);
+        CHECK(order.empty());
+        CHECK(wakes == JOBS);
+    }
+
+    CHECK(JobSystem::PumpMainThread() == JOBS);
+    CHECK(onMain);
+    bool inOrder = order.size() == JOBS;
+    for (size_t j = 0; inOrder && j < order.size(); j++)
+        inOrder = order[j] == int(j);
+    CHECK(inOrder);
+    CHECK(JobSystem::PumpMainThread() == 0);
+    CHECK(JobSystem::GetStats().mainThreadJobs - before.mainThreadJobs == JOBS);
+
+    // Queued from the main thread, they run right away
+    int ranInline = 0;
+    JobSystem::RunOnMainThread([&ranInline]() { ranInline++; });
+    CHECK(ranInline == 1);
+    CHECK(JobSystem::PumpMainThread() == 0);
+
+    JobSystem::SetMainThreadWake(nullptr, nullptr);
+}
+
+TEST(JobSystem, WaitingPumpsMainThreadJobs)
+{
+    Restart(WORKERS);
+
+    // Every iteration hands part of its work to the main thread, in the group the main thread waits on
+    constexpr size_t COUNT = 1000;
+    std::vector<int> runs(COUNT, 0);
+    bool onMain = true;
+    {
+        JobGroup group;
+        JobSystem::ParallelFor(size_t(0), COUNT, [&](size_t i)
+        {
+            JobSystem::RunOnMainThread([&runs, &onMain, i]()
+            {
+                onMain = onMain && JobSystem::IsMainThread();
+                runs[i]++;
+            }, &group);
+        });
+        group.Wait();
+    }
+
+    CHECK(onMain);
+    CHECK(size_t(std::count(runs.begin(), runs.end(), 1)) == COUNT);
+}
@@ -0,0 +1,119 @@
+#include "Tests.h"
+#include "LodCooker.h"
+#include "CmoFile.h"
+#include "Platform.h"
+#include <algorithm>
+
+namespace
+{
+    const char* SCRATCH_MODEL = "scenetests_lod.cmo";
+
+    // The placeholder with every index moved to the first vertex at its position, smoothing over its hard
+    // edges so there is something to simplify
+    bool WriteSmoothPlaceholder(const std::string& path)
+    {
+        CmoFile model;
+        if (!model.Read(Tests::SourcePath("database/data/placeholder.cmo")))
+            return false;
+
+        for (CmoFile::Mesh& mesh : model.meshes)
+        {
+            for (CmoFile::SubMesh& subMesh : mesh.subMeshes)
+            {
+                const std::vector<CmoFile::Vertex>& vertices = mesh.vertexBuffers[subMesh.vertexBuffer];
+                std::vector<uint16_t>& indices = mesh.indexBuffers[subMesh.indexBuffer];
+                for (size_t i = subMesh.startIndex; i < subMesh.startIndex + (subMesh.primCount * 3); i++)
+                {
+                    for (uint16_t first = 0; first < indices[i]; first++)
+                    {
+                        if (std::equal(vertices[first].position, vertices[first].position + 3, vertices[indices[i]].position))
+                        {
+                            indices[i] = first;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        return model.Write(path);
+    }
+
+    void RemoveModel(const std::string& path)
+    {
+        Platform::RemoveFile(path);
+        for (size_t level = 1; level < LodCooker::MAX_LEVELS; level++)
+            Platform::RemoveFile(LodCooker::LodPath(path, level));
+    }
+}
+
+TEST(LodCooker, LodPath)
+{
+    CHECK(LodCooker::LodPath("database/data/placeholder.cmo", 2) == "database/data/placeholder_lod2.cmo");
+    CHECK(LodCooker::LodPath("data.dir\\model", 1) == "data.dir\\model_lod1");
+}
+
+TEST(LodCooker, CooksLevels)
+{
+    RemoveModel(SCRATCH_MODEL);
+    CHECK(WriteSmoothPlaceholder(SCRATCH_MODEL));
+
+    CmoFile source;
+    CHECK(source.Read(SCRATCH_MODEL));
+
+    LodCooker cooker;
+    cooker.Cook({ SCRATCH_MODEL, SCRATCH_MODEL });
+    CHECK(cooker.GetStats().assets == 1);
+    CHECK(cooker.GetStats().cooked == 1 && cooker.GetStats().failed == 0);
+    CHECK(cooker.GetStats().levels >= 1);
+    CHECK(cooker.GetStats().trianglesIn == source.NumTriangles());
+    CHECK(cooker.GetStats().trianglesOut < source.NumTriangles());
+
+    // Each level has fewer triangles than the one before, over the source's vertices
+    size_t previous = source.NumTriangles();
+    for (size_t level = 1; level <= cooker.GetStats().levels; level++)
+    {
+        CmoFile lod;
+        CHECK(lod.Read(LodCooker::LodPath(SCRATCH_MODEL, level)));
+        CHECK(lod.NumTriangles() < previous);
+        previous = lod.NumTriangles();
+
+        bool sameVertices = lod.meshes.size() == source.meshes.size();
+        for (size_t m = 0; sameVertices && m < lod.meshes.size(); m++)
+        {
+            sameVertices = lod.meshes[m].vertexBuffers.size() == source.meshes[m].vertexBuffers.size()
+                        && lod.meshes[m].header == source.meshes[m].header && lod.meshes[m].trailer == source.meshes[m].trailer;
+            for (size_t b = 0; sameVertices && b < lod.meshes[m].vertexBuffers.size(); b++)
+                sameVertices = std::equal(lod.meshes[m].vertexBuffers[b].begin(), lod.meshes[m].vertexBuffers[b].end(), source.meshes[m].vertexBuffers[b].begin(),
+                    [](const CmoFile::Vertex& a, const CmoFile::Vertex& b) { return std::equal(a.position, a.position + 3, b.position) && std::equal(a.texcoord, a.texcoord + 2, b.texcoord); });
+        }
+        CHECK(sameVertices);
+    }
+    CHECK(previous == cooker.GetStats().trianglesOut);
+    CHECK(Platform::FileTime(LodCooker::LodPath(SCRATCH_MODEL, cooker.GetStats().levels + 1)) < 0);
+
+    // Up to date until forced
+    cooker.Cook({ SCRATCH_MODEL });
+    CHECK(cooker.GetStats().upToDate == 1 && cooker.GetStats().cooked == 0);
+    cooker.Cook({ SCRATCH_MODEL }, true);
+    CHECK(cooker.GetStats().cooked == 1);
+
+    RemoveModel(SCRATCH_MODEL);
+}
+
+TEST(LodCooker, HardEdgedModelKeepsNoLevels)
+{
+    // The placeholder as it is: every edge is hard, so no level would be worth drawing
+    CmoFile placeholder;
+    CHECK(placeholder.Read(Tests::SourcePath("database/data/placeholder.cmo")));
+    CHECK(placeholder.Write(SCRATCH_MODEL));
+
+    LodCooker cooker;
+    cooker.Cook({ SCRATCH_MODEL, "scenetests_missing.cmo" });
+    CHECK(cooker.GetStats().assets == 2);
+    CHECK(cooker.GetStats().cooked == 1 && cooker.GetStats().failed == 1);
+    CHECK(cooker.GetStats().levels == 0);
+    CHECK(cooker.GetStats().trianglesOut == placeholder.NumTriangles());
+    CHECK(Platform::FileTime(LodCooker::LodPath(SCRATCH_MODEL, 1)) < 0);
+
+    RemoveModel(SCRATCH_MODEL);
+}
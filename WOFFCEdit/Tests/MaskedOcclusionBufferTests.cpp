@@ -0,0 +1,311 @@
+#include "Tests.h"
+#include "MaskedOcclusionBuffer.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+    using Buffer = MaskedOcclusionBuffer;
+
+    constexpr double NEAR_PLANE = 0.1;
+    constexpr double FAR_PLANE = 1000.0;
+    constexpr double FOV_Y_DEG = 60.0;
+    constexpr float BLOCK_SPACING = 20.f;	//metres between building centres, leaving streets of at least 4 metres
+
+    struct Box
+    {
+        double min[3];
+        double max[3];
+    };
+
+    // Box buildings on a grid of city blocks, with random footprints and heights
+    std::vector<Box> MakeCity(size_t blocksPerSide, unsigned seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> halfWidth(4.f, 8.f);
+        std::uniform_real_distribution<float> height(5.f, 60.f);
+
+        std::vector<Box> buildings;
+        for (size_t z = 0; z < blocksPerSide; z++)
+        {
+            for (size_t x = 0; x < blocksPerSide; x++)
+            {
+                const double centreX = x * BLOCK_SPACING;
+                const double centreZ = z * BLOCK_SPACING;
+                const double halfX = halfWidth(random);
+                const double halfZ = halfWidth(random);
+                buildings.push_back({ { centreX - halfX, 0.0, centreZ - halfZ }, { centreX + halfX, double(height(random)), centreZ + halfZ } });
+            }
+        }
+        return buildings;
+    }
+
+    OccluderMesh UnitCube()
+    {
+        OccluderMesh cube;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            cube.positions.push_back((corner & 1) ? 0.5f : -0.5f);
+            cube.positions.push_back((corner & 2) ? 0.5f : -0.5f);
+            cube.positions.push_back((corner & 4) ? 0.5f : -0.5f);
+        }
+        cube.indices = { 0, 2, 3, 0, 3, 1,  4, 5, 7, 4, 7, 6,  0, 1, 5, 0, 5, 4,  2, 6, 7, 2, 7, 3,  0, 4, 6, 0, 6, 2,  1, 3, 7, 1, 7, 5 };
+        return cube;
+    }
+
+    // A camera as the editor's: left handed, looking along +Z at no yaw or pitch, D3D clip space
+    struct Camera
+    {
+        double eye[3];
+        double right[3];
+        double up[3];
+        double forward[3];
+        double xScale;
+        double yScale;
+        float viewProjection[16];
+
+        Camera(double x, double y, double z, double yawDeg, double pitchDeg)
+            : eye{ x, y, z }
+        {
+            const double yaw = yawDeg * 3.14159265358979 / 180.0;
+            const double pitch = pitchDeg * 3.14159265358979 / 180.0;
+            forward[0] = std::sin(yaw) * std::cos(pitch);
+            forward[1] = std::sin(pitch);
+            forward[2] = std::cos(yaw) * std::cos(pitch);
+            right[0] = std::cos(yaw);
+            right[1] = 0.0;
+            right[2] = -std::sin(yaw);
+            up[0] = (forward[1] * right[2]) - (forward[2] * right[1]);
+            up[1] = (forward[2] * right[0]) - (forward[0] * right[2]);
+            up[2] = (forward[0] * right[1]) - (forward[1] * right[0]);
+
+            yScale = 1.0 / std::tan(FOV_Y_DEG * 3.14159265358979 / 360.0);
+            xScale = yScale * Buffer::HEIGHT / Buffer::WIDTH;
+
+            // view * projection for row vectors, as XMMatrixLookToLH * XMMatrixPerspectiveFovLH
+            const double range = FAR_PLANE / (FAR_PLANE - NEAR_PLANE);
+            const double* axes[3] = { right, up, forward };
+            const double scales[3] = { xScale, yScale, range };
+            for (int row = 0; row < 3; row++)
+            {
+                for (int col = 0; col < 3; col++)
+                    viewProjection[(row * 4) + col] = float(axes[col][row] * scales[col]);
+                viewProjection[(row * 4) + 3] = float(forward[row]);
+            }
+            for (int col = 0; col < 3; col++)
+            {
+                const double viewPosition = -((axes[col][0] * x) + (axes[col][1] * y) + (axes[col][2] * z));
+                viewProjection[12 + col] = float((viewPosition * scales[col]) - (col == 2 ? NEAR_PLANE * range : 0.0));
+            }
+            viewProjection[15] = float(-((forward[0] * x) + (forward[1] * y) + (forward[2] * z)));
+        }
+
+        // Distance along the view direction of a point, and its pixel coordinates
+        double Project(const double* point, double& pixelX, double& pixelY) const
+        {
+            const double d[3] = { point[0] - eye[0], point[1] - eye[1], point[2] - eye[2] };
+            const double w = (d[0] * forward[0]) + (d[1] * forward[1]) + (d[2] * forward[2]);
+            const double u = ((d[0] * right[0]) + (d[1] * right[1]) + (d[2] * right[2])) * xScale / w;
+            const double v = ((d[0] * up[0]) + (d[1] * up[1]) + (d[2] * up[2])) * yScale / w;
+            pixelX = ((u * 0.5) + 0.5) * Buffer::WIDTH;
+            pixelY = (0.5 - (v * 0.5)) * Buffer::HEIGHT;
+            return w;
+        }
+    };
+
+    // The depth buffer worked out the slow way: a ray through every pixel centre, in doubles, against every
+    // building. 1 / w of the nearest hit in front of the near plane, 0 where the ray hits nothing.
+    std::vector<double> ReferenceDepth(const Camera& camera, const std::vector<Box>& buildings)
+    {
+        std::vector<double> depth(Buffer::WIDTH * Buffer::HEIGHT, 0.0);
+        for (int y = 0; y < Buffer::HEIGHT; y++)
+        {
+            for (int x = 0; x < Buffer::WIDTH; x++)
+            {
+                // Scaled so the distance along the ray is the view depth
+                const double u = (((x + 0.5) / Buffer::WIDTH) * 2.0) - 1.0;
+                const double v = 1.0 - (((y + 0.5) / Buffer::HEIGHT) * 2.0);
+                double ray[3];
+                for (int i = 0; i < 3; i++)
+                    ray[i] = camera.forward[i] + (camera.right[i] * u / camera.xScale) + (camera.up[i] * v / camera.yScale);
+
+                double nearest = FAR_PLANE;
+                for (const Box& box : buildings)
+                {
+                    double enter = NEAR_PLANE;
+                    double exit = nearest;
+                    for (int i = 0; i < 3 && enter <= exit; i++)
+                    {
+                        if (ray[i] == 0.0)
+                        {
+                            if (camera.eye[i] < box.min[i] || camera.eye[i] > box.max[i])
+                                exit = -1.0;
+                            continue;
+                        }
+                        const double t0 = (box.min[i] - camera.eye[i]) / ray[i];
+                        const double t1 = (box.max[i] - camera.eye[i]) / ray[i];
+                        enter = std::max(enter, std::min(t0, t1));
+                        exit = std::min(exit, std::max(t0, t1));
+                    }
+                    if (enter <= exit)
+                        nearest = enter;
+                }
+                if (nearest < FAR_PLANE)
+                    depth[(y * Buffer::WIDTH) + x] = 1.0 / nearest;
+            }
+        }
+        return depth;
+    }
+
+    std::vector<OccluderInstance> MakeOccluders(const OccluderMesh& cube, const std::vector<Box>& buildings)
+    {
+        std::vector<OccluderInstance> occluders(buildings.size());
+        for (size_t b = 0; b < buildings.size(); b++)
+        {
+            float* world = occluders[b].world;
+            std::fill(world, world + 16, 0.f);
+            for (int i = 0; i < 3; i++)
+            {
+                world[(i * 4) + i] = float(buildings[b].max[i] - buildings[b].min[i]);
+                world[12 + i] = float((buildings[b].min[i] + buildings[b].max[i]) * 0.5);
+            }
+            world[15] = 1.f;
+            occluders[b].mesh = &cube;
+        }
+        return occluders;
+    }
+
+    // Views along a street, across the blocks, and from above looking down into the city
+    std::vector<Camera> CityViews(size_t blocksPerSide)
+    {
+        const double streetX = BLOCK_SPACING * 0.5;
+        const double middle = BLOCK_SPACING * (blocksPerSide - 1) * 0.5;
+        return {
+            Camera(streetX, 1.7, -5.0, 0.0, 0.0),
+            Camera(streetX, 1.7, middle + (BLOCK_SPACING * 0.5), 35.0, 5.0),
+            Camera(-30.0, 20.0, -30.0, 45.0, -10.0),
+            Camera(middle, 150.0, -40.0, 0.0, -50.0),
+        };
+    }
+}
+
+TEST(MaskedOcclusionBuffer, EmptyBufferHidesNothing)
+{
+    const Camera camera(0.0, 2.0, -10.0, 0.0, 0.0);
+    Buffer buffer;
+    buffer.Render(nullptr, 0, camera.viewProjection);
+
+    const float boxMin[3] = { -1.f, 0.f, 20.f };
+    const float boxMax[3] = { 1.f, 2.f, 22.f };
+    CHECK(buffer.IsVisible(boxMin, boxMax));
+    CHECK(buffer.GetPixelDepth(Buffer::WIDTH / 2, Buffer::HEIGHT / 2) == 0.f);
+}
+
+TEST(MaskedOcclusionBuffer, NeverNearerThanReference)
+{
+    const OccluderMesh cube = UnitCube();
+    Buffer buffer;
+
+    for (unsigned seed = 1; seed <= 3; seed++)
+    {
+        const size_t blocksPerSide = 4 * seed;
+        const std::vector<Box> buildings = MakeCity(blocksPerSide, seed);
+        const std::vector<OccluderInstance> occluders = MakeOccluders(cube, buildings);
+
+        for (const Camera& camera : CityViews(blocksPerSide))
+        {
+            buffer.Render(occluders.data(), occluders.size(), camera.viewProjection);
+            CHECK(buffer.GetStats().occluders == buildings.size());
+            CHECK(buffer.GetStats().triangles == buildings.size() * 12);
+
+            // Every stored depth is at or behind the true surface, and most of what the reference covers is covered
+            const std::vector<double> reference = ReferenceDepth(camera, buildings);
+            size_t nearer = 0;
+            size_t covered = 0;
+            size_t referenceCovered = 0;
+            for (int y = 0; y < Buffer::HEIGHT; y++)
+            {
+                for (int x = 0; x < Buffer::WIDTH; x++)
+                {
+                    const double expected = reference[(y * Buffer::WIDTH) + x];
+                    const double depth = buffer.GetPixelDepth(x, y);
+                    nearer += depth > expected * (1.0 + 1e-6);
+                    covered += depth > 0.0;
+                    referenceCovered += expected > 0.0;
+                }
+            }
+            CHECK(nearer == 0);
+            CHECK(covered >= referenceCovered * 9 / 10);
+        }
+    }
+}
+
+TEST(MaskedOcclusionBuffer, CullsOnlyHiddenBoxes)
+{
+    const OccluderMesh cube = UnitCube();
+    const size_t blocksPerSide = 8;
+    const std::vector<Box> buildings = MakeCity(blocksPerSide, 7);
+    const std::vector<OccluderInstance> occluders = MakeOccluders(cube, buildings);
+
+    // Small boxes scattered over the city, in the streets and inside buildings alike
+    std::mt19937 random(11);
+    std::uniform_real_distribution<double> position(-BLOCK_SPACING, BLOCK_SPACING * blocksPerSide);
+    std::uniform_real_distribution<double> size(0.5, 4.0);
+    std::vector<Box> boxes(2000);
+    for (Box& box : boxes)
+    {
+        box.min[0] = position(random);
+        box.min[1] = size(random) - 0.5;
+        box.min[2] = position(random);
+        for (int i = 0; i < 3; i++)
+            box.max[i] = box.min[i] + size(random);
+    }
+
+    Buffer buffer;
+    size_t culled = 0;
+    size_t wronglyCulled = 0;
+    for (const Camera& camera : CityViews(blocksPerSide))
+    {
+        buffer.Render(occluders.data(), occluders.size(), camera.viewProjection);
+        const std::vector<double> reference = ReferenceDepth(camera, buildings);
+
+        for (const Box& box : boxes)
+        {
+            const float boxMin[3] = { float(box.min[0]), float(box.min[1]), float(box.min[2]) };
+            const float boxMax[3] = { float(box.max[0]), float(box.max[1]), float(box.max[2]) };
+            if (buffer.IsVisible(boxMin, boxMax))
+                continue;
+            culled++;
+
+            // Hidden means every pixel centre the box's screen rectangle touches has an occluder nearer than its nearest corner
+            double minX = 1e30, minY = 1e30, maxX = -1e30, maxY = -1e30;
+            double nearestDepth = 0.0;
+            bool inFront = true;
+            for (int corner = 0; corner < 8; corner++)
+            {
+                const double point[3] = { (corner & 1) ? box.max[0] : box.min[0], (corner & 2) ? box.max[1] : box.min[1], (corner & 4) ? box.max[2] : box.min[2] };
+                double pixelX, pixelY;
+                const double w = camera.Project(point, pixelX, pixelY);
+                inFront = inFront && w > NEAR_PLANE;
+                minX = std::min(minX, pixelX);
+                maxX = std::max(maxX, pixelX);
+                minY = std::min(minY, pixelY);
+                maxY = std::max(maxY, pixelY);
+                nearestDepth = std::max(nearestDepth, 1.0 / w);
+            }
+
+            bool hidden = inFront && maxX > 0.0 && maxY > 0.0 && minX < Buffer::WIDTH && minY < Buffer::HEIGHT;
+            for (int y = std::max(int(std::floor(minY)), 0); hidden && y <= std::min(int(std::ceil(maxY)) - 1, Buffer::HEIGHT - 1); y++)
+            {
+                for (int x = std::max(int(std::floor(minX)), 0); hidden && x <= std::min(int(std::ceil(maxX)) - 1, Buffer::WIDTH - 1); x++)
+                    hidden = reference[(y * Buffer::WIDTH) + x] > nearestDepth;
+            }
+            wronglyCulled += !hidden;
+        }
+    }
+
+    CHECK(wronglyCulled == 0);
+    CHECK(culled > boxes.size());		//of four views' worth, a city hides plenty
+}
@@ -0,0 +1,313 @@
+#include "Tests.h"
+#include "MeshSimplifier.h"
+#include "CmoFile.h"
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <vector>
+
+namespace
+{
+    struct Mesh
+    {
+        std::vector<float>		positions;		//xyz
+        std::vector<float>		attributes;		//normal and texcoord
+        std::vector<uint32_t>	indices;
+    };
+
+    // A 'size' x 'size' vertex grid over [0, 1]² in X/Z, raised by 'height'. With 'seam', the column at
+    // X = 0.5 is split in two: the left half of the grid uses one copy, the right half the other, and the
+    // right half's texture coordinates are offset, so they don't meet the left half's.
+    template<class Height>
+    Mesh Heightfield(size_t size, bool seam, const Height& height)
+    {
+        Mesh mesh;
+        const size_t seamColumn = size / 2;
+        std::vector<uint32_t> right(size * size);
+        for (size_t z = 0; z < size; z++)
+        {
+            for (size_t x = 0; x < size; x++)
+            {
+                const float fx = float(x) / (size - 1);
+                const float fz = float(z) / (size - 1);
+                const size_t copies = seam && x == seamColumn ? 2 : 1;
+                for (size_t copy = 0; copy < copies; copy++)
+                {
+                    right[(z * size) + x] = uint32_t(mesh.positions.size() / 3);
+                    mesh.positions.insert(mesh.positions.end(), { fx, height(fx, fz), fz });
+                    const bool rightHalf = seam && (x > seamColumn || copy == 1);
+                    mesh.attributes.insert(mesh.attributes.end(), { 0.f, 1.f, 0.f, fx + (rightHalf ? 0.5f : 0.f), fz });
+                }
+            }
+        }
+
+        // The vertex of a grid point used by the quad to its right, or left of the seam column
+        std::vector<uint32_t> left = right;
+        for (size_t z = 0; z < size && seam; z++)
+            left[(z * size) + seamColumn]--;
+
+        for (size_t z = 0; z + 1 < size; z++)
+        {
+            for (size_t x = 0; x + 1 < size; x++)
+            {
+                const std::vector<uint32_t>& side = x < seamColumn ? left : right;
+                const uint32_t v0 = side[(z * size) + x], v1 = side[(z * size) + x + 1];
+                const uint32_t v2 = side[((z + 1) * size) + x + 1], v3 = side[((z + 1) * size) + x];
+                mesh.indices.insert(mesh.indices.end(), { v0, v2, v1, v0, v3, v2 });
+            }
+        }
+        return mesh;
+    }
+
+    float Bumps(float x, float z)
+    {
+        return 0.05f * std::sin(x * 6.2831853f) * std::cos(z * 6.2831853f);
+    }
+
+    MeshSimplifier::Input MakeInput(const Mesh& mesh)
+    {
+        MeshSimplifier::Input input;
+        input.indices = mesh.indices.data();
+        input.indexCount = mesh.indices.size();
+        input.positions = mesh.positions.data();
+        input.vertexCount = mesh.positions.size() / 3;
+        input.attributes = mesh.attributes.data();
+        input.attributeCount = 5;
+        return input;
+    }
+
+    // Y of the triangle's normal, positive for a triangle facing up as the heightfields do
+    float FacingUp(const float* positions, size_t stride, const uint32_t* triangle)
+    {
+        const auto P = [&](int c) { return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + (triangle[c] * stride)); };
+        const float* a = P(0);
+        const float* b = P(1);
+        const float* c = P(2);
+        return ((c[0] - a[0]) * (b[2] - a[2])) - ((c[2] - a[2]) * (b[0] - a[0]));
+    }
+
+    bool Degenerate(const uint32_t* triangle)
+    {
+        return triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2];
+    }
+
+    // Whether every triangle of 'simplified' turns the same way about the middle of the placeholder's box, or
+    // of the sphere above it, as those of 'original' do, and none are degenerate
+    bool Unturned(const std::vector<CmoFile::Vertex>& vertices, const std::vector<uint32_t>& original, const std::vector<uint32_t>& simplified)
+    {
+        const auto Facing = [&](const uint32_t* triangle)
+        {
+            const float* p[3] = { vertices[triangle[0]].position, vertices[triangle[1]].position, vertices[triangle[2]].position };
+            const float centroid[3] = { (p[0][0] + p[1][0] + p[2][0]) / 3.f, (p[0][1] + p[1][1] + p[2][1]) / 3.f, (p[0][2] + p[1][2] + p[2][2]) / 3.f };
+            const float middleY = centroid[1] > 0.6f ? 1.f : 0.f;
+            const float e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+            const float e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+            const float normal[3] = { (e1[1] * e2[2]) - (e1[2] * e2[1]), (e1[2] * e2[0]) - (e1[0] * e2[2]), (e1[0] * e2[1]) - (e1[1] * e2[0]) };
+            const float facing = (normal[0] * centroid[0]) + (normal[1] * (centroid[1] - middleY)) + (normal[2] * centroid[2]);
+            return facing > 0.f ? 1 : (facing < 0.f ? -1 : 0);
+        };
+
+        const int way = Facing(original.data());
+        bool unturned = way != 0;
+        for (size_t t = 0; t < original.size(); t += 3)
+            unturned = unturned && Facing(&original[t]) == way;
+        for (size_t t = 0; t < simplified.size(); t += 3)
+            unturned = unturned && Facing(&simplified[t]) == way && !Degenerate(&simplified[t]);
+        return unturned;
+    }
+
+    // Height of the simplified surface above (x, z), found by brute force, NAN if no triangle covers it
+    float SurfaceHeight(const Mesh& mesh, const std::vector<uint32_t>& indices, float x, float z)
+    {
+        for (size_t t = 0; t < indices.size(); t += 3)
+        {
+            const float* a = &mesh.positions[indices[t] * 3];
+            const float* b = &mesh.positions[indices[t + 1] * 3];
+            const float* c = &mesh.positions[indices[t + 2] * 3];
+            const float area = ((b[0] - a[0]) * (c[2] - a[2])) - ((c[0] - a[0]) * (b[2] - a[2]));
+            if (area == 0.f)
+                continue;
+
+            const float wb = (((x - a[0]) * (c[2] - a[2])) - ((c[0] - a[0]) * (z - a[2]))) / area;
+            const float wc = (((b[0] - a[0]) * (z - a[2])) - ((x - a[0]) * (b[2] - a[2]))) / area;
+            const float wa = 1.f - wb - wc;
+            const float tolerance = -1e-5f;
+            if (wa >= tolerance && wb >= tolerance && wc >= tolerance)
+                return (wa * a[1]) + (wb * b[1]) + (wc * c[1]);
+        }
+        return NAN;
+    }
+}
+
+TEST(MeshSimplifier, NoFlipsOrDegenerates)
+{
+    // Bumpy enough that careless collapses fold triangles over
+    const Mesh mesh = Heightfield(65, false, [](float x, float z) { return Bumps(x, z) * 4.f; });
+    MeshSimplifier simplifier;
+    std::vector<uint32_t> result;
+
+    const size_t targets[] = { mesh.indices.size() / 2, mesh.indices.size() / 8, 3 };
+    for (size_t target : targets)
+    {
+        simplifier.Simplify(MakeInput(mesh), target, 1.f, result);
+        CHECK(!result.empty() && result.size() % 3 == 0);
+        CHECK(result.size() < mesh.indices.size());
+
+        size_t flipped = 0, degenerate = 0;
+        for (size_t t = 0; t < result.size(); t += 3)
+        {
+            flipped += FacingUp(mesh.positions.data(), sizeof(float) * 3, &result[t]) <= 0.f;
+            degenerate += Degenerate(&result[t]);
+        }
+        CHECK(flipped == 0);
+        CHECK(degenerate == 0);
+        CHECK(simplifier.GetStats().trianglesOut == result.size() / 3);
+    }
+}
+
+TEST(MeshSimplifier, KeepsTextureSeam)
+{
+    const size_t size = 33;
+    const Mesh mesh = Heightfield(size, true, Bumps);
+    MeshSimplifier simplifier;
+    std::vector<uint32_t> result;
+    simplifier.Simplify(MakeInput(mesh), mesh.indices.size() / 8, 1.f, result);
+    CHECK(result.size() <= mesh.indices.size() / 4);
+
+    // Each triangle stays on its side of the seam, by position and by which copy of the seam it uses,
+    // and both sides still meet at the same seam vertices
+    std::set<float> leftSeam, rightSeam;
+    size_t crossing = 0;
+    for (size_t t = 0; t < result.size(); t += 3)
+    {
+        bool left = false, right = false;
+        for (size_t c = 0; c < 3; c++)
+        {
+            const float* attributes = &mesh.attributes[result[t + c] * 5];
+            const float x = mesh.positions[result[t + c] * 3];
+            const bool rightHalf = attributes[3] > x + 0.25f;
+            left = left || x < 0.5f || !rightHalf;
+            right = right || x > 0.5f || rightHalf;
+        }
+        crossing += left && right;
+
+        for (size_t c = 0; c < 3; c++)
+        {
+            if (mesh.positions[result[t + c] * 3] == 0.5f)
+                (left ? leftSeam : rightSeam).insert(mesh.positions[(result[t + c] * 3) + 2]);
+        }
+    }
+    CHECK(crossing == 0);
+    CHECK(leftSeam == rightSeam);
+    CHECK(leftSeam.count(0.f) == 1 && leftSeam.count(1.f) == 1);
+}
+
+TEST(MeshSimplifier, SurfaceErrorWithinBound)
+{
+    // The error bound is on the area weighted mean of the squared distances to the original planes, so the
+    // simplified surface stays that close on average, and single points only a few times further
+    const Mesh mesh = Heightfield(33, false, Bumps);
+    const float maxError = 0.005f;
+    MeshSimplifier simplifier;
+    std::vector<uint32_t> result;
+    simplifier.Simplify(MakeInput(mesh), 3, maxError, result);
+
+    CHECK(result.size() < mesh.indices.size() / 8);
+    CHECK(simplifier.GetStats().error <= maxError);
+
+    float boundsMin[3] = { 0.f, 0.f, 0.f }, boundsMax[3] = { 0.f, 0.f, 0.f };
+    for (size_t v = 0; v < mesh.positions.size(); v++)
+    {
+        boundsMin[v % 3] = std::min(boundsMin[v % 3], mesh.positions[v]);
+        boundsMax[v % 3] = std::max(boundsMax[v % 3], mesh.positions[v]);
+    }
+    const float distance = maxError * std::sqrt(std::pow(boundsMax[0] - boundsMin[0], 2.f) + std::pow(boundsMax[1] - boundsMin[1], 2.f) + std::pow(boundsMax[2] - boundsMin[2], 2.f));
+
+    float worst = 0.f;
+    double squares = 0.0;
+    size_t uncovered = 0;
+    for (size_t v = 0; v < mesh.positions.size(); v += 3)
+    {
+        const float height = SurfaceHeight(mesh, result, mesh.positions[v], mesh.positions[v + 2]);
+        if (std::isnan(height))
+        {
+            uncovered++;
+            continue;
+        }
+        const float error = std::fabs(height - mesh.positions[v + 1]);
+        worst = std::max(worst, error);
+        squares += double(error) * error;
+    }
+    CHECK(uncovered == 0);
+    CHECK(std::sqrt(squares / (mesh.positions.size() / 3)) <= distance);
+    CHECK(worst <= distance * 4.f);
+}
+
+TEST(MeshSimplifier, PlaceholderModel)
+{
+    // A box and a faceted sphere: every edge is a hard edge between split normals, so as it is nothing may
+    // collapse, and welded into one smooth surface it simplifies without turning any face over
+    CmoFile model;
+    CHECK(model.Read(Tests::SourcePath("database/data/placeholder.cmo")));
+    CHECK(model.meshes.size() == 1 && model.meshes[0].subMeshes.size() == 1);
+    if (model.meshes.size() != 1 || model.meshes[0].subMeshes.size() != 1)
+        return;
+
+    const CmoFile::Mesh& mesh = model.meshes[0];
+    const CmoFile::SubMesh& subMesh = mesh.subMeshes[0];
+    const std::vector<CmoFile::Vertex>& vertices = mesh.vertexBuffers[subMesh.vertexBuffer];
+    const std::vector<uint16_t>& source = mesh.indexBuffers[subMesh.indexBuffer];
+    std::vector<uint32_t> indices(source.begin() + subMesh.startIndex, source.begin() + subMesh.startIndex + (subMesh.primCount * 3));
+
+    std::vector<float> attributes;
+    for (const CmoFile::Vertex& vertex : vertices)
+    {
+        attributes.insert(attributes.end(), vertex.normal, vertex.normal + 3);
+        attributes.insert(attributes.end(), vertex.texcoord, vertex.texcoord + 2);
+    }
+
+    MeshSimplifier::Input input;
+    input.indices = indices.data();
+    input.indexCount = indices.size();
+    input.positions = vertices[0].position;
+    input.positionStride = sizeof(CmoFile::Vertex);
+    input.vertexCount = vertices.size();
+    input.attributes = attributes.data();
+    input.attributeCount = 5;
+
+    MeshSimplifier simplifier;
+    std::vector<uint32_t> result;
+    simplifier.Simplify(input, indices.size() / 2, 0.05f, result);
+    CHECK(result == indices);
+
+    for (uint32_t& index : indices)
+    {
+        for (uint32_t first = 0; first < index; first++)
+        {
+            if (std::equal(vertices[first].position, vertices[first].position + 3, vertices[index].position))
+            {
+                index = first;
+                break;
+            }
+        }
+    }
+    input.attributes = nullptr;
+    input.attributeCount = 0;
+    simplifier.Simplify(input, indices.size() / 2, 0.05f, result);
+    CHECK(result.size() <= (indices.size() * 3) / 4);
+    CHECK(simplifier.GetStats().error <= 0.05f);
+
+    CHECK(Unturned(vertices, indices, result));
+}
+
+TEST(MeshSimplifier, LargeGridTiming)
+{
+    // 130k triangles down to an eighth, far inside what cooking a model at startup can afford
+    const Mesh mesh = Heightfield(257, false, Bumps);
+    MeshSimplifier simplifier;
+    std::vector<uint32_t> result;
+    simplifier.Simplify(MakeInput(mesh), mesh.indices.size() / 8, 1.f, result);
+
+    CHECK(result.size() <= mesh.indices.size() / 8);
+    CHECK(simplifier.GetStats().milliseconds < 2000.0);
+}
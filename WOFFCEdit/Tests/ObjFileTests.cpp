@@ -0,0 +1,142 @@
+#include "Tests.h"
+#include "ObjFile.h"
+#include "Platform.h"
+#include <cmath>
+#include <cstring>
+#include <string>
+
+namespace
+{
+    const char* SCRATCH_OBJ = "scenetests_mesh.obj";
+
+    bool SameCorner(const ObjMesh::Corner& corner, int32_t position, int32_t texcoord, int32_t normal)
+    {
+        return corner.position == position && corner.texcoord == texcoord && corner.normal == normal;
+    }
+}
+
+TEST(ObjFile, WriteAndReadRoundTrip)
+{
+    // Two objects, each indexing its own vertices from 0, and floats the fixed point formatting has to round
+    const size_t numVertices = 5000;		//enough to flush the buffer a few times
+    {
+        ObjWriter writer;
+        CHECK(writer.Open(SCRATCH_OBJ));
+        writer.Comment("round trip");
+        for (int object = 0; object < 2; object++)
+        {
+            writer.BeginObject(object == 0 ? "first" : "second");
+            for (size_t v = 0; v < numVertices; v++)
+            {
+                const float f = float(v) + (object * 0.25f);
+                writer.Position(f * 0.001f, -f * 1.75f, 123456.789f);
+                writer.TexCoord(f / numVertices, 1.f - (f / numVertices));
+                writer.Normal(0.f, -1.f, 1e-7f);
+            }
+            for (uint32_t v = 0; v + 2 < numVertices; v += 3)
+                writer.Triangle(v, v + 1, v + 2);
+        }
+        CHECK(writer.Close());
+        CHECK(writer.GetStats().bytes > ObjWriter::BUFFER_SIZE);
+    }
+
+    ObjMesh mesh;
+    ObjIoStats stats;
+    CHECK(ObjReader::Read(SCRATCH_OBJ, mesh, &stats));
+    CHECK(mesh.positions.size() == numVertices * 2 * 3);
+    CHECK(mesh.texcoords.size() == numVertices * 2 * 2);
+    CHECK(mesh.normals.size() == numVertices * 2 * 3);
+    CHECK(mesh.corners.size() == (numVertices / 3) * 2 * 3);
+
+    float worst = 0.f;
+    for (size_t v = 0; v < numVertices * 2 && mesh.positions.size() == numVertices * 2 * 3; v++)
+    {
+        const float f = float(v % numVertices) + ((v / numVertices) * 0.25f);
+        worst = std::max(worst, std::fabs(mesh.positions[v * 3] - (f * 0.001f)));
+        worst = std::max(worst, std::fabs(mesh.positions[(v * 3) + 1] - (-f * 1.75f)) / std::max(1.f, f * 1.75f));
+        worst = std::max(worst, std::fabs(mesh.texcoords[v * 2] - (f / numVertices)));
+    }
+    CHECK(worst < 1e-6f);
+
+    // The second object's faces land on its own vertices
+    const size_t secondFaces = (numVertices / 3) * 3;
+    CHECK(mesh.corners.size() > secondFaces && SameCorner(mesh.corners[secondFaces], int32_t(numVertices), int32_t(numVertices), int32_t(numVertices)));
+    CHECK(SameCorner(mesh.corners.back(), int32_t((numVertices * 2) - 3), int32_t((numVertices * 2) - 3), int32_t((numVertices * 2) - 3)));
+
+    Platform::RemoveFile(SCRATCH_OBJ);
+}
+
+TEST(ObjFile, ParsesFaceForms)
+{
+    const char* obj =
+        "# comment\n"
+        "mtllib ignored.mtl\n"
+        "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+        "vt 0 0\nvt 1 1\n"
+        "vn 0 0 1\n"
+        "f 1 2 3\n"
+        "f 1/1 2/2 3/1\n"
+        "f 1//1 3//1 4//1\n"
+        "f -4/-2/-1 -3/-1/-1 -2/-2/-1 -1/-1/-1\n"		//a relative quad, fanned into two triangles
+        "s off\n"
+        "f 1 2 3";										//no line break at the end
+
+    ObjMesh mesh;
+    ObjReader::Parse(obj, strlen(obj), mesh);
+    CHECK(mesh.positions.size() == 12 && mesh.texcoords.size() == 4 && mesh.normals.size() == 3);
+    CHECK(mesh.corners.size() == 6 * 3);
+    if (mesh.corners.size() == 6 * 3)
+    {
+        CHECK(SameCorner(mesh.corners[0], 0, -1, -1));
+        CHECK(SameCorner(mesh.corners[4], 1, 1, -1));
+        CHECK(SameCorner(mesh.corners[8], 3, -1, 0));
+        CHECK(SameCorner(mesh.corners[9], 0, 0, 0) && SameCorner(mesh.corners[10], 1, 1, 0) && SameCorner(mesh.corners[11], 2, 0, 0));
+        CHECK(SameCorner(mesh.corners[12], 0, 0, 0) && SameCorner(mesh.corners[13], 2, 0, 0) && SameCorner(mesh.corners[14], 3, 1, 0));
+        CHECK(SameCorner(mesh.corners[17], 2, -1, -1));
+    }
+}
+
+TEST(ObjFile, BlocksMatchOneBlock)
+{
+    // Relative indices that reach back across block boundaries have to be resolved the same as in one pass
+    std::string obj;
+    for (int i = 0; i < 3000; i++)
+    {
+        obj += "v " + std::to_string(i) + " " + std::to_string(i * 2) + " 0.5\n";
+        obj += "vt 0." + std::to_string(i % 10) + " 0\n";
+        if (i >= 2)
+            obj += (i % 2) ? "f -3/-3 -2/-2 -1/-1\n" : "f " + std::to_string(i - 1) + " " + std::to_string(i) + " " + std::to_string(i + 1) + "\n";
+    }
+
+    ObjMesh whole, blocks;
+    ObjReader::Parse(obj.data(), obj.size(), whole, obj.size());
+    ObjReader::Parse(obj.data(), obj.size(), blocks, 100);
+
+    CHECK(whole.positions == blocks.positions && whole.texcoords == blocks.texcoords);
+    CHECK(whole.corners.size() == blocks.corners.size());
+    bool same = whole.corners.size() == blocks.corners.size();
+    for (size_t i = 0; same && i < whole.corners.size(); i++)
+        same = SameCorner(blocks.corners[i], whole.corners[i].position, whole.corners[i].texcoord, whole.corners[i].normal);
+    CHECK(same);
+    CHECK(whole.corners.size() == 2998 * 3 && whole.corners.back().position == 2999);
+}
+
+TEST(ObjFile, UnopenedWriterFails)
+{
+    // More than a buffer's worth with nowhere to flush it to
+    ObjWriter writer;
+    for (uint32_t i = 0; i < 10000; i++)
+    {
+        writer.Position(1.f, 2.f, 3.f);
+        writer.Triangle(i, i, i);
+    }
+    CHECK(!writer.Close());
+
+    ObjWriter failedOpen;
+    CHECK(!failedOpen.Open("scenetests_missing/mesh.obj"));
+    failedOpen.Comment("lost");
+    CHECK(!failedOpen.Close());
+
+    ObjMesh mesh;
+    CHECK(!ObjReader::Read("scenetests_missing/mesh.obj", mesh));
+}
@@ -0,0 +1,114 @@
+#include "Tests.h"
+#include "SceneDatabase.h"
+#include "Platform.h"
+
+namespace
+{
+    const char* SCRATCH_DATABASE = "scenetests_database.db";
+
+    SceneObject MakeObject(int id)
+    {
+        SceneObject object;
+        object.ID = id;
+        object.model_path = "database/data/placeholder.cmo";
+        object.tex_diffuse_path = "database/data/placeholder.dds";
+        object.posX = id * 1.5f;
+        object.posY = -2.25f;
+        object.rotY = 90.f;
+        object.scaX = object.scaY = object.scaZ = 2.f;
+        object.parent_id = id / 2;
+        object.pan = -0.5f;
+        object.name = "O'Brien's \"object\" " + std::to_string(id);		//quotes that a built up statement would trip on
+        return object;
+    }
+}
+
+TEST(SceneDatabase, LoadsTestDatabase)
+{
+    SceneDatabase database;
+    std::vector<SceneObject> objects;
+    ChunkObject chunk;
+    CHECK(database.Open(Tests::SourcePath("database/test.db")));
+    CHECK(database.LoadObjects(objects));
+    CHECK(database.LoadChunk(chunk));
+    CHECK(objects.size() == 15);
+    CHECK(chunk.heightmap_path == "database/data/heightmap.raw");
+}
+
+TEST(SceneDatabase, SaveAndLoadRoundTrip)
+{
+    Platform::RemoveFile(SCRATCH_DATABASE);
+
+    std::vector<SceneObject> saved;
+    for (int id = 1; id <= 100; id++)
+        saved.push_back(MakeObject(id));
+
+    ChunkObject chunk = {};
+    chunk.name = "Chunk";
+    chunk.heightmap_path = "database/data/heightmap.raw";
+    chunk.chunk_base_resolution = 128;
+    chunk.tex_diffuse_tiling = 16;
+
+    {
+        SceneDatabase database;
+        CHECK(database.Open(SCRATCH_DATABASE, true));
+        CHECK(database.SaveChunk(chunk));
+        CHECK(database.SaveObjects(saved));
+        CHECK(database.GetStats().objects == saved.size());
+    }
+
+    SceneDatabase database;
+    std::vector<SceneObject> loaded;
+    ChunkObject loadedChunk;
+    CHECK(database.Open(SCRATCH_DATABASE));
+    CHECK(database.LoadObjects(loaded));
+    CHECK(database.LoadChunk(loadedChunk));
+    CHECK(loaded.size() == saved.size());
+    for (size_t i = 0; i < loaded.size() && i < saved.size(); i++)
+    {
+        CHECK(loaded[i].ID == saved[i].ID);
+        CHECK(loaded[i].name == saved[i].name);
+        CHECK(loaded[i].model_path == saved[i].model_path);
+        CHECK(loaded[i].posX == saved[i].posX && loaded[i].posY == saved[i].posY);
+        CHECK(loaded[i].scaZ == saved[i].scaZ && loaded[i].pan == saved[i].pan);
+        CHECK(loaded[i].parent_id == saved[i].parent_id);
+    }
+    CHECK(loadedChunk.heightmap_path == chunk.heightmap_path);
+    CHECK(loadedChunk.tex_diffuse_tiling == chunk.tex_diffuse_tiling);
+
+    database.Close();
+    Platform::RemoveFile(SCRATCH_DATABASE);
+}
+
+TEST(SceneDatabase, AbandonedSaveKeepsRows)
+{
+    Platform::RemoveFile(SCRATCH_DATABASE);
+
+    SceneDatabase database;
+    CHECK(database.Open(SCRATCH_DATABASE, true));
+    CHECK(database.SaveObjects({ MakeObject(1), MakeObject(2) }));
+
+    // Ended without committing, and left open when the database closes
+    CHECK(database.BeginSaveObjects());
+    CHECK(database.SaveObject(MakeObject(3)));
+    CHECK(!database.EndSaveObjects(false));
+
+    CHECK(database.BeginSaveObjects());
+    CHECK(database.SaveObject(MakeObject(4)));
+    database.Close();
+
+    std::vector<SceneObject> loaded;
+    CHECK(database.Open(SCRATCH_DATABASE));
+    CHECK(database.LoadObjects(loaded));
+    CHECK(loaded.size() == 2);
+
+    database.Close();
+    Platform::RemoveFile(SCRATCH_DATABASE);
+}
+
+TEST(SceneDatabase, MissingDatabaseFails)
+{
+    SceneDatabase database;
+    CHECK(!database.Open("scenetests_missing/none.db"));
+    CHECK(!database.IsOpen());
+}
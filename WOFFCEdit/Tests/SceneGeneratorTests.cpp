@@ -0,0 +1,55 @@
+#include "Tests.h"
+#include "SceneGenerator.h"
+#include "SceneDatabase.h"
+#include "Platform.h"
+#include <vector>
+
+namespace
+{
+    const char* SCRATCH_DATABASE = "scenetests_generated.db";
+
+    SceneGenerator::Settings SmallScene()
+    {
+        SceneGenerator::Settings settings;
+        settings.objects = 500;
+        settings.assets = 1;		//the source files themselves, nothing copied
+        settings.sourceModel = Tests::SourcePath("database/data/placeholder.cmo");
+        settings.sourceTexture = Tests::SourcePath("database/data/placeholder.dds");
+        settings.assetDirectory = ".";
+        return settings;
+    }
+}
+
+TEST(SceneGenerator, WritesLoadableDatabase)
+{
+    SceneGenerator generator(SmallScene());
+    CHECK(generator.Write(SCRATCH_DATABASE));
+    CHECK(generator.GetError().empty());
+
+    SceneDatabase database;
+    std::vector<SceneObject> objects;
+    ChunkObject chunk;
+    CHECK(database.Open(SCRATCH_DATABASE));
+    CHECK(database.LoadObjects(objects) && objects.size() == 500);
+    CHECK(database.LoadChunk(chunk) && chunk.heightmap_path == "./heightmap.raw");
+    database.Close();
+
+    // Writing again replaces the scene rather than adding to it
+    CHECK(generator.Write(SCRATCH_DATABASE));
+    CHECK(database.Open(SCRATCH_DATABASE) && database.LoadObjects(objects) && objects.size() == 500);
+    database.Close();
+
+    Platform::RemoveFile(SCRATCH_DATABASE);
+    Platform::RemoveFile("heightmap.raw");
+}
+
+TEST(SceneGenerator, FailedWriteLeavesNoFile)
+{
+    SceneGenerator generator(SmallScene());
+    const std::string path = "scenetests_missing/scene.db";
+    CHECK(!generator.Write(path));
+    CHECK(!generator.GetError().empty());
+    CHECK(Platform::FileTime(path) < 0);
+
+    Platform::RemoveFile("heightmap.raw");
+}
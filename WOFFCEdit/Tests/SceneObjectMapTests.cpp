@@ -0,0 +1,171 @@
+#include "Tests.h"
+#include "SceneObjectMap.h"
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    SceneObject MakeObject(int id)
+    {
+        SceneObject object;
+        object.ID = id;
+        object.name = std::to_string(id);
+        return object;
+    }
+
+    std::vector<SceneObject> MakeObjects(size_t count, int firstId)
+    {
+        std::vector<SceneObject> objects;
+        for (size_t i = 0; i < count; i++)
+            objects.push_back(MakeObject(firstId + int(i)));
+        return objects;
+    }
+
+    // Every packed object is where its handle says
+    bool HandlesMatchObjects(const SceneObjectMap& map)
+    {
+        for (size_t i = 0; i < map.Size(); i++)
+        {
+            if (map.Get(map.GetHandle(i)) != &map[i])
+                return false;
+        }
+        return true;
+    }
+}
+
+TEST(SceneObjectMap, AssignDropsRepeatedIds)
+{
+    // IDs 1 to 900, then the first 100 of them again
+    std::vector<SceneObject> objects;
+    for (int i = 0; i < 1000; i++)
+        objects.push_back(MakeObject((i % 900) + 1));
+
+    SceneObjectMap map;
+    map.Assign(std::move(objects));
+    CHECK(map.Size() == 900);
+    CHECK(HandlesMatchObjects(map));
+
+    bool found = true;
+    for (int id = 1; id <= 900; id++)
+    {
+        const SceneObject* object = map.Get(map.Find(id));
+        found = found && object && object->ID == id && object->name == std::to_string(id);
+    }
+    CHECK(found);
+    CHECK(!map.Find(0).IsValid() && !map.Find(901).IsValid());
+    CHECK(!map.Get(SceneObjectHandle()));
+}
+
+TEST(SceneObjectMap, RandomOperations)
+{
+    // Inserts, erases and lookups over a range of IDs, negative ones included, checked against std::map. Small
+    // enough a range that IDs keep coming back, through slots that have been erased from many times.
+    std::mt19937 random(7);
+    SceneObjectMap map;
+    std::map<int, SceneObjectHandle> reference;
+    std::vector<SceneObjectHandle> erased;
+
+    map.Assign(MakeObjects(900, 1));
+    for (size_t i = 0; i < map.Size(); i++)
+        reference[map[i].ID] = map.GetHandle(i);
+
+    bool insertsMatch = true;
+    bool erasesMatch = true;
+    bool findsMatch = true;
+    bool consistent = true;
+    for (int step = 0; step < 400000; step++)
+    {
+        const int id = int(random() % 4000) - 2000;
+        const auto expected = reference.find(id);
+        const SceneObjectHandle handle = map.Find(id);
+
+        switch (random() % 3)
+        {
+        case 0:
+        {
+            const SceneObjectHandle inserted = map.Insert(MakeObject(id));
+            if (expected != reference.end())
+                insertsMatch = insertsMatch && !inserted.IsValid();
+            else
+            {
+                insertsMatch = insertsMatch && inserted.IsValid() && map.Get(inserted) && map.Get(inserted)->ID == id;
+                reference[id] = inserted;
+            }
+            break;
+        }
+        case 1:
+            if (expected != reference.end())
+            {
+                // A second erase through the same handle finds nothing
+                erasesMatch = erasesMatch && handle == expected->second && map.Erase(handle) && !map.Erase(handle);
+                erased.push_back(handle);
+                reference.erase(expected);
+            }
+            else
+                erasesMatch = erasesMatch && !handle.IsValid() && !map.Erase(handle);
+            break;
+        default:
+            if (expected != reference.end())
+                findsMatch = findsMatch && handle == expected->second && map.Get(handle) && map.Get(handle)->ID == id;
+            else
+                findsMatch = findsMatch && !handle.IsValid() && !map.Get(handle);
+            break;
+        }
+
+        if (step % 1000 == 0)
+        {
+            consistent = consistent && map.Size() == reference.size() && HandlesMatchObjects(map);
+            for (const auto& entry : reference)
+                consistent = consistent && map.Get(entry.second) && map.Get(entry.second)->ID == entry.first;
+            for (const SceneObjectHandle& stale : erased)
+                consistent = consistent && !map.Get(stale);
+        }
+    }
+
+    CHECK(insertsMatch);
+    CHECK(erasesMatch);
+    CHECK(findsMatch);
+    CHECK(consistent);
+    CHECK(!erased.empty());
+}
+
+TEST(SceneObjectMap, AssignAndClearLeaveHandlesStale)
+{
+    SceneObjectMap map;
+    map.Assign(MakeObjects(500, 0));
+    std::vector<SceneObjectHandle> before;
+    for (size_t i = 0; i < map.Size(); i++)
+        before.push_back(map.GetHandle(i));
+
+    // Erased handles stay stale through the next Assign too
+    const SceneObjectHandle erased = map.Find(10);
+    CHECK(map.Erase(erased));
+
+    map.Assign(MakeObjects(3000, 0));
+    CHECK(map.Size() == 3000);
+    bool stale = !map.Get(erased);
+    for (const SceneObjectHandle& handle : before)
+        stale = stale && !map.Get(handle);
+    CHECK(stale);
+
+    bool found = true;
+    for (int id = 0; id < 3000; id++)
+        found = found && map.Get(map.Find(id)) && map.Get(map.Find(id))->ID == id;
+    CHECK(found);
+    CHECK(HandlesMatchObjects(map));
+
+    // Shrinking frees the slots past the new objects, for inserts to reuse
+    map.Assign(MakeObjects(2, 1));
+    const SceneObjectHandle inserted = map.Insert(MakeObject(9));
+    CHECK(inserted.IsValid() && inserted.slot == 2);
+
+    const SceneObjectHandle beforeClear = map.Find(9);
+    map.Clear();
+    CHECK(map.Empty() && !map.Find(9).IsValid() && !map.Get(beforeClear));
+
+    const SceneObjectHandle afterClear = map.Insert(MakeObject(5));
+    CHECK(afterClear.IsValid() && map.Find(5) == afterClear);
+    CHECK(!map.Get(beforeClear));
+}
@@ -0,0 +1,112 @@
+#include "Tests.h"
+#include "SplatMapGenerator.h"
+#include "SceneGenerator.h"
+#include "TerrainHeightmap.h"
+#include "Platform.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    constexpr size_t RESOLUTION = 128;
+    constexpr float HEIGHT_SCALE = 0.25f;
+    constexpr float CELL_SIZE = 512.f / (RESOLUTION - 1);
+
+    const char* SCRATCH_SPLAT_MAP = "scenetests_splat.raw";
+
+    TerrainHeightmap GeneratedHeightmap()
+    {
+        TerrainHeightmap heightmap(RESOLUTION, HEIGHT_SCALE, CELL_SIZE);
+        SceneGenerator(SceneGenerator::Settings()).GenerateHeightmap(heightmap);
+        return heightmap;
+    }
+
+    void PaintAll(SplatMapGenerator& splatMap, const TerrainHeightmap& heightmap)
+    {
+        splatMap.Initialise(RESOLUTION, HEIGHT_SCALE, CELL_SIZE);
+        splatMap.MarkAllDirty();
+        splatMap.Update(heightmap.GetHeights());
+    }
+
+    bool SameWeights(const SplatMapGenerator& a, const SplatMapGenerator& b)
+    {
+        return std::memcmp(a.GetData(), b.GetData(), RESOLUTION * RESOLUTION * SplatMapGenerator::NUM_LAYERS) == 0;
+    }
+
+    void WriteBytes(const char* path, size_t count)
+    {
+        FILE* pFile = nullptr;
+        if (fopen_s(&pFile, path, "wb") != 0 || !pFile)
+            return;
+
+        const std::vector<uint8_t> bytes(count, 7);
+        fwrite(bytes.data(), 1, bytes.size(), pFile);
+        fclose(pFile);
+    }
+}
+
+TEST(SplatMapGenerator, SaveAndLoadRoundTrip)
+{
+    const TerrainHeightmap heightmap = GeneratedHeightmap();
+    SplatMapGenerator saved;
+    PaintAll(saved, heightmap);
+    CHECK(saved.Save(SCRATCH_SPLAT_MAP));
+
+    SplatMapGenerator loaded;
+    loaded.Initialise(RESOLUTION, HEIGHT_SCALE, CELL_SIZE);
+    CHECK(loaded.Load(SCRATCH_SPLAT_MAP));
+    CHECK(SameWeights(loaded, saved));
+
+    Platform::RemoveFile(SCRATCH_SPLAT_MAP);
+}
+
+TEST(SplatMapGenerator, LoadRejectsWrongSize)
+{
+    const TerrainHeightmap heightmap = GeneratedHeightmap();
+    SplatMapGenerator painted;
+    PaintAll(painted, heightmap);
+    SplatMapGenerator splatMap;
+    PaintAll(splatMap, heightmap);
+
+    const size_t size = RESOLUTION * RESOLUTION * SplatMapGenerator::NUM_LAYERS;
+    const size_t wrongSizes[] = { 0, size - 1, size + 1, size * 2 };
+    for (size_t wrongSize : wrongSizes)
+    {
+        WriteBytes(SCRATCH_SPLAT_MAP, wrongSize);
+        CHECK(!splatMap.Load(SCRATCH_SPLAT_MAP));
+        CHECK(SameWeights(splatMap, painted));
+    }
+
+    WriteBytes(SCRATCH_SPLAT_MAP, size);
+    CHECK(splatMap.Load(SCRATCH_SPLAT_MAP));
+    CHECK(splatMap.GetData()[0] == 7 && splatMap.GetData()[size - 1] == 7);
+
+    Platform::RemoveFile(SCRATCH_SPLAT_MAP);
+}
+
+TEST(SplatMapGenerator, RegionRepaintMatchesFullPaint)
+{
+    // Edits inside a tile, across tile edges and on the border of the map
+    const size_t regions[][4] = { { 40, 40, 50, 50 }, { 30, 60, 33, 97 }, { 0, 0, 3, 127 }, { 127, 127, 127, 127 } };
+    for (const size_t* region : regions)
+    {
+        TerrainHeightmap heightmap = GeneratedHeightmap();
+        SplatMapGenerator repainted;
+        PaintAll(repainted, heightmap);
+
+        for (size_t z = region[1]; z <= region[3]; z++)
+        {
+            for (size_t x = region[0]; x <= region[2]; x++)
+                heightmap.GetHeights()[(z * RESOLUTION) + x] = uint8_t(((x * 37) + (z * 11)) & 0xFF);
+        }
+        repainted.MarkDirty(region[0], region[1], region[2], region[3]);
+        CHECK(repainted.IsDirty());
+        repainted.Update(heightmap.GetHeights());
+        CHECK(!repainted.IsDirty());
+
+        SplatMapGenerator painted;
+        PaintAll(painted, heightmap);
+        CHECK(SameWeights(repainted, painted));
+    }
+}
@@ -0,0 +1,282 @@
+#include "Tests.h"
+#include "StaticGeometryBaker.h"
+#include "Platform.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+    constexpr float CELL_SIZE = 64.f;
+    constexpr int CELLS_PER_SIDE = 3;
+    constexpr int MEMBERS_PER_CELL = 4;
+    constexpr size_t NUM_CELLS = CELLS_PER_SIDE * CELLS_PER_SIDE;
+
+    const char* SCRATCH_CACHE = "scenetests_bakecache";
+
+    // A unit quad facing up, two triangles
+    StaticGeometryBaker::Mesh MakeQuad()
+    {
+        StaticGeometryBaker::Mesh quad;
+        const float corners[4][2] = { { 0.f, 0.f }, { 1.f, 0.f }, { 1.f, 1.f }, { 0.f, 1.f } };
+        for (const auto& corner : corners)
+            quad.vertices.push_back({ { corner[0], 0.f, corner[1] }, { 0.f, 1.f, 0.f }, { corner[0], corner[1] } });
+        quad.indices = { 0, 1, 2, 0, 2, 3 };
+        return quad;
+    }
+
+    // A few members in each cell of a square of cells, materials alternating
+    struct Level
+    {
+        std::vector<StaticGeometryBaker::Member>	members;
+
+        Level()
+        {
+            for (int cell = 0; cell < int(NUM_CELLS); cell++)
+            {
+                for (int m = 0; m < MEMBERS_PER_CELL; m++)
+                {
+                    StaticGeometryBaker::Member member = {};
+                    member.object = uint32_t(members.size());
+                    member.material = uint32_t(m % 2);
+                    for (int axis = 0; axis < 4; axis++)
+                        member.world[(axis * 4) + axis] = 1.f;
+                    member.world[12] = ((cell % CELLS_PER_SIDE) * CELL_SIZE) + 4.f + (m * 10.f);
+                    member.world[13] = float(m);
+                    member.world[14] = ((cell / CELLS_PER_SIDE) * CELL_SIZE) + 8.f;
+                    members.push_back(member);
+                    Rehash(members.size() - 1);
+                }
+            }
+        }
+
+        void Rehash(size_t m)
+        {
+            StaticGeometryBaker::Member& member = members[m];
+            member.hash = StaticGeometryBaker::Hash(&member.object, sizeof(member.object));
+            member.hash = StaticGeometryBaker::Hash(member.world, sizeof(member.world), member.hash);
+        }
+
+        void Move(size_t m, float dx, float dz)
+        {
+            members[m].world[12] += dx;
+            members[m].world[14] += dz;
+            Rehash(m);
+        }
+    };
+
+    // Bakes 'level', counting the meshes the baker asked for
+    size_t Bake(StaticGeometryBaker& baker, const Level& level)
+    {
+        static const StaticGeometryBaker::Mesh quad = MakeQuad();
+        size_t requests = 0;
+        baker.Bake(level.members.data(), level.members.size(), [&requests](size_t) { requests++; return &quad; });
+        return requests;
+    }
+
+    bool SameCells(const StaticGeometryBaker& a, const StaticGeometryBaker& b)
+    {
+        if (a.GetCells().size() != b.GetCells().size())
+            return false;
+
+        for (const auto& entry : a.GetCells())
+        {
+            const auto other = b.GetCells().find(entry.first);
+            if (other == b.GetCells().end() || other->second.groups.size() != entry.second.groups.size())
+                return false;
+
+            for (size_t g = 0; g < entry.second.groups.size(); g++)
+            {
+                const StaticGeometryBaker::Group& x = entry.second.groups[g];
+                const StaticGeometryBaker::Group& y = other->second.groups[g];
+                if (x.material != y.material || x.objects != y.objects || x.mesh.indices != y.mesh.indices
+                    || x.mesh.vertices.size() != y.mesh.vertices.size()
+                    || memcmp(x.mesh.vertices.data(), y.mesh.vertices.data(), x.mesh.vertices.size() * sizeof(StaticGeometryBaker::Vertex)) != 0
+                    || memcmp(x.boundsMin, y.boundsMin, sizeof(x.boundsMin)) != 0 || memcmp(x.boundsMax, y.boundsMax, sizeof(x.boundsMax)) != 0)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    std::string CacheFile(int x, int z)
+    {
+        return std::string(SCRATCH_CACHE) + "/cell_" + std::to_string(x) + "_" + std::to_string(z) + ".bin";
+    }
+
+    void RemoveCache()
+    {
+        for (int cell = 0; cell < int(NUM_CELLS); cell++)
+            Platform::RemoveFile(CacheFile(cell % CELLS_PER_SIDE, cell / CELLS_PER_SIDE));
+    }
+
+    std::vector<uint8_t> ReadBytes(const std::string& path)
+    {
+        std::vector<uint8_t> bytes;
+        FILE* pFile = nullptr;
+        if (fopen_s(&pFile, path.c_str(), "rb") != 0 || !pFile)
+            return bytes;
+
+        uint8_t buffer[4096];
+        for (size_t read; (read = fread(buffer, 1, sizeof(buffer), pFile)) > 0; )
+            bytes.insert(bytes.end(), buffer, buffer + read);
+        fclose(pFile);
+        return bytes;
+    }
+
+    void WriteBytes(const std::string& path, const std::vector<uint8_t>& bytes, size_t count)
+    {
+        FILE* pFile = nullptr;
+        if (fopen_s(&pFile, path.c_str(), "wb") != 0 || !pFile)
+            return;
+
+        fwrite(bytes.data(), 1, count, pFile);
+        fclose(pFile);
+    }
+}
+
+TEST(StaticGeometryBaker, MergesMembersPerCellAndMaterial)
+{
+    Level level;
+    StaticGeometryBaker baker(CELL_SIZE);
+    CHECK(Bake(baker, level) == level.members.size());
+
+    const StaticGeometryBaker::Stats& stats = baker.GetStats();
+    CHECK(stats.cells == NUM_CELLS && stats.groups == NUM_CELLS * 2);
+    CHECK(stats.merged == NUM_CELLS && stats.loaded == 0 && stats.reused == 0);
+    CHECK(stats.vertices == level.members.size() * 4 && stats.triangles == level.members.size() * 2);
+
+    // Each group holds its material's members, moved into place
+    bool placed = true;
+    for (const auto& entry : baker.GetCells())
+    {
+        for (const StaticGeometryBaker::Group& group : entry.second.groups)
+        {
+            placed = placed && group.objects.size() == MEMBERS_PER_CELL / 2 && group.mesh.vertices.size() == group.objects.size() * 4;
+            for (size_t o = 0; placed && o < group.objects.size(); o++)
+            {
+                const StaticGeometryBaker::Member& member = level.members[group.objects[o]];
+                const StaticGeometryBaker::Vertex& corner = group.mesh.vertices[o * 4];
+                placed = member.material == group.material && corner.position[0] == member.world[12] && corner.position[2] == member.world[14]
+                    && entry.first.first == int(member.world[12] / CELL_SIZE) && entry.first.second == int(member.world[14] / CELL_SIZE);
+            }
+        }
+    }
+    CHECK(placed);
+}
+
+TEST(StaticGeometryBaker, RebuildsOnlyChangedCells)
+{
+    Level level;
+    StaticGeometryBaker baker(CELL_SIZE);
+    Bake(baker, level);
+    std::vector<uint32_t> versions;
+    for (const auto& entry : baker.GetCells())
+        versions.push_back(entry.second.version);
+
+    // Nothing changed, nothing is merged or even asked for
+    CHECK(Bake(baker, level) == 0);
+    CHECK(baker.GetStats().reused == NUM_CELLS && baker.GetStats().merged == 0);
+
+    // A member moving within its cell rebuilds that cell alone, from its members
+    level.Move(MEMBERS_PER_CELL * 4, 1.f, 1.f);
+    CHECK(Bake(baker, level) == MEMBERS_PER_CELL);
+    CHECK(baker.GetStats().merged == 1 && baker.GetStats().reused == NUM_CELLS - 1);
+
+    size_t changed = 0;
+    size_t c = 0;
+    for (const auto& entry : baker.GetCells())
+        changed += entry.second.version != versions[c++];
+    CHECK(changed == 1);
+
+    // One moving to the next cell rebuilds both
+    level.Move(0, CELL_SIZE, 0.f);
+    CHECK(Bake(baker, level) == MEMBERS_PER_CELL * 2);
+    CHECK(baker.GetStats().merged == 2 && baker.GetStats().reused == NUM_CELLS - 2);
+    CHECK(baker.GetStats().vertices == level.members.size() * 4);
+}
+
+TEST(StaticGeometryBaker, NextRunLoadsFromCache)
+{
+    Platform::MakeDirectory(SCRATCH_CACHE);
+    RemoveCache();
+
+    Level level;
+    StaticGeometryBaker first(CELL_SIZE);
+    first.SetCacheDirectory(SCRATCH_CACHE);
+    Bake(first, level);
+    CHECK(first.GetStats().merged == NUM_CELLS && first.GetStats().loaded == 0);
+
+    // Another baker, as the next run of the editor would have, reads every cell back without any source mesh
+    StaticGeometryBaker second(CELL_SIZE);
+    second.SetCacheDirectory(SCRATCH_CACHE);
+    CHECK(Bake(second, level) == 0);
+    CHECK(second.GetStats().loaded == NUM_CELLS && second.GetStats().merged == 0);
+    CHECK(SameCells(first, second));
+
+    // A cell whose members changed since the file was written merges again
+    level.Move(1, 2.f, 0.f);
+    StaticGeometryBaker third(CELL_SIZE);
+    third.SetCacheDirectory(SCRATCH_CACHE);
+    CHECK(Bake(third, level) == MEMBERS_PER_CELL);
+    CHECK(third.GetStats().loaded == NUM_CELLS - 1 && third.GetStats().merged == 1);
+
+    RemoveCache();
+}
+
+TEST(StaticGeometryBaker, RejectsDamagedCache)
+{
+    Platform::MakeDirectory(SCRATCH_CACHE);
+    RemoveCache();
+
+    Level level;
+    StaticGeometryBaker original(CELL_SIZE);
+    original.SetCacheDirectory(SCRATCH_CACHE);
+    Bake(original, level);
+
+    const std::string path = CacheFile(1, 1);
+    const std::vector<uint8_t> bytes = ReadBytes(path);
+    CHECK(!bytes.empty());
+
+    // Every damaged file is merged again from source, the same as it was, and written back whole
+    auto rejected = [&](const std::vector<uint8_t>& damaged)
+    {
+        WriteBytes(path, damaged, damaged.size());
+        StaticGeometryBaker baker(CELL_SIZE);
+        baker.SetCacheDirectory(SCRATCH_CACHE);
+        const size_t requests = Bake(baker, level);
+        return requests == MEMBERS_PER_CELL && baker.GetStats().merged == 1 && baker.GetStats().loaded == NUM_CELLS - 1
+            && SameCells(baker, original) && ReadBytes(path) == bytes;
+    };
+
+    // Cut anywhere
+    bool truncated = true;
+    for (size_t length = 0; length < bytes.size(); length += 7)
+        truncated = truncated && rejected(std::vector<uint8_t>(bytes.begin(), bytes.begin() + length));
+    CHECK(truncated);
+    CHECK(rejected(std::vector<uint8_t>(bytes.begin(), bytes.end() - 1)));
+
+    // Any one byte changed, in the headers or the geometry
+    bool flipped = true;
+    for (size_t b = 0; b < bytes.size(); b += 5)
+    {
+        std::vector<uint8_t> damaged(bytes);
+        damaged[b] ^= 0x10;
+        flipped = flipped && rejected(damaged);
+    }
+    CHECK(flipped);
+
+    // Trailing bytes
+    std::vector<uint8_t> longer(bytes);
+    longer.push_back(0);
+    CHECK(rejected(longer));
+
+    // A vertex count far past the file's size is refused before anything is allocated for it
+    std::vector<uint8_t> huge(bytes);
+    const size_t firstGroupHeader = 32;
+    memset(&huge[firstGroupHeader], 0xFF, sizeof(uint32_t));
+    CHECK(rejected(huge));
+
+    RemoveCache();
+}
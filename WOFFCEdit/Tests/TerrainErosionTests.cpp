@@ -0,0 +1,141 @@
+#include "Tests.h"
+#include "TerrainErosion.h"
+#include "JobSystem.h"
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+    // Not a multiple of the tile size, so the last row and column of tiles are partial
+    constexpr size_t RESOLUTION = 200;
+    constexpr float CELL_SIZE = 2.f;
+
+    // Rolling hills with noise on top, steep enough in places for both kinds of erosion to move material
+    std::vector<float> MakeTerrain()
+    {
+        std::mt19937 random(11);
+        std::uniform_real_distribution<float> noise(-3.f, 3.f);
+        std::vector<float> heights(RESOLUTION * RESOLUTION);
+        for (size_t z = 0; z < RESOLUTION; z++)
+        {
+            for (size_t x = 0; x < RESOLUTION; x++)
+                heights[(z * RESOLUTION) + x] = (std::sin(x * 0.07f) * 20.f) + (std::cos(z * 0.05f) * 30.f) + noise(random);
+        }
+        return heights;
+    }
+
+    bool Same(const std::vector<float>& a, const std::vector<float>& b)
+    {
+        return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+    }
+
+    ThermalErosionSettings ThermalSettings()
+    {
+        ThermalErosionSettings settings;
+        settings.iterations = 20;
+        return settings;
+    }
+
+    HydraulicErosionSettings HydraulicSettings()
+    {
+        HydraulicErosionSettings settings;
+        settings.seed = 1234;
+        return settings;
+    }
+}
+
+TEST(TerrainErosion, SameResultOnAnyNumberOfThreads)
+{
+    const std::vector<float> terrain = MakeTerrain();
+
+    std::vector<float> thermal[3];
+    std::vector<float> hydraulic[3];
+    const size_t workerCounts[] = { 0, 2, 7 };
+    for (size_t w = 0; w < 3; w++)
+    {
+        JobSystem::Shutdown();
+        JobSystem::Start(workerCounts[w]);
+        CHECK(JobSystem::GetNumThreads() == workerCounts[w] + 1);
+
+        thermal[w] = terrain;
+        CHECK(TerrainErosion::Thermal(thermal[w].data(), RESOLUTION, CELL_SIZE, ThermalSettings()));
+        hydraulic[w] = terrain;
+        CHECK(TerrainErosion::Hydraulic(hydraulic[w].data(), RESOLUTION, HydraulicSettings()));
+    }
+
+    CHECK(!Same(thermal[0], terrain));
+    CHECK(!Same(hydraulic[0], terrain));
+    for (size_t w = 1; w < 3; w++)
+    {
+        CHECK(Same(thermal[w], thermal[0]));
+        CHECK(Same(hydraulic[w], hydraulic[0]));
+    }
+
+    // Another seed erodes differently
+    HydraulicErosionSettings reseeded = HydraulicSettings();
+    reseeded.seed++;
+    std::vector<float> other = terrain;
+    CHECK(TerrainErosion::Hydraulic(other.data(), RESOLUTION, reseeded));
+    CHECK(!Same(other, hydraulic[0]));
+}
+
+TEST(TerrainErosion, CancelStopsEarly)
+{
+    JobSystem::Shutdown();
+    JobSystem::Start(3);
+    const std::vector<float> terrain = MakeTerrain();
+
+    // Progress only ever grows, up to 1 for a run that isn't cancelled
+    float lastProgress = 0.f;
+    bool growing = true;
+    std::vector<float> full = terrain;
+    CHECK(TerrainErosion::Thermal(full.data(), RESOLUTION, CELL_SIZE, ThermalSettings(), [&](float progress)
+    {
+        growing = growing && progress > lastProgress && progress <= 1.f;
+        lastProgress = progress;
+        return true;
+    }));
+    CHECK(growing && lastProgress == 1.f);
+
+    // Thermal erosion cancelled after some iterations is left as a run of only those iterations leaves it
+    constexpr int CANCEL_AFTER = 5;
+    int calls = 0;
+    std::vector<float> cancelled = terrain;
+    CHECK(!TerrainErosion::Thermal(cancelled.data(), RESOLUTION, CELL_SIZE, ThermalSettings(), [&calls](float) { return ++calls < CANCEL_AFTER; }));
+    CHECK(calls == CANCEL_AFTER);
+
+    ThermalErosionSettings shorter = ThermalSettings();
+    shorter.iterations = CANCEL_AFTER;
+    std::vector<float> partial = terrain;
+    CHECK(TerrainErosion::Thermal(partial.data(), RESOLUTION, CELL_SIZE, shorter));
+    CHECK(Same(cancelled, partial));
+    CHECK(!Same(cancelled, full));
+
+    // Hydraulic erosion stops at the first pass the callback turns down
+    lastProgress = 0.f;
+    growing = true;
+    full = terrain;
+    CHECK(TerrainErosion::Hydraulic(full.data(), RESOLUTION, HydraulicSettings(), [&](float progress)
+    {
+        growing = growing && progress > lastProgress && progress <= 1.f;
+        lastProgress = progress;
+        return true;
+    }));
+    CHECK(growing && lastProgress == 1.f);
+
+    calls = 0;
+    cancelled = terrain;
+    CHECK(!TerrainErosion::Hydraulic(cancelled.data(), RESOLUTION, HydraulicSettings(), [&calls](float) { return ++calls < CANCEL_AFTER; }));
+    CHECK(calls == CANCEL_AFTER);
+    CHECK(!Same(cancelled, terrain));
+    CHECK(!Same(cancelled, full));
+
+    // Cancelled straight away, only the first pass has run
+    calls = 0;
+    std::vector<float> first = terrain;
+    CHECK(!TerrainErosion::Hydraulic(first.data(), RESOLUTION, HydraulicSettings(), [&calls](float) { return ++calls < 1; }));
+    CHECK(calls == 1);
+    CHECK(!Same(first, cancelled));
+}
@@ -0,0 +1,82 @@
+#include "Tests.h"
+#include "TerrainHeightmap.h"
+#include "Platform.h"
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+    constexpr size_t RESOLUTION = 128;
+    constexpr float HEIGHT_SCALE = 0.25f;
+    constexpr float CELL_SIZE = 512.f / (RESOLUTION - 1);
+
+    const char* SCRATCH_HEIGHTMAP = "scenetests_heightmap.raw";
+}
+
+TEST(TerrainHeightmap, SaveAndLoadRoundTrip)
+{
+    TerrainHeightmap saved(RESOLUTION, HEIGHT_SCALE, CELL_SIZE);
+    for (size_t i = 0; i < saved.GetNumSamples(); i++)
+        saved.GetHeights()[i] = uint8_t((i * 7) ^ (i >> 5));
+    CHECK(saved.Save(SCRATCH_HEIGHTMAP));
+
+    TerrainHeightmap loaded(RESOLUTION, HEIGHT_SCALE, CELL_SIZE);
+    CHECK(loaded.Load(SCRATCH_HEIGHTMAP));
+    bool same = true;
+    for (size_t i = 0; i < saved.GetNumSamples(); i++)
+        same = same && loaded.GetHeights()[i] == saved.GetHeights()[i];
+    CHECK(same);
+
+    Platform::RemoveFile(SCRATCH_HEIGHTMAP);
+}
+
+TEST(TerrainHeightmap, ShortFileLeavesHeights)
+{
+    FILE* pFile = nullptr;
+    CHECK(fopen_s(&pFile, SCRATCH_HEIGHTMAP, "wb") == 0 && pFile);
+    if (pFile)
+    {
+        const uint8_t bytes[100] = {};
+        fwrite(bytes, 1, sizeof(bytes), pFile);
+        fclose(pFile);
+    }
+
+    TerrainHeightmap heightmap(RESOLUTION, HEIGHT_SCALE, CELL_SIZE);
+    heightmap.GetHeights()[0] = 42;
+    CHECK(!heightmap.Load(SCRATCH_HEIGHTMAP));
+    CHECK(!heightmap.Load("scenetests_missing.raw"));
+    CHECK(heightmap.GetHeights()[0] == 42);
+
+    Platform::RemoveFile(SCRATCH_HEIGHTMAP);
+}
+
+TEST(TerrainHeightmap, NormalsOfPlanes)
+{
+    // A flat map faces up, and a ramp rising along X tilts back against it by its slope
+    TerrainHeightmap heightmap(RESOLUTION, HEIGHT_SCALE, CELL_SIZE);
+    std::vector<float> normals(heightmap.GetNumSamples() * 3);
+
+    heightmap.CalculateNormals(normals.data(), sizeof(float) * 3);
+    bool up = true;
+    for (size_t i = 0; i < heightmap.GetNumSamples(); i++)
+        up = up && normals[i * 3] == 0.f && normals[(i * 3) + 1] == 1.f && normals[(i * 3) + 2] == 0.f;
+    CHECK(up);
+
+    for (size_t z = 0; z < RESOLUTION; z++)
+    {
+        for (size_t x = 0; x < RESOLUTION; x++)
+            heightmap.GetHeights()[(z * RESOLUTION) + x] = uint8_t(x * 2);
+    }
+    heightmap.CalculateNormals(normals.data(), sizeof(float) * 3);
+
+    const float rise = 2.f * HEIGHT_SCALE / CELL_SIZE;
+    const float length = std::sqrt((rise * rise) + 1.f);
+    float worst = 0.f;
+    for (size_t i = 0; i < heightmap.GetNumSamples(); i++)
+    {
+        worst = std::max(worst, std::fabs(normals[i * 3] - (-rise / length)));
+        worst = std::max(worst, std::fabs(normals[(i * 3) + 1] - (1.f / length)));
+        worst = std::max(worst, std::fabs(normals[(i * 3) + 2]));
+    }
+    CHECK(worst < 1e-5f);
+}
@@ -0,0 +1,84 @@
+#include "Tests.h"
+#include "TerrainIndexBuilder.h"
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace
+{
+    constexpr size_t TERRAIN_RESOLUTION = 128;		//as DisplayChunk's
+
+    // The whole grid walked row by row, as the terrain was indexed before
+    std::vector<uint16_t> RowOrderIndices(size_t resolution)
+    {
+        std::vector<uint16_t> indices;
+        for (size_t z = 0; z + 1 < resolution; z++)
+        {
+            for (size_t x = 0; x + 1 < resolution; x++)
+            {
+                const uint16_t bottomL = uint16_t((resolution * z) + x);
+                const uint16_t topL = uint16_t(bottomL + resolution);
+                indices.insert(indices.end(), { bottomL, uint16_t(bottomL + 1), uint16_t(topL + 1), bottomL, uint16_t(topL + 1), topL });
+            }
+        }
+        return indices;
+    }
+
+    // Triangles rotated to start at their lowest index, which keeps the winding, then sorted
+    std::vector<std::array<uint16_t, 3>> SortedTriangles(const std::vector<uint16_t>& indices)
+    {
+        std::vector<std::array<uint16_t, 3>> triangles;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            std::array<uint16_t, 3> triangle = { indices[i], indices[i + 1], indices[i + 2] };
+            std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+            triangles.push_back(triangle);
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    }
+}
+
+TEST(TerrainIndexBuilder, SameTrianglesAsRowOrder)
+{
+    // Grids with whole patches, and with narrower last columns and rows of them
+    const size_t resolutions[] = { 2, 3, 8, 9, 15, 16, 100, TERRAIN_RESOLUTION, 256 };
+    for (size_t resolution : resolutions)
+    {
+        std::vector<uint16_t> indices;
+        TerrainIndexBuilder::BuildGridIndices(indices, resolution);
+        CHECK(indices.size() == TerrainIndexBuilder::IndexCount(resolution));
+        CHECK(SortedTriangles(indices) == SortedTriangles(RowOrderIndices(resolution)));
+    }
+}
+
+TEST(TerrainIndexBuilder, ACMRBelowRowOrder)
+{
+    std::vector<uint16_t> indices;
+    TerrainIndexBuilder::BuildGridIndices(indices, TERRAIN_RESOLUTION);
+    const std::vector<uint16_t> rowOrder = RowOrderIndices(TERRAIN_RESOLUTION);
+    const size_t numVertices = TERRAIN_RESOLUTION * TERRAIN_RESOLUTION;
+
+    // Row order misses the cache for nearly every vertex twice, once for each row of quads it is in
+    const size_t cacheSizes[] = { TerrainIndexBuilder::DEFAULT_CACHE_SIZE, 32 };
+    for (size_t cacheSize : cacheSizes)
+    {
+        const float acmr = TerrainIndexBuilder::ComputeACMR(indices.data(), indices.size(), numVertices, cacheSize);
+        const float rowOrderAcmr = TerrainIndexBuilder::ComputeACMR(rowOrder.data(), rowOrder.size(), numVertices, cacheSize);
+        CHECK(rowOrderAcmr > 0.95f);
+        CHECK(acmr < 0.7f);
+        CHECK(acmr < rowOrderAcmr * 0.75f);
+    }
+}
+
+TEST(TerrainIndexBuilder, ACMRBounds)
+{
+    // One triangle misses three times, and a cache large enough for the whole grid misses each vertex once
+    const uint16_t triangle[3] = { 0, 1, 2 };
+    CHECK(TerrainIndexBuilder::ComputeACMR(triangle, 3, 3) == 3.f);
+
+    std::vector<uint16_t> indices;
+    TerrainIndexBuilder::BuildGridIndices(indices, 9);
+    const float acmr = TerrainIndexBuilder::ComputeACMR(indices.data(), indices.size(), 81, 81);
+    CHECK(acmr == 81.f / (8 * 8 * 2));
+}
@@ -0,0 +1,176 @@
+#include "Tests.h"
+#include "TerrainVertexCodec.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace
+{
+    constexpr float MAX_HEIGHT = 255.f * 0.25f;		//of the editor's terrain
+    constexpr float MAX_NORMAL_ERROR_DEGREES = 1.f;
+
+    // Floats among other members, as in the editor's VertexPositionNormalTexture
+    struct Vertex
+    {
+        float position[3];
+        float normal[3];
+        float texCoord[2];
+    };
+
+    std::vector<Vertex> RandomVertices(size_t count, unsigned seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> height(0.f, MAX_HEIGHT);
+        std::normal_distribution<float> direction;
+
+        std::vector<Vertex> vertices(count);
+        for (Vertex& vertex : vertices)
+        {
+            vertex.position[1] = height(random);
+
+            float length = 0.f;
+            while (length < 1e-3f)
+            {
+                for (float& n : vertex.normal)
+                    n = direction(random);
+                length = std::sqrt((vertex.normal[0] * vertex.normal[0]) + (vertex.normal[1] * vertex.normal[1]) + (vertex.normal[2] * vertex.normal[2]));
+            }
+            for (float& n : vertex.normal)
+                n /= length;
+        }
+        return vertices;
+    }
+
+    float AngleDegrees(const float* a, const float* b)
+    {
+        const float cosine = (a[0] * b[0]) + (a[1] * b[1]) + (a[2] * b[2]);
+        return std::acos(std::min(std::max(cosine, -1.f), 1.f)) * (180.f / 3.14159265f);
+    }
+}
+
+TEST(TerrainVertexCodec, HeightsWithinHalfAStep)
+{
+    // Counts that leave every remainder after the four at a time
+    for (size_t count : { 1, 2, 3, 4, 5, 7, 8, 1001, 16384 })
+    {
+        const std::vector<Vertex> vertices = RandomVertices(count, unsigned(count));
+        std::vector<TerrainVertexCompact> compact(count);
+        std::vector<Vertex> decoded(count);
+        TerrainVertexCodec::EncodeHeights(&vertices[0].position[1], sizeof(Vertex), count, MAX_HEIGHT, compact.data());
+        TerrainVertexCodec::DecodeHeights(compact.data(), count, MAX_HEIGHT, &decoded[0].position[1], sizeof(Vertex));
+
+        float worst = 0.f;
+        for (size_t i = 0; i < count; i++)
+            worst = std::max(worst, std::fabs(decoded[i].position[1] - vertices[i].position[1]));
+        CHECK(worst <= (MAX_HEIGHT / 65535.f / 2.f) + (MAX_HEIGHT * 1e-6f));	//and float rounding
+    }
+}
+
+TEST(TerrainVertexCodec, HeightsClampToRange)
+{
+    const float heights[6] = { -10.f, 0.f, MAX_HEIGHT, MAX_HEIGHT * 2.f, -1.f, 1e9f };
+    TerrainVertexCompact compact[6];
+    TerrainVertexCodec::EncodeHeights(heights, sizeof(float), 6, MAX_HEIGHT, compact);
+    CHECK(compact[0].height == 0 && compact[1].height == 0 && compact[4].height == 0);
+    CHECK(compact[2].height == 65535 && compact[3].height == 65535 && compact[5].height == 65535);
+}
+
+TEST(TerrainVertexCodec, NormalsWithinErrorBound)
+{
+    for (size_t count : { 1, 3, 4, 6, 100003 })
+    {
+        const std::vector<Vertex> vertices = RandomVertices(count, unsigned(count) + 1);
+        std::vector<TerrainVertexCompact> compact(count);
+        std::vector<Vertex> decoded(count);
+        TerrainVertexCodec::EncodeNormals(vertices[0].normal, sizeof(Vertex), count, compact.data());
+        TerrainVertexCodec::DecodeNormals(compact.data(), count, decoded[0].normal, sizeof(Vertex));
+
+        float worst = 0.f;
+        float worstLengthError = 0.f;
+        for (size_t i = 0; i < count; i++)
+        {
+            const float* n = decoded[i].normal;
+            worst = std::max(worst, AngleDegrees(n, vertices[i].normal));
+            worstLengthError = std::max(worstLengthError, std::fabs(std::sqrt((n[0] * n[0]) + (n[1] * n[1]) + (n[2] * n[2])) - 1.f));
+        }
+        CHECK(worst < MAX_NORMAL_ERROR_DEGREES);
+        CHECK(worstLengthError < 1e-5f);
+    }
+}
+
+TEST(TerrainVertexCodec, AxesAndFoldEdges)
+{
+    // Straight down folds to the corners of the octahedron, the equator to its edges
+    const float normals[][3] = {
+        { 0.f, 1.f, 0.f }, { 0.f, -1.f, 0.f }, { 1.f, 0.f, 0.f }, { -1.f, 0.f, 0.f },
+        { 0.f, 0.f, 1.f }, { 0.f, 0.f, -1.f }, { 0.7071068f, 0.f, -0.7071068f }, { -0.5773503f, -0.5773503f, 0.5773503f },
+    };
+    const size_t count = sizeof(normals) / sizeof(normals[0]);
+
+    TerrainVertexCompact compact[count];
+    float decoded[count][3];
+    TerrainVertexCodec::EncodeNormals(normals[0], sizeof(normals[0]), count, compact);
+    TerrainVertexCodec::DecodeNormals(compact, count, decoded[0], sizeof(decoded[0]));
+    for (size_t i = 0; i < count; i++)
+        CHECK(AngleDegrees(decoded[i], normals[i]) < MAX_NORMAL_ERROR_DEGREES);
+}
+
+TEST(TerrainVertexCodec, FourAtATimeMatchesOneAtATime)
+{
+    // The SSE2 path rounds halves to even, the scalar one up, so the codes may be a step apart but no more
+    const size_t count = 4096;
+    const std::vector<Vertex> vertices = RandomVertices(count, 7);
+    std::vector<TerrainVertexCompact> together(count);
+    std::vector<TerrainVertexCompact> apart(count);
+    TerrainVertexCodec::EncodeHeights(&vertices[0].position[1], sizeof(Vertex), count, MAX_HEIGHT, together.data());
+    TerrainVertexCodec::EncodeNormals(vertices[0].normal, sizeof(Vertex), count, together.data());
+    for (size_t i = 0; i < count; i++)
+    {
+        TerrainVertexCodec::EncodeHeights(&vertices[i].position[1], sizeof(Vertex), 1, MAX_HEIGHT, &apart[i]);
+        TerrainVertexCodec::EncodeNormals(vertices[i].normal, sizeof(Vertex), 1, &apart[i]);
+    }
+
+    int worstStep = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        worstStep = std::max(worstStep, std::abs(together[i].height - apart[i].height));
+        worstStep = std::max(worstStep, std::abs(together[i].normalU - apart[i].normalU));
+        worstStep = std::max(worstStep, std::abs(together[i].normalV - apart[i].normalV));
+    }
+    CHECK(worstStep <= 1);
+
+    std::vector<Vertex> decodedTogether(count);
+    std::vector<Vertex> decodedApart(count);
+    TerrainVertexCodec::DecodeHeights(together.data(), count, MAX_HEIGHT, &decodedTogether[0].position[1], sizeof(Vertex));
+    TerrainVertexCodec::DecodeNormals(together.data(), count, decodedTogether[0].normal, sizeof(Vertex));
+    float worstDifference = 0.f;
+    for (size_t i = 0; i < count; i++)
+    {
+        TerrainVertexCodec::DecodeHeights(&together[i], 1, MAX_HEIGHT, &decodedApart[i].position[1], sizeof(Vertex));
+        TerrainVertexCodec::DecodeNormals(&together[i], 1, decodedApart[i].normal, sizeof(Vertex));
+        worstDifference = std::max(worstDifference, std::fabs(decodedTogether[i].position[1] - decodedApart[i].position[1]));
+        for (size_t k = 0; k < 3; k++)
+            worstDifference = std::max(worstDifference, std::fabs(decodedTogether[i].normal[k] - decodedApart[i].normal[k]));
+    }
+    CHECK(worstDifference < 1e-5f);
+}
+
+TEST(TerrainVertexCodec, StrideLeavesOtherMembers)
+{
+    std::vector<Vertex> vertices = RandomVertices(9, 3);
+    for (Vertex& vertex : vertices)
+        vertex.position[0] = vertex.position[2] = vertex.texCoord[0] = vertex.texCoord[1] = 12.5f;
+
+    std::vector<TerrainVertexCompact> compact(vertices.size());
+    TerrainVertexCodec::EncodeHeights(&vertices[0].position[1], sizeof(Vertex), vertices.size(), MAX_HEIGHT, compact.data());
+    TerrainVertexCodec::EncodeNormals(vertices[0].normal, sizeof(Vertex), vertices.size(), compact.data());
+    TerrainVertexCodec::DecodeHeights(compact.data(), vertices.size(), MAX_HEIGHT, &vertices[0].position[1], sizeof(Vertex));
+    TerrainVertexCodec::DecodeNormals(compact.data(), vertices.size(), vertices[0].normal, sizeof(Vertex));
+
+    bool untouched = true;
+    for (const Vertex& vertex : vertices)
+        untouched = untouched && vertex.position[0] == 12.5f && vertex.position[2] == 12.5f && vertex.texCoord[0] == 12.5f && vertex.texCoord[1] == 12.5f;
+    CHECK(untouched);
+}
@@ -0,0 +1,79 @@
+// Runs the tests registered with TEST, all of them or those whose Module.Case name starts with an argument.
+//
+//     SceneTests [prefix...]
+
+#include "Tests.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    struct Test
+    {
+        std::string				name;
+        Tests::TestFunction		function;
+    };
+
+    std::vector<Test>& Registered()
+    {
+        static std::vector<Test> tests;
+        return tests;
+    }
+
+    size_t s_failures = 0;		//CHECKs failed in the running test
+
+    bool Selected(const std::string& name, int argc, char** argv)
+    {
+        if (argc < 2)
+            return true;
+
+        for (int a = 1; a < argc; a++)
+        {
+            if (name.compare(0, strlen(argv[a]), argv[a]) == 0)
+                return true;
+        }
+        return false;
+    }
+}
+
+Tests::Registration::Registration(const char* module, const char* name, TestFunction function)
+{
+    Registered().push_back({ std::string(module) + "." + name, function });
+}
+
+void Tests::Fail(const char* file, int line, const char* expression)
+{
+    fprintf(stderr, "    %s(%d): CHECK(%s) failed\n", file, line, expression);
+    s_failures++;
+}
+
+std::string Tests::SourcePath(const std::string& path)
+{
+    return std::string(SCENE_SOURCE_DIR) + "/" + path;
+}
+
+int main(int argc, char** argv)
+{
+    size_t run = 0;
+    size_t failed = 0;
+    for (const Test& test : Registered())
+    {
+        if (!Selected(test.name, argc, argv))
+            continue;
+
+        s_failures = 0;
+        const auto start = std::chrono::high_resolution_clock::now();
+        test.function();
+        const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        printf("%-56s %s %10.1f ms\n", test.name.c_str(), s_failures == 0 ? "ok    " : "FAILED", milliseconds);
+        fflush(stdout);
+        run++;
+        failed += s_failures > 0;
+    }
+
+    printf("\n%zu of %zu tests passed\n", run - failed, run);
+    return failed == 0 && run > 0 ? 0 : 1;
+}
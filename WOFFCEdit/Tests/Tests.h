@@ -0,0 +1,33 @@
+#pragma once
+#include <string>
+
+// The headless scene core's tests: each TEST registers itself with the runner in TestMain.cpp, and CHECK
+// records a failure and carries on, so one run reports everything that is wrong. Tests are named
+// Module.Case and run from the build directory, where they may leave scratch files, with the sources,
+// and the database's assets, found through SourcePath.
+//
+//     TEST(SceneObjectMap, RandomOperations)
+//     {
+//         CHECK(map.Get(handle) != nullptr);
+//     }
+namespace Tests
+{
+    typedef void (*TestFunction)();
+
+    struct Registration
+    {
+        Registration(const char* module, const char* name, TestFunction function);
+    };
+
+    void Fail(const char* file, int line, const char* expression);
+
+    std::string SourcePath(const std::string& path);	//relative to WOFFCEdit/
+}
+
+#define TEST(module, name) \
+    static void Test_##module##_##name(); \
+    static const Tests::Registration s_##module##_##name(#module, #name, &Test_##module##_##name); \
+    static void Test_##module##_##name()
+
+#define CHECK(expression) \
+    do { if (!(expression)) Tests::Fail(__FILE__, __LINE__, #expression); } while (false)
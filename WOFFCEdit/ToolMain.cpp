@@ -1,26 +1,85 @@
 #include "ToolMain.h"
 #include "resource.h"
-#include "sqlite3.h"
-#include <sstream>
+#include "Profiler.h"
+#include "StartupTimings.h"
 #include <cassert>
+#include <algorithm>
+#include <cstring>
+#include <psapi.h>
 
 using DirectX::GamePad;
 using DirectX::Keyboard;
 using DirectX::Mouse;
 
-ToolMain::~ToolMain()
+namespace
 {
-    sqlite3_close(m_databaseConnection);
+    // User and kernel time of the process, in 100ns units
+    uint64_t ProcessCpuTime()
+    {
+        FILETIME creation, exit, kernel, user;
+        if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+            return 0;
+
+        return ((uint64_t(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime) + ((uint64_t(user.dwHighDateTime) << 32) | user.dwLowDateTime);
+    }
+
+    // Physical memory in use by the process, and the private memory it has committed
+    void ProcessMemory(Game::FramePacing& pacing)
+    {
+        PROCESS_MEMORY_COUNTERS_EX counters = {};
+        if (GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters)))
+        {
+            pacing.workingSetBytes = counters.WorkingSetSize;
+            pacing.privateBytes = counters.PrivateUsage;
+        }
+    }
+
+    static_assert(sizeof(Keyboard::State) == InputFrame::KEY_BYTES, "recordings store the keyboard state as it is");
+
+    InputFrame ToInputFrame(const Mouse::State& mouse, const Keyboard::State& keyboard)
+    {
+        InputFrame frame;
+        frame.mouseX = mouse.x;
+        frame.mouseY = mouse.y;
+        frame.scrollWheel = mouse.scrollWheelValue;
+        frame.buttons = uint8_t((mouse.leftButton ? InputFrame::BUTTON_LEFT : 0) | (mouse.middleButton ? InputFrame::BUTTON_MIDDLE : 0) | (mouse.rightButton ? InputFrame::BUTTON_RIGHT : 0)
+            | (mouse.xButton1 ? InputFrame::BUTTON_X1 : 0) | (mouse.xButton2 ? InputFrame::BUTTON_X2 : 0));
+        frame.relative = uint8_t(mouse.positionMode == Mouse::MODE_RELATIVE);
+        memcpy(frame.keys, &keyboard, InputFrame::KEY_BYTES);
+        return frame;
+    }
+
+    void FromInputFrame(const InputFrame& frame, Mouse::State& mouse, Keyboard::State& keyboard)
+    {
+        mouse.x = frame.mouseX;
+        mouse.y = frame.mouseY;
+        mouse.scrollWheelValue = frame.scrollWheel;
+        mouse.leftButton = (frame.buttons & InputFrame::BUTTON_LEFT) != 0;
+        mouse.middleButton = (frame.buttons & InputFrame::BUTTON_MIDDLE) != 0;
+        mouse.rightButton = (frame.buttons & InputFrame::BUTTON_RIGHT) != 0;
+        mouse.xButton1 = (frame.buttons & InputFrame::BUTTON_X1) != 0;
+        mouse.xButton2 = (frame.buttons & InputFrame::BUTTON_X2) != 0;
+        mouse.positionMode = frame.relative ? Mouse::MODE_RELATIVE : Mouse::MODE_ABSOLUTE;
+        memcpy(&keyboard, frame.keys, InputFrame::KEY_BYTES);
+    }
 }
 
+ToolMain::~ToolMain()
+{
+    if (m_wakeEvent)
+        CloseHandle(m_wakeEvent);
+}
 
 int ToolMain::getCurrentSelectionID() const
 {
-    return m_selectedObject;
+    const SceneObject* selected = m_sceneGraph.Get(m_selectedObject);
+    return selected ? selected->ID : 0;
 }
 
-void ToolMain::onActionInitialise(HWND handle, int width, int height)
+void ToolMain::onActionInitialise(HWND handle, int width, int height, const std::string& databasePath)
 {
+    Profiler::SetThreadName("Main");
+
     //window size, handle etc for directX
     m_toolHandle = handle;
     m_width = width;
@@ -40,122 +99,36 @@ void ToolMain::onActionInitialise(HWND handle, int width, int height)
 
     m_d3dRenderer.InitialiseInput(*m_mouseTracker, *m_kbTracker);
 
+    m_pacingStart = std::chrono::high_resolution_clock::now();
+    m_pacingCpuStart = ProcessCpuTime();
+
     //database connection establish
-    int rc = sqlite3_open_v2("database/test.db", &m_databaseConnection, SQLITE_OPEN_READWRITE, nullptr);
+    {
+        STARTUP_PHASE("Open database");
+        const bool opened = m_database.Open(databasePath);
 
-    assert(("could not open database", rc == SQLITE_OK));
+        assert(("could not open database", opened));
+    }
+
+    //merged static geometry is cached beside the database it came from
+    const size_t slash = databasePath.find_last_of("/\\");
+    m_d3dRenderer.SetStaticCacheDirectory((slash == std::string::npos ? std::string(".") : databasePath.substr(0, slash)) + "/cache");
 
     onActionLoad();
 }
 
 void ToolMain::onActionLoad()
 {
-    //load current chunk and objects into lists
-    if (!m_sceneGraph.empty())
-    {
-        m_sceneGraph.clear();
-    }
-
-    //SQL
-    int rc;
-    char *sqlCommand;
-    char *ErrMSG = 0;
-    //results of the query
-    sqlite3_stmt *pResults;
-    sqlite3_stmt *pResultsChunk;
-
-    //OBJECTS IN THE WORLD
-    //prepare SQL Text
-    sqlCommand = "SELECT * from Objects";   //sql command which will return all records from the objects table.
-    //Send Command and fill result object
-    rc = sqlite3_prepare_v2(m_databaseConnection, sqlCommand, -1, &pResults, 0);
-
-    //loop for each row in results until there are no more rows.  ie for every row in the results. We create and object
-    while (sqlite3_step(pResults) == SQLITE_ROW)
-    {
-        SceneObject newSceneObject;
-        newSceneObject.ID = sqlite3_column_int(pResults, 0);
-        newSceneObject.chunk_ID = sqlite3_column_int(pResults, 1);
-        newSceneObject.model_path = reinterpret_cast<const char*>(sqlite3_column_text(pResults, 2));
-        newSceneObject.tex_diffuse_path = reinterpret_cast<const char*>(sqlite3_column_text(pResults, 3));
-        newSceneObject.posX = static_cast<float>(sqlite3_column_double(pResults, 4));
-        newSceneObject.posY = static_cast<float>(sqlite3_column_double(pResults, 5));
-        newSceneObject.posZ = static_cast<float>(sqlite3_column_double(pResults, 6));
-        newSceneObject.rotX = static_cast<float>(sqlite3_column_double(pResults, 7));
-        newSceneObject.rotY = static_cast<float>(sqlite3_column_double(pResults, 8));
-        newSceneObject.rotZ = static_cast<float>(sqlite3_column_double(pResults, 9));
-        newSceneObject.scaX = static_cast<float>(sqlite3_column_double(pResults, 10));
-        newSceneObject.scaY = static_cast<float>(sqlite3_column_double(pResults, 11));
-        newSceneObject.scaZ = static_cast<float>(sqlite3_column_double(pResults, 12));
-        newSceneObject.render = (sqlite3_column_int(pResults, 13) != 0);
-        newSceneObject.collision = (sqlite3_column_int(pResults, 14) != 0);
-        newSceneObject.collision_mesh = reinterpret_cast<const char*>(sqlite3_column_text(pResults, 15));
-        newSceneObject.collectable = (sqlite3_column_int(pResults, 16) != 0);
-        newSceneObject.destructable = (sqlite3_column_int(pResults, 17) != 0);
-        newSceneObject.health_amount = sqlite3_column_int(pResults, 18);
-        newSceneObject.editor_render = (sqlite3_column_int(pResults, 19) != 0);
-        newSceneObject.editor_texture_vis = (sqlite3_column_int(pResults, 20) != 0);
-        newSceneObject.editor_normals_vis = (sqlite3_column_int(pResults, 21) != 0);
-        newSceneObject.editor_collision_vis = (sqlite3_column_int(pResults, 22) != 0);
-        newSceneObject.editor_pivot_vis = (sqlite3_column_int(pResults, 23) != 0);
-        newSceneObject.pivotX = static_cast<float>(sqlite3_column_double(pResults, 24));
-        newSceneObject.pivotY = static_cast<float>(sqlite3_column_double(pResults, 25));
-        newSceneObject.pivotZ = static_cast<float>(sqlite3_column_double(pResults, 26));
-        newSceneObject.snapToGround = (sqlite3_column_int(pResults, 27) != 0);
-        newSceneObject.AINode = (sqlite3_column_int(pResults, 28) != 0);
-        newSceneObject.audio_path = reinterpret_cast<const char*>(sqlite3_column_text(pResults, 29));
-        newSceneObject.volume = static_cast<float>(sqlite3_column_double(pResults, 30));
-        newSceneObject.pitch = static_cast<float>(sqlite3_column_double(pResults, 31));
-        newSceneObject.pan = static_cast<float>(sqlite3_column_int(pResults, 32));
-        newSceneObject.one_shot = (sqlite3_column_int(pResults, 33) != 0);
-        newSceneObject.play_on_init = (sqlite3_column_int(pResults, 34) != 0);
-        newSceneObject.play_in_editor = (sqlite3_column_int(pResults, 35) != 0);
-        newSceneObject.min_dist = static_cast<int>(sqlite3_column_double(pResults, 36));
-        newSceneObject.max_dist = static_cast<int>(sqlite3_column_double(pResults, 37));
-        newSceneObject.camera = (sqlite3_column_int(pResults, 38) != 0);
-        newSceneObject.path_node = (sqlite3_column_int(pResults, 39) != 0);
-        newSceneObject.path_node_start = (sqlite3_column_int(pResults, 40) != 0);
-        newSceneObject.path_node_end = (sqlite3_column_int(pResults, 41) != 0);
-        newSceneObject.parent_id = sqlite3_column_int(pResults, 42);
-        newSceneObject.editor_wireframe = (sqlite3_column_int(pResults, 43) != 0);
-        newSceneObject.name = reinterpret_cast<const char*>(sqlite3_column_text(pResults, 44));
-
-        //send completed object to scenegraph
-        m_sceneGraph.push_back(newSceneObject);
-    }
-
-    //THE WORLD CHUNK
-    //prepare SQL Text
-    sqlCommand = "SELECT * from Chunks";    //sql command which will return all records from  chunks table. There is only one tho.
-
-    //Send Command and fill result object
-    rc = sqlite3_prepare_v2(m_databaseConnection, sqlCommand, -1, &pResultsChunk, 0);
-
-
-    sqlite3_step(pResultsChunk);
-    m_chunk.ID = sqlite3_column_int(pResultsChunk, 0);
-    m_chunk.name = reinterpret_cast<const char*>(sqlite3_column_text(pResultsChunk, 1));
-    m_chunk.chunk_x_size_metres = sqlite3_column_int(pResultsChunk, 2);
-    m_chunk.chunk_y_size_metres = sqlite3_column_int(pResultsChunk, 3);
-    m_chunk.chunk_base_resolution = sqlite3_column_int(pResultsChunk, 4);
-    m_chunk.heightmap_path = reinterpret_cast<const char*>(sqlite3_column_text(pResultsChunk, 5));
-    m_chunk.tex_diffuse_path = reinterpret_cast<const char*>(sqlite3_column_text(pResultsChunk, 6));
-    m_chunk.tex_splat_alpha_path = reinterpret_cast<const char*>(sqlite3_column_text(pResultsChunk, 7));
-    m_chunk.tex_splat_1_path = reinterpret_cast<const char*>(sqlite3_column_text(pResultsChunk, 8));
-    m_chunk.tex_splat_2_path = reinterpret_cast<const char*>(sqlite3_column_text(pResultsChunk, 9));
-    m_chunk.tex_splat_3_path = reinterpret_cast<const char*>(sqlite3_column_text(pResultsChunk, 10));
-    m_chunk.tex_splat_4_path = reinterpret_cast<const char*>(sqlite3_column_text(pResultsChunk, 11));
-    m_chunk.render_wireframe = (sqlite3_column_int(pResultsChunk, 12) != 0);
-    m_chunk.render_normals = (sqlite3_column_int(pResultsChunk, 13) != 0);
-    m_chunk.tex_diffuse_tiling = sqlite3_column_int(pResultsChunk, 14);
-    m_chunk.tex_splat_1_tiling = sqlite3_column_int(pResultsChunk, 15);
-    m_chunk.tex_splat_2_tiling = sqlite3_column_int(pResultsChunk, 16);
-    m_chunk.tex_splat_3_tiling = sqlite3_column_int(pResultsChunk, 17);
-    m_chunk.tex_splat_4_tiling = sqlite3_column_int(pResultsChunk, 18);
+    STARTUP_PHASE("Load scene");
 
+    //load current chunk and objects into lists
+    std::vector<SceneObject> objects;
+    if (!m_database.LoadObjects(objects) || !m_database.LoadChunk(m_chunk))
+        MessageBox(NULL, L"Could not load the scene", L"Error", MB_OK);
+    m_sceneGraph.Assign(std::move(objects));
 
     //Process REsults into renderable
-    m_d3dRenderer.BuildDisplayList(&m_sceneGraph);
+    m_d3dRenderer.BuildDisplayList(&m_sceneGraph.GetObjects());
     //build the renderable chunk 
     m_d3dRenderer.BuildDisplayChunk(&m_chunk);
 
@@ -163,77 +136,13 @@ void ToolMain::onActionLoad()
 
 void ToolMain::onActionSave()
 {
-    //SQL
-    int rc;
-    char *sqlCommand;
-    char *ErrMSG = 0;
-    //results of the query
-    sqlite3_stmt *pResults;
-
+    PROFILE_SCOPE("Save");
 
-    //OBJECTS IN THE WORLD Delete them all
-    //prepare SQL Text
-    sqlCommand = "DELETE FROM Objects";	 //will delete the whole object table.   Slightly risky but hey.
-    rc = sqlite3_prepare_v2(m_databaseConnection, sqlCommand, -1, &pResults, 0);
-    sqlite3_step(pResults);
-
-    //Populate with our new objects
-    std::wstring sqlCommand2;
-    int numObjects = m_sceneGraph.size();	//Loop thru the scengraph.
-
-    for (int i = 0; i < numObjects; i++)
+    //replaces the whole object table, or leaves it as it was if anything fails
+    if (!m_database.SaveObjects(m_sceneGraph.GetObjects()))
     {
-        std::stringstream command;
-        command << "INSERT INTO Objects "
-            << "VALUES(" << m_sceneGraph.at(i).ID << ","
-            << m_sceneGraph.at(i).chunk_ID << ","
-            << "'" << m_sceneGraph.at(i).model_path << "'" << ","
-            << "'" << m_sceneGraph.at(i).tex_diffuse_path << "'" << ","
-            << m_sceneGraph.at(i).posX << ","
-            << m_sceneGraph.at(i).posY << ","
-            << m_sceneGraph.at(i).posZ << ","
-            << m_sceneGraph.at(i).rotX << ","
-            << m_sceneGraph.at(i).rotY << ","
-            << m_sceneGraph.at(i).rotZ << ","
-            << m_sceneGraph.at(i).scaX << ","
-            << m_sceneGraph.at(i).scaY << ","
-            << m_sceneGraph.at(i).scaZ << ","
-            << m_sceneGraph.at(i).render << ","
-            << m_sceneGraph.at(i).collision << ","
-            << "'" << m_sceneGraph.at(i).collision_mesh << "'" << ","
-            << m_sceneGraph.at(i).collectable << ","
-            << m_sceneGraph.at(i).destructable << ","
-            << m_sceneGraph.at(i).health_amount << ","
-            << m_sceneGraph.at(i).editor_render << ","
-            << m_sceneGraph.at(i).editor_texture_vis << ","
-            << m_sceneGraph.at(i).editor_normals_vis << ","
-            << m_sceneGraph.at(i).editor_collision_vis << ","
-            << m_sceneGraph.at(i).editor_pivot_vis << ","
-            << m_sceneGraph.at(i).pivotX << ","
-            << m_sceneGraph.at(i).pivotY << ","
-            << m_sceneGraph.at(i).pivotZ << ","
-            << m_sceneGraph.at(i).snapToGround << ","
-            << m_sceneGraph.at(i).AINode << ","
-            << "'" << m_sceneGraph.at(i).audio_path << "'" << ","
-            << m_sceneGraph.at(i).volume << ","
-            << m_sceneGraph.at(i).pitch << ","
-            << m_sceneGraph.at(i).pan << ","
-            << m_sceneGraph.at(i).one_shot << ","
-            << m_sceneGraph.at(i).play_on_init << ","
-            << m_sceneGraph.at(i).play_in_editor << ","
-            << m_sceneGraph.at(i).min_dist << ","
-            << m_sceneGraph.at(i).max_dist << ","
-            << m_sceneGraph.at(i).camera << ","
-            << m_sceneGraph.at(i).path_node << ","
-            << m_sceneGraph.at(i).path_node_start << ","
-            << m_sceneGraph.at(i).path_node_end << ","
-            << m_sceneGraph.at(i).parent_id << ","
-            << m_sceneGraph.at(i).editor_wireframe << ","
-            << "'" << m_sceneGraph.at(i).name << "'"
-            << ")";
-        std::string sqlCommand2 = command.str();
-        rc = sqlite3_prepare_v2(m_databaseConnection, sqlCommand2.c_str(), -1, &pResults, 0);
-        sqlite3_step(pResults);
+        MessageBox(NULL, L"Could not save objects", L"Error", MB_OK);
+        return;
     }
     MessageBox(NULL, L"Objects Saved", L"Notification", MB_OK);
 }
@@ -241,6 +150,101 @@ void ToolMain::onActionSave()
 void ToolMain::onActionSaveTerrain()
 {
     m_d3dRenderer.SaveDisplayChunk(&m_chunk);
+
+    //the chunk row holds the splat map's path, which saving the terrain may have just picked
+    if (!m_database.SaveChunk(m_chunk))
+        MessageBox(NULL, L"Could not save the terrain chunk", L"Error", MB_OK);
+}
+
+bool ToolMain::onActionErodeTerrain(bool hydraulic, const ErosionProgressCallback& progress)
+{
+    m_inputRecorder.RecordCommand(COMMAND_ERODE_TERRAIN, hydraulic ? "1" : "0");
+    return m_d3dRenderer.ErodeDisplayChunk(hydraulic, progress);
+}
+
+bool ToolMain::onActionExportObj(const std::string& path, ObjIoStats* stats)
+{
+    return m_d3dRenderer.ExportObj(path, getCurrentSelectionID(), stats);
+}
+
+bool ToolMain::onActionImportTerrainObj(const std::string& path, ObjIoStats* stats)
+{
+    m_inputRecorder.RecordCommand(COMMAND_IMPORT_TERRAIN_OBJ, path);
+    return m_d3dRenderer.ImportTerrainObj(path, stats);
+}
+
+bool ToolMain::onActionToggleStaticMerging()
+{
+    m_inputRecorder.RecordCommand(COMMAND_TOGGLE_STATIC_MERGING);
+    m_d3dRenderer.SetStaticMerging(!m_d3dRenderer.GetStaticMerging());
+    m_d3dRenderer.BuildDisplayList(&m_sceneGraph.GetObjects());
+    return m_d3dRenderer.GetStaticMerging();
+}
+
+bool ToolMain::onActionCookLods(LodCooker::Stats* stats)
+{
+    m_inputRecorder.RecordCommand(COMMAND_COOK_LODS);
+
+    std::vector<std::string> paths;
+    paths.reserve(m_sceneGraph.Size());
+    for (const SceneObject& sceneObject : m_sceneGraph)
+        paths.push_back(sceneObject.model_path);
+
+    LodCooker cooker;
+    cooker.Cook(paths);
+    if (stats)
+        *stats = cooker.GetStats();
+
+    // Reload the models so the new levels are drawn
+    if (cooker.GetStats().cooked > 0)
+        m_d3dRenderer.BuildDisplayList(&m_sceneGraph.GetObjects());
+
+    return cooker.GetStats().failed == 0;
+}
+
+bool ToolMain::onActionToggleRenderOnDemand()
+{
+    m_inputRecorder.RecordCommand(COMMAND_TOGGLE_RENDER_ON_DEMAND);
+    m_renderOnDemand = !m_renderOnDemand;
+    return m_renderOnDemand;
+}
+
+bool ToolMain::onActionExportTrace(const std::string& path)
+{
+    return Profiler::WriteChromeTrace(path);
+}
+
+bool ToolMain::onActionRecordInput(const std::string& path)
+{
+    if (m_inputReplay.IsPlaying() || !m_inputRecorder.Start(path))
+        return false;
+
+    m_recordedSelection = -1;
+    return true;
+}
+
+bool ToolMain::onActionReplayInput(const std::string& path, bool quitWhenDone)
+{
+    // A replay would record itself
+    m_inputRecorder.Stop();
+    if (!m_inputReplay.Open(path))
+        return false;
+
+    const FrameStats& frameStats = m_d3dRenderer.GetFrameStats();
+    const char* sectionNames[FrameStats::MAX_SECTIONS];
+    for (size_t s = 0; s < frameStats.GetNumSections(); s++)
+        sectionNames[s] = frameStats.GetSectionName(s);
+
+    if (!m_replayTimings.Open(path + ".frames.csv", sectionNames, frameStats.GetNumSections(), m_inputReplay.GetNumFrames()))
+    {
+        m_inputReplay.Close();
+        return false;
+    }
+
+    m_d3dRenderer.SetAdaptiveCulling(false);
+    m_replayPath = path;
+    m_quitAfterReplay = quitWhenDone;
+    return true;
 }
 
 void ToolMain::OnWindowSizeChanged(int width, int height)
@@ -250,21 +254,180 @@ void ToolMain::OnWindowSizeChanged(int width, int height)
 
 void ToolMain::Tick(MSG *msg)
 {
-    // Inputs
-    auto mouse = m_mouse->GetState();
-    m_mouseTracker->Update(mouse);
+    PROFILE_SCOPE("Tick");
 
+    // Inputs, from the devices or the replay standing in for them
+    auto mouse = m_mouse->GetState();
     auto keyboard = m_keyboard->GetState();
+
+    const bool replaying = m_inputReplay.IsPlaying() && ReplayFrame(mouse, keyboard);
+    if (m_inputRecorder.IsRecording())
+    {
+        const int selectedID = getCurrentSelectionID();
+        if (selectedID != m_recordedSelection)
+        {
+            m_inputRecorder.RecordCommand(COMMAND_SELECT, std::to_string(selectedID));
+            m_recordedSelection = selectedID;
+        }
+        m_inputRecorder.RecordFrame(ToInputFrame(mouse, keyboard));
+    }
+
+    m_mouseTracker->Update(mouse);
     m_kbTracker->Update(keyboard);
 
     if (m_kbTracker->IsKeyPressed(Keyboard::Space))
     {
         m_fpsCameraActive = !m_fpsCameraActive;
-        m_mouse->SetMode(m_fpsCameraActive ? Mouse::MODE_RELATIVE : Mouse::MODE_ABSOLUTE);
+
+        // Replayed frames carry the mode they were recorded in
+        if (!replaying)
+            m_mouse->SetMode(m_fpsCameraActive ? Mouse::MODE_RELATIVE : Mouse::MODE_ABSOLUTE);
+    }
+
+    // Frame pacing over the last second or so. After a long wait that is the whole wait.
+    m_pacingFrames++;
+    const auto now = std::chrono::high_resolution_clock::now();
+    const double pacingSeconds = std::chrono::duration<double>(now - m_pacingStart).count();
+    if (pacingSeconds >= 1.0)
+    {
+        const uint64_t cpuTime = ProcessCpuTime();
+
+        Game::FramePacing pacing;
+        pacing.onDemand = m_renderOnDemand;
+        pacing.framesPerSecond = float(m_pacingFrames / pacingSeconds);
+        pacing.waiting = float(std::min(m_pacingWaitSeconds / pacingSeconds, 1.0));
+        pacing.cpu = float(((cpuTime - m_pacingCpuStart) * 1e-7) / pacingSeconds);
+        pacing.loopAllocations = m_pacingAllocations;
+        ProcessMemory(pacing);
+        m_d3dRenderer.SetFramePacing(pacing);
+
+        m_pacingStart = now;
+        m_pacingFrames = 0;
+        m_pacingWaitSeconds = 0.0;
+        m_pacingCpuStart = cpuTime;
+        m_pacingAllocations = 0;
     }
 
     //Renderer Update Call
-    m_d3dRenderer.Tick(mouse, keyboard);
+    if (StartupTimings::IsFinished())
+        m_d3dRenderer.Tick(mouse, keyboard);
+    else
+    {
+        {
+            STARTUP_PHASE("First frame");
+            m_d3dRenderer.Tick(mouse, keyboard);
+        }
+        onStartupFinished();
+    }
+    m_frameRequested = false;
+
+    if (replaying)
+    {
+        const FrameStats& frameStats = m_d3dRenderer.GetFrameStats();
+        float sectionMs[FrameStats::MAX_SECTIONS];
+        for (size_t s = 0; s < frameStats.GetNumSections(); s++)
+            sectionMs[s] = frameStats.GetFrameSectionMs(0, s);
+
+        m_replayTimings.AddFrame(m_inputReplay.GetFrame().microseconds, frameStats.GetFrameMs(0), sectionMs);
+    }
+    else if (!m_replayPath.empty())
+        onReplayFinished();
+}
+
+bool ToolMain::ReplayFrame(Mouse::State& mouse, Keyboard::State& keyboard)
+{
+    for (;;)
+    {
+        switch (m_inputReplay.Next())
+        {
+            case InputReplay::RECORD_FRAME:
+                FromInputFrame(m_inputReplay.GetFrame(), mouse, keyboard);
+                return true;
+
+            case InputReplay::RECORD_COMMAND:
+                ReplayCommand(m_inputReplay.GetCommand(), m_inputReplay.GetArgument());
+                break;
+
+            case InputReplay::RECORD_END:
+                return false;
+        }
+    }
+}
+
+void ToolMain::ReplayCommand(uint32_t command, const std::string& argument)
+{
+    switch (command)
+    {
+        case COMMAND_SELECT:
+            m_selectedObject = m_sceneGraph.Find(atoi(argument.c_str()));
+            break;
+
+        case COMMAND_ERODE_TERRAIN:
+            onActionErodeTerrain(argument == "1", ErosionProgressCallback());
+            break;
+
+        case COMMAND_IMPORT_TERRAIN_OBJ:
+            onActionImportTerrainObj(argument, nullptr);
+            break;
+
+        case COMMAND_TOGGLE_STATIC_MERGING:
+            onActionToggleStaticMerging();
+            break;
+
+        case COMMAND_COOK_LODS:
+            onActionCookLods(nullptr);
+            break;
+
+        case COMMAND_TOGGLE_RENDER_ON_DEMAND:
+            onActionToggleRenderOnDemand();
+            break;
+    }
+}
+
+void ToolMain::onReplayFinished()
+{
+    const bool logged = m_replayTimings.Finish("replay.log", m_replayPath);
+    m_d3dRenderer.SetAdaptiveCulling(true);
+
+    // Paths can be longer than a fixed buffer
+    const std::string message = "Replay of " + m_replayPath + ": " + std::to_string(m_inputReplay.GetFramesPlayed()) + " frames, timings in "
+        + m_replayPath + ".frames.csv" + (logged ? ", summary in replay.log\n" : "\n");
+    OutputDebugStringA(message.c_str());
+
+    m_inputReplay.Close();
+    m_replayPath.clear();
+    if (m_quitAfterReplay)
+        PostQuitMessage(0);
+}
+
+void ToolMain::onStartupFinished()
+{
+    StartupTimings::Finish();
+
+    char message[128];
+    const bool logged = StartupTimings::AppendLog("startup.log");
+    sprintf_s(message, "Startup: %.1f ms to first frame%s\n", StartupTimings::GetTotalMilliseconds(), logged ? ", phases in startup.log" : "");
+    OutputDebugStringA(message);
+}
+
+bool ToolMain::NeedsFrame() const
+{
+    if (!m_renderOnDemand || m_frameRequested || m_d3dRenderer.IsSettling() || m_inputReplay.IsPlaying() || !m_replayPath.empty())
+        return true;
+
+    // Held keys and buttons move the camera every frame, without sending messages
+    const Keyboard::State keyboard = m_keyboard->GetState();
+    const Keyboard::State released = {};
+    const Mouse::State mouse = m_mouse->GetState();
+    return memcmp(&keyboard, &released, sizeof(keyboard)) != 0
+        || mouse.leftButton || mouse.middleButton || mouse.rightButton || mouse.xButton1 || mouse.xButton2;
+}
+
+void ToolMain::WaitForInput()
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+    MsgWaitForMultipleObjectsEx(m_wakeEvent ? 1 : 0, &m_wakeEvent, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+    m_pacingWaitSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
 }
 
 void ToolMain::UpdateInput(MSG * msg)
@@ -273,6 +436,10 @@ void ToolMain::UpdateInput(MSG * msg)
     WPARAM wParam = msg->wParam;
     LPARAM lParam = msg->lParam;
 
+    // Input, repaints, and menu commands and the scene edits they make all change what's on screen
+    if (message != WM_TIMER)
+        m_frameRequested = true;
+
     switch (message)
     {
         case WM_ACTIVATEAPP:
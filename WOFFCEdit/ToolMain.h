@@ -2,10 +2,13 @@
 
 #include "Game.h"
 #include "SceneObject.h"
+#include "SceneObjectMap.h"
 #include "ChunkObject.h"
+#include "LodCooker.h"
+#include "InputRecording.h"
+#include "SceneDatabase.h"
 #include <vector>
-
-struct sqlite3;
+#include <chrono>
 
 class ToolMain
 {
@@ -21,33 +24,62 @@ public:
 
     // functions
     int		getCurrentSelectionID() const;									//returns the selection number of currently selected object so that It can be displayed.
-    void	onActionInitialise(HWND handle, int width, int height);			//Passes through handle and hieght and width and initialises DirectX renderer and SQL LITE
+    void	onActionInitialise(HWND handle, int width, int height, const std::string& databasePath = "database/test.db");	//Passes through handle and hieght and width and initialises DirectX renderer and SQL LITE
     void	onActionFocusCamera();
     void	onActionLoad();													//load the current chunk
     void	onActionSave();											//save the current chunk
     void	onActionSaveTerrain();									//save chunk geometry
+    bool	onActionErodeTerrain(bool hydraulic, const ErosionProgressCallback& progress);	//erode the chunk heightmap, false if cancelled
+    bool	onActionExportObj(const std::string& path, ObjIoStats* stats);			//export terrain and current selection as OBJ
+    bool	onActionImportTerrainObj(const std::string& path, ObjIoStats* stats);	//replace terrain heights from an OBJ mesh
+    bool	onActionToggleStaticMerging();							//merge static objects per area and material, or stop. Returns the new state
+    bool	onActionCookLods(LodCooker::Stats* stats);				//generate the levels of detail of the scene's models, false if any failed
+    bool	onActionToggleRenderOnDemand();							//draw frames only when something changed, or always. Returns the new state
+    bool	onActionExportTrace(const std::string& path);			//write the recent profiler markers as a Chrome trace
+    bool	onActionRecordInput(const std::string& path);			//record input and commands from now until exit, to replay later
+    bool	onActionReplayInput(const std::string& path, bool quitWhenDone);	//play a recording back in place of the input devices, timing each frame
 
     void OnWindowSizeChanged(int width, int height);
 
     void	Tick(MSG *msg);
     void	UpdateInput(MSG *msg);
+    bool	NeedsFrame() const;						//false while rendering on demand and nothing changed since the last frame
+    void	RequestFrame() { m_frameRequested = true; }	//for changes that don't arrive as messages
+    void	WaitForInput();							//blocks until a message arrives or the wake event is set
+    HANDLE	GetWakeEvent() const { return m_wakeEvent; }	//set from any thread to end WaitForInput()
+    void	AddLoopAllocations(uint64_t count) { m_pacingAllocations += count; }	//made by the idle loop, shown with the frame pacing
 
 
     // variables
-    std::vector<SceneObject>    m_sceneGraph;	//our scenegraph storing all the objects in the current chunk
+    SceneObjectMap				m_sceneGraph;	//our scenegraph storing all the objects in the current chunk
     ChunkObject					m_chunk;		//our landscape chunk
-    int m_selectedObject = 0;					//ID of current Selection
+    SceneObjectHandle			m_selectedObject;	//current Selection, stays valid across edits
 
 
 private:
+    // commands recorded with the input, for the actions that change the scene
+    enum RecordedCommand : uint32_t
+    {
+        COMMAND_SELECT = 1,				//argument is the object ID
+        COMMAND_ERODE_TERRAIN,			//argument is "1" for hydraulic, "0" for thermal
+        COMMAND_IMPORT_TERRAIN_OBJ,		//argument is the path
+        COMMAND_TOGGLE_STATIC_MERGING,
+        COMMAND_COOK_LODS,
+        COMMAND_TOGGLE_RENDER_ON_DEMAND,
+    };
+
     // functions
     void	onContentAdded();
+    void	onStartupFinished();					//logs how long startup took
+    bool	ReplayFrame(DirectX::Mouse::State& mouse, DirectX::Keyboard::State& keyboard);	//runs the commands up to the next frame and returns its input, false at the end
+    void	ReplayCommand(uint32_t command, const std::string& argument);
+    void	onReplayFinished();						//logs the replay's timings
 
 
     //variables
     HWND	m_toolHandle;		//Handle to the  window
     Game	m_d3dRenderer;		//Instance of D3D rendering system for our tool
-    sqlite3 *m_databaseConnection = nullptr;	//sqldatabase handle
+    SceneDatabase m_database;		//objects and chunk, in database/test.db
 
     int m_width;		//dimensions passed to directX
     int m_height;
@@ -61,4 +93,22 @@ private:
     std::unique_ptr<DirectX::Keyboard::KeyboardStateTracker> m_kbTracker;
 
     bool m_fpsCameraActive = false;
+
+    // Render on demand
+    bool		m_renderOnDemand = true;
+    bool		m_frameRequested = true;
+    HANDLE		m_wakeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);	//auto reset
+    std::chrono::high_resolution_clock::time_point	m_pacingStart;			//frame pacing is measured over about a second
+    uint32_t	m_pacingFrames = 0;
+    double		m_pacingWaitSeconds = 0.0;
+    uint64_t	m_pacingCpuStart = 0;		//process CPU time, 100ns units
+    uint64_t	m_pacingAllocations = 0;
+
+    // Input recording and replay
+    InputRecorder	m_inputRecorder;
+    int				m_recordedSelection = -1;	//last selection recorded, changes are recorded as commands
+    InputReplay		m_inputReplay;
+    ReplayTimings	m_replayTimings;
+    std::string		m_replayPath;
+    bool			m_quitAfterReplay = false;
 };